@@ -0,0 +1,126 @@
+#include "vertex_interleave.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+// Compares vertex interleaving kernels with per-vertex memcpy loop glTF import used before, on Sponza sized mesh
+// (~185K vertices of float position, normal, tangent and texcoord, in separate tightly packed accessors).
+// Destination is ordinary cached memory, on write-combined mapped memory streaming stores gain more.
+
+constexpr size_t   VERTEX_COUNT = 184'330;
+constexpr uint32_t RUNS         = 50;
+
+struct Attribute
+{
+	std::vector<uint8_t> bytes;
+	uint32_t             element_size;
+};
+
+void interleave_memcpy_loop(const Vertex_Stream* streams, uint32_t stream_count, const uint32_t* remap,
+                            size_t vertex_count, uint32_t stride, uint8_t* destination)
+{
+	memset(destination, 0, vertex_count * stride);
+	for (size_t offset = 0; offset < vertex_count; offset++)
+	{
+		uint8_t* vertex = destination + size_t(remap[offset]) * stride;
+		for (uint32_t stream_i = 0; stream_i < stream_count; stream_i++)
+		{
+			memcpy(vertex, streams[stream_i].data + offset * streams[stream_i].stride, streams[stream_i].element_size);
+			vertex += streams[stream_i].size;
+		}
+	}
+}
+
+template <typename Function>
+double best_time_ms(Function function)
+{
+	double best = 1e30;
+	for (uint32_t run = 0; run < RUNS; run++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		function();
+		auto end = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
+
+int main()
+{
+	std::mt19937 random(42);
+	std::uniform_int_distribution<uint32_t> byte(0, 255);
+
+	Attribute attributes[] = {
+		{ .element_size = 12 }, // Position
+		{ .element_size = 12 }, // Normal
+		{ .element_size = 16 }, // Tangent
+		{ .element_size = 8  }, // Texcoord
+	};
+
+	std::vector<Vertex_Stream> streams;
+	uint32_t stride = 0;
+	for (auto& attribute : attributes)
+	{
+		attribute.bytes.resize(VERTEX_COUNT * attribute.element_size);
+		for (auto& value : attribute.bytes) value = static_cast<uint8_t>(byte(random));
+
+		streams.push_back({
+			.data         = attribute.bytes.data(),
+			.stride       = attribute.element_size,
+			.element_size = attribute.element_size,
+			.size         = attribute.element_size,
+		});
+		stride += attribute.element_size;
+	}
+
+	// Vertex fetch optimization reorders vertices by first use, which is mostly sequential with local shuffles
+	std::vector<uint32_t> remap(VERTEX_COUNT);
+	std::iota(remap.begin(), remap.end(), 0);
+	for (size_t block = 0; block < VERTEX_COUNT; block += 256)
+	{
+		std::shuffle(remap.begin() + block, remap.begin() + std::min(block + 256, VERTEX_COUNT), random);
+	}
+
+	std::vector<uint32_t> source_vertices(VERTEX_COUNT);
+	for (size_t offset = 0; offset < VERTEX_COUNT; offset++) source_vertices[remap[offset]] = uint32_t(offset);
+
+	// Over-allocate so kernels get 16 byte aligned destination, like upload buffer
+	std::vector<uint8_t> expected(VERTEX_COUNT * stride + 16);
+	std::vector<uint8_t> result(VERTEX_COUNT * stride + 16);
+	uint8_t* expected_ptr = expected.data() + (16 - reinterpret_cast<uintptr_t>(expected.data()) % 16) % 16;
+	uint8_t* result_ptr   = result.data()   + (16 - reinterpret_cast<uintptr_t>(result.data())   % 16) % 16;
+
+	double memcpy_ms = best_time_ms([&]
+	{
+		interleave_memcpy_loop(streams.data(), uint32_t(streams.size()), remap.data(), VERTEX_COUNT, stride,
+		                       expected_ptr);
+	});
+	double scalar_ms = best_time_ms([&]
+	{
+		vertex_interleave_scalar(streams.data(), uint32_t(streams.size()), source_vertices.data(), VERTEX_COUNT,
+		                         result_ptr);
+	});
+	bool scalar_matches = memcmp(expected_ptr, result_ptr, VERTEX_COUNT * stride) == 0;
+
+	memset(result_ptr, 0, VERTEX_COUNT * stride);
+	double kernel_ms = best_time_ms([&]
+	{
+		vertex_interleave(streams.data(), uint32_t(streams.size()), source_vertices.data(), VERTEX_COUNT, result_ptr);
+	});
+	bool kernel_matches = memcmp(expected_ptr, result_ptr, VERTEX_COUNT * stride) == 0;
+
+	double megabytes = VERTEX_COUNT * stride / (1024.0 * 1024.0);
+	spdlog::info("Interleaving {} vertices, {} bytes each, best of {} runs", VERTEX_COUNT, stride, RUNS);
+	spdlog::info("Memcpy loop: {:.3f} ms ({:.0f} MB/s)", memcpy_ms, megabytes / memcpy_ms * 1000.0);
+	spdlog::info("Scalar:      {:.3f} ms ({:.0f} MB/s){}", scalar_ms, megabytes / scalar_ms * 1000.0,
+	             scalar_matches ? "" : " MISMATCH");
+	spdlog::info("Kernel:      {:.3f} ms ({:.0f} MB/s){}", kernel_ms, megabytes / kernel_ms * 1000.0,
+	             kernel_matches ? "" : " MISMATCH");
+
+	return (scalar_matches && kernel_matches) ? 0 : 1;
+}
@@ -1,12 +1,19 @@
 #include "application.h"
 
 #include "common.h"
+#include "asset_watcher.h"
 #include "hot_reload.h"
 #include "input.h"
+#include "io_queue.h"
+#include "job_system.h"
+#include "meshlet_culling.h"
 #include "gfx_context.h"
 #include "renderer.h"
+#include "scene_pack.h"
+#include "vertex_pulling.h"
 
 #include <algorithm>
+#include <charconv>
 #include <numbers>
 #include <glm/glm.hpp>
 #include <glm/ext/matrix_transform.hpp>
@@ -15,34 +22,54 @@
 #include <imgui/backends/imgui_impl_vulkan.h>
 
 // Private functions
+Launch_Options parse_launch_options(int32_t argc, char** argv);
 void build_ui();
 void build_info_window();
 void build_scene_window();
 
-void application_entry(Platform* p_platform)
+void application_entry(Platform* p_platform, int32_t argc, char** argv)
 {
 	spdlog::info("Rendering demos startup");
 
-	app = new Application{};
+	app = new Application{ .launch_options = parse_launch_options(argc, argv) };
 	platform = p_platform;
 
+	// Offline mode, no window or Vulkan needed
+	if (!app->launch_options.bake_gltf.empty())
+	{
+		std::filesystem::path gltf_file = app->launch_options.bake_gltf;
+
+		job_system_init();
+		bake_scene_pack(gltf_file, scene_pack_path(gltf_file), app->launch_options.bake_compress,
+		                app->launch_options.packed_vertices, app->launch_options.static_batching);
+		job_system_deinit();
+
+		delete app;
+		return;
+	}
+
 	Hot_Reload::ptr = new Hot_Reload();
 	p_platform->window_init(Window_Params{ .name = "Rendering demos", .size = {1280, 720} });
 	input_init();
+	job_system_init();
+	io_queue_init();
 	gfx_context_init();
 	imgui_init();
 	camera_init();
 	renderer_init();
+	asset_watcher_init(app->launch_options.scene);
 
 	timings = new Timings{ .zero_delta = true }; // First frame have dt = 0
 
 	spdlog::info("Initialization done, running");
 
-	while (!p_platform->window_requested_to_close())
+	// Load-only run is done once renderer_init() returns, load report is out already
+	while (!app->launch_options.load_only && !p_platform->window_requested_to_close())
 	{
 		timings_new_frame();
 
 		Hot_Reload::ptr->dispatch_reload();
+		asset_watcher_update();
 
 		p_platform->poll_events();
 		p_platform->fill_input();
@@ -74,15 +101,87 @@ void application_entry(Platform* p_platform)
 
 	delete timings;
 
+	asset_watcher_deinit();
 	renderer_deinit();
 	imgui_deinit();
 	gfx_context_deinit();
+	io_queue_deinit();
+	job_system_deinit();
 	input_destroy();
 
 	p_platform->window_destroy();
 	delete Hot_Reload::ptr;
 }
 
+Launch_Options parse_launch_options(int32_t argc, char** argv)
+{
+	Launch_Options options = {};
+
+	for (int32_t i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--bake" && i + 1 < argc)
+		{
+			options.bake_gltf = argv[++i];
+		}
+		else if (arg == "--lz4")
+		{
+			options.bake_compress = true;
+		}
+		else if (arg == "--scene" && i + 1 < argc)
+		{
+			options.scene = argv[++i];
+		}
+		else if (arg == "--sync-load")
+		{
+			options.sync_load = true;
+		}
+		else if (arg == "--load-only")
+		{
+			// Whole load has to happen in renderer_init(), there won't be any frames to finish it
+			options.load_only = true;
+			options.sync_load = true;
+		}
+		else if (arg == "--load-report" && i + 1 < argc)
+		{
+			options.load_report = argv[++i];
+		}
+		else if (arg == "--staging-budget" && i + 1 < argc)
+		{
+			// In MB. Few MB at least, so batches aren't ridiculously small, and clamped before scaling, so it can't
+			// overflow. Invalid value keeps the default.
+			std::string value = argv[++i];
+			uint64_t    megabytes;
+			auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), megabytes);
+			if (error != std::errc{} || end != value.data() + value.size())
+			{
+				spdlog::warn("Invalid --staging-budget {}, keeping {} MB", value, options.staging_budget / 1000 / 1000);
+			}
+			else
+			{
+				options.staging_budget = std::clamp(megabytes, uint64_t(8), uint64_t(64 * 1000)) * 1000 * 1000;
+			}
+		}
+		else if (arg == "--packed-vertices")
+		{
+			// Applies to baking too, packs baked otherwise are ignored
+			options.packed_vertices = true;
+		}
+		else if (arg == "--static-batching")
+		{
+			// Same as packed vertices, batches are baked into packs, packs baked otherwise are ignored
+			options.static_batching = true;
+		}
+		else
+		{
+			spdlog::warn("Unknown command line argument {}", arg);
+		}
+	}
+
+	return options;
+}
+
 void build_ui()
 {
 	if (ImGui::BeginMainMenuBar())
@@ -154,6 +253,34 @@ void build_scene_window()
 				ImGui::PopID();
 			}
 		}
+
+		ImGui::Text("Render objects: %zu, instanced draws: %zu",
+		            scene_data->render_objects.size(), scene_data->instance_groups.size());
+
+		if (ImGui::CollapsingHeader("Meshlet culling"))
+		{
+			auto mode = reinterpret_cast<int*>(&meshlet_culling->mode);
+			ImGui::RadioButton("None", mode, static_cast<int>(Culling_Mode::NONE)); ImGui::SameLine();
+			ImGui::RadioButton("CPU",  mode, static_cast<int>(Culling_Mode::CPU));  ImGui::SameLine();
+			ImGui::RadioButton("GPU",  mode, static_cast<int>(Culling_Mode::GPU));
+
+			if (meshlet_culling->mode == Culling_Mode::CPU)
+			{
+				ImGui::Text("Visible meshlets: %u / %u",
+				            meshlet_culling->meshlets_visible, meshlet_culling->meshlets_total);
+			}
+			else
+			{
+				ImGui::Text("Meshlets: %u", meshlet_culling->meshlets_total);
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Geometry"))
+		{
+			auto mode = reinterpret_cast<int*>(&vertex_pulling->mode);
+			ImGui::RadioButton("Vertex input",   mode, static_cast<int>(Geometry_Mode::VERTEX_INPUT)); ImGui::SameLine();
+			ImGui::RadioButton("Vertex pulling", mode, static_cast<int>(Geometry_Mode::VERTEX_PULLING));
+		}
 	}
 	ImGui::End();
 }
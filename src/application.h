@@ -3,6 +3,7 @@
 #include "platform.h"
 
 #include <chrono>
+#include <string>
 #include <vulkan/vulkan.h>
 //#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
@@ -50,8 +51,24 @@ inline Timings* timings;
 
 void timings_new_frame();
 
+struct Launch_Options
+{
+	// --scene <file.gltf>: scene to load, baked scene pack next to it is used if it's up-to-date
+	std::string scene           = "assets/Sponza/glTF/Sponza.gltf";
+	std::string bake_gltf;                          // --bake <file.gltf>: bake scene pack next to it and exit
+	bool        bake_compress   = false;            // --lz4: compress baked chunks
+	bool        sync_load       = false;            // --sync-load: load whole scene before first frame
+	bool        load_only       = false;            // --load-only: load scene synchronously and exit, for benchmarking
+	std::string load_report;                        // --load-report <file.json>: write load timings there
+	size_t      staging_budget  = 96 * 1000 * 1000; // --staging-budget <MB>: upload memory used by scene loader
+	bool        packed_vertices = false;            // --packed-vertices: import meshes in PACKED_VERTEX_FORMAT
+	bool        static_batching = false;            // --static-batching: merge static meshes by material
+};
+
 struct Application
 {
+	Launch_Options launch_options = {};
+
 	struct Dev_Menu
 	{
 		struct Windows
@@ -67,4 +84,4 @@ struct Application
 
 inline Application* app;
 
-void application_entry(Platform* p_platform);
\ No newline at end of file
+void application_entry(Platform* p_platform, int32_t argc, char** argv);
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "asset_watcher.h"
+
+#include "common.h"
+#include "loader.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Private functions
+void asset_watcher_read_events();
+
+void asset_watcher_init(const std::filesystem::path& scene_file)
+{
+	ZoneScopedN("Asset watcher initialization");
+
+	asset_watcher = new Asset_Watcher{ .inotify = -1 };
+
+#ifdef __linux__
+	asset_watcher->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (asset_watcher->inotify < 0)
+	{
+		spdlog::warn("Can't watch assets for changes, inotify isn't available");
+		return;
+	}
+
+	std::filesystem::path directory = std::filesystem::absolute(scene_file).lexically_normal().parent_path();
+
+	// inotify doesn't watch subdirectories, every one needs its own watch
+	std::vector<std::filesystem::path> directories = { directory };
+	std::error_code                    error;
+	for (auto& entry : std::filesystem::recursive_directory_iterator(directory, error))
+	{
+		if (entry.is_directory()) directories.push_back(entry.path());
+	}
+
+	// Writes are done when file is closed, renamed files are moved into directory
+	for (auto& watched : directories)
+	{
+		int watch = inotify_add_watch(asset_watcher->inotify, watched.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watch >= 0) asset_watcher->directories[watch] = watched;
+	}
+
+	spdlog::info("Watching {} for asset changes ({} directories)", directory.string(),
+	             asset_watcher->directories.size());
+#else
+	spdlog::info("Assets aren't watched for changes, it needs inotify");
+#endif
+}
+
+void asset_watcher_deinit()
+{
+#ifdef __linux__
+	if (asset_watcher->inotify >= 0) close(asset_watcher->inotify);
+#endif
+
+	delete asset_watcher;
+}
+
+void asset_watcher_update()
+{
+	if (asset_watcher->inotify < 0) return;
+
+	asset_watcher_read_events();
+
+	auto& changed_files = asset_watcher->changed_files;
+	if (changed_files.empty()) return;
+
+	auto now = std::chrono::high_resolution_clock::now();
+	if (now - asset_watcher->last_change < ASSET_WATCHER_SETTLE_TIME) return;
+
+	// Scene might be still loading, or previous changes are being reloaded
+	if (!scene_loader_idle()) return;
+
+	ZoneScopedN("Asset reload");
+
+	spdlog::info("{} asset files changed, reloading", changed_files.size());
+	scene_loader_reload(std::move(changed_files));
+	changed_files.clear();
+}
+
+void asset_watcher_read_events()
+{
+#ifdef __linux__
+	alignas(inotify_event) char buffer[4096];
+
+	// Descriptor is non-blocking, read fails once there are no more events
+	ssize_t size;
+	while ((size = read(asset_watcher->inotify, buffer, sizeof(buffer))) > 0)
+	{
+		for (ssize_t offset = 0; offset < size;)
+		{
+			auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			auto directory = asset_watcher->directories.find(event->wd);
+			if (directory == asset_watcher->directories.end() || event->len == 0 || (event->mask & IN_ISDIR)) continue;
+
+			std::filesystem::path file = directory->second / event->name;
+
+			auto& changed_files = asset_watcher->changed_files;
+			if (std::find(changed_files.begin(), changed_files.end(), file) == changed_files.end())
+			{
+				changed_files.push_back(file);
+			}
+			asset_watcher->last_change = std::chrono::high_resolution_clock::now();
+		}
+	}
+#endif
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+// Watches directory of loaded scene (and its subdirectories) and reloads assets whose files change, see
+// scene_loader_reload(). Uses inotify, elsewhere than on Linux it does nothing.
+//
+// Editors tend to save in several writes, or write temporary file and rename it over the old one, so changed files
+// are collected until they stay untouched for ASSET_WATCHER_SETTLE_TIME. Reload waits for loader to be idle.
+
+constexpr std::chrono::milliseconds ASSET_WATCHER_SETTLE_TIME(200);
+
+struct Asset_Watcher
+{
+	int                                            inotify;     // -1 if assets aren't watched
+	std::unordered_map<int, std::filesystem::path> directories; // By watch descriptor, absolute
+
+	std::vector<std::filesystem::path>             changed_files; // Absolute, waiting to settle
+	std::chrono::high_resolution_clock::time_point last_change;
+};
+
+inline Asset_Watcher* asset_watcher;
+
+void asset_watcher_init(const std::filesystem::path& scene_file);
+void asset_watcher_deinit();
+void asset_watcher_update(); // Call every frame on main thread
@@ -0,0 +1,110 @@
+#include "content_hash.h"
+
+#include <cstring>
+
+constexpr uint64_t CONTENT_HASH_PRIME_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t CONTENT_HASH_PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t CONTENT_HASH_PRIME_3 = 0x165667B19E3779F9ull;
+constexpr uint64_t CONTENT_HASH_PRIME_4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t CONTENT_HASH_PRIME_5 = 0x27D4EB2F165667C5ull;
+
+// Private functions
+uint64_t content_hash_rotate(uint64_t value, int bits);
+uint64_t content_hash_round(uint64_t accumulator, uint64_t lane);
+uint64_t content_hash_merge(uint64_t hash, uint64_t accumulator);
+uint64_t content_hash_read_64(const uint8_t* bytes);
+uint32_t content_hash_read_32(const uint8_t* bytes);
+
+uint64_t content_hash(const void* data, size_t size, uint64_t seed)
+{
+	auto bytes = static_cast<const uint8_t*>(data);
+	auto end   = bytes + size;
+
+	uint64_t hash;
+	if (size >= 32)
+	{
+		// Lanes are independent, so CPU keeps four multiplies in flight
+		uint64_t lanes[4] = {
+			seed + CONTENT_HASH_PRIME_1 + CONTENT_HASH_PRIME_2,
+			seed + CONTENT_HASH_PRIME_2,
+			seed,
+			seed - CONTENT_HASH_PRIME_1,
+		};
+
+		for (; bytes + 32 <= end; bytes += 32)
+		{
+			lanes[0] = content_hash_round(lanes[0], content_hash_read_64(bytes));
+			lanes[1] = content_hash_round(lanes[1], content_hash_read_64(bytes + 8));
+			lanes[2] = content_hash_round(lanes[2], content_hash_read_64(bytes + 16));
+			lanes[3] = content_hash_round(lanes[3], content_hash_read_64(bytes + 24));
+		}
+
+		hash = content_hash_rotate(lanes[0], 1) + content_hash_rotate(lanes[1], 7) +
+		       content_hash_rotate(lanes[2], 12) + content_hash_rotate(lanes[3], 18);
+		for (uint64_t lane : lanes) hash = content_hash_merge(hash, lane);
+	}
+	else
+	{
+		hash = seed + CONTENT_HASH_PRIME_5;
+	}
+
+	hash += size;
+
+	// Tail
+	for (; bytes + 8 <= end; bytes += 8)
+	{
+		hash ^= content_hash_round(0, content_hash_read_64(bytes));
+		hash  = content_hash_rotate(hash, 27) * CONTENT_HASH_PRIME_1 + CONTENT_HASH_PRIME_4;
+	}
+	if (bytes + 4 <= end)
+	{
+		hash ^= content_hash_read_32(bytes) * CONTENT_HASH_PRIME_1;
+		hash  = content_hash_rotate(hash, 23) * CONTENT_HASH_PRIME_2 + CONTENT_HASH_PRIME_3;
+		bytes += 4;
+	}
+	for (; bytes < end; bytes++)
+	{
+		hash ^= *bytes * CONTENT_HASH_PRIME_5;
+		hash  = content_hash_rotate(hash, 11) * CONTENT_HASH_PRIME_1;
+	}
+
+	// Avalanche
+	hash ^= hash >> 33;
+	hash *= CONTENT_HASH_PRIME_2;
+	hash ^= hash >> 29;
+	hash *= CONTENT_HASH_PRIME_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint64_t content_hash_rotate(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t content_hash_round(uint64_t accumulator, uint64_t lane)
+{
+	accumulator += lane * CONTENT_HASH_PRIME_2;
+	accumulator  = content_hash_rotate(accumulator, 31);
+	return accumulator * CONTENT_HASH_PRIME_1;
+}
+
+uint64_t content_hash_merge(uint64_t hash, uint64_t accumulator)
+{
+	hash ^= content_hash_round(0, accumulator);
+	return hash * CONTENT_HASH_PRIME_1 + CONTENT_HASH_PRIME_4;
+}
+
+uint64_t content_hash_read_64(const uint8_t* bytes)
+{
+	uint64_t value;
+	memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+uint32_t content_hash_read_32(const uint8_t* bytes)
+{
+	uint32_t value;
+	memcpy(&value, bytes, sizeof(value));
+	return value;
+}
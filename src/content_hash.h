@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fast 64-bit non-cryptographic hash (xxHash64 construction, four lanes over 32 byte stripes), for deduplicating
+// loaded content by its bytes. Runs at several GB/s, so hashing encoded image before decoding it is cheap.
+uint64_t content_hash(const void* data, size_t size, uint64_t seed = 0);
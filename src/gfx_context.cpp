@@ -271,11 +271,14 @@ void create_device()
 		auto dynamic_rendering = candidate.device_features13.dynamicRendering;
 		auto synchronization2 = candidate.device_features13.synchronization2;
 		auto anisotropy = candidate.device_features.samplerAnisotropy;
+		auto multi_draw_indirect = candidate.device_features.multiDrawIndirect;
 		auto variable_descriptor = candidate.device_features12.descriptorBindingVariableDescriptorCount;
 		auto descriptor_partially_bound = candidate.device_features12.descriptorBindingPartiallyBound;
 		auto non_uniform_indexing = candidate.device_features12.shaderSampledImageArrayNonUniformIndexing;
+		auto update_unused_while_pending = candidate.device_features12.descriptorBindingUpdateUnusedWhilePending;
 		if (!dynamic_rendering || !synchronization2 || !anisotropy || !variable_descriptor
-			|| !descriptor_partially_bound || !non_uniform_indexing)
+			|| !descriptor_partially_bound || !non_uniform_indexing || !update_unused_while_pending
+			|| !multi_draw_indirect)
 		{
 			continue;
 		}
@@ -382,10 +385,15 @@ void create_device()
 	gfx_context->physical_device = selected_candidate.physical_device;
 	gfx_context->physical_device_properties = selected_candidate.device_properties;
 	gfx_context->gfx_queue_family_index = selected_candidate.gfx_family_queue_index;
+	gfx_context->texture_compression_bc = selected_candidate.device_features.textureCompressionBC;
 
 	spdlog::info("Selected device: {}", selected_candidate.device_properties.properties.deviceName);
 	spdlog::info("Driver: {}, id {}", selected_candidate.device_properties.properties12.driverName,
 				 selected_candidate.device_properties.properties.driverVersion);
+	if (!gfx_context->texture_compression_bc)
+	{
+		spdlog::warn("Device doesn't support BC textures, scene packs won't be used");
+	}
 
 	// Create device
 	float queue_priorities = 1.0;
@@ -406,13 +414,16 @@ void create_device()
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
 		.pNext = &device_13_features,
 		.shaderSampledImageArrayNonUniformIndexing = true,
+		.descriptorBindingUpdateUnusedWhilePending = true,
 		.descriptorBindingPartiallyBound = true,
 		.descriptorBindingVariableDescriptorCount = true,
 		.timelineSemaphore = true,
 	};
 
 	VkPhysicalDeviceFeatures device_core_features = {
+		.multiDrawIndirect = true,
 		.samplerAnisotropy = true,
+		.textureCompressionBC = gfx_context->texture_compression_bc,
 	};
 
 	std::vector<char*> enabled_extensions(selected_candidate.interested_extensions.size());
@@ -82,6 +82,8 @@ struct Gfx_Context
 	VkQueue  gfx_queue;
 	uint32_t gfx_queue_family_index;
 
+	bool texture_compression_bc; // Optional, without it BC packs aren't used and KTX2 is transcoded to RGBA8
+
 	VmaAllocator vma_allocator;
 	Swapchain    swapchain;
 };
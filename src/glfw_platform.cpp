@@ -226,7 +226,7 @@ void GLFW_Platform::fill_input()
 	}
 }
 
-int32_t main()
+int32_t main(int32_t argc, char** argv)
 {
 	if (!glfwInit())
 	{
@@ -234,7 +234,7 @@ int32_t main()
 	}
 
 	auto p_platform = new GLFW_Platform();
-	application_entry(p_platform);
+	application_entry(p_platform, argc, argv);
 
 	glfwTerminate();
 	return 0;
@@ -2,6 +2,12 @@
 
 #include <tracy/TracyClient.cpp>
 
+// LZ4 (used by scene packs). TracyClient already pulls in tracy_lz4.cpp when profiler is enabled.
+#ifndef TRACY_ENABLE
+#include <tracy/common/tracy_lz4.cpp>
+#endif
+#include <tracy/common/tracy_lz4hc.cpp>
+
 #define VOLK_IMPLEMENTATION
 #include <volk.h>
 
@@ -11,5 +17,13 @@
 #define SPDLOG_HEADER_ONLY
 #include <spdlog/spdlog.h>
 
+// stb_image can decode straight into upload heap, allocators are in loader_gltf.cpp
+void* stbi_target_malloc(size_t size);
+void* stbi_target_realloc(void* pointer, size_t size);
+void  stbi_target_free(void* pointer);
+#define STBI_MALLOC(size)           stbi_target_malloc(size)
+#define STBI_REALLOC(pointer, size) stbi_target_realloc(pointer, size)
+#define STBI_FREE(pointer)          stbi_target_free(pointer)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
\ No newline at end of file
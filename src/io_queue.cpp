@@ -0,0 +1,376 @@
+#include "io_queue.h"
+
+#include "common.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#ifdef IO_QUEUE_URING
+#include <cerrno>
+#include <fcntl.h>
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct Io_Uring_Backend
+{
+	io_uring    ring;
+	int         wake_event; // eventfd, written by io_submit(), so loop doesn't sleep on completions only
+	uint64_t    wake_value;
+	std::thread thread;
+};
+
+// Read in flight. Short reads are resubmitted for the rest.
+struct Io_Uring_Read
+{
+	Io_Request request;
+	Io_Read    read;
+	int        file_descriptor;
+	uint8_t*   destination;
+	uint64_t   done;
+};
+
+constexpr uint32_t IO_URING_MAX_READ = 1u << 30; // Reads take 32 bit length
+#endif
+
+// Private functions
+bool io_queue_pop(Io_Request* request);
+Io_Read io_read_blocking(const Io_Request& request);
+void io_queue_worker_loop(uint32_t worker_index);
+#ifdef IO_QUEUE_URING
+bool io_uring_backend_init();
+void io_uring_loop();
+void io_uring_start(Io_Request request, uint32_t* in_flight);
+void io_uring_submit_read(Io_Uring_Read* read);
+void io_uring_finish(Io_Uring_Read* read, bool ok, uint32_t* in_flight);
+void io_uring_arm_wake_event();
+#endif
+
+void io_queue_init()
+{
+	ZoneScopedN("I/O queue initialization");
+
+	io_queue = new Io_Queue{ .stopping = false, .uring = nullptr };
+
+#ifdef IO_QUEUE_URING
+	if (io_uring_backend_init())
+	{
+		spdlog::info("I/O queue started with io_uring, {} reads in flight", IO_QUEUE_DEPTH);
+		return;
+	}
+	spdlog::warn("io_uring not available, falling back to I/O threads");
+#endif
+
+	for (uint32_t worker_index = 0; worker_index < IO_QUEUE_THREADS; worker_index++)
+	{
+		io_queue->threads.emplace_back(io_queue_worker_loop, worker_index);
+	}
+
+	spdlog::info("I/O queue started with {} threads", IO_QUEUE_THREADS);
+}
+
+void io_queue_deinit()
+{
+	ZoneScopedN("I/O queue destruction");
+
+	{
+		std::lock_guard lock(io_queue->queue_mutex);
+		io_queue->stopping = true;
+	}
+	io_queue->queue_condition.notify_all();
+
+#ifdef IO_QUEUE_URING
+	if (io_queue->uring != nullptr)
+	{
+		uint64_t wake = 1;
+		[[maybe_unused]] auto written = write(io_queue->uring->wake_event, &wake, sizeof(wake));
+
+		io_queue->uring->thread.join();
+		io_uring_queue_exit(&io_queue->uring->ring);
+		close(io_queue->uring->wake_event);
+		delete io_queue->uring;
+	}
+#endif
+
+	for (auto& thread : io_queue->threads)
+	{
+		thread.join();
+	}
+
+	delete io_queue;
+}
+
+void io_submit(Io_Request request)
+{
+	{
+		std::lock_guard lock(io_queue->queue_mutex);
+		io_queue->queues[static_cast<uint32_t>(request.priority)].push_back(std::move(request));
+	}
+
+#ifdef IO_QUEUE_URING
+	if (io_queue->uring != nullptr)
+	{
+		uint64_t wake = 1;
+		[[maybe_unused]] auto written = write(io_queue->uring->wake_event, &wake, sizeof(wake));
+		return;
+	}
+#endif
+
+	io_queue->queue_condition.notify_one();
+}
+
+std::future<Io_Read> io_read(Io_Request request)
+{
+	// Callback has to be copyable, so promise is shared
+	auto promise = std::make_shared<std::promise<Io_Read>>();
+	auto future  = promise->get_future();
+
+	request.callback = [promise](Io_Read read) { promise->set_value(std::move(read)); };
+	io_submit(std::move(request));
+
+	return future;
+}
+
+// Caller holds queue_mutex
+bool io_queue_pop(Io_Request* request)
+{
+	for (auto& queue : io_queue->queues)
+	{
+		if (queue.empty()) continue;
+
+		*request = std::move(queue.front());
+		queue.pop_front();
+		return true;
+	}
+	return false;
+}
+
+Io_Read io_read_blocking(const Io_Request& request)
+{
+	ZoneScopedN("Blocking read");
+
+	Io_Read read = {};
+
+	std::ifstream file(request.path, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) return read;
+
+	uint64_t file_size = static_cast<uint64_t>(file.tellg());
+	if (request.offset > file_size) return read;
+
+	uint64_t size = (request.size == IO_WHOLE_FILE) ? file_size - request.offset : request.size;
+	if (request.offset + size > file_size) return read;
+
+	uint8_t* destination = request.destination;
+	if (destination == nullptr)
+	{
+		read.bytes.resize(size);
+		destination = read.bytes.data();
+	}
+
+	file.seekg(static_cast<std::streamoff>(request.offset));
+	file.read(reinterpret_cast<char*>(destination), static_cast<std::streamsize>(size));
+
+	read.size = size;
+	read.ok   = static_cast<bool>(file);
+	if (!read.ok) read.bytes.clear();
+	return read;
+}
+
+void io_queue_worker_loop(uint32_t worker_index)
+{
+	std::string thread_name = "I/O worker " + std::to_string(worker_index);
+	tracy::SetThreadName(thread_name.c_str());
+
+	while (true)
+	{
+		Io_Request request;
+		{
+			std::unique_lock lock(io_queue->queue_mutex);
+
+			// Drain queues before stopping, someone might be waiting on these
+			bool popped = false;
+			io_queue->queue_condition.wait(lock, [&]
+			{
+				popped = io_queue_pop(&request);
+				return popped || io_queue->stopping;
+			});
+			if (!popped) return;
+		}
+
+		Io_Read read = io_read_blocking(request);
+		if (!read.ok) spdlog::error("Can't read {}", request.path.string());
+		request.callback(std::move(read));
+	}
+}
+
+#ifdef IO_QUEUE_URING
+
+bool io_uring_backend_init()
+{
+	auto backend = std::make_unique<Io_Uring_Backend>();
+
+	// Room for every read in flight plus wake event read
+	if (io_uring_queue_init(IO_QUEUE_DEPTH * 2, &backend->ring, 0) < 0) return false;
+
+	backend->wake_event = eventfd(0, EFD_CLOEXEC);
+	if (backend->wake_event < 0)
+	{
+		io_uring_queue_exit(&backend->ring);
+		return false;
+	}
+
+	io_queue->uring = backend.release();
+	io_uring_arm_wake_event();
+	io_queue->uring->thread = std::thread(io_uring_loop);
+	return true;
+}
+
+void io_uring_loop()
+{
+	tracy::SetThreadName("I/O ring");
+
+	io_uring* ring      = &io_queue->uring->ring;
+	uint32_t  in_flight = 0;
+
+	while (true)
+	{
+		// Start reads while there is room, highest priority first
+		std::vector<Io_Request> started;
+		bool                    stopping;
+		{
+			std::lock_guard lock(io_queue->queue_mutex);
+
+			Io_Request request;
+			while (in_flight + started.size() < IO_QUEUE_DEPTH && io_queue_pop(&request))
+			{
+				started.push_back(std::move(request));
+			}
+			stopping = io_queue->stopping;
+		}
+
+		for (auto& request : started) io_uring_start(std::move(request), &in_flight);
+
+		// Failed (or empty) reads finish right away, don't wait on completions if nothing is in flight because of it.
+		// With nothing started, queues are empty.
+		if (in_flight == 0 && !started.empty()) continue;
+		if (in_flight == 0 && stopping) return;
+
+		io_uring_submit_and_wait(ring, 1);
+
+		unsigned      head;
+		unsigned      seen = 0;
+		io_uring_cqe* cqe;
+		io_uring_for_each_cqe(ring, head, cqe)
+		{
+			seen++;
+
+			auto read = static_cast<Io_Uring_Read*>(io_uring_cqe_get_data(cqe));
+			if (read == nullptr)
+			{
+				io_uring_arm_wake_event();
+				continue;
+			}
+
+			if (cqe->res == -EINTR || cqe->res == -EAGAIN)
+			{
+				io_uring_submit_read(read);
+				continue;
+			}
+
+			// Zero means end of file came before requested size
+			if (cqe->res <= 0)
+			{
+				io_uring_finish(read, false, &in_flight);
+				continue;
+			}
+
+			read->done += static_cast<uint64_t>(cqe->res);
+			if (read->done < read->read.size) io_uring_submit_read(read);
+			else                              io_uring_finish(read, true, &in_flight);
+		}
+		io_uring_cq_advance(ring, seen);
+	}
+}
+
+void io_uring_start(Io_Request request, uint32_t* in_flight)
+{
+	auto read = new Io_Uring_Read{ .request = std::move(request), .file_descriptor = -1 };
+	(*in_flight)++;
+
+	// Opening is blocking, but it's cheap next to reads
+	read->file_descriptor = open(read->request.path.c_str(), O_RDONLY | O_CLOEXEC);
+
+	struct stat file_stat;
+	if (read->file_descriptor < 0 || fstat(read->file_descriptor, &file_stat) != 0)
+	{
+		io_uring_finish(read, false, in_flight);
+		return;
+	}
+
+	uint64_t file_size = static_cast<uint64_t>(file_stat.st_size);
+	uint64_t offset    = read->request.offset;
+	uint64_t size      = (read->request.size == IO_WHOLE_FILE) ? file_size - std::min(offset, file_size)
+	                                                           : read->request.size;
+	if (offset > file_size || offset + size > file_size)
+	{
+		io_uring_finish(read, false, in_flight);
+		return;
+	}
+
+	read->read.size   = size;
+	read->destination = read->request.destination;
+	if (read->destination == nullptr)
+	{
+		read->read.bytes.resize(size);
+		read->destination = read->read.bytes.data();
+	}
+
+	if (size == 0)
+	{
+		io_uring_finish(read, true, in_flight);
+		return;
+	}
+
+	io_uring_submit_read(read);
+}
+
+// Submission queue has room for every read in flight, so there is always free entry
+void io_uring_submit_read(Io_Uring_Read* read)
+{
+	uint64_t remaining = read->read.size - read->done;
+
+	io_uring_sqe* sqe = io_uring_get_sqe(&io_queue->uring->ring);
+	io_uring_prep_read(sqe, read->file_descriptor, read->destination + read->done,
+	                   static_cast<unsigned>(std::min<uint64_t>(remaining, IO_URING_MAX_READ)),
+	                   read->request.offset + read->done);
+	io_uring_sqe_set_data(sqe, read);
+}
+
+void io_uring_finish(Io_Uring_Read* read, bool ok, uint32_t* in_flight)
+{
+	if (read->file_descriptor >= 0) close(read->file_descriptor);
+
+	read->read.ok = ok;
+	if (!ok)
+	{
+		spdlog::error("Can't read {}", read->request.path.string());
+		read->read.bytes.clear();
+	}
+
+	read->request.callback(std::move(read->read));
+
+	delete read;
+	(*in_flight)--;
+}
+
+void io_uring_arm_wake_event()
+{
+	io_uring_sqe* sqe = io_uring_get_sqe(&io_queue->uring->ring);
+	io_uring_prep_read(sqe, io_queue->uring->wake_event, &io_queue->uring->wake_value, sizeof(uint64_t), 0);
+	io_uring_sqe_set_data(sqe, nullptr);
+}
+
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Asynchronous file reads, so loading can keep many of them in flight and overlap them with decoding and uploads.
+// Requests wait in per-priority queues and are started highest priority first, FIFO within the same priority.
+//
+// On Linux, single I/O thread owns io_uring and keeps up to IO_QUEUE_DEPTH reads in flight. Elsewhere (or when
+// kernel doesn't allow io_uring) few threads do blocking reads.
+//
+// Callbacks run on I/O thread, so they should just hand the result over (job_system_submit(), promise), and
+// never block on other reads.
+
+constexpr uint32_t IO_QUEUE_DEPTH   = 64;
+constexpr uint32_t IO_QUEUE_THREADS = 4;     // Fallback
+constexpr uint64_t IO_WHOLE_FILE    = ~0ull;
+
+enum class Io_Priority : uint32_t
+{
+	HIGH,   // Someone is waiting for it right now (shaders)
+	NORMAL, // Streaming
+	LOW,    // Prefetching
+	COUNT,
+};
+
+struct Io_Read
+{
+	std::vector<uint8_t> bytes; // Empty if request had destination
+	uint64_t             size;
+	bool                 ok;    // False if file couldn't be opened, or is shorter than requested
+};
+
+struct Io_Request
+{
+	std::filesystem::path             path;
+	uint64_t                          offset;
+	uint64_t                          size;        // IO_WHOLE_FILE reads from offset to the end
+	uint8_t*                          destination; // Null to get bytes in Io_Read, otherwise must fit size bytes
+	Io_Priority                       priority;
+	std::function<void(Io_Read read)> callback;
+};
+
+struct Io_Uring_Backend;
+
+struct Io_Queue
+{
+	std::deque<Io_Request>   queues[static_cast<uint32_t>(Io_Priority::COUNT)];
+	std::mutex               queue_mutex;
+	std::condition_variable  queue_condition; // Fallback threads wait on it
+	bool                     stopping;
+	std::vector<std::thread> threads;
+	Io_Uring_Backend*        uring; // Null when fallback is used
+};
+
+inline Io_Queue* io_queue;
+
+void io_queue_init();
+void io_queue_deinit(); // Queued reads are finished first
+
+// Callback is called exactly once, also when the read fails
+void io_submit(Io_Request request);
+
+// Same as io_submit(), request's callback is replaced by fulfilling the future
+std::future<Io_Read> io_read(Io_Request request);
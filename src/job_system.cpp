@@ -0,0 +1,145 @@
+#include "job_system.h"
+
+#include "common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <string>
+
+// Private functions
+void job_system_worker_loop(uint32_t worker_index);
+
+void job_system_init(uint32_t worker_count)
+{
+	ZoneScopedN("Job system initialization");
+
+	job_system = new Job_System{ .stopping = false };
+
+	if (worker_count == 0)
+	{
+		uint32_t hardware_threads = std::thread::hardware_concurrency();
+		worker_count = (hardware_threads > 1) ? hardware_threads - 1 : 1;
+	}
+
+	for (uint32_t worker_index = 0; worker_index < worker_count; worker_index++)
+	{
+		job_system->workers.emplace_back(job_system_worker_loop, worker_index);
+	}
+
+	spdlog::info("Job system started with {} workers", worker_count);
+}
+
+void job_system_deinit()
+{
+	ZoneScopedN("Job system destruction");
+
+	{
+		std::lock_guard lock(job_system->queue_mutex);
+		job_system->stopping = true;
+	}
+	job_system->queue_condition.notify_all();
+
+	for (auto& worker : job_system->workers)
+	{
+		worker.join();
+	}
+
+	delete job_system;
+}
+
+void job_system_worker_loop(uint32_t worker_index)
+{
+	std::string thread_name = "Job worker " + std::to_string(worker_index);
+	tracy::SetThreadName(thread_name.c_str());
+
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock lock(job_system->queue_mutex);
+			job_system->queue_condition.wait(lock, [] { return job_system->stopping || !job_system->queue.empty(); });
+
+			// Drain queue before stopping, someone might be waiting on these
+			if (job_system->queue.empty()) return;
+
+			job = std::move(job_system->queue.front());
+			job_system->queue.pop_front();
+		}
+		job();
+	}
+}
+
+void job_system_submit(std::function<void()> job)
+{
+	{
+		std::lock_guard lock(job_system->queue_mutex);
+		job_system->queue.push_back(std::move(job));
+	}
+	job_system->queue_condition.notify_one();
+}
+
+void parallel_for(size_t count, const std::function<void(size_t)>& function)
+{
+	if (count == 0) return;
+
+	// State shared between all participants. Helpers that get picked up late (after everything is done)
+	// still hold a reference, so it has to outlive this call.
+	struct Parallel_For_State
+	{
+		const std::function<void(size_t)>* function;
+		size_t                             count;
+		std::atomic<size_t>                next_index;
+		std::atomic<size_t>                finished_count;
+		std::mutex                         mutex;
+		std::condition_variable            finished_condition;
+		std::exception_ptr                 exception;
+	};
+
+	auto state = std::make_shared<Parallel_For_State>();
+	state->function       = &function;
+	state->count          = count;
+	state->next_index     = 0;
+	state->finished_count = 0;
+
+	// Grab indices one by one until there is nothing left. Returns when there is no more work to pick up,
+	// which does not mean all work is finished.
+	auto execute = [](Parallel_For_State* state)
+	{
+		size_t index;
+		while ((index = state->next_index.fetch_add(1)) < state->count)
+		{
+			try
+			{
+				(*state->function)(index);
+			}
+			catch (...)
+			{
+				std::lock_guard lock(state->mutex);
+				if (!state->exception) state->exception = std::current_exception();
+			}
+
+			if (state->finished_count.fetch_add(1) + 1 == state->count)
+			{
+				std::lock_guard lock(state->mutex);
+				state->finished_condition.notify_all();
+			}
+		}
+	};
+
+	size_t helpers_count = std::min(count - 1, job_system->workers.size());
+	for (size_t helper = 0; helper < helpers_count; helper++)
+	{
+		job_system_submit([state, execute] { execute(state.get()); });
+	}
+
+	execute(state.get());
+
+	{
+		std::unique_lock lock(state->mutex);
+		state->finished_condition.wait(lock, [&] { return state->finished_count == state->count; });
+	}
+
+	if (state->exception) std::rethrow_exception(state->exception);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool of worker threads executing queued jobs.
+// Used mostly by asset loading for now (image decoding, etc.), so it doesn't do anything clever - single shared
+// queue guarded by mutex. Good enough as long as jobs are coarse (milliseconds, not microseconds).
+struct Job_System
+{
+	std::vector<std::thread>          workers;
+	std::deque<std::function<void()>> queue;
+	std::mutex                        queue_mutex;
+	std::condition_variable           queue_condition;
+	bool                              stopping;
+};
+
+inline Job_System* job_system;
+
+void job_system_init(uint32_t worker_count = 0); // 0 = one worker per hardware thread (minus calling thread)
+void job_system_deinit();
+
+// Enqueue single job. Fire and forget - if you need to know when it finishes, signal it yourself.
+void job_system_submit(std::function<void()> job);
+
+// Calls function(index) for every index in [0, count) on worker threads and blocks until all of them are done.
+// Calling thread participates in execution, so it's fine to call it from a job.
+// If any of the calls throws, first exception is rethrown on the calling thread (after all calls finished).
+void parallel_for(size_t count, const std::function<void(size_t)>& function);
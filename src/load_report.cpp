@@ -0,0 +1,115 @@
+#include "load_report.h"
+
+#include "common.h"
+
+#include <format>
+
+constexpr const char* LOAD_PHASE_NAMES[] = {
+	"file_read",
+	"json_parse",
+	"image_decode",
+	"vertex_transcode",
+	"copy_recording",
+	"gpu_execution",
+};
+static_assert(std::size(LOAD_PHASE_NAMES) == static_cast<size_t>(Load_Phase::COUNT));
+
+// Private functions
+void load_report_append_string(std::string* json, std::string_view string);
+void load_report_append_timing(std::string* json, uint64_t nanoseconds, uint64_t bytes);
+
+void load_report_init()
+{
+	load_report = new Load_Report{};
+}
+
+void load_report_deinit()
+{
+	delete load_report;
+	load_report = nullptr;
+}
+
+void load_report_add(Load_Phase phase, uint64_t nanoseconds, uint64_t bytes)
+{
+	if (load_report == nullptr) return;
+
+	auto& report_phase = load_report->phases[static_cast<uint32_t>(phase)];
+	report_phase.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+	report_phase.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void load_report_add_image(std::string_view name, uint64_t nanoseconds, uint64_t bytes)
+{
+	if (load_report == nullptr) return;
+
+	std::lock_guard lock(load_report->images_mutex);
+	load_report->images.push_back({ std::string(name), nanoseconds, bytes });
+}
+
+std::string load_report_json(std::string_view scene, double wall_seconds)
+{
+	std::string json = "{\"scene\":";
+	load_report_append_string(&json, scene);
+	json += std::format(",\"wall_seconds\":{:.4f},\"phases\":{{", wall_seconds);
+
+	for (uint32_t phase = 0; phase < static_cast<uint32_t>(Load_Phase::COUNT); phase++)
+	{
+		auto& report_phase = load_report->phases[phase];
+		json += std::format("{}\"{}\":", phase == 0 ? "" : ",", LOAD_PHASE_NAMES[phase]);
+		load_report_append_timing(&json, report_phase.nanoseconds.load(), report_phase.bytes.load());
+	}
+
+	json += "},\"images\":[";
+	{
+		std::lock_guard lock(load_report->images_mutex);
+		for (size_t image_index = 0; image_index < load_report->images.size(); image_index++)
+		{
+			auto& image = load_report->images[image_index];
+			json += (image_index == 0) ? "{\"name\":" : ",{\"name\":";
+			load_report_append_string(&json, image.name);
+			json += ",\"timing\":";
+			load_report_append_timing(&json, image.nanoseconds, image.bytes);
+			json += "}";
+		}
+	}
+	json += "]}";
+
+	return json;
+}
+
+void load_report_append_string(std::string* json, std::string_view string)
+{
+	*json += '"';
+	for (char c : string)
+	{
+		if (c == '"' || c == '\\')                   *json += std::format("\\{}", c);
+		else if (static_cast<unsigned char>(c) < 32) *json += std::format("\\u{:04x}", static_cast<int>(c));
+		else                                         *json += c;
+	}
+	*json += '"';
+}
+
+void load_report_append_timing(std::string* json, uint64_t nanoseconds, uint64_t bytes)
+{
+	double seconds       = nanoseconds / 1e9;
+	double mb_per_second = (nanoseconds > 0) ? (bytes / 1e6) / seconds : 0.0;
+	*json += std::format("{{\"seconds\":{:.4f},\"bytes\":{},\"mb_per_s\":{:.1f}}}", seconds, bytes, mb_per_second);
+}
+
+Load_Timer::Load_Timer(Load_Phase phase, uint64_t bytes)
+{
+	this->phase = phase;
+	this->bytes = bytes;
+	this->start = std::chrono::high_resolution_clock::now();
+}
+
+Load_Timer::~Load_Timer()
+{
+	load_report_add(phase, elapsed_nanoseconds(), bytes);
+}
+
+uint64_t Load_Timer::elapsed_nanoseconds() const
+{
+	auto elapsed = std::chrono::high_resolution_clock::now() - start;
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
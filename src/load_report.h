@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Per-phase timings of scene loading with byte counts, so load throughput (MB/s) can be tracked across scenes and
+// changes. CPU phases are timed by Load_Timer scopes placed next to Tracy zones. Phases running in parallel sum time
+// of all threads, so they can add up to more than wall time. GPU execution is measured with timestamp queries
+// around every upload batch.
+//
+// Once loading finishes, report is logged as single line of JSON (and written to --load-report file, if given).
+
+enum class Load_Phase : uint32_t
+{
+	FILE_READ,        // Mapping glTF, its buffers and images, reading (and LZ4 decompressing) pack chunks
+	JSON_PARSE,       // glTF JSON
+	IMAGE_DECODE,     // PNG/JPEG decoding, KTX2 transcoding
+	VERTEX_TRANSCODE, // Meshopt and Draco decoding, dequantization and interleaving of primitives
+	COPY_RECORDING,   // Recording of upload batches
+	GPU_EXECUTION,    // Upload batches on GPU
+	COUNT,
+};
+
+struct Load_Report
+{
+	struct Phase
+	{
+		std::atomic<uint64_t> nanoseconds;
+		std::atomic<uint64_t> bytes;
+	};
+
+	struct Image
+	{
+		std::string name;
+		uint64_t    nanoseconds;
+		uint64_t    bytes; // Decoded
+	};
+
+	Phase phases[static_cast<uint32_t>(Load_Phase::COUNT)];
+
+	std::mutex         images_mutex;
+	std::vector<Image> images;
+};
+
+inline Load_Report* load_report; // Null when not loading (baking doesn't report), timers do nothing then
+
+void load_report_init();
+void load_report_deinit();
+
+void load_report_add(Load_Phase phase, uint64_t nanoseconds, uint64_t bytes);
+void load_report_add_image(std::string_view name, uint64_t nanoseconds, uint64_t bytes);
+
+// Everything gathered so far
+std::string load_report_json(std::string_view scene, double wall_seconds);
+
+// Adds time of enclosing scope to phase, bytes can be set any time before scope ends
+struct Load_Timer
+{
+	Load_Phase phase;
+	uint64_t   bytes;
+	std::chrono::high_resolution_clock::time_point start;
+
+	explicit Load_Timer(Load_Phase phase, uint64_t bytes = 0);
+	~Load_Timer();
+
+	[[nodiscard]] uint64_t elapsed_nanoseconds() const;
+};
@@ -0,0 +1,1327 @@
+#include "loader.h"
+
+#include "common.h"
+#include "application.h"
+#include "load_report.h"
+#include "scene_pack.h"
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <map>
+
+// Room for material writes, added to every batch. Every material is written at most twice in one batch (placeholder,
+// and for real once its textures land).
+constexpr size_t SCENE_UPLOAD_MATERIAL_SLACK = 2 * 40000;
+
+// Private functions
+void scene_loader_run();
+void scene_loader_run_reload(std::vector<std::filesystem::path> changed_files);
+void scene_loader_abandon_upload();
+void scene_loader_destroy_retired(uint64_t rendered_value);
+void scene_loader_wait(uint64_t timeline_value);
+void scene_loader_retire(size_t max_in_flight_size);
+void scene_loader_report();
+void scene_upload_material_write(Scene_Upload& upload, Slot_Handle material, const PBR_Material& value);
+VkDeviceSize scene_upload_mesh_allocate(Scene_Upload& upload, Mesh_Buffer* mesh_buffer, VkDeviceSize size,
+                                        VkDeviceSize alignment, VmaVirtualAllocation* allocation);
+void scene_upload_record(Scene_Upload& upload);
+void scene_upload_submit(Scene_Upload* upload);
+std::array<uint32_t, 16> sampler_create_info_key(const VkSamplerCreateInfo& create_info);
+Allocated_View_Image scene_upload_create_image(Slot_Handle image, const VkImageCreateInfo& create_info,
+                                               std::string_view name, VkComponentMapping components);
+
+void load_scene_data()
+{
+	ZoneScopedN("Loading scene data");
+
+	scene_descriptors_init();
+	scene_loader_init(app->launch_options.scene, !app->launch_options.sync_load, app->launch_options.staging_budget,
+	                  app->launch_options.packed_vertices, app->launch_options.static_batching);
+}
+
+void scene_loader_init(const std::filesystem::path& scene_file, bool asynchronous, size_t staging_budget,
+                       bool packed_vertices, bool static_batching)
+{
+	ZoneScopedN("Scene loader initialization");
+
+	load_report_init();
+
+	scene_loader = new Scene_Loader{};
+	scene_loader->scene_file            = scene_file;
+	scene_loader->asynchronous          = asynchronous;
+	scene_loader->staging_budget        = staging_budget;
+	scene_loader->batch_size            = staging_budget / 3 - SCENE_UPLOAD_MATERIAL_SLACK;
+	scene_loader->packed_vertices       = packed_vertices;
+	scene_loader->static_batching       = static_batching;
+	scene_loader->default_texture_image = texture_manager->images.values[Texture_Manager::DEFAULT_TEXTURE].image;
+	scene_loader->default_material      = material_manager->materials.values[Material_Manager::DEFAULT_MATERIAL];
+	scene_loader->start_time            = std::chrono::high_resolution_clock::now();
+	scene_loader->next_timeline_value   = 1;
+	scene_loader->next_node_index       = scene_data->transforms.parents.size();
+	scene_loader->landed_images.assign(texture_manager->images.size(), true);
+
+	VkSemaphoreTypeCreateInfo semaphore_type_create_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue  = 0,
+	};
+
+	VkSemaphoreCreateInfo semaphore_create_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &semaphore_type_create_info,
+	};
+
+	vkCreateSemaphore(gfx_context->device, &semaphore_create_info, nullptr, &scene_loader->semaphore);
+	name_object(scene_loader->semaphore, "Scene loader timeline semaphore");
+
+	if (asynchronous)
+	{
+		scene_loader->thread = std::thread(scene_loader_run);
+		return;
+	}
+
+	scene_loader_run();
+
+	if (scene_loader->exception) std::rethrow_exception(scene_loader->exception);
+
+	scene_loader_report();
+}
+
+void scene_loader_deinit()
+{
+	ZoneScopedN("Scene loader deinitialization");
+
+	scene_loader->cancelled = true;
+	if (scene_loader->thread.joinable()) scene_loader->thread.join();
+
+	// Main thread never got to submit these. Their blocks and pools are released with the rest below, so is the newest
+	// mesh buffer (with mesh manager).
+	for (Scene_Upload* upload : scene_loader->ready_uploads)
+	{
+		for (auto& growth : upload->buffer_growths)
+		{
+			if (growth.new_buffer.buffer == growth.mesh_buffer->loader_buffer.buffer) continue;
+			vmaDestroyBuffer(gfx_context->vma_allocator, growth.new_buffer.buffer, growth.new_buffer.allocation);
+		}
+		delete upload;
+	}
+
+	vkDeviceWaitIdle(gfx_context->device);
+
+	scene_loader_destroy_retired(UINT64_MAX);
+
+	for (auto& in_flight_upload : scene_loader->in_flight_uploads)
+	{
+		renderer->upload_heap.free_block(in_flight_upload.upload_heap_block);
+		vkDestroyCommandPool(gfx_context->device, in_flight_upload.command_pool, nullptr);
+		vkDestroyQueryPool(gfx_context->device, in_flight_upload.timestamp_pool, nullptr);
+	}
+
+	vkDestroySemaphore(gfx_context->device, scene_loader->semaphore, nullptr);
+
+	delete scene_loader;
+	load_report_deinit();
+}
+
+void scene_loader_update()
+{
+	if (!scene_loader->asynchronous) return;
+
+	ZoneScopedN("Scene loader update");
+
+	std::deque<Scene_Upload*> ready_uploads;
+	std::exception_ptr        exception;
+	bool                      finished;
+	{
+		std::lock_guard lock(scene_loader->mutex);
+		std::swap(ready_uploads, scene_loader->ready_uploads);
+		exception = scene_loader->exception;
+		finished  = scene_loader->finished;
+	}
+
+	for (Scene_Upload* upload : ready_uploads)
+	{
+		scene_upload_submit(upload);
+	}
+
+	// Frame N signals render semaphore with N + buffering once it's done (see renderer_dispatch())
+	uint64_t rendered_value;
+	vkGetSemaphoreCounterValue(gfx_context->device, renderer->render_semaphore, &rendered_value);
+	scene_loader_destroy_retired(rendered_value);
+
+	if (exception) std::rethrow_exception(exception);
+
+	if (finished && scene_loader->thread.joinable())
+	{
+		scene_loader->thread.join();
+
+		if (!scene_loader->reloading) scene_loader_report();
+	}
+}
+
+bool scene_loader_idle()
+{
+	std::lock_guard lock(scene_loader->mutex);
+	return scene_loader->finished && scene_loader->ready_uploads.empty() && !scene_loader->thread.joinable();
+}
+
+void scene_loader_reload(std::vector<std::filesystem::path> changed_files)
+{
+	{
+		std::lock_guard lock(scene_loader->mutex);
+		scene_loader->finished = false;
+	}
+	scene_loader->reloading  = true;
+	scene_loader->start_time = std::chrono::high_resolution_clock::now();
+
+	if (scene_loader->asynchronous)
+	{
+		scene_loader->thread = std::thread(scene_loader_run_reload, std::move(changed_files));
+		return;
+	}
+
+	scene_loader_run_reload(std::move(changed_files));
+}
+
+void scene_loader_run()
+{
+	if (scene_loader->asynchronous)
+	{
+		tracy::SetThreadName("Scene loader");
+	}
+
+	try
+	{
+		std::filesystem::path gltf_file = scene_loader->scene_file;
+
+		// Prefer baked scene pack, if there is an up-to-date one (pack checks files it was baked from)
+		std::filesystem::path pack_file = scene_pack_path(gltf_file);
+		bool pack_loaded = false;
+		if (std::filesystem::exists(pack_file))
+		{
+			pack_loaded = load_scene_pack(pack_file);
+		}
+
+		if (!pack_loaded)
+		{
+			load_gltf_scene(gltf_file);
+		}
+
+		// Everything is released by the time we report being finished
+		scene_loader_retire(0);
+	}
+	catch (...)
+	{
+		// Nobody is interested in why we stopped, if we were asked to
+		if (!scene_loader->cancelled)
+		{
+			std::lock_guard lock(scene_loader->mutex);
+			scene_loader->exception = std::current_exception();
+		}
+	}
+
+	std::lock_guard lock(scene_loader->mutex);
+	scene_loader->finished = true;
+}
+
+void scene_loader_run_reload(std::vector<std::filesystem::path> changed_files)
+{
+	if (scene_loader->asynchronous)
+	{
+		tracy::SetThreadName("Scene reloader");
+	}
+
+	try
+	{
+		reload_gltf_assets(scene_loader->scene_file, changed_files);
+		scene_loader_retire(0);
+
+		auto duration = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(
+			std::chrono::high_resolution_clock::now() - scene_loader->start_time);
+		spdlog::info("Assets reloaded! [{:.1f}ms]", duration.count());
+	}
+	catch (const std::exception& exception)
+	{
+		// Broken file shouldn't take the application down, it's likely still being edited
+		if (!scene_loader->cancelled)
+		{
+			spdlog::error("Asset reload failed: {}", exception.what());
+			scene_loader_abandon_upload();
+		}
+	}
+
+	std::lock_guard lock(scene_loader->mutex);
+	scene_loader->finished = true;
+}
+
+// Batch left open by failed reload is still submitted, so its timeline value gets signalled, just without its images
+// (they might be half-decoded). Materials waiting for them keep their old textures.
+void scene_loader_abandon_upload()
+{
+	Scene_Upload* upload = scene_loader->open_upload;
+	if (upload != nullptr)
+	{
+		for (auto& [image_index, image] : upload->images)
+		{
+			vkDestroyImageView(gfx_context->device, image.view, nullptr);
+			vmaDestroyImage(gfx_context->vma_allocator, image.image, image.allocation);
+		}
+		upload->images.clear();
+		upload->image_uploads.clear();
+
+		scene_upload_finish(upload);
+	}
+
+	scene_loader->pending_materials.clear();
+}
+
+void scene_loader_destroy_retired(uint64_t rendered_value)
+{
+	auto& retired_assets = scene_loader->retired_assets;
+
+	while (!retired_assets.empty() && retired_assets.front().frame + renderer->buffering <= rendered_value)
+	{
+		auto& retired = retired_assets.front();
+
+		// Slots get default texture, so there is nothing dangling in them until they are reused
+		auto& default_image = texture_manager->images.values[Texture_Manager::DEFAULT_TEXTURE];
+		VkDescriptorImageInfo default_descriptor = {
+			.imageView   = default_image.view,
+			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		};
+
+		std::vector<VkWriteDescriptorSet> descriptor_set_writes;
+		for (Slot_Handle image_handle : retired.images)
+		{
+			auto& image = texture_manager->images[image_handle];
+			vkDestroyImageView(gfx_context->device, image.view, nullptr);
+			vmaDestroyImage(gfx_context->vma_allocator, image.image, image.allocation);
+			texture_manager->images.remove(image_handle);
+
+			descriptor_set_writes.push_back({
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet          = renderer->global_data_descriptor_set,
+				.dstBinding      = 2,
+				.dstArrayElement = image_handle.index,
+				.descriptorCount = 1,
+				.descriptorType  = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+				.pImageInfo      = &default_descriptor,
+			});
+		}
+		vkUpdateDescriptorSets(gfx_context->device, descriptor_set_writes.size(), descriptor_set_writes.data(),
+		                       0, nullptr);
+
+		for (auto& buffer : retired.buffers)
+		{
+			vmaDestroyBuffer(gfx_context->vma_allocator, buffer.buffer, buffer.allocation);
+		}
+
+		retired_assets.pop_front();
+	}
+}
+
+void scene_loader_wait(uint64_t timeline_value)
+{
+	ZoneScopedN("Waiting on scene upload");
+
+	VkSemaphoreWaitInfo wait_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores    = &scene_loader->semaphore,
+		.pValues        = &timeline_value,
+	};
+
+	// Batch might never get submitted if main thread is shutting down, so check once in a while
+	while (vkWaitSemaphores(gfx_context->device, &wait_info, 10 * 1000 * 1000) == VK_TIMEOUT)
+	{
+		if (scene_loader->cancelled) throw std::runtime_error("Scene loading cancelled");
+	}
+}
+
+void scene_loader_retire(size_t max_in_flight_size)
+{
+	auto& in_flight_uploads = scene_loader->in_flight_uploads;
+
+	while (!in_flight_uploads.empty() && scene_loader->in_flight_size > max_in_flight_size)
+	{
+		auto& oldest = in_flight_uploads.front();
+
+		scene_loader_wait(oldest.timeline_value);
+
+		if (oldest.timestamp_pool != VK_NULL_HANDLE)
+		{
+			uint64_t timestamps[2];
+			vkGetQueryPoolResults(gfx_context->device, oldest.timestamp_pool, 0, 2, sizeof(timestamps), timestamps,
+			                      sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+			float period = gfx_context->physical_device_properties.properties.limits.timestampPeriod;
+			load_report_add(Load_Phase::GPU_EXECUTION, static_cast<uint64_t>((timestamps[1] - timestamps[0]) * period),
+			                oldest.upload_heap_block.size);
+		}
+
+		renderer->upload_heap.free_block(oldest.upload_heap_block);
+		vkDestroyCommandPool(gfx_context->device, oldest.command_pool, nullptr);
+		vkDestroyQueryPool(gfx_context->device, oldest.timestamp_pool, nullptr);
+
+		scene_loader->in_flight_size -= oldest.upload_heap_block.size;
+		in_flight_uploads.pop_front();
+	}
+}
+
+void scene_loader_report()
+{
+	auto duration = std::chrono::duration_cast<std::chrono::duration<float>>(
+		std::chrono::high_resolution_clock::now() - scene_loader->start_time);
+	spdlog::info("Scene loaded! [{:.2f}s]", duration.count());
+
+	std::string report = load_report_json(scene_loader->scene_file.string(), duration.count());
+	spdlog::info("Load report: {}", report);
+
+	auto& report_file = app->launch_options.load_report;
+	if (!report_file.empty())
+	{
+		std::ofstream file(report_file);
+		file << report << '\n';
+		if (!file) spdlog::error("Can't write load report to {}", report_file);
+	}
+}
+
+Slot_Handle scene_loader_reserve_image()
+{
+	Slot_Handle image = texture_manager->images.reserve();
+
+	auto& landed_images = scene_loader->landed_images;
+	if (landed_images.size() <= image.index) landed_images.resize(image.index + 1);
+	landed_images[image.index] = false;
+
+	return image;
+}
+
+uint32_t scene_loader_reserve_nodes(uint32_t count)
+{
+	uint32_t first_node = scene_loader->next_node_index;
+	scene_loader->next_node_index += count;
+	return first_node;
+}
+
+Scene_Upload* scene_upload_begin(size_t upload_size)
+{
+	ZoneScopedN("Scene upload begin");
+
+	if (scene_loader->cancelled) throw std::runtime_error("Scene loading cancelled");
+
+	upload_size += SCENE_UPLOAD_MATERIAL_SLACK;
+
+	// Throttle ourselves, upload heap is shared with rendering
+	size_t budget = scene_loader->staging_budget;
+	scene_loader_retire(upload_size < budget ? budget - upload_size : 0);
+
+	auto upload_heap_block = renderer->upload_heap.allocate_block(upload_size);
+
+	auto upload = new Scene_Upload{
+		.upload_heap_block = upload_heap_block,
+		.upload_writer     = Mapped_Buffer_Writer(upload_heap_block.ptr),
+		.timeline_value    = scene_loader->next_timeline_value++,
+	};
+
+	VkCommandPoolCreateInfo command_pool_create_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = gfx_context->gfx_queue_family_index,
+	};
+
+	vkCreateCommandPool(gfx_context->device, &command_pool_create_info, nullptr, &upload->command_pool);
+	name_object(upload->command_pool, "Scene upload command pool {}", upload->timeline_value);
+
+	VkCommandBufferAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = upload->command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+
+	vkAllocateCommandBuffers(gfx_context->device, &allocate_info, &upload->command_buffer);
+	name_object(upload->command_buffer, "Scene upload command buffer {}", upload->timeline_value);
+
+	if (gfx_context->physical_device_properties.properties.limits.timestampComputeAndGraphics)
+	{
+		VkQueryPoolCreateInfo query_pool_create_info = {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType  = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = 2,
+		};
+		vkCreateQueryPool(gfx_context->device, &query_pool_create_info, nullptr, &upload->timestamp_pool);
+		name_object(upload->timestamp_pool, "Scene upload timestamps {}", upload->timeline_value);
+	}
+
+	// Tracked from now on, so it's released even if we don't get to finish it
+	scene_loader->in_flight_uploads.push_back({
+		.timeline_value    = upload->timeline_value,
+		.upload_heap_block = upload_heap_block,
+		.command_pool      = upload->command_pool,
+		.timestamp_pool    = upload->timestamp_pool,
+	});
+	scene_loader->in_flight_size += upload_heap_block.size;
+	scene_loader->open_upload     = upload;
+
+	return upload;
+}
+
+void scene_upload_finish(Scene_Upload* upload)
+{
+	ZoneScopedN("Scene upload finish");
+
+	scene_loader->open_upload = nullptr;
+
+	// Images of this batch are usable once it's committed, so are materials that were only waiting for them
+	for (auto& [image_handle, image] : upload->images)
+	{
+		scene_loader->landed_images[image_handle.index] = true;
+	}
+
+	auto& landed_images = scene_loader->landed_images;
+	std::erase_if(scene_loader->pending_materials, [&](const Scene_Loader::Pending_Material& pending)
+	{
+		if (!landed_images[pending.material.albedo_texture] || !landed_images[pending.material.metal_roughness_texture])
+		return false;
+
+		scene_upload_material_write(*upload, pending.handle, pending.material);
+		return true;
+	});
+
+	scene_upload_record(*upload);
+	renderer->upload_heap.flush_block(upload->upload_heap_block);
+
+	if (!scene_loader->asynchronous)
+	{
+		scene_upload_submit(upload);
+		return;
+	}
+
+	std::lock_guard lock(scene_loader->mutex);
+	scene_loader->ready_uploads.push_back(upload);
+}
+
+void scene_upload_defaults(Scene_Upload& upload)
+{
+	uint8_t pixel_data[] = { 255, 255, 255, 255 };
+	upload.upload_writer.align_next(4); // Offset need to be multiple of texel size (4)
+	VkDeviceSize offset = upload.upload_writer.write(pixel_data, 4);
+	upload.image_uploads.push_back({
+		.image         = scene_loader->default_texture_image,
+		.format        = VK_FORMAT_R8G8B8A8_SRGB,
+		.height        = 1,
+		.width         = 1,
+		.mip_levels    = 1,
+		.generate_mips = false,
+		.upload_offset = offset,
+		.first_row     = 0,
+		.row_count     = 1,
+	});
+
+	scene_upload_material_write(upload, { Material_Manager::DEFAULT_MATERIAL, 0 }, scene_loader->default_material);
+}
+
+void scene_upload_image(Scene_Upload& upload, Slot_Handle image, const VkImageCreateInfo& create_info,
+                        VkDeviceSize upload_offset, bool generate_mips, std::string_view name,
+                        VkComponentMapping components)
+{
+	Allocated_View_Image view_image = scene_upload_create_image(image, create_info, name, components);
+
+	upload.image_uploads.push_back({
+		.image         = view_image.image,
+		.format        = create_info.format,
+		.height        = static_cast<int>(create_info.extent.height),
+		.width         = static_cast<int>(create_info.extent.width),
+		.mip_levels    = create_info.mipLevels,
+		.generate_mips = generate_mips,
+		.upload_offset = upload_offset,
+		.first_row     = 0,
+		.row_count     = create_info.extent.height,
+	});
+
+	upload.images.push_back({ image, view_image });
+}
+
+void scene_upload_image_rows(Scene_Upload& upload, Slot_Handle image, const VkImageCreateInfo& create_info,
+                             VkDeviceSize upload_offset, uint32_t first_row, uint32_t row_count,
+                             std::string_view name)
+{
+	if (first_row == 0)
+	{
+		scene_loader->sliced_image = scene_upload_create_image(image, create_info, name, {});
+	}
+
+	upload.image_uploads.push_back({
+		.image         = scene_loader->sliced_image.image,
+		.format        = create_info.format,
+		.height        = static_cast<int>(create_info.extent.height),
+		.width         = static_cast<int>(create_info.extent.width),
+		.mip_levels    = create_info.mipLevels,
+		.generate_mips = true,
+		.upload_offset = upload_offset,
+		.first_row     = first_row,
+		.row_count     = row_count,
+	});
+
+	if (first_row + row_count == create_info.extent.height)
+	{
+		upload.images.push_back({ image, scene_loader->sliced_image });
+	}
+}
+
+Allocated_View_Image scene_upload_create_image(Slot_Handle image, const VkImageCreateInfo& create_info,
+                                               std::string_view name, VkComponentMapping components)
+{
+	Allocated_View_Image view_image; // What we will be allocating
+
+	VmaAllocationCreateInfo allocation_create_info = { .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, };
+
+	VmaAllocationInfo allocation_info;
+	vmaCreateImage(gfx_context->vma_allocator, &create_info,
+	               &allocation_create_info, &view_image.image,
+	               &view_image.allocation, &allocation_info);
+	name_object(view_image.image, "Loaded image {} {}", image.index, name);
+
+	// Create default image view
+	create_default_image_view(gfx_context->device, create_info, view_image.image, nullptr, &view_image.view,
+	                          components);
+	name_object(view_image.view, "Loaded image view {} {}", image.index, name);
+
+	return view_image;
+}
+
+Slot_Handle scene_upload_sampler(Scene_Upload& upload, const VkSamplerCreateInfo& create_info, std::string_view name)
+{
+	// glTF files tend to declare the same sampler over and over
+	std::array<uint32_t, 16> key = sampler_create_info_key(create_info);
+	if (auto found = scene_loader->sampler_handles.find(key); found != scene_loader->sampler_handles.end())
+	{
+		return found->second;
+	}
+
+	Slot_Handle sampler_handle = texture_manager->samplers.reserve();
+	scene_loader->sampler_handles[key] = sampler_handle;
+
+	VkSampler sampler;
+	vkCreateSampler(gfx_context->device, &create_info, nullptr, &sampler);
+	name_object(sampler, "Loaded sampler {} {}", sampler_handle.index, name);
+
+	upload.samplers.push_back({ sampler_handle, sampler });
+	return sampler_handle;
+}
+
+void scene_upload_nodes(Scene_Upload& upload, uint32_t first_node, const std::vector<uint32_t>& parents,
+                        const std::vector<glm::mat4>& local_transforms)
+{
+	upload.first_node = first_node;
+	upload.node_transforms = local_transforms;
+	upload.node_parents.resize(parents.size());
+	for (size_t node = 0; node < parents.size(); node++)
+	{
+		upload.node_parents[node] = (parents[node] == TRANSFORM_NO_PARENT)
+		? TRANSFORM_NO_PARENT : first_node + parents[node];
+	}
+}
+
+std::array<uint32_t, 16> sampler_create_info_key(const VkSamplerCreateInfo& create_info)
+{
+	// Fields one by one, struct has padding. Loaders don't chain anything to pNext.
+	return {
+		create_info.flags,
+		static_cast<uint32_t>(create_info.magFilter),
+		static_cast<uint32_t>(create_info.minFilter),
+		static_cast<uint32_t>(create_info.mipmapMode),
+		static_cast<uint32_t>(create_info.addressModeU),
+		static_cast<uint32_t>(create_info.addressModeV),
+		static_cast<uint32_t>(create_info.addressModeW),
+		std::bit_cast<uint32_t>(create_info.mipLodBias),
+		create_info.anisotropyEnable,
+		std::bit_cast<uint32_t>(create_info.maxAnisotropy),
+		create_info.compareEnable,
+		static_cast<uint32_t>(create_info.compareOp),
+		std::bit_cast<uint32_t>(create_info.minLod),
+		std::bit_cast<uint32_t>(create_info.maxLod),
+		static_cast<uint32_t>(create_info.borderColor),
+		create_info.unnormalizedCoordinates,
+	};
+}
+
+Slot_Handle scene_upload_material(Scene_Upload& upload, const PBR_Material& material)
+{
+	Slot_Handle material_handle = material_manager->materials.reserve();
+
+	auto& landed_images = scene_loader->landed_images;
+	bool albedo_landed          = landed_images[material.albedo_texture];
+	bool metal_roughness_landed = landed_images[material.metal_roughness_texture];
+
+	PBR_Material placeholder = material;
+	if (!albedo_landed)          placeholder.albedo_texture          = Texture_Manager::DEFAULT_TEXTURE;
+	if (!metal_roughness_landed) placeholder.metal_roughness_texture = Texture_Manager::DEFAULT_TEXTURE;
+
+	scene_upload_material_write(upload, material_handle, placeholder);
+
+	if (!albedo_landed || !metal_roughness_landed)
+	{
+		scene_loader->pending_materials.push_back({ .handle = material_handle, .material = material });
+	}
+
+	return material_handle;
+}
+
+void scene_upload_material_update(Scene_Upload& upload, Slot_Handle material_handle, const PBR_Material& material)
+{
+	// Older version that was still waiting is dropped
+	auto& pending_materials = scene_loader->pending_materials;
+	std::erase_if(pending_materials, [&](const Scene_Loader::Pending_Material& pending)
+	{
+		return pending.handle == material_handle;
+	});
+
+	auto& landed_images = scene_loader->landed_images;
+	if (landed_images[material.albedo_texture] && landed_images[material.metal_roughness_texture])
+	{
+		scene_upload_material_write(upload, material_handle, material);
+		return;
+	}
+
+	pending_materials.push_back({ .handle = material_handle, .material = material });
+}
+
+void scene_upload_material_write(Scene_Upload& upload, Slot_Handle material, const PBR_Material& value)
+{
+	VkDeviceSize material_offset = upload.upload_writer.write(&value, sizeof(PBR_Material));
+
+	upload.material_copies.push_back({
+		.srcOffset = upload.upload_heap_block.offset + material_offset,
+		.dstOffset = material.index * sizeof(PBR_Material),
+		.size      = sizeof(PBR_Material),
+	});
+
+	upload.materials.push_back({ material, value });
+}
+
+Mesh_Manager::Id scene_upload_mesh(Scene_Upload& upload, const Imported_Primitive& primitive,
+                                   std::optional<Mesh_Manager::Id> shared_vertices)
+{
+	// Allocate mesh and indices. Offsets have to be aligned to size of index and of attribute components.
+	VmaVirtualAllocation vertex_allocation;
+	VkDeviceSize vertex_dst_offset;
+	if (shared_vertices.has_value())
+	{
+		auto shared = std::find_if(upload.meshes.begin(), upload.meshes.end(),
+		                           [&](auto& mesh) { return mesh.id == shared_vertices.value(); });
+		if (shared == upload.meshes.end() || shared->description.vertex_count != primitive.vertex_count)
+		throw std::runtime_error("GLTF Problem");
+
+		vertex_allocation = shared->storage.vertex_allocation;
+		vertex_dst_offset = shared->description.vertex_offset;
+	}
+	else
+	{
+		vertex_dst_offset = scene_upload_mesh_allocate(upload, &mesh_manager->vertex_buffer, primitive.vertex_size, 4,
+		                                               &vertex_allocation);
+
+		upload.vertex_copies.push_back({
+			.srcOffset = upload.upload_heap_block.offset + primitive.vertex_offset,
+			.dstOffset = vertex_dst_offset,
+			.size      = primitive.vertex_size,
+		});
+	}
+
+	VmaVirtualAllocation indices_allocation;
+	VkDeviceSize indices_dst_offset = scene_upload_mesh_allocate(upload, &mesh_manager->indices_buffer,
+	                                                             primitive.indices_size,
+	                                                             primitive.index_type == VK_INDEX_TYPE_UINT32 ? 4 : 2,
+	                                                             &indices_allocation);
+
+	// Aligned to meshlet size, so offset can be turned into meshlet index
+	VmaVirtualAllocation meshlets_allocation;
+	VkDeviceSize meshlets_dst_offset = scene_upload_mesh_allocate(upload, &mesh_manager->meshlet_buffer,
+	                                                              primitive.meshlets_count * sizeof(Meshlet),
+	                                                              sizeof(Meshlet), &meshlets_allocation);
+
+	auto meshlets = reinterpret_cast<const Meshlet*>(upload.upload_writer.base_ptr + primitive.meshlets_offset);
+
+	Mesh_Manager::Mesh_Description mesh_description = {
+		.vertex_offset       = vertex_dst_offset,
+		.vertex_count        = primitive.vertex_count,
+		.indices_offset      = indices_dst_offset,
+		.indices_count       = primitive.indices_count,
+		.vertex_format       = primitive.vertex_format,
+		.index_type          = primitive.index_type,
+		.meshlets_offset     = meshlets_dst_offset,
+		.meshlets_count      = primitive.meshlets_count,
+		.position_offset     = primitive.position_offset,
+		.position_scale      = primitive.position_scale,
+	};
+
+	Mesh_Manager::Mesh_Storage mesh_storage = {
+		.vertex_allocation   = vertex_allocation,
+		.indices_allocation  = indices_allocation,
+		.meshlets_allocation = meshlets_allocation,
+		.meshlets            = std::vector<Meshlet>(meshlets, meshlets + primitive.meshlets_count),
+	};
+
+	Mesh_Manager::Id mesh_id = mesh_manager->meshes.reserve();
+	upload.meshes.push_back({
+		.id          = mesh_id,
+		.description = mesh_description,
+		.storage     = std::move(mesh_storage),
+	});
+
+	// Meshlet building drops degenerate triangles, primitive made only of them has no indices and meshlets
+	if (primitive.indices_size > 0)
+	{
+		upload.indices_copies.push_back({
+			.srcOffset = upload.upload_heap_block.offset + primitive.indices_offset,
+			.dstOffset = indices_dst_offset,
+			.size      = primitive.indices_size,
+		});
+	}
+
+	if (primitive.meshlets_count > 0)
+	{
+		upload.meshlet_copies.push_back({
+			.srcOffset = upload.upload_heap_block.offset + primitive.meshlets_offset,
+			.dstOffset = meshlets_dst_offset,
+			.size      = primitive.meshlets_count * sizeof(Meshlet),
+		});
+	}
+
+	return mesh_id;
+}
+
+VkDeviceSize scene_upload_mesh_allocate(Scene_Upload& upload, Mesh_Buffer* mesh_buffer, VkDeviceSize size,
+                                        VkDeviceSize alignment, VmaVirtualAllocation* allocation)
+{
+	// Empty range gets no allocation (VMA doesn't take zero sizes), mesh manager skips null ones
+	if (size == 0)
+	{
+		*allocation = VK_NULL_HANDLE;
+		return 0;
+	}
+
+	VkDeviceSize offset;
+	while (!mesh_buffer_allocate(mesh_buffer, size, alignment, allocation, &offset))
+	{
+		VkDeviceSize    old_size   = mesh_buffer->size;
+		AllocatedBuffer old_buffer = mesh_buffer_grow(mesh_buffer, size + alignment);
+
+		upload.buffer_growths.push_back({
+			.mesh_buffer = mesh_buffer,
+			.old_buffer  = old_buffer,
+			.old_size    = old_size,
+			.new_buffer  = mesh_buffer->loader_buffer,
+			.new_size    = mesh_buffer->size,
+		});
+	}
+	return offset;
+}
+
+void scene_upload_record(Scene_Upload& upload)
+{
+	ZoneScopedN("Scene upload recording");
+	Load_Timer timer(Load_Phase::COPY_RECORDING, upload.upload_writer.offset());
+
+	VkCommandBuffer command_buffer = upload.command_buffer;
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	vkBeginCommandBuffer(command_buffer, &begin_info);
+
+	if (upload.timestamp_pool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(command_buffer, upload.timestamp_pool, 0, 2);
+		vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, upload.timestamp_pool, 0);
+	}
+
+	// Materials get overwritten while frames submitted before us might still be reading them
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+						 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	// Grown mesh buffers get content of the old ones first. Previous batches wrote into them, and copies into free
+	// space of the new ones might overlap the old content.
+	VkMemoryBarrier growth_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+	};
+	for (auto& growth : upload.buffer_growths)
+	{
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		                     1, &growth_barrier, 0, nullptr, 0, nullptr);
+
+		VkBufferCopy region = { .srcOffset = 0, .dstOffset = 0, .size = growth.old_size };
+		vkCmdCopyBuffer(command_buffer, growth.old_buffer.buffer, growth.new_buffer.buffer, 1, &region);
+	}
+	if (!upload.buffer_growths.empty())
+	{
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		                     1, &growth_barrier, 0, nullptr, 0, nullptr);
+	}
+
+	// Copy buffers. Meshes without triangles have no indices and meshlets, so each of them can be empty.
+	if (!upload.vertex_copies.empty())
+	{
+		vkCmdCopyBuffer(command_buffer, renderer->upload_heap.upload_buffer.buffer,
+						mesh_manager->vertex_buffer.loader_buffer.buffer, upload.vertex_copies.size(),
+						upload.vertex_copies.data());
+	}
+	if (!upload.indices_copies.empty())
+	{
+		vkCmdCopyBuffer(command_buffer, renderer->upload_heap.upload_buffer.buffer,
+						mesh_manager->indices_buffer.loader_buffer.buffer, upload.indices_copies.size(),
+						upload.indices_copies.data());
+	}
+	if (!upload.meshlet_copies.empty())
+	{
+		vkCmdCopyBuffer(command_buffer, renderer->upload_heap.upload_buffer.buffer,
+						mesh_manager->meshlet_buffer.loader_buffer.buffer, upload.meshlet_copies.size(),
+						upload.meshlet_copies.data());
+	}
+
+	if (!upload.material_copies.empty())
+	{
+		vkCmdCopyBuffer(command_buffer, renderer->upload_heap.upload_buffer.buffer,
+						material_manager->material_storage_buffer.buffer, upload.material_copies.size(),
+						upload.material_copies.data());
+	}
+
+	// Enqueue upload of all pending textures
+	for (auto& image_upload : upload.image_uploads)
+	{
+		auto vk_image = image_upload.image;
+
+		uint32_t mip_levels   = image_upload.mip_levels;
+		uint32_t copied_mips  = image_upload.generate_mips ? 1 : mip_levels; // Mips that come from upload heap
+
+		// Image uploaded in slices stays in copy layout between batches, rest is done once its last rows are in
+		bool first_slice = image_upload.first_row == 0;
+		bool last_slice  = image_upload.first_row + image_upload.row_count == static_cast<uint32_t>(image_upload.height);
+
+		// Transition copied mips to copy layout
+		if (first_slice)
+		{
+			VkImageMemoryBarrier to_transfer_dst_barrier = {
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = 0,
+				.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.oldLayout     = VK_IMAGE_LAYOUT_UNDEFINED,
+				.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				.image         = vk_image,
+				.subresourceRange = {
+					.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel   = 0,
+					.levelCount     = copied_mips,
+					.baseArrayLayer = 0,
+					.layerCount     = 1,
+				},
+			};
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_HOST_BIT,
+								 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+								 &to_transfer_dst_barrier);
+		}
+
+		// Enqueue copy (pre-generated mips are tightly packed one after another, in rows of blocks if compressed)
+		std::vector<VkBufferImageCopy> regions(copied_mips);
+		VkDeviceSize mip_offset = upload.upload_heap_block.offset + image_upload.upload_offset;
+		for (uint32_t mip = 0; mip < copied_mips; mip++)
+		{
+			uint32_t mip_width  = std::max(image_upload.width >> mip, 1);
+			uint32_t mip_height = std::max(image_upload.height >> mip, 1);
+
+			// Slice of mip 0 only
+			uint32_t first_row = 0;
+			if (mip == 0)
+			{
+				first_row  = image_upload.first_row;
+				mip_height = image_upload.row_count;
+			}
+
+			regions[mip] = {
+				.bufferOffset = mip_offset,
+				.imageSubresource = {
+					.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel       = mip,
+					.baseArrayLayer = 0,
+					.layerCount     = 1,
+				},
+				.imageOffset = { 0, static_cast<int32_t>(first_row), 0 },
+				.imageExtent = {
+					.width   = mip_width,
+					.height  = mip_height,
+					.depth   = 1,
+				},
+			};
+			mip_offset += texture_level_size(image_upload.format, mip_width, mip_height);
+		}
+		vkCmdCopyBufferToImage(command_buffer, renderer->upload_heap.upload_buffer.buffer,
+							   vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copied_mips, regions.data());
+
+		if (!last_slice) continue;
+
+		// Await transfer for copied mips
+		VkImageMemoryBarrier await_transfer_barrier = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+			.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.image         = vk_image,
+			.subresourceRange = {
+				.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel   = 0,
+				.levelCount     = copied_mips,
+				.baseArrayLayer = 0,
+				.layerCount     = 1,
+			},
+		};
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+							 &await_transfer_barrier);
+
+		// Generate mipmaps
+		for (uint32_t dst_mip = copied_mips; dst_mip < mip_levels; dst_mip++)
+		{
+			// Move dst mip to trransfer dst
+			VkImageMemoryBarrier mip_to_transfer_dst = {
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = 0,
+				.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.oldLayout     = VK_IMAGE_LAYOUT_UNDEFINED,
+				.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				.image         = vk_image,
+				.subresourceRange = {
+					.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel   = dst_mip,
+					.levelCount     = 1,
+					.baseArrayLayer = 0,
+					.layerCount     = 1,
+				},
+			};
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+								 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+								 &mip_to_transfer_dst);
+
+			VkImageBlit2 regions = {
+				.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2,
+				.srcSubresource = {
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel = dst_mip - 1,
+						.baseArrayLayer = 0,
+						.layerCount = 1,
+				},
+				.srcOffsets = {
+					{ 0, 0, 0 },
+					{ (image_upload.width >> dst_mip - 1), (image_upload.width >> dst_mip - 1), 1 }
+				},
+				.dstSubresource = {
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = dst_mip,
+					.baseArrayLayer = 0,
+					.layerCount = 1,
+				},
+				.dstOffsets = {
+					{ 0, 0, 0 },
+					{ (image_upload.width >> dst_mip), (image_upload.width >> dst_mip), 1 }
+				},
+			};
+
+			VkBlitImageInfo2 blit_info = {
+				.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2,
+				.srcImage = vk_image,
+				.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				.dstImage = vk_image,
+				.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				.regionCount = 1,
+				.pRegions = &regions,
+				.filter = VK_FILTER_LINEAR,
+			};
+
+			vkCmdBlitImage2(command_buffer, &blit_info);
+
+			// Move dst mip to trransfer src
+			VkImageMemoryBarrier mip_to_transfer_src = {
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				.image = vk_image,
+				.subresourceRange = {
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = dst_mip,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1,
+				},
+			};
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+				&mip_to_transfer_src);
+		}
+
+		// Immediately transition into proper layout
+		VkImageMemoryBarrier from_transform_transition_barrier = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			.image = vk_image,
+			.subresourceRange = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = mip_levels,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			},
+		};
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+			&from_transform_transition_barrier);
+	}
+
+	// Make buffers visible to everything submitted after us (images are transitioned above)
+	VkMemoryBarrier transfer_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+	};
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+						 VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+						 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+						 1, &transfer_barrier, 0, nullptr, 0, nullptr);
+
+	if (upload.timestamp_pool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, upload.timestamp_pool, 1);
+	}
+
+	vkEndCommandBuffer(command_buffer);
+}
+
+void scene_upload_submit(Scene_Upload* upload)
+{
+	ZoneScopedN("Scene upload submission");
+
+	VkCommandBufferSubmitInfo command_buffer_submit_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+		.commandBuffer = upload->command_buffer,
+	};
+
+	VkSemaphoreSubmitInfo signal_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+		.semaphore = scene_loader->semaphore,
+		.value     = upload->timeline_value,
+		.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+	};
+
+	VkSubmitInfo2 submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+		.commandBufferInfoCount   = 1,
+		.pCommandBufferInfos      = &command_buffer_submit_info,
+		.signalSemaphoreInfoCount = 1,
+		.pSignalSemaphoreInfos    = &signal_info,
+	};
+	vkQueueSubmit2(gfx_context->gfx_queue, 1, &submit_info, VK_NULL_HANDLE);
+
+	// Commit. Whatever gets submitted to the queue from now on is ordered after the upload, so it can be used
+	// right away.
+
+	std::vector<VkDescriptorImageInfo> image_descriptor_updates;
+	image_descriptor_updates.reserve(upload->images.size());
+	for (auto& [image_handle, image] : upload->images)
+	{
+		texture_manager->images.set(image_handle, image);
+
+		image_descriptor_updates.push_back({
+			.imageView   = image.view,
+			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		});
+	}
+
+	// Slots of new images aren't used by any frame in flight yet (binding is UPDATE_UNUSED_WHILE_PENDING)
+	std::vector<VkWriteDescriptorSet> descriptor_set_writes;
+	for (size_t i = 0; i < upload->images.size(); i++)
+	{
+		descriptor_set_writes.push_back({
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet          = renderer->global_data_descriptor_set,
+			.dstBinding      = 2,
+			.dstArrayElement = upload->images[i].first.index,
+			.descriptorCount = 1,
+			.descriptorType  = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+			.pImageInfo      = &image_descriptor_updates[i],
+		});
+	}
+	vkUpdateDescriptorSets(gfx_context->device, descriptor_set_writes.size(), descriptor_set_writes.data(), 0, nullptr);
+
+	for (auto& [sampler_handle, sampler] : upload->samplers)
+	{
+		texture_manager->samplers.set(sampler_handle, sampler);
+	}
+
+	for (auto& [material_handle, material] : upload->materials)
+	{
+		material_manager->materials.set(material_handle, material);
+	}
+
+	for (auto& mesh : upload->meshes)
+	{
+		mesh_manager->vertex_users[mesh.storage.vertex_allocation]++;
+		mesh_manager->meshes.set(mesh.id, mesh.description);
+
+		auto& storage = mesh_manager->storage;
+		if (storage.size() <= mesh.id.index) storage.resize(mesh.id.index + 1);
+		storage[mesh.id.index] = std::move(mesh.storage);
+	}
+
+	// Frames recorded from now on use reloaded assets and grown mesh buffers, ones already in flight might still use
+	// the old ones
+	if (!upload->retired_images.empty() || !upload->buffer_growths.empty())
+	{
+		Scene_Loader::Retired_Assets retired = { .frame = app->frame_number, .images = upload->retired_images };
+
+		for (auto& growth : upload->buffer_growths)
+		{
+			Mesh_Buffer* mesh_buffer = growth.mesh_buffer;
+			retired.buffers.push_back({ .buffer = mesh_buffer->buffer, .allocation = mesh_buffer->allocation });
+			mesh_buffer->buffer      = growth.new_buffer.buffer;
+			mesh_buffer->allocation  = growth.new_buffer.allocation;
+			mesh_buffer->buffer_size = growth.new_size;
+		}
+
+		scene_loader->retired_assets.push_back(std::move(retired));
+	}
+
+	if (!upload->replaced_meshes.empty())
+	{
+		std::map<Mesh_Manager::Id, Mesh_Manager::Id> new_ids(upload->replaced_meshes.begin(),
+		                                                     upload->replaced_meshes.end());
+		for (auto& render_object : scene_data->render_objects)
+		{
+			auto found = new_ids.find(render_object.mesh_id);
+			if (found != new_ids.end()) render_object.mesh_id = found->second;
+		}
+
+		for (auto& [old_id, new_id] : upload->replaced_meshes)
+		{
+			mesh_manager_unload(old_id);
+		}
+	}
+
+	if (!upload->node_parents.empty())
+	{
+		transform_hierarchy_insert(&scene_data->transforms, upload->first_node, upload->node_parents.data(),
+		                           upload->node_transforms.data(), static_cast<uint32_t>(upload->node_parents.size()));
+	}
+
+	scene_data->render_objects.insert(scene_data->render_objects.end(),
+	                                  upload->render_objects.begin(), upload->render_objects.end());
+	if (!upload->render_objects.empty() || !upload->replaced_meshes.empty()) scene_data_build_instances();
+
+	delete upload;
+}
+
+void scene_descriptors_init()
+{
+	// Images are written as they land (see scene_upload_submit), this covers what exists up-front
+
+	// Bind uniform buffer
+	VkDescriptorBufferInfo global_uniform_descriptor = {
+		.buffer = renderer->global_uniform_data_buffer.buffer,
+		.offset = 0,
+		.range  = sizeof(Global_Uniform_Data),
+	};
+
+	// Samplers, all slots get default one (sampler selection in shader is broken, see gltf_sampler_create_info)
+	std::vector<VkDescriptorImageInfo> sampler_descriptor_updates;
+	VkSampler default_sampler = texture_manager->samplers.values[Texture_Manager::DEFAULT_SAMPLER];
+	for (uint32_t sampler_index = 0; sampler_index < 100; sampler_index++)
+	{
+		VkDescriptorImageInfo update_info = { .sampler = default_sampler };
+		sampler_descriptor_updates.push_back(update_info);
+	}
+
+	// Images
+	std::vector<VkDescriptorImageInfo> image_descriptor_updates;
+	for (uint32_t image_index = 0; image_index < texture_manager->images.size(); image_index++)
+	{
+		VkDescriptorImageInfo update_info = {
+			.imageView   = texture_manager->images.values[image_index].view,
+			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		};
+		image_descriptor_updates.push_back(update_info);
+	}
+
+	// Bind material storage buffer
+	VkDescriptorBufferInfo material_storage_descriptor = {
+		.buffer = material_manager->material_storage_buffer.buffer,
+		.offset = 0,
+		.range  = 40000,
+	};
+
+	// Bind instance buffer, frame's part is selected with dynamic offset
+	VkDescriptorBufferInfo instance_storage_descriptor = {
+		.buffer = renderer->instance_buffer.buffer,
+		.offset = 0,
+		.range  = MAX_INSTANCES * sizeof(glm::mat4),
+	};
+
+	VkWriteDescriptorSet descriptor_set_writes[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet          = renderer->global_data_descriptor_set,
+			.dstBinding      = 0,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			.pBufferInfo     = &global_uniform_descriptor,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet          = renderer->global_data_descriptor_set,
+			.dstBinding      = 1,
+			.dstArrayElement = 0,
+			.descriptorCount = static_cast<uint32_t>(sampler_descriptor_updates.size()),
+			.descriptorType  = VK_DESCRIPTOR_TYPE_SAMPLER,
+			.pImageInfo      = sampler_descriptor_updates.data(),
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet          = renderer->global_data_descriptor_set,
+			.dstBinding      = 2,
+			.dstArrayElement = 0,
+			.descriptorCount = static_cast<uint32_t>(image_descriptor_updates.size()),
+			.descriptorType  = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+			.pImageInfo      = image_descriptor_updates.data(),
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet          = renderer->global_data_descriptor_set,
+			.dstBinding      = 3,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pBufferInfo     = &material_storage_descriptor,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet          = renderer->global_data_descriptor_set,
+			.dstBinding      = 4,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			.pBufferInfo     = &instance_storage_descriptor,
+		},
+	};
+
+	vkUpdateDescriptorSets(gfx_context->device, 5, descriptor_set_writes, 0, nullptr);
+}
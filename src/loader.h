@@ -0,0 +1,466 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "renderer.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fastgltf/types.hpp>
+#include <glm/glm.hpp>
+
+// Scene loading runs on loader thread (or inline, with --sync-load), so we can render while assets stream in.
+// CPU side work (parsing, decoding, transcoding, recording copies) is done in batches of bounded size
+// (Scene_Upload). Main thread submits recorded batches and at the same time commits their content into managers.
+// Anything submitted later to the same queue will see the data, so it's safe to use right away.
+// Completion of every batch on GPU is signalled by scene_loader->semaphore (timeline), loader uses it to throttle
+// itself and to release upload heap memory.
+//
+// Materials are committed before their textures. Until all of their textures land, they are using
+// Texture_Manager::DEFAULT_TEXTURE, and get updated by the batch that brings the last of them.
+//
+// Staging memory is bounded by the budget (--staging-budget), no matter how big the scene is: batches not yet
+// finished by GPU never take more than that, batches are a third of it, so decoding overlaps with copies, and
+// images are read from disk only when their batch is decoded. RGBA8 images that don't fit in a batch are uploaded
+// in slices of rows.
+//
+// Assets of loaded scene can be reloaded through the same batches (see scene_loader_reload()). Nothing is modified
+// in place while frames in flight might be using it: descriptors of new images go to free slots, and replaced
+// images and meshes are destroyed a few frames after the batch that replaced them is committed.
+
+// Location of primitive's data written by gltf_import_vertex_group()
+struct Imported_Primitive
+{
+	VkDeviceSize  vertex_offset; // Offsets are relative to writer's base pointer
+	VkDeviceSize  vertex_size;
+	uint32_t      vertex_count;
+	VkDeviceSize  indices_offset;
+	VkDeviceSize  indices_size;
+	uint32_t      indices_count;
+	Vertex_Format vertex_format;
+	VkIndexType   index_type;
+	VkDeviceSize  meshlets_offset; // Meshlet[], aligned to 16
+	uint32_t      meshlets_count;
+	glm::vec3     position_offset = glm::vec3(0.0f); // Dequantization of packed positions
+	glm::vec3     position_scale  = glm::vec3(1.0f);
+};
+
+struct Scene_Upload
+{
+	struct Image_Upload
+	{
+		VkImage      image;
+		VkFormat     format;
+		int          height, width;
+		uint32_t     mip_levels;
+		bool         generate_mips; // If false, all mip levels are tightly packed one after another at upload_offset
+		VkDeviceSize upload_offset;
+		uint32_t     first_row, row_count; // Rows of mip 0 in this batch, all of them unless image is uploaded in slices
+	};
+
+	// Old content of mesh buffer is copied into the new one, before anything else in the batch
+	struct Buffer_Growth
+	{
+		Mesh_Buffer*    mesh_buffer;
+		AllocatedBuffer old_buffer;
+		VkDeviceSize    old_size;
+		AllocatedBuffer new_buffer;
+		VkDeviceSize    new_size;
+	};
+
+	Upload_Heap::Block   upload_heap_block;
+	Mapped_Buffer_Writer upload_writer;
+	VkCommandPool        command_pool;
+	VkCommandBuffer      command_buffer;
+	VkQueryPool          timestamp_pool; // Start and end of batch on GPU, null if queue can't do timestamps
+	uint64_t             timeline_value;
+
+	std::vector<Image_Upload>  image_uploads;
+	std::vector<VkBufferCopy>  vertex_copies;
+	std::vector<VkBufferCopy>  indices_copies;
+	std::vector<VkBufferCopy>  meshlet_copies;
+	std::vector<VkBufferCopy>  material_copies;
+	std::vector<Buffer_Growth> buffer_growths; // In order, mesh buffer might grow more than once
+
+	struct Mesh
+	{
+		Mesh_Manager::Id               id;
+		Mesh_Manager::Mesh_Description description;
+		Mesh_Manager::Mesh_Storage     storage;
+	};
+
+	// Committed into managers by main thread, once batch is submitted. Slots were reserved by loader.
+	std::vector<std::pair<Slot_Handle, Allocated_View_Image>> images;
+	std::vector<std::pair<Slot_Handle, VkSampler>>            samplers;
+	std::vector<std::pair<Slot_Handle, PBR_Material>>         materials;
+	std::vector<Mesh>                                         meshes;
+	std::vector<Render_Object>                                render_objects;
+
+	// Reloaded assets (see scene_loader_reload()). Render objects of old meshes switch to new ones, old meshes and
+	// images no material refers to anymore are destroyed once frames that might be using them are done.
+	std::vector<std::pair<Mesh_Manager::Id, Mesh_Manager::Id>> replaced_meshes; // Old id, new id
+	std::vector<Slot_Handle>                                   retired_images;
+
+	// Nodes written at first_node of scene_data->transforms (reserved by scene_loader_reserve_nodes())
+	uint32_t               first_node;
+	std::vector<uint32_t>  node_parents; // Absolute indices
+	std::vector<glm::mat4> node_transforms;
+};
+
+// Where glTF scene ended up in managers, so its assets can be reloaded in place. Indexed like the asset.
+struct Gltf_Scene_Map
+{
+	std::vector<Slot_Handle>                   images;          // [image] in texture_manager
+	std::vector<uint32_t>                      samplers;        // [sampler] texture_manager slot index
+	std::vector<Slot_Handle>                   materials;       // [material] in material_manager
+	std::vector<PBR_Material>                  material_values; // [material] with real textures
+	std::vector<std::vector<Mesh_Manager::Id>> meshes;          // [mesh][primitive]
+};
+
+struct Scene_Loader
+{
+	struct In_Flight_Upload
+	{
+		uint64_t           timeline_value;
+		Upload_Heap::Block upload_heap_block;
+		VkCommandPool      command_pool;
+		VkQueryPool        timestamp_pool;
+	};
+
+	struct Pending_Material
+	{
+		Slot_Handle  handle;
+		PBR_Material material; // With real textures
+	};
+
+	// Replaced by reload or by growth, waiting for frames in flight (replaced meshes wait in mesh_manager)
+	struct Retired_Assets
+	{
+		uint64_t                     frame; // Frames before this one might still use them
+		std::vector<Slot_Handle>     images;
+		std::vector<AllocatedBuffer> buffers; // Mesh buffers replaced by bigger ones
+	};
+
+	std::filesystem::path scene_file;
+	bool                  asynchronous;
+	size_t                staging_budget; // Max size of batches not yet finished by GPU
+	size_t                batch_size;     // Batches are kept under it, unless single item is bigger
+	bool                  packed_vertices; // Import meshes in PACKED_VERTEX_FORMAT
+	bool                  static_batching; // Merge static meshes, see gltf_static_batches()
+	std::thread           thread;
+	VkSemaphore           semaphore;
+	VkImage               default_texture_image;
+	PBR_Material          default_material;
+
+	std::chrono::high_resolution_clock::time_point start_time;
+
+	// Shared between threads, guarded by mutex
+	std::mutex                mutex;
+	std::deque<Scene_Upload*> ready_uploads; // Recorded, waiting for main thread to submit them
+	std::exception_ptr        exception;
+	bool                      finished;
+	std::atomic<bool>         cancelled;
+	bool                      reloading; // Loader thread is reloading assets, not loading the scene
+
+	// Loader thread only. Slots of images, samplers, materials and meshes are reserved up-front, so batches can
+	// refer to things that will be committed later.
+	uint64_t                      next_timeline_value;
+	std::deque<In_Flight_Upload>  in_flight_uploads;
+	size_t                        in_flight_size;
+	uint32_t                      next_node_index;
+	std::vector<bool>             landed_images; // By slot index
+	std::vector<Pending_Material> pending_materials;
+	Allocated_View_Image          sliced_image; // Image being uploaded by scene_upload_image_rows()
+	Scene_Upload*                 open_upload;  // Begun and not finished yet
+	Gltf_Scene_Map                gltf_map;     // Filled by load_gltf_scene(), empty if scene pack was loaded
+
+	// By fields of create info (see sampler_create_info_key()), identical samplers are shared
+	std::map<std::array<uint32_t, 16>, Slot_Handle> sampler_handles;
+
+	// Main thread only
+	std::deque<Retired_Assets> retired_assets;
+};
+
+inline Scene_Loader* scene_loader;
+
+// Synchronous loading returns once everything is submitted. Scene pack next to glTF file is preferred, if it's
+// up-to-date.
+void scene_loader_init(const std::filesystem::path& scene_file, bool asynchronous, size_t staging_budget,
+                       bool packed_vertices, bool static_batching);
+void scene_loader_deinit();
+void scene_loader_update(); // Call every frame on main thread
+
+// Nothing is being loaded or reloaded, main thread side
+bool scene_loader_idle();
+
+// Re-import assets of loaded glTF scene that depend on changed files: images are uploaded into new slots and
+// materials are switched to them, materials are rewritten in place and meshes get new ids that their render objects
+// switch to. Runs the same way loading does (on loader thread, unless it's synchronous), errors are only logged.
+// Loader has to be idle.
+void scene_loader_reload(std::vector<std::filesystem::path> changed_files);
+
+// Loader thread side. Batches are started with scene_upload_begin() and handed over to main thread with
+// scene_upload_finish(), which also records all the copies.
+
+// May block until enough of previous batches are finished by GPU. Materials don't need to be counted in upload_size.
+Scene_Upload* scene_upload_begin(size_t upload_size);
+void          scene_upload_finish(Scene_Upload* upload);
+
+// Write white texel of Texture_Manager::DEFAULT_TEXTURE and Material_Manager::DEFAULT_MATERIAL, and enqueue their upload
+void scene_upload_defaults(Scene_Upload& upload);
+
+// Reserve texture_manager slot for image that will be uploaded later. Slots of destroyed images are reused.
+Slot_Handle scene_loader_reserve_image();
+
+// Reserve nodes of scene_data->transforms, so render objects can refer to them before they are committed.
+// Returns first one.
+uint32_t scene_loader_reserve_nodes(uint32_t count);
+
+// Nodes in pre-order, parents relative to first_node (reserved), or TRANSFORM_NO_PARENT
+void scene_upload_nodes(Scene_Upload& upload, uint32_t first_node, const std::vector<uint32_t>& parents,
+                        const std::vector<glm::mat4>& local_transforms);
+
+// Create image (and its view, with given swizzle) in reserved slot and enqueue its upload from upload_offset.
+// Block compressed images can't generate mips, upload_offset has to be multiple of their block size.
+void scene_upload_image(Scene_Upload& upload, Slot_Handle image, const VkImageCreateInfo& create_info,
+                        VkDeviceSize upload_offset, bool generate_mips, std::string_view name,
+                        VkComponentMapping components = {});
+
+// RGBA8 image too big for a batch, uploaded over several consecutive batches. Each one enqueues copy of
+// row_count rows of mip 0, starting with first_row, from upload_offset. First slice creates the image, last one
+// generates mips and commits it. Only one image can be uploaded this way at a time.
+void scene_upload_image_rows(Scene_Upload& upload, Slot_Handle image, const VkImageCreateInfo& create_info,
+                             VkDeviceSize upload_offset, uint32_t first_row, uint32_t row_count,
+                             std::string_view name);
+
+// Returns already created sampler if there's one with the same create info
+Slot_Handle scene_upload_sampler(Scene_Upload& upload, const VkSamplerCreateInfo& create_info, std::string_view name);
+
+// Textures that haven't landed yet are replaced with default one, until they do. Render objects and other materials
+// refer to it by slot index.
+Slot_Handle scene_upload_material(Scene_Upload& upload, const PBR_Material& material);
+
+// Overwrite committed material. If its textures haven't landed yet, old one stays until the batch that brings them.
+void scene_upload_material_update(Scene_Upload& upload, Slot_Handle material_handle, const PBR_Material& material);
+
+// Register mesh in mesh_manager and enqueue copy of its data (already written to upload heap). Mesh can use vertices
+// of other mesh registered earlier in the same upload (imported from the same vertex group), then only its indices
+// and meshlets are copied. Mesh can have no indices and meshlets (all its triangles were degenerate), those get no
+// allocation then.
+Mesh_Manager::Id scene_upload_mesh(Scene_Upload& upload, const Imported_Primitive& primitive,
+                                   std::optional<Mesh_Manager::Id> shared_vertices = std::nullopt);
+
+// Write global descriptors, including all images present in texture_manager
+void scene_descriptors_init();
+
+// glTF loading
+
+// Primitive compressed with KHR_draco_mesh_compression. fastgltf doesn't know the extension, so it's read separately.
+struct Gltf_Draco_Primitive
+{
+	size_t buffer_view;
+	std::vector<std::pair<std::string, uint32_t>> attributes; // glTF attribute name, Draco attribute id
+};
+
+// Compressed geometry of asset. EXT_meshopt_compression buffer views are decoded right after parsing (they are
+// usually shared by many primitives), Draco primitives are decoded when they are imported.
+struct Gltf_Compression
+{
+	std::vector<std::vector<uint8_t>>                             meshopt_views;    // Empty for uncompressed views
+	std::vector<std::vector<std::optional<Gltf_Draco_Primitive>>> draco_primitives; // [mesh][primitive]
+};
+
+// Bytes of every glTF buffer. fastgltf doesn't load external buffers, they are memory mapped instead, so vertex and
+// index data is copied just once, from page cache straight into upload heap. Data URIs are decoded by parser.
+struct Gltf_Buffers
+{
+	std::vector<std::span<const uint8_t>> bytes; // [buffer]
+	std::vector<Mapped_File>              files; // Mapped external buffers, bytes point into them
+
+	Gltf_Buffers() = default;
+	Gltf_Buffers(const Gltf_Buffers&) = delete;
+	Gltf_Buffers& operator=(const Gltf_Buffers&) = delete;
+	~Gltf_Buffers();
+};
+
+void load_gltf_scene(const std::filesystem::path& gltf_file);
+
+// Loader side of scene_loader_reload(). Files are absolute. Asset is parsed again, it has to have the same images,
+// materials and meshes as the loaded one, otherwise nothing is reloaded.
+void reload_gltf_assets(const std::filesystem::path& gltf_file,
+                        const std::vector<std::filesystem::path>& changed_files);
+
+// Buffers have to outlive everything read from the asset
+std::unique_ptr<fastgltf::Asset> gltf_parse(const std::filesystem::path& gltf_file, Gltf_Buffers* buffers,
+                                            Gltf_Compression* compression);
+
+VkSamplerCreateInfo gltf_sampler_create_info(const fastgltf::Sampler& sampler);
+
+// Maps are indexed by glTF image/sampler index. Missing textures/samplers get default_texture/default_sampler.
+PBR_Material gltf_material(const fastgltf::Asset& asset, const fastgltf::Material& material,
+                           const std::vector<uint32_t>& image_map, const std::vector<uint32_t>& sampler_map,
+                           uint32_t default_texture, uint32_t default_sampler);
+
+// Primitives using the same vertex attribute accessors (meshes split by material usually do). They are imported
+// together, vertices are stored once and every primitive gets only its own indices and meshlets. Draco primitives
+// are decoded one by one, so each of them is in a group of its own.
+struct Gltf_Vertex_Group
+{
+	std::vector<std::pair<size_t, size_t>> primitives; // Mesh index, primitive index
+};
+
+// Groups are in order of their first primitives
+std::vector<Gltf_Vertex_Group> gltf_vertex_groups(const fastgltf::Asset& asset, const Gltf_Compression& compression);
+
+// Upper bound of bytes that gltf_import_vertex_group() will write (including alignment)
+size_t gltf_vertex_group_size_bound(const fastgltf::Asset& asset, const Gltf_Vertex_Group& group);
+
+// Totals over imported primitives, for ACMR (transformed vertices per triangle) and ATVR (transformed vertices per
+// vertex) of post-transform vertex cache, before and after optimization
+struct Mesh_Import_Stats
+{
+	size_t triangles;
+	size_t meshlets;
+	size_t vertices_before,    vertices_after;
+	size_t transformed_before, transformed_after;
+};
+
+constexpr uint32_t MESH_CACHE_SIZE = 16; // Vertex cache size used for analysis (FIFO)
+
+// Write vertex region (position stream and interleaved attributes, keeping their formats, or in
+// PACKED_VERTEX_FORMAT if packed_vertices is set) and copy indices (8-bit ones are widened to 16 bits).
+// Triangles of every primitive are reordered for vertex cache and overdraw, shared vertices for fetch locality (in
+// order of first use by any of the primitives). Then triangles are split into meshlets, and indices are written
+// meshlet by meshlet. Draco primitives are decoded first.
+// Returns primitives in group order, all of them with the same vertex region.
+// Doesn't touch anything shared, so groups can be imported in parallel (with their own writers and stats).
+std::vector<Imported_Primitive> gltf_import_vertex_group(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                                         const Gltf_Compression& compression,
+                                                         const Gltf_Vertex_Group& group,
+                                                         Mapped_Buffer_Writer& writer, Mesh_Import_Stats& stats,
+                                                         bool packed_vertices);
+
+void gltf_log_import_stats(const Mesh_Import_Stats& stats);
+
+// Nodes of every scene, flattened in pre-order, ready for Transform_Hierarchy. Parents index into the same arrays.
+struct Gltf_Nodes
+{
+	static const uint32_t NO_MESH = ~0u;
+
+	std::vector<uint32_t>  parents; // TRANSFORM_NO_PARENT for roots
+	std::vector<glm::mat4> local_transforms;
+	std::vector<uint32_t>  meshes;   // GLTF mesh index, or NO_MESH
+	std::vector<bool>      animated; // Node or any of its ancestors is target of animation channel
+};
+
+Gltf_Nodes gltf_flatten_nodes(const fastgltf::Asset& asset);
+
+// Static batching (--static-batching). Primitives on nodes that never move are merged by material into meshes with
+// vertices pre-transformed to world space, which are drawn with identity transform, so a static scene takes a few
+// draws instead of one per primitive. Primitives of every material are split spatially (median split along the
+// longest axis of their centers) until they fit STATIC_BATCH_MAX_VERTICES, so batches stay compact and meshlets
+// built from them cull as well as the original ones did.
+//
+// Node is batched when it isn't animated and all of its primitives can be: triangles with indices and required
+// attributes, not Draco compressed. Meshes used by several nodes are left to instancing, they are one draw already
+// and merging them would duplicate their vertices.
+
+constexpr uint32_t STATIC_BATCH_MAX_VERTICES = 64 * 1024; // Batches keep 16-bit indices
+
+struct Gltf_Static_Batch
+{
+	static const size_t NO_MATERIAL = ~size_t(0);
+
+	struct Instance
+	{
+		size_t   mesh_index;
+		size_t   primitive_index;
+		uint32_t node; // In Gltf_Nodes
+	};
+
+	size_t                material_index; // GLTF one, or NO_MATERIAL
+	std::vector<Instance> instances;
+	uint32_t              vertex_count;  // Sum over instances, before deduplication
+	size_t                indices_count;
+};
+
+struct Gltf_Static_Batches
+{
+	std::vector<Gltf_Static_Batch> batches;
+	std::vector<bool>              batched_nodes;    // [node] of Gltf_Nodes, they don't get render objects
+	std::vector<glm::mat4>         world_transforms; // [node]
+};
+
+// Reads positions of batched primitives, for their bounds
+Gltf_Static_Batches gltf_static_batches(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                        const Gltf_Compression& compression, const Gltf_Nodes& nodes);
+
+// Vertex groups with primitive of a mesh that isn't batched, the others don't have to be imported
+std::vector<Gltf_Vertex_Group> gltf_unbatched_vertex_groups(const fastgltf::Asset& asset, const Gltf_Nodes& nodes,
+                                                            const Gltf_Static_Batches& static_batches,
+                                                            std::vector<Gltf_Vertex_Group> groups);
+
+// Upper bound of bytes that gltf_import_static_batch() will write
+size_t gltf_static_batch_size_bound(const Gltf_Static_Batch& batch);
+
+// Write merged mesh of batch like gltf_import_vertex_group() does for a group with single primitive: vertices of
+// every instance transformed by world transform of its node (mirroring ones get their triangles flipped), then
+// optimized, split into meshlets and written in Vertex_Format{} or PACKED_VERTEX_FORMAT. Thread safe the same way.
+Imported_Primitive gltf_import_static_batch(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                            const Gltf_Compression& compression,
+                                            const Gltf_Static_Batches& static_batches, const Gltf_Static_Batch& batch,
+                                            Mapped_Buffer_Writer& writer, Mesh_Import_Stats& stats,
+                                            bool packed_vertices);
+
+// Encoded bytes of glTF image. Images aren't loaded with the asset, external ones are mapped just while they are
+// needed, so they don't pile up in memory.
+struct Gltf_Image_Bytes
+{
+	const uint8_t* data;
+	size_t         size;
+	bool           mapped;
+	Mapped_File    file; // If mapped, data points into it
+};
+
+// Directory is the one glTF file is in
+Gltf_Image_Bytes gltf_image_open(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                 const fastgltf::Image& image, const std::filesystem::path& directory);
+void             gltf_image_close(Gltf_Image_Bytes* bytes);
+
+// Images with the same encoded bytes (found by content hash, then compared) only need to be loaded once. Returns GLTF
+// index of the first image with every distinct content, and maps every GLTF image to index in returned vector.
+std::vector<size_t> gltf_unique_images(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                       const std::filesystem::path& directory, std::vector<uint32_t>* unique_map);
+
+// KTX2 images (KHR_texture_basisu) come with all their mips. Basis Universal ones are transcoded to BC7, anything
+// else is uploaded as is.
+struct Gltf_Ktx2_Info
+{
+	VkFormat format; // After transcoding
+	uint32_t width, height;
+	uint32_t mip_levels;
+	size_t   texels_size; // All levels, tightly packed (largest first)
+};
+
+bool gltf_image_is_ktx2(const Gltf_Image_Bytes& bytes);
+
+// Reads just the header. Throws for cubemaps, arrays and formats we can't upload. Basis Universal is transcoded to
+// BC7, or to RGBA8 if device can't sample BC formats (bc_supported is false).
+Gltf_Ktx2_Info gltf_ktx2_info(const Gltf_Image_Bytes& bytes, bool bc_supported);
+
+// Writes info.texels_size bytes to destination. Thread safe.
+void gltf_transcode_ktx2(const Gltf_Image_Bytes& bytes, const Gltf_Ktx2_Info& info, uint8_t* destination);
@@ -1,792 +1,2626 @@
 #include "common.h"
-#include "renderer.h"
-
+#include "loader.h"
+#include "content_hash.h"
+#include "job_system.h"
+#include "load_report.h"
+#include "mapped_file.h"
+#include "texture_compression.h"
+#include "vertex_interleave.h"
+
+#include <algorithm>
+#include <array>
+#include <draco/compression/decode.h>
 #include <fastgltf/parser.hpp>
 #include <fastgltf/tools.hpp>
 #include <fastgltf/glm_element_traits.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <ktx.h>
+#include <limits>
+#include <map>
+#include <meshoptimizer.h>
+#include <simdjson.h>
 #include <stb_image.h>
 
-void load_scene_data()
-{
-	ZoneScopedN("Loading scene data");
+constexpr std::string_view GLTF_DRACO_EXTENSION = "KHR_draco_mesh_compression";
+constexpr uint8_t GLTF_KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
 
-	using namespace fastgltf;
+// Data of accessor, either straight from glTF buffer or decompressed
+struct Gltf_Accessor_View
+{
+	const uint8_t*          data;
+	size_t                  stride;
+	size_t                  count;
+	fastgltf::AccessorType  type;
+	fastgltf::ComponentType component_type;
+	bool                    normalized;
+};
+
+// Decoded Draco primitive, views point into its storage
+struct Gltf_Draco_Data
+{
+	std::vector<uint32_t>             indices_storage;
+	std::vector<std::vector<uint8_t>> attributes_storage;
 
-	auto start_time = std::chrono::high_resolution_clock::now();
+	Gltf_Accessor_View                                      indices;
+	std::vector<std::pair<std::string, Gltf_Accessor_View>> attributes;
+};
 
-	Parser parser;
-	std::filesystem::path gltf_file = "assets/Sponza/glTF/Sponza.gltf";
+// Vertex in PACKED_VERTEX_FORMAT, position goes to position stream and the rest to attribute stream
+struct Gltf_Packed_Vertex
+{
+	uint16_t position[4]; // Relative to bounds of vertex group, w is sign of tangent (0 is -1)
 
-	spdlog::info("Loading GLTF 2.0 file {}", gltf_file.string());
+	struct Attributes
+	{
+		int16_t  normal[2];   // Octahedral
+		int16_t  tangent[2];  // Octahedral
+		uint16_t texcoord[2]; // Half float
+	} attributes;
+};
+static_assert(sizeof(Gltf_Packed_Vertex::Attributes) == 12);
+
+// Called for every imported primitive, from the batch that uploads its mesh
+using Gltf_Mesh_Callback = std::function<void(Scene_Upload& upload, size_t mesh_index, size_t primitive_index,
+                                              Mesh_Manager::Id mesh_id)>;
+
+// Meshes imported together into their own region of upload heap, vertex group or static batch. First mesh brings
+// vertices, the rest use them.
+struct Gltf_Mesh_Job
+{
+	size_t size_bound;
+	std::function<std::vector<Imported_Primitive>(Mapped_Buffer_Writer& writer, Mesh_Import_Stats& stats)> import;
+	std::function<void(Scene_Upload& upload, size_t mesh, Mesh_Manager::Id mesh_id)> on_mesh; // Mesh is import's index
 
-	GltfDataBuffer gltf_data;
-	gltf_data.loadFromFile(gltf_file);
+	VkDeviceSize                    upload_offset;
+	std::vector<Imported_Primitive> imported;
+	Mesh_Import_Stats               stats;
+};
 
-	auto gltf = parser.loadGLTF(&gltf_data, gltf_file.parent_path(),
-	                            Options::LoadExternalBuffers | Options::LoadExternalImages);
+// Primitive of static node, before it's assigned to batch
+struct Gltf_Batch_Candidate
+{
+	Gltf_Static_Batch::Instance instance;
+	glm::vec3                   center; // Of bounds, in world space
+	uint32_t                    vertex_count;
+	size_t                      indices_count;
+};
+
+// Block of upload heap offered to stb_image by decoding thread, see stbi_target_malloc()
+struct Gltf_Decode_Target
+{
+	uint8_t* data;
+	size_t   size;
+	bool     taken;
+};
+thread_local Gltf_Decode_Target gltf_decode_target;
+
+// Private functions
+std::vector<Gltf_Mesh_Job> gltf_vertex_group_jobs(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                                  const Gltf_Compression& compression,
+                                                  std::vector<Gltf_Vertex_Group> groups,
+                                                  const Gltf_Mesh_Callback& on_mesh);
+void gltf_upload_meshes(std::vector<Gltf_Mesh_Job> jobs);
+void gltf_upload_images(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                        const std::filesystem::path& directory,
+                        const std::vector<std::pair<size_t, Slot_Handle>>& images);
+std::vector<uint32_t> gltf_slot_indices(const std::vector<Slot_Handle>& handles);
+bool gltf_decode_image(const Gltf_Image_Bytes& bytes, uint8_t* destination, size_t texels_size);
+bool gltf_images_equal(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                       const std::filesystem::path& directory, size_t first_image, size_t second_image);
+void gltf_read_draco_primitives(std::string_view json, Gltf_Compression* compression);
+void gltf_hide_required_extension(std::string* json, std::string_view extension);
+void gltf_map_buffers(const fastgltf::Asset& asset, const std::filesystem::path& directory, Gltf_Buffers* buffers);
+void gltf_decode_meshopt_views(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                               Gltf_Compression* compression);
+void gltf_decode_draco(const fastgltf::Asset& asset, const Gltf_Buffers& buffers, const Gltf_Draco_Primitive& draco,
+                       Gltf_Draco_Data* decoded);
+VkFormat gltf_attribute_format(const Gltf_Accessor_View& view);
+Gltf_Accessor_View gltf_accessor_view(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                      const Gltf_Compression& compression, const fastgltf::Accessor& accessor);
+std::vector<uint32_t> gltf_read_indices(const Gltf_Accessor_View& view);
+float gltf_decode_component(const Gltf_Accessor_View& view, const uint8_t* component);
+glm::vec4 gltf_decode_element(const Gltf_Accessor_View& view, size_t index);
+std::vector<glm::vec3> gltf_decode_positions(const Gltf_Accessor_View& view);
+glm::vec2 gltf_octahedral_encode(glm::vec3 direction);
+void gltf_pack_vertices(const std::vector<glm::vec3>& positions, const Gltf_Accessor_View& normal_view,
+                        const Gltf_Accessor_View& tangent_view, const Gltf_Accessor_View& texcoord_view,
+                        const std::vector<uint32_t>& source_vertices, uint8_t* destination,
+                        glm::vec3* position_offset, glm::vec3* position_scale);
+void gltf_write_meshlets(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, size_t vertex_count,
+                         bool double_sided, Mapped_Buffer_Writer& writer, Mesh_Import_Stats& stats,
+                         Imported_Primitive* primitive);
+void gltf_split_static_batch(std::vector<Gltf_Batch_Candidate>& candidates, size_t begin, size_t end,
+                             size_t material_index, std::vector<Gltf_Static_Batch>* batches);
+
+void load_gltf_scene(const std::filesystem::path& gltf_file)
+{
+	ZoneScopedN("Loading GLTF scene");
 
-	if (gltf->parse() != Error::None)
-	throw std::runtime_error("GLTF Problem");
+	using namespace fastgltf;
 
-	auto asset = gltf->getParsedAsset();
+	spdlog::info("Loading GLTF 2.0 file {}", gltf_file.string());
 
-	auto upload_heap_block = renderer->upload_heap.allocate_block(200 * 1000 * 1000);
-	auto upload_writer = Mapped_Buffer_Writer(upload_heap_block.ptr);
+	Gltf_Buffers     buffers;
+	Gltf_Compression compression;
+	auto asset = gltf_parse(gltf_file, &buffers, &compression);
 
 	// Texture and sampler data loading into texture_manager.
 	// This design might seem weird, but gathering all textures in one place opens doors to easier migration to
 	// bindless in the future.
 
-	struct Image_Upload {
-		size_t            image_index;
-		int               height, width;
-		VkDeviceSize      upload_offset;
-	};
+	// Images are uploaded last (decoding is by far the most expensive part of loading), but materials need to know
+	// where they will end up, so their slots in texture_manager are reserved right away.
+
+	// Images with the same bytes (same file referenced by several images, or embedded twice) share one slot.
 
-	std::vector<Image_Upload>          image_uploads;
-	std::unordered_map<size_t, size_t> asset_map_images; // Maps index of GLTF image to index in texture_manager
+	std::filesystem::path directory = gltf_file.parent_path();
+	std::vector<uint32_t> asset_map_unique_images; // Maps index of GLTF image to index in unique_images
+	std::vector<size_t>   unique_images = gltf_unique_images(*asset, buffers, directory, &asset_map_unique_images);
 
-	// Upload default texture when we're at this
+	std::vector<Slot_Handle> unique_image_slots(unique_images.size());
+	for (auto& slot : unique_image_slots) slot = scene_loader_reserve_image();
+
+	std::vector<Slot_Handle> asset_map_images(asset->images.size()); // Maps index of GLTF image to texture_manager slot
+	for (size_t asset_image_index = 0; asset_image_index < asset->images.size(); asset_image_index++)
 	{
-		uint8_t pixel_data[] = { 255, 255, 255, 255 };
-		upload_writer.align_next(4); // Offset need to be multiple of texel size (4)
-		VkDeviceSize offset = upload_writer.write(pixel_data, 4);
-		image_uploads.push_back({Texture_Manager::DEFAULT_TEXTURE, 1, 1, offset, });
+		asset_map_images[asset_image_index] = unique_image_slots[asset_map_unique_images[asset_image_index]];
 	}
+	std::vector<uint32_t> asset_image_indices = gltf_slot_indices(asset_map_images);
 
-	for (size_t asset_image_index = 0; asset_image_index < asset->images.size(); asset_image_index++)
+	std::vector<uint32_t>    asset_map_samplers(asset->samplers.size());   // Maps index of GLTF sampler to slot index
+	std::vector<Slot_Handle> asset_map_materials(asset->materials.size()); // Maps index of GLTF material to its slot
+	std::vector<PBR_Material> asset_material_values(asset->materials.size()); // With real textures, kept for reloading
+
+	// Node hierarchy, render objects refer to its nodes. Static batches are already in world space, they go under
+	// extra root node with identity transform.
+	Gltf_Nodes          nodes = gltf_flatten_nodes(*asset);
+	Gltf_Static_Batches static_batches;
+	if (scene_loader->static_batching) static_batches = gltf_static_batches(*asset, buffers, compression, nodes);
+
+	auto batch_node = static_cast<uint32_t>(nodes.parents.size());
+	if (!static_batches.batches.empty())
 	{
-		auto& image = asset->images[asset_image_index];
+		nodes.parents.push_back(TRANSFORM_NO_PARENT);
+		nodes.local_transforms.push_back(glm::mat4(1.0f));
+		nodes.meshes.push_back(Gltf_Nodes::NO_MESH);
+		nodes.animated.push_back(false);
+	}
+	uint32_t first_node = scene_loader_reserve_nodes(nodes.parents.size());
 
-		auto data = std::get<sources::Vector>(image.data);
-		
-		if (data.mimeType == MimeType::None)
-		throw std::runtime_error("GLTF Problem");
+	// First batch is tiny: defaults, nodes, samplers and materials (using default texture until their textures land)
+	{
+		Scene_Upload* upload = scene_upload_begin(4);
 
-		int width, height, channels;
-		auto pixels = stbi_load_from_memory(data.bytes.data(), static_cast<int>(data.bytes.size()),
-											&width, &height, &channels, STBI_rgb_alpha);
+		scene_upload_nodes(*upload, first_node, nodes.parents, nodes.local_transforms);
 
-		if (pixels == nullptr)
-		throw std::runtime_error("GLTF Problem");
+		// Upload default texture when we're at this
+		scene_upload_defaults(*upload);
 
-		Allocated_View_Image view_image; // What we will be allocating
+		for (size_t asset_sampler_index = 0; asset_sampler_index < asset->samplers.size(); asset_sampler_index++)
+		{
+			auto& sampler = asset->samplers[asset_sampler_index];
+			asset_map_samplers[asset_sampler_index] = scene_upload_sampler(*upload, gltf_sampler_create_info(sampler),
+			                                                               sampler.name).index;
+		}
 
-		VkImageCreateInfo image_create_info = {
-			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-			.imageType     = VK_IMAGE_TYPE_2D,
-			.format        = VK_FORMAT_R8G8B8A8_SRGB,
-			.extent        = { static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1},
-			.mipLevels     = width == 4 ? 1u : 10u,
-			.arrayLayers   = 1,
-			.samples       = VK_SAMPLE_COUNT_1_BIT,
-			.tiling        = VK_IMAGE_TILING_OPTIMAL,
-			.usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-			.sharingMode   = VK_SHARING_MODE_EXCLUSIVE,
-			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		};
+		for (size_t asset_material_index = 0; asset_material_index < asset->materials.size(); asset_material_index++)
+		{
+			auto& material = asset->materials[asset_material_index];
 
-		VmaAllocationCreateInfo allocation_create_info = { .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, };
-
-		VmaAllocationInfo allocation_info;
-		vmaCreateImage(gfx_context->vma_allocator, &image_create_info,
-					   &allocation_create_info,&view_image.image,
-					   &view_image.allocation, &allocation_info);
-		name_object(view_image.image, "Loaded image {} {}", asset_image_index, image.name);
-
-		// Create default image view
-		create_default_image_view(gfx_context->device, image_create_info, view_image.image, nullptr, &view_image.view);
-		name_object(view_image.view, "Loaded image view {} {}", asset_image_index, image.name);
-
-		// Put in texture_manager
-		texture_manager->images.push_back(view_image);
-		size_t image_index = texture_manager->images.size() - 1;
-		asset_map_images[asset_image_index] = image_index;
-
-		// Push to upload heap and enqueue for upload
-		upload_writer.align_next(4); // Offset need to be multiple of texel size (4)
-		VkDeviceSize offset = upload_writer.write(pixels, height * width * 4);
-		image_uploads.push_back({
-			.image_index   = image_index,
-			.height        = height,
-			.width         = width,
-			.upload_offset = offset,
-		});
+			PBR_Material pbr_material = gltf_material(*asset, material, asset_image_indices, asset_map_samplers,
+			                                          Texture_Manager::DEFAULT_TEXTURE, Texture_Manager::DEFAULT_SAMPLER);
+			asset_map_materials[asset_material_index]   = scene_upload_material(*upload, pbr_material);
+			asset_material_values[asset_material_index] = pbr_material;
+		}
 
-		// Free from stb_image
-		stbi_image_free(pixels);
+		scene_upload_finish(upload);
 	}
 
-	// Read and crate all samplers
+	// Gather instances of every mesh up-front, so render objects can go with the batch that uploads their mesh.
+	// Batched nodes are drawn by their batches.
+	std::vector<std::vector<uint32_t>> asset_mesh_nodes(asset->meshes.size());
+	for (uint32_t node = 0; node < nodes.meshes.size(); node++)
+	{
+		bool batched = node < static_batches.batched_nodes.size() && static_batches.batched_nodes[node];
+		if (nodes.meshes[node] == Gltf_Nodes::NO_MESH || batched) continue;
 
-	std::unordered_map<size_t, size_t> asset_map_samplers; // Maps index of GLTF image to index in texture_manager
+		asset_mesh_nodes[nodes.meshes[node]].push_back(first_node + node);
+	}
 
-	for (size_t asset_sampler_index = 0; asset_sampler_index < asset->samplers.size(); asset_sampler_index++) {
-		auto& sampler = asset->samplers[asset_sampler_index];
+	// Meshes, primitives remember where they ended up so they can be replaced on reload
+	std::vector<std::vector<Mesh_Manager::Id>> asset_map_meshes(asset->meshes.size());
+	for (size_t mesh_index = 0; mesh_index < asset->meshes.size(); mesh_index++)
+	{
+		asset_map_meshes[mesh_index].resize(asset->meshes[mesh_index].primitives.size());
+	}
 
-		VkSamplerAddressMode address_mode_u =
-		(sampler.wrapS == Wrap::ClampToEdge)    ? VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE   :
-		(sampler.wrapS == Wrap::MirroredRepeat) ? VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT :
-		VK_SAMPLER_ADDRESS_MODE_REPEAT; // Wrap::Repeat
+	std::vector<Gltf_Vertex_Group> groups = gltf_vertex_groups(*asset, compression);
+	if (scene_loader->static_batching)
+	{
+		groups = gltf_unbatched_vertex_groups(*asset, nodes, static_batches, std::move(groups));
+	}
 
-		VkSamplerAddressMode address_mode_v =
-		(sampler.wrapT == Wrap::ClampToEdge)    ? VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE   :
-		(sampler.wrapT == Wrap::MirroredRepeat) ? VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT :
-		VK_SAMPLER_ADDRESS_MODE_REPEAT; // Wrap::Repeat
+	std::vector<Gltf_Mesh_Job> jobs = gltf_vertex_group_jobs(*asset, buffers, compression, std::move(groups),
+	                                                         [&](Scene_Upload& upload, size_t mesh_index,
+	                                                             size_t primitive_index, Mesh_Manager::Id mesh_id)
+	{
+		auto& primitive = asset->meshes[mesh_index].primitives[primitive_index];
+		asset_map_meshes[mesh_index][primitive_index] = mesh_id;
 
-		VkFilter mag_filter = VK_FILTER_LINEAR;
-		if (sampler.magFilter.has_value() && sampler.magFilter.value() == Filter::Nearest)
-		{
-			mag_filter = VK_FILTER_NEAREST; // Mag filter can only have linear or nearest.
-		}
+		// Get material index
+		uint32_t material_id = (primitive.materialIndex.has_value())
+		? asset_map_materials[primitive.materialIndex.value()].index : Material_Manager::DEFAULT_MATERIAL;
 
-		VkFilter min_filter             = VK_FILTER_LINEAR;
-		VkSamplerMipmapMode mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		if (sampler.minFilter.has_value())
+		for (uint32_t node : asset_mesh_nodes[mesh_index])
 		{
-			auto gltf_f = sampler.minFilter.value();
-			min_filter = (gltf_f == Filter::NearestMipMapNearest || gltf_f == Filter::NearestMipMapLinear)
-			? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
-			mipmap_mode = (gltf_f == Filter::NearestMipMapNearest || gltf_f == Filter::LinearMipMapNearest)
-			? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			Render_Object render_object = {
+				.mesh_id        = mesh_id,
+				.material_id    = material_id,
+				.transform_node = node,
+			};
+			upload.render_objects.push_back(render_object);
 		}
+	});
 
-		// TODO FIX this doesn't work!!! Sampler selection in shader is broken. I'll leave anisotropy off and
-		// low mip max lod for debug purposes
-		VkSamplerCreateInfo sampler_create_info = {
-			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-			.magFilter        = mag_filter,
-			.minFilter        = min_filter,
-			.mipmapMode       = mipmap_mode,
-			.addressModeU     = address_mode_u,
-			.addressModeV     = address_mode_v,
-			.addressModeW     = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-			.mipLodBias       = 0,
-			.anisotropyEnable = false,
-			.maxAnisotropy    = 16,
-			.compareEnable    = false,
-			.compareOp        = VK_COMPARE_OP_NEVER,
-			.borderColor      = VK_BORDER_COLOR_INT_OPAQUE_WHITE,
-			.unnormalizedCoordinates = false,
-		};
-		VkSampler our_sampler;
-		vkCreateSampler(gfx_context->device, &sampler_create_info, nullptr, &our_sampler);
-		name_object(our_sampler, "Loaded sampler {} {}", asset_sampler_index, sampler.name);
+	// Batches aren't in asset_map_meshes, they can't be reloaded anyway
+	for (auto& batch : static_batches.batches)
+	{
+		uint32_t material_id = (batch.material_index != Gltf_Static_Batch::NO_MATERIAL)
+		? asset_map_materials[batch.material_index].index : Material_Manager::DEFAULT_MATERIAL;
 
-		// Put in texture_manager
-		texture_manager->samplers.push_back(our_sampler);
-		size_t sampler_index = texture_manager->samplers.size() - 1;
-		asset_map_samplers[asset_sampler_index] = sampler_index;
+		jobs.push_back({
+			.size_bound = gltf_static_batch_size_bound(batch),
+			.import     = [&](Mapped_Buffer_Writer& writer, Mesh_Import_Stats& stats)
+			{
+				return std::vector{ gltf_import_static_batch(*asset, buffers, compression, static_batches, batch,
+				                                             writer, stats, scene_loader->packed_vertices) };
+			},
+			.on_mesh    = [material_id, node = first_node + batch_node](Scene_Upload& upload, size_t mesh,
+			                                                            Mesh_Manager::Id mesh_id)
+			{
+				upload.render_objects.push_back({
+					.mesh_id        = mesh_id,
+					.material_id    = material_id,
+					.transform_node = node,
+				});
+			},
+		});
 	}
 
-	// Material parsing.
+	gltf_upload_meshes(std::move(jobs));
+
+	// Images, each unique one into its reserved slot
+	std::vector<std::pair<size_t, Slot_Handle>> images;
+	for (size_t unique_index = 0; unique_index < unique_images.size(); unique_index++)
+	{
+		images.emplace_back(unique_images[unique_index], unique_image_slots[unique_index]);
+	}
+	gltf_upload_images(*asset, buffers, directory, images);
+
+	scene_loader->gltf_map = {
+		.images          = std::move(asset_map_images),
+		.samplers        = std::move(asset_map_samplers),
+		.materials       = std::move(asset_map_materials),
+		.material_values = std::move(asset_material_values),
+		.meshes          = std::move(asset_map_meshes),
+	};
+}
 
-	std::unordered_map<size_t, size_t> asset_map_materials; // Maps index of GLTF image to index in material_manager
+void reload_gltf_assets(const std::filesystem::path& gltf_file,
+                        const std::vector<std::filesystem::path>& changed_files)
+{
+	ZoneScopedN("Reloading GLTF assets");
 
-	for (size_t asset_material_index = 0; asset_material_index < asset->materials.size(); asset_material_index++) {
-		auto &material = asset->materials[asset_material_index];
+	using namespace fastgltf;
 
-		if (!material.pbrData.has_value())
-		throw std::runtime_error("GLTF Problem");
-		PBRData& pbr_data = material.pbrData.value();
+	auto& map = scene_loader->gltf_map;
+	if (map.images.empty() && map.materials.empty() && map.meshes.empty())
+	{
+		spdlog::warn("Scene was loaded from scene pack, bake it again to see changed assets");
+		return;
+	}
 
-		uint32_t albedo_texture          = Texture_Manager::DEFAULT_TEXTURE;
-		uint32_t albedo_sampler          = Texture_Manager::DEFAULT_SAMPLER;
-		uint32_t metal_roughness_texture = Texture_Manager::DEFAULT_TEXTURE;
-		uint32_t metal_roughness_sampler = Texture_Manager::DEFAULT_SAMPLER;
+	Gltf_Buffers     buffers;
+	Gltf_Compression compression;
+	auto asset = gltf_parse(gltf_file, &buffers, &compression);
 
-		// Find base color texture and sampler
-		if (pbr_data.baseColorTexture.has_value())
-		{
-			auto& base_color_texture = pbr_data.baseColorTexture.value();
+	// Only content of what was loaded can change, anything added or removed needs a restart
+	bool same_layout = asset->images.size() == map.images.size() && asset->materials.size() == map.materials.size()
+	                   && asset->samplers.size() == map.samplers.size() && asset->meshes.size() == map.meshes.size();
+	for (size_t mesh_index = 0; same_layout && mesh_index < asset->meshes.size(); mesh_index++)
+	{
+		same_layout = asset->meshes[mesh_index].primitives.size() == map.meshes[mesh_index].size();
+	}
+	if (!same_layout)
+	{
+		spdlog::warn("{} doesn't match loaded scene anymore, restart to see it", gltf_file.string());
+		return;
+	}
 
-			if (base_color_texture.texCoordIndex != 0)
-			throw std::runtime_error("GLTF Problem");
+	std::filesystem::path directory = gltf_file.parent_path();
 
-			auto image_index = asset->textures[base_color_texture.textureIndex].imageIndex;
-			if (!image_index.has_value())
-			throw std::runtime_error("GLTF Problem");
-			albedo_texture = asset_map_images[image_index.value()];
+	auto file_changed = [&](const std::filesystem::path& file)
+	{
+		std::filesystem::path normal = std::filesystem::absolute(file).lexically_normal();
+		return std::find(changed_files.begin(), changed_files.end(), normal) != changed_files.end();
+	};
+	bool gltf_changed = file_changed(gltf_file);
 
-			auto sampler_index = asset->textures[base_color_texture.textureIndex].samplerIndex;
-			if (sampler_index.has_value())
-			{
-				albedo_sampler = asset_map_samplers[sampler_index.value()];
-			}
+	std::vector<bool> changed_buffers(asset->buffers.size());
+	for (size_t buffer_index = 0; buffer_index < asset->buffers.size(); buffer_index++)
+	{
+		auto& source = asset->buffers[buffer_index].data;
+		if (auto uri = std::get_if<sources::URI>(&source))
+		{
+			changed_buffers[buffer_index] = uri->uri.isLocalPath() && file_changed(directory / uri->uri.fspath());
 		}
-
-		// Find metalness+roughness texture and sampler
-		if (pbr_data.metallicRoughnessTexture.has_value())
+		else
 		{
-			auto& mr_texture = pbr_data.metallicRoughnessTexture.value();
+			changed_buffers[buffer_index] = gltf_changed; // Embedded (or GLB binary chunk)
+		}
+	}
 
-			if (mr_texture.texCoordIndex != 0)
-			throw std::runtime_error("GLTF Problem");
+	// Changed images go to new slots, deduplicated like when loading. Their old slots are destroyed unless
+	// some unchanged image with the same content still uses them.
+	std::vector<Slot_Handle>                    image_map = map.images;
+	std::vector<std::pair<size_t, Slot_Handle>> reloaded_images; // glTF image, new slot
+	std::unordered_multimap<uint64_t, size_t>   reloaded_by_hash; // Index in reloaded_images
+	for (size_t image_index = 0; image_index < asset->images.size(); image_index++)
+	{
+		auto& source  = asset->images[image_index].data;
+		bool  changed = gltf_changed;
+		if (auto uri = std::get_if<sources::URI>(&source))
+		{
+			changed = uri->uri.isLocalPath() && file_changed(directory / uri->uri.fspath());
+		}
+		else if (auto view = std::get_if<sources::BufferView>(&source))
+		{
+			changed = changed_buffers[asset->bufferViews[view->bufferViewIndex].bufferIndex];
+		}
+		if (!changed) continue;
 
-			auto image_index = asset->textures[mr_texture.textureIndex].imageIndex;
-			if (!image_index.has_value())
-			throw std::runtime_error("GLTF Problem");
-			metal_roughness_texture = asset_map_images[image_index.value()];
+		Gltf_Image_Bytes bytes = gltf_image_open(*asset, buffers, asset->images[image_index], directory);
+		uint64_t         hash  = content_hash(bytes.data, bytes.size);
+		gltf_image_close(&bytes);
 
-			auto sampler_index = asset->textures[mr_texture.textureIndex].samplerIndex;
-			if (sampler_index.has_value())
-			{
-				metal_roughness_sampler = asset_map_samplers[sampler_index.value()];
-			}
+		// Hash only finds candidates, bytes decide
+		auto [first, last] = reloaded_by_hash.equal_range(hash);
+		auto same = std::find_if(first, last, [&](auto& candidate)
+		{
+			return gltf_images_equal(*asset, buffers, directory, reloaded_images[candidate.second].first, image_index);
+		});
+		if (same == last)
+		{
+			same = reloaded_by_hash.emplace(hash, reloaded_images.size());
+			reloaded_images.emplace_back(image_index, scene_loader_reserve_image());
 		}
+		image_map[image_index] = reloaded_images[same->second].second;
+	}
 
-		PBR_Material pbr_material = {
-			.albedo_color            = glm::make_vec4(pbr_data.baseColorFactor.data()),
-			.albedo_texture          = albedo_texture,
-			.albedo_sampler          = albedo_sampler,
-			.metalness_factor        = pbr_data.metallicFactor,
-			.roughness_factor        = pbr_data.roughnessFactor,
-			.metal_roughness_texture = metal_roughness_texture,
-			.metal_roughness_sampler = metal_roughness_sampler,
-		};
+	std::vector<Slot_Handle> retired_images;
+	for (Slot_Handle old_slot : map.images)
+	{
+		bool used = std::find(image_map.begin(), image_map.end(), old_slot) != image_map.end();
+		bool seen = std::find(retired_images.begin(), retired_images.end(), old_slot) != retired_images.end();
+		if (!used && !seen) retired_images.push_back(old_slot);
+	}
 
-		// Put it in material manager
-		material_manager->materials.push_back(pbr_material);
-		size_t material_index = material_manager->materials.size() - 1;
-		asset_map_materials[asset_material_index] = material_index;
+	// Materials that differ from committed ones. Samplers aren't reloaded, shaders use the default one anyway.
+	std::vector<uint32_t>     image_indices = gltf_slot_indices(image_map);
+	std::vector<PBR_Material> material_values(asset->materials.size());
+	std::vector<size_t>       changed_materials;
+	for (size_t material_index = 0; material_index < asset->materials.size(); material_index++)
+	{
+		material_values[material_index] = gltf_material(*asset, asset->materials[material_index], image_indices,
+		                                                map.samplers, Texture_Manager::DEFAULT_TEXTURE,
+		                                                Texture_Manager::DEFAULT_SAMPLER);
+		if (memcmp(&material_values[material_index], &map.material_values[material_index], sizeof(PBR_Material)) != 0)
+		{
+			changed_materials.push_back(material_index);
+		}
 	}
 
-	uint32_t material_data_size = material_manager->materials.size() * sizeof(PBR_Material);
-	VkDeviceSize material_data_offset = upload_writer.write(material_manager->materials.data(), material_data_size);
+	// Vertex groups reading from changed buffers (meshes don't follow edits of accessors in glTF file alone)
+	auto view_changed = [&](size_t view_index)
+	{
+		if (view_index >= asset->bufferViews.size()) return false;
+		auto& view = asset->bufferViews[view_index];
+		return changed_buffers[view.bufferIndex]
+		       || (view.meshoptCompression && changed_buffers[view.meshoptCompression->bufferIndex]);
+	};
+	auto accessor_changed = [&](size_t accessor_index)
+	{
+		auto& accessor = asset->accessors[accessor_index];
+		return accessor.bufferViewIndex.has_value() && view_changed(accessor.bufferViewIndex.value());
+	};
 
-	// Meshes parsing and loading
+	std::vector<Gltf_Vertex_Group> groups = gltf_vertex_groups(*asset, compression);
+	std::erase_if(groups, [&](const Gltf_Vertex_Group& group)
+	{
+		for (auto& [mesh_index, primitive_index] : group.primitives)
+		{
+			auto& primitive = asset->meshes[mesh_index].primitives[primitive_index];
+			auto& draco     = compression.draco_primitives[mesh_index][primitive_index];
+			if (draco.has_value() && view_changed(draco->buffer_view)) return false;
 
-	std::vector<VkBufferCopy> vertex_copies;
-	std::vector<VkBufferCopy> indices_copies;
+			for (auto& [name, accessor_index] : primitive.attributes)
+			{
+				if (accessor_changed(accessor_index)) return false;
+			}
+			if (primitive.indicesAccessor.has_value() && accessor_changed(primitive.indicesAccessor.value()))
+			return false;
+		}
+		return true;
+	});
 
-	// This maps single GLTF mesh into set of our meshes
-	// (each mesh might have multiple primitives, which we consider separate meshes)
-	struct Primitive
+	// Batches are baked from several meshes, and meshes that went into them don't have their own
+	if (scene_loader->static_batching && !groups.empty())
 	{
-		Mesh_Manager::Id mesh_id;
-		uint32_t         material_id;
-	};
+		spdlog::warn("Meshes aren't reloaded with static batching, restart to see them");
+		groups.clear();
+	}
 
-	std::unordered_map<size_t, std::vector<Primitive>> asset_map_meshes;
+	if (reloaded_images.empty() && changed_materials.empty() && groups.empty()) return;
 
-	for (size_t mesh_index = 0; mesh_index < asset->meshes.size(); mesh_index++)
-	{
-		auto& mesh = asset->meshes[mesh_index];
-		asset_map_meshes[mesh_index] = {}; // Initialize primitives list
+	spdlog::info("Reloading {} images, {} materials and {} vertex groups", reloaded_images.size(),
+	             changed_materials.size(), groups.size());
 
-		// Each primitive will be separate mesh
-		for (auto& primitive : mesh.primitives)
+	// Materials first, ones using reloaded images keep the old ones until the new ones land
+	if (!changed_materials.empty())
+	{
+		Scene_Upload* upload = scene_upload_begin(0);
+		for (size_t material_index : changed_materials)
 		{
-			// Right now, only handle triangles (conversion from other types will be implemented later)
-			if (primitive.type != PrimitiveType::Triangles)
-			throw std::runtime_error("GLTF Problem");
+			scene_upload_material_update(*upload, map.materials[material_index], material_values[material_index]);
+		}
+		scene_upload_finish(upload);
+	}
 
-			// We don't generate indices as of now
-			if (!primitive.indicesAccessor.has_value())
-			throw std::runtime_error("GLTF Problem");
+	gltf_upload_meshes(gltf_vertex_group_jobs(*asset, buffers, compression, std::move(groups),
+	                                          [&](Scene_Upload& upload, size_t mesh_index, size_t primitive_index,
+	                                              Mesh_Manager::Id mesh_id)
+	{
+		Mesh_Manager::Id& mapped = map.meshes[mesh_index][primitive_index];
+		upload.replaced_meshes.emplace_back(mapped, mesh_id);
+		mapped = mesh_id;
+	}));
 
-			// Check if all required attributes are present
-			bool attributes_present =
-			primitive.attributes.contains("POSITION") &&
-			primitive.attributes.contains("NORMAL") &&
-			primitive.attributes.contains("TEXCOORD_0");
+	gltf_upload_images(*asset, buffers, directory, reloaded_images);
 
-			bool has_tangent = primitive.attributes.contains("TANGENT");
+	// By now every material is switched to new images (by the batch that brought them)
+	if (!retired_images.empty())
+	{
+		Scene_Upload* upload = scene_upload_begin(0);
+		upload->retired_images = std::move(retired_images);
+		scene_upload_finish(upload);
+	}
 
-			if (!attributes_present)
-			throw std::runtime_error("GLTF Problem");
+	map.images          = std::move(image_map);
+	map.material_values = std::move(material_values);
+}
 
-			if (!has_tangent)
+std::vector<Gltf_Mesh_Job> gltf_vertex_group_jobs(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                                  const Gltf_Compression& compression,
+                                                  std::vector<Gltf_Vertex_Group> groups,
+                                                  const Gltf_Mesh_Callback& on_mesh)
+{
+	// Each primitive will be separate mesh, but primitives using the same vertex accessors share vertices
+	std::vector<Gltf_Mesh_Job> jobs;
+	for (auto& group : groups)
+	{
+		size_t size_bound = gltf_vertex_group_size_bound(asset, group);
+		auto   primitives = std::make_shared<Gltf_Vertex_Group>(std::move(group));
+
+		jobs.push_back({
+			.size_bound = size_bound,
+			.import     = [&asset, &buffers, &compression, primitives](Mapped_Buffer_Writer& writer,
+			                                                           Mesh_Import_Stats& stats)
 			{
-				spdlog::info("Missing tangent!"); // Todo better logging
-			}
+				return gltf_import_vertex_group(asset, buffers, compression, *primitives, writer, stats,
+				                                scene_loader->packed_vertices);
+			},
+			.on_mesh    = [on_mesh, primitives](Scene_Upload& upload, size_t mesh, Mesh_Manager::Id mesh_id)
+			{
+				auto& [mesh_index, primitive_index] = primitives->primitives[mesh];
+				on_mesh(upload, mesh_index, primitive_index, mesh_id);
+			},
+		});
+	}
+	return jobs;
+}
 
-			auto indices_accessor  = asset->accessors[primitive.indicesAccessor.value()];
-			auto position_accessor = asset->accessors[primitive.attributes["POSITION"]];
-			auto normal_accessor   = asset->accessors[primitive.attributes["NORMAL"]];
-			auto tangent_accessor  = asset->accessors[primitive.attributes["TANGENT"]];
-			auto texcoord_accessor = asset->accessors[primitive.attributes["TEXCOORD_0"]];
+void gltf_upload_meshes(std::vector<Gltf_Mesh_Job> jobs)
+{
+	// Meshes, in batches of bounded size. Jobs of a batch are decompressed and imported in parallel, straight into
+	// their reserved upload heap regions (sized by upper bound).
 
-			// So eh, apparently, texcoord can be float, uint8_t or uint16_t... we might need to convert.
-			if (texcoord_accessor.componentType != ComponentType::Float)
-			throw std::runtime_error("GLTF Problem");
+	Mesh_Import_Stats stats       = {};
+	size_t            batch_start = 0;
+	while (batch_start < jobs.size())
+	{
+		ZoneScopedN("Mesh batch");
 
-			// Also, indices can also be of multiple types...
-			if (indices_accessor.componentType != ComponentType::UnsignedShort)
-			throw std::runtime_error("GLTF Problem");
+		// Jobs bigger than batch size still go in their own batch
+		size_t batch_end  = batch_start;
+		size_t batch_size = 0;
+		while (batch_end < jobs.size())
+		{
+			size_t job_size = jobs[batch_end].size_bound + 16; // Including alignment
+			if (batch_end > batch_start && batch_size + job_size > scene_loader->batch_size) break;
+			batch_size += job_size;
+			batch_end++;
+		}
 
-			// All attributes accessors has matching counts. This is enforced by the specs
-			size_t attr_count = position_accessor.count;
+		Scene_Upload* upload = scene_upload_begin(batch_size);
 
-			// Save offset of vertex region
-			VkDeviceSize vertex_src_offset = upload_writer.offset();
+		for (size_t job_index = batch_start; job_index < batch_end; job_index++)
+		{
+			upload->upload_writer.align_next(16);
+			jobs[job_index].upload_offset = upload->upload_writer.offset();
+			upload->upload_writer.advance(jobs[job_index].size_bound);
+		}
 
-			for (size_t offset = 0; offset < attr_count; offset++)
-			{
-				auto p = getAccessorElement<glm::vec3>(*asset, position_accessor, offset);
-				auto n = getAccessorElement<glm::vec3>(*asset, normal_accessor,   offset);
-				auto tx= getAccessorElement<glm::vec2>(*asset, texcoord_accessor, offset);
+		{
+			ZoneScopedN("Primitive importing");
 
-				auto tg = (has_tangent)
-				? getAccessorElement<glm::vec4>(*asset, tangent_accessor,  offset)
-				: glm::vec4(0, 0, 0, 0);
+			parallel_for(batch_end - batch_start, [&](size_t batch_index)
+			{
+				ZoneScopedN("Vertex group import");
+				Load_Timer timer(Load_Phase::VERTEX_TRANSCODE);
 
-				auto attr = { p.x, p.y, p.z, n.x, n.y, n.z, tg.x, tg.y, tg.z, tg.w, tx.x, tx.y }; // Vulkan UV fix
-				upload_writer.write(attr.begin(), 12 * sizeof(float));
-			}
+				auto& job = jobs[batch_start + batch_index];
 
-			// Save offset of indices region
-			VkDeviceSize indices_src_offset = upload_writer.offset();
-
-			// Copy indices
-			copyFromAccessor<uint16_t>(*asset, indices_accessor, upload_writer.offset_ptr);
-			upload_writer.advance(indices_accessor.count * sizeof(uint16_t));
-
-			// Allocate mesh and indices
-			VkResult alloc_result;
-			VmaVirtualAllocationCreateInfo vertex_allocation_info = { .size = attr_count * sizeof(float) * 12 };
-			VmaVirtualAllocation vertex_allocation;
-			VkDeviceSize vertex_dst_offset;
-			alloc_result = vmaVirtualAllocate(mesh_manager->vertex_sub_allocator,
-											  &vertex_allocation_info, &vertex_allocation,
-											  &vertex_dst_offset);
-			if (alloc_result != VK_SUCCESS)
-			throw std::runtime_error("GLTF Problem");
+				Mapped_Buffer_Writer writer(upload->upload_writer.base_ptr + job.upload_offset);
+				job.imported = job.import(writer, job.stats);
+				timer.bytes  = writer.offset();
+			});
+		}
 
-			VmaVirtualAllocationCreateInfo indices_allocation_info = { .size = indices_accessor.count * sizeof(uint16_t) };
-			VmaVirtualAllocation indices_allocation;
-			VkDeviceSize indices_dst_offset;
-			alloc_result = vmaVirtualAllocate(mesh_manager->indices_sub_allocator,
-											  &indices_allocation_info,&indices_allocation,
-											  &indices_dst_offset);
-			if (alloc_result != VK_SUCCESS)
-			throw std::runtime_error("GLTF Problem");
+		for (size_t job_index = batch_start; job_index < batch_end; job_index++)
+		{
+			auto& job = jobs[job_index];
 
-			Mesh_Manager::Mesh_Description mesh_description = {
-				.vertex_offset  = vertex_dst_offset,
-				.vertex_count   = static_cast<uint32_t>(attr_count),
-				.indices_offset = indices_dst_offset,
-				.indices_count  = static_cast<uint32_t>(indices_accessor.count),
-				.vertex_allocation  = vertex_allocation,
-				.indices_allocation = indices_allocation,
-			};
+			// First mesh of the job brings vertices, the rest use them
+			std::optional<Mesh_Manager::Id> job_vertices;
+			for (size_t mesh = 0; mesh < job.imported.size(); mesh++)
+			{
+				auto& imported = job.imported[mesh];
 
-			Mesh_Manager::Id mesh_id = mesh_manager->next_index++;
-			mesh_manager->meshes[mesh_id] = mesh_description;
+				// Offsets are relative to job's region
+				imported.vertex_offset   += job.upload_offset;
+				imported.indices_offset  += job.upload_offset;
+				imported.meshlets_offset += job.upload_offset;
+				Mesh_Manager::Id mesh_id = scene_upload_mesh(*upload, imported, job_vertices);
+				if (!job_vertices.has_value()) job_vertices = mesh_id;
 
-			vertex_copies.push_back({
-				.srcOffset = vertex_src_offset,
-				.dstOffset = vertex_dst_offset,
-				.size      = vertex_allocation_info.size,
-			});
+				job.on_mesh(*upload, mesh, mesh_id);
+			}
 
-			indices_copies.push_back({
-				.srcOffset = indices_src_offset,
-				.dstOffset = indices_dst_offset,
-				.size      = indices_allocation_info.size,
-			});
+			stats.triangles          += job.stats.triangles;
+			stats.meshlets           += job.stats.meshlets;
+			stats.vertices_before    += job.stats.vertices_before;
+			stats.vertices_after     += job.stats.vertices_after;
+			stats.transformed_before += job.stats.transformed_before;
+			stats.transformed_after  += job.stats.transformed_after;
+		}
 
-			// Get material index
-			uint32_t material_id = (primitive.materialIndex.has_value())
-			? asset_map_materials[primitive.materialIndex.value()] : Material_Manager::DEFAULT_MATERIAL;
+		scene_upload_finish(upload);
 
-			asset_map_meshes[mesh_index].push_back({ .mesh_id = mesh_id, .material_id = material_id });
-		}
+		batch_start = batch_end;
 	}
 
-	// Now, let's start traversing entire scene and node hierarchy
+	gltf_log_import_stats(stats);
+}
 
-	struct Enqueued_Node
-	{
-		glm::mat4 parent_transform;
-		size_t    node_id;
+void gltf_upload_images(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                        const std::filesystem::path& directory,
+                        const std::vector<std::pair<size_t, Slot_Handle>>& images)
+{
+	// We only read headers first, to know how big images are. Then images are read and decoded batch by batch,
+	// in parallel, straight into their reserved upload heap regions. PNG/JPEG is decoded to RGBA8 and mipped on GPU,
+	// KTX2 (KHR_texture_basisu) comes with its mips and is transcoded to BC7 if it's Basis Universal.
+
+	struct Image_Decode {
+		size_t         asset_image_index;
+		Slot_Handle    image; // In texture_manager
+		bool           ktx2;
+		Gltf_Ktx2_Info ktx2_info;
+		VkFormat       format;
+		int            width, height;
+		uint32_t       mip_levels;
+		VkDeviceSize   upload_offset;
+		size_t         texels_size;
 	};
-	std::deque<Enqueued_Node> nodes_queue;
 
-	// Enqueue root nodes from scenes for traversal
-	for (auto& scene : asset->scenes)
-	{
-		for (auto& node_id : scene.nodeIndices)
-		{
-			nodes_queue.push_back({
-				.parent_transform = glm::translate(glm::mat4 {1.0f}, glm::vec3 {0.0f, 0.0f, 0.0f}),
-				.node_id = node_id,
-			});
-		}
-	}
+	std::vector<Image_Decode> image_decodes(images.size());
 
-	while (!nodes_queue.empty())
+	for (size_t decode_index = 0; decode_index < images.size(); decode_index++)
 	{
-		Enqueued_Node enqueued_node = nodes_queue.front();
-		Node node = asset->nodes[enqueued_node.node_id];
+		auto [asset_image_index, image] = images[decode_index];
+		Gltf_Image_Bytes bytes = gltf_image_open(asset, buffers, asset.images[asset_image_index], directory);
 
-		// Compose matrix if needed
-		glm::mat4 transform_matrix;
-		if (std::holds_alternative<Node::TransformMatrix>(node.transform))
+		if (gltf_image_is_ktx2(bytes))
 		{
-			transform_matrix = glm::make_mat4(std::get<Node::TransformMatrix>(node.transform).data());
+			Gltf_Ktx2_Info info = gltf_ktx2_info(bytes, gfx_context->texture_compression_bc);
+			image_decodes[decode_index] = {
+				.asset_image_index = asset_image_index,
+				.image       = image,
+				.ktx2        = true,
+				.ktx2_info   = info,
+				.format      = info.format,
+				.width       = static_cast<int>(info.width),
+				.height      = static_cast<int>(info.height),
+				.mip_levels  = info.mip_levels,
+				.texels_size = info.texels_size,
+			};
 		}
 		else
 		{
-			Node::TRS trs = std::get<Node::TRS>(node.transform);
-			auto t = glm::translate(glm::mat4 { 1.0f }, glm::make_vec3(trs.translation.data()));
-			auto r = glm::mat4_cast(glm::make_quat(trs.rotation.data()));
-			auto s = glm::scale(glm::mat4 { 1.0f }, glm::make_vec3(trs.scale.data()));
-			transform_matrix = t * r * s;
-		}
+			int width, height, channels;
+			if (!stbi_info_from_memory(bytes.data, static_cast<int>(bytes.size), &width, &height, &channels))
+			throw std::runtime_error("GLTF Problem");
 
-		for (auto& child_id : node.children)
-		{
-			nodes_queue.push_back({
-				.parent_transform = transform_matrix * enqueued_node.parent_transform,
-				.node_id = child_id,
-			});
+			image_decodes[decode_index] = {
+				.asset_image_index = asset_image_index,
+				.image       = image,
+				.ktx2        = false,
+				.format      = VK_FORMAT_R8G8B8A8_SRGB,
+				.width       = width,
+				.height      = height,
+				.mip_levels  = width == 4 ? 1u : 10u,
+				.texels_size = static_cast<size_t>(height) * width * 4,
+			};
 		}
 
-		// Finally, spawn scene objects
-		if (node.meshIndex.has_value())
+		gltf_image_close(&bytes);
+	}
+
+	auto image_create_info = [&](const Image_Decode& decode)
+	{
+		VkImageCreateInfo create_info = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType     = VK_IMAGE_TYPE_2D,
+			.format        = decode.format,
+			.extent        = { static_cast<uint32_t>(decode.width), static_cast<uint32_t>(decode.height), 1},
+			.mipLevels     = decode.mip_levels,
+			.arrayLayers   = 1,
+			.samples       = VK_SAMPLE_COUNT_1_BIT,
+			.tiling        = VK_IMAGE_TILING_OPTIMAL,
+			.usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			.sharingMode   = VK_SHARING_MODE_EXCLUSIVE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		};
+		return create_info;
+	};
+
+	size_t batch_start = 0;
+	while (batch_start < image_decodes.size())
+	{
+		ZoneScopedN("Image batch");
+
+		// RGBA8 image that doesn't fit in a batch on its own goes in slices. Other images bigger than batch size
+		// still go in their own batch.
+		Image_Decode& first_decode = image_decodes[batch_start];
+		if (!first_decode.ktx2 && first_decode.texels_size + 16 > scene_loader->batch_size)
 		{
-			for (Primitive& primitive : asset_map_meshes[node.meshIndex.value()])
+			size_t asset_image_index = first_decode.asset_image_index;
+			stbi_uc* pixels;
+			int      width, height, channels;
 			{
-				Render_Object render_object = {
-					.mesh_id     = primitive.mesh_id,
-					.material_id = primitive.material_id,
-					.transform   = transform_matrix,
-				};
-				scene_data->render_objects.push_back(render_object);
+				Load_Timer timer(Load_Phase::IMAGE_DECODE, first_decode.texels_size);
+
+				Gltf_Image_Bytes bytes = gltf_image_open(asset, buffers, asset.images[asset_image_index], directory);
+				pixels = stbi_load_from_memory(bytes.data, static_cast<int>(bytes.size),
+				                               &width, &height, &channels, STBI_rgb_alpha);
+				gltf_image_close(&bytes);
+
+				load_report_add_image(asset.images[asset_image_index].name, timer.elapsed_nanoseconds(),
+				                      first_decode.texels_size);
 			}
-		}
 
-		nodes_queue.pop_front();
-	}
+			if (pixels == nullptr)
+			throw std::runtime_error("GLTF Problem");
 
-	// TODO: remove this, once we do async loading
-	VkCommandPool   upload_command_pool;
-	VkCommandBuffer upload_command_buffer;
+			std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> pixels_owner(pixels, &stbi_image_free);
 
-	{
-		ZoneScopedN("Command Pool and Command buffer creation");
+			size_t   row_size       = static_cast<size_t>(width) * 4;
+			size_t   slice_rows     = std::max((scene_loader->batch_size - 16) / row_size, size_t(1));
+			uint32_t rows_per_slice = static_cast<uint32_t>(std::min(slice_rows, static_cast<size_t>(height)));
+			for (uint32_t first_row = 0; first_row < static_cast<uint32_t>(height); first_row += rows_per_slice)
+			{
+				ZoneScopedN("Image slice");
 
-		VkCommandPoolCreateInfo command_pool_create_info = {
-			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-			.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-			.queueFamilyIndex = gfx_context->gfx_queue_family_index,
-		};
+				uint32_t row_count = std::min(rows_per_slice, static_cast<uint32_t>(height) - first_row);
 
-		vkCreateCommandPool(gfx_context->device, &command_pool_create_info, nullptr, &upload_command_pool);
-		name_object(upload_command_pool, "Main upload heap command pool");
+				Scene_Upload* upload = scene_upload_begin(row_count * row_size + 16);
 
-		VkCommandBufferAllocateInfo allocate_info = {
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-			.commandPool = upload_command_pool,
-			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			.commandBufferCount = 1,
-		};
+				upload->upload_writer.align_next(16);
+				VkDeviceSize offset = upload->upload_writer.write(pixels + first_row * row_size, row_count * row_size);
 
-		vkAllocateCommandBuffers(gfx_context->device, &allocate_info, &upload_command_buffer);
-		name_object(upload_command_buffer, "Main upload heap command buffer");
-	}
+				scene_upload_image_rows(*upload, first_decode.image, image_create_info(first_decode),
+				                        offset, first_row, row_count, asset.images[asset_image_index].name);
+				scene_upload_finish(upload);
+			}
 
-	{
-		ZoneScopedN("Upload command submission");
+			batch_start++;
+			continue;
+		}
 
-		//flush_buffer_writer(upload_writer, gfx_context->vma_allocator, renderer->main_upload_heap.allocation);
-		renderer->upload_heap.submit_free(upload_heap_block);
+		size_t batch_end  = batch_start;
+		size_t batch_size = 0;
+		while (batch_end < image_decodes.size())
+		{
+			size_t image_size = image_decodes[batch_end].texels_size + 16; // Including alignment
+			if (batch_end > batch_start && batch_size + image_size > scene_loader->batch_size) break;
+			batch_size += image_size;
+			batch_end++;
+		}
 
-		VkCommandBufferBeginInfo begin_info = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, };
-		vkBeginCommandBuffer(upload_command_buffer, &begin_info);
+		Scene_Upload* upload = scene_upload_begin(batch_size);
 
-		// Copy buffers
-		vkCmdCopyBuffer(upload_command_buffer, renderer->upload_heap.upload_buffer.buffer,
-						mesh_manager->vertex_buffer.buffer, vertex_copies.size(), vertex_copies.data());
-		vkCmdCopyBuffer(upload_command_buffer, renderer->upload_heap.upload_buffer.buffer,
-						mesh_manager->indices_buffer.buffer, indices_copies.size(), indices_copies.data());
+		for (size_t decode_index = batch_start; decode_index < batch_end; decode_index++)
+		{
+			Image_Decode& decode            = image_decodes[decode_index];
+			size_t        asset_image_index = decode.asset_image_index;
 
-		VkBufferCopy material_copy = {
-			.srcOffset = material_data_offset,
-			.dstOffset = 0,
-			.size      = material_data_size,
-		};
-		vkCmdCopyBuffer(upload_command_buffer, renderer->upload_heap.upload_buffer.buffer,
-						material_manager->material_storage_buffer.buffer, 1, &material_copy);
-
-		// Enqueue upload of all pending textures
-		for (auto& image_upload : image_uploads)
-		{
-			auto vk_image = texture_manager->images[image_upload.image_index].image;
-
-			uint32_t mip_levels = image_upload.height == 1 || image_upload.height == 4 ? 1 : 10;
-
-			// Transition first mip to copy layout
-			VkImageMemoryBarrier to_transfer_dst_barrier = {
-				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-				.srcAccessMask = 0,
-				.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-				.oldLayout     = VK_IMAGE_LAYOUT_UNDEFINED,
-				.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				.image         = vk_image,
-				.subresourceRange = {
-					.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-					.baseMipLevel   = 0,
-					.levelCount     = 1,
-					.baseArrayLayer = 0,
-					.layerCount     = 1,
-				},
-			};
-			vkCmdPipelineBarrier(upload_command_buffer, VK_PIPELINE_STAGE_HOST_BIT,
-								 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-								 &to_transfer_dst_barrier);
-
-			// Enqueue copy
-			VkBufferImageCopy region = {
-				.bufferOffset = image_upload.upload_offset,
-				.imageSubresource = {
-					.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-					.mipLevel       = 0,
-					.baseArrayLayer = 0,
-					.layerCount     = 1,
-				},
-				.imageExtent = {
-					.width   = static_cast<uint32_t>(image_upload.width),
-					.height  = static_cast<uint32_t>(image_upload.height),
-					.depth   = 1,
-				},
-			};
-			vkCmdCopyBufferToImage(upload_command_buffer, renderer->upload_heap.upload_buffer.buffer,
-								   vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-			// Await transfer for mip 0
-			VkImageMemoryBarrier await_transfer_barrier = {
-				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-				.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-				.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				.image         = vk_image,
-				.subresourceRange = {
-					.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-					.baseMipLevel   = 0,
-					.levelCount     = 1,
-					.baseArrayLayer = 0,
-					.layerCount     = 1,
-				},
-			};
-			vkCmdPipelineBarrier(upload_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
-								 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-								 &await_transfer_barrier);
+			// Reserve space in upload heap and enqueue for upload
+			upload->upload_writer.align_next(16); // Offset need to be multiple of texel (4) or block (8, 16) size
+			decode.upload_offset = upload->upload_writer.offset();
+			upload->upload_writer.advance(decode.texels_size);
+
+			scene_upload_image(*upload, decode.image, image_create_info(decode),
+			                   decode.upload_offset, !decode.ktx2, asset.images[asset_image_index].name);
+		}
 
-			// Generate mipmaps
-			for (uint32_t dst_mip = 1; dst_mip < mip_levels; dst_mip++)
+		{
+			ZoneScopedN("Image decoding");
+
+			parallel_for(batch_end - batch_start, [&](size_t batch_index)
 			{
-				// Move dst mip to trransfer dst
-				VkImageMemoryBarrier mip_to_transfer_dst = {
-					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-					.srcAccessMask = 0,
-					.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-					.oldLayout     = VK_IMAGE_LAYOUT_UNDEFINED,
-					.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-					.image         = vk_image,
-					.subresourceRange = {
-						.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-						.baseMipLevel   = dst_mip,
-						.levelCount     = 1,
-						.baseArrayLayer = 0,
-						.layerCount     = 1,
-					},
-				};
-				vkCmdPipelineBarrier(upload_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-									 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-									 &mip_to_transfer_dst);
-
-				VkImageBlit2 regions = {
-					.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2,
-					.srcSubresource = {
-						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-							.mipLevel = dst_mip - 1,
-							.baseArrayLayer = 0,
-							.layerCount = 1,
-					},
-					.srcOffsets = {
-						{ 0, 0, 0 },
-						{ (image_upload.width >> dst_mip - 1), (image_upload.width >> dst_mip - 1), 1 }
-					},
-					.dstSubresource = {
-						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-						.mipLevel = dst_mip,
-						.baseArrayLayer = 0,
-						.layerCount = 1,
-					},
-					.dstOffsets = {
-						{ 0, 0, 0 },
-						{ (image_upload.width >> dst_mip), (image_upload.width >> dst_mip), 1 }
-					},
-				};
+				ZoneScopedN("Image decode");
 
-				VkBlitImageInfo2 blit_info = {
-					.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2,
-					.srcImage = vk_image,
-					.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-					.dstImage = vk_image,
-					.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-					.regionCount = 1,
-					.pRegions = &regions,
-					.filter = VK_FILTER_LINEAR,
-				};
+				Image_Decode& decode      = image_decodes[batch_start + batch_index];
+				uint8_t*      destination = upload->upload_writer.base_ptr + decode.upload_offset;
+				auto&         asset_image = asset.images[decode.asset_image_index];
 
-				vkCmdBlitImage2(upload_command_buffer, &blit_info);
-
-				// Move dst mip to trransfer src
-				VkImageMemoryBarrier mip_to_transfer_src = {
-					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-					.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-					.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-					.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-					.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-					.image = vk_image,
-					.subresourceRange = {
-						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-						.baseMipLevel = dst_mip,
-						.levelCount = 1,
-						.baseArrayLayer = 0,
-						.layerCount = 1,
-					},
-				};
-				vkCmdPipelineBarrier(upload_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-					VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-					&mip_to_transfer_src);
-			}
+				Load_Timer timer(Load_Phase::IMAGE_DECODE, decode.texels_size);
 
-			// Immediately transition into proper layout
-			VkImageMemoryBarrier from_transform_transition_barrier = {
-				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
-				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-				.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-				.image = vk_image,
-				.subresourceRange = {
-					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-					.baseMipLevel = 0,
-					.levelCount = mip_levels,
-					.baseArrayLayer = 0,
-					.layerCount = 1,
-				},
-			};
+				// File is mapped only while it's decoded
+				Gltf_Image_Bytes bytes = gltf_image_open(asset, buffers, asset_image, directory);
+
+				if (decode.ktx2)
+				{
+					gltf_transcode_ktx2(bytes, decode.ktx2_info, destination);
+					gltf_image_close(&bytes);
+					load_report_add_image(asset_image.name, timer.elapsed_nanoseconds(), decode.texels_size);
+					return;
+				}
+
+				bool decoded = gltf_decode_image(bytes, destination, decode.texels_size);
+				gltf_image_close(&bytes);
+
+				if (!decoded)
+				throw std::runtime_error("GLTF Problem");
 
-			vkCmdPipelineBarrier(upload_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-				&from_transform_transition_barrier);
+				load_report_add_image(asset_image.name, timer.elapsed_nanoseconds(), decode.texels_size);
+			});
 		}
 
-		vkEndCommandBuffer(upload_command_buffer);
+		scene_upload_finish(upload);
 
-		VkCommandBufferSubmitInfo command_buffer_submit_info = {
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
-			.commandBuffer = upload_command_buffer,
-		};
+		batch_start = batch_end;
+	}
+}
 
-		VkSubmitInfo2 submit_info = {
-			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
-			.waitSemaphoreInfoCount = 0,
-			.commandBufferInfoCount = 1,
-			.pCommandBufferInfos = &command_buffer_submit_info,
-			.signalSemaphoreInfoCount = 0,
-		};
-		vkQueueSubmit2(gfx_context->gfx_queue, 1, &submit_info, VK_NULL_HANDLE);
+// Materials refer to images by slot index
+std::vector<uint32_t> gltf_slot_indices(const std::vector<Slot_Handle>& handles)
+{
+	std::vector<uint32_t> indices(handles.size());
+	for (size_t i = 0; i < handles.size(); i++) indices[i] = handles[i].index;
+	return indices;
+}
+
+std::unique_ptr<fastgltf::Asset> gltf_parse(const std::filesystem::path& gltf_file, Gltf_Buffers* buffers,
+                                            Gltf_Compression* compression)
+{
+	ZoneScopedN("GLTF parsing");
+
+	using namespace fastgltf;
+
+	// Draco is decoded by us, fastgltf would refuse it as unknown required extension. Its small JSON pass is
+	// counted as part of file reading.
+	*compression = {};
+	GltfDataBuffer gltf_data;
+	size_t         json_size;
+	{
+		Load_Timer timer(Load_Phase::FILE_READ);
 
-		// Block entire upload operation
+		Mapped_File file;
+		if (!mapped_file_open(gltf_file, &file))
+		throw std::runtime_error("GLTF Problem");
+
+		std::string_view json(reinterpret_cast<const char*>(file.data), file.size);
+		std::string      patched_json;
+
+		if (json.find(GLTF_DRACO_EXTENSION) != std::string_view::npos)
 		{
-			ZoneScopedN("Upload command execution");
-			vkDeviceWaitIdle(gfx_context->device);
+			gltf_read_draco_primitives(json, compression);
+
+			patched_json = json;
+			gltf_hide_required_extension(&patched_json, GLTF_DRACO_EXTENSION);
+			json = patched_json;
 		}
+
+		gltf_data.copyBytes(reinterpret_cast<const uint8_t*>(json.data()), json.size());
+		json_size   = json.size();
+		timer.bytes = file.size;
+		mapped_file_close(&file);
 	}
 
+	Parser parser(Extensions::KHR_mesh_quantization | Extensions::EXT_meshopt_compression
+	              | Extensions::KHR_texture_basisu);
+
+	std::unique_ptr<Asset> asset;
 	{
-		ZoneScopedN("Destroy command buffers");
-		vkFreeCommandBuffers(gfx_context->device, upload_command_pool, 1, &upload_command_buffer);
-		vkDestroyCommandPool(gfx_context->device, upload_command_pool, nullptr);
-	}
+		Load_Timer timer(Load_Phase::JSON_PARSE, json_size);
 
-	auto finish_time = std::chrono::high_resolution_clock::now();
-	auto duration = std::chrono::duration_cast<std::chrono::duration<float>>(finish_time - start_time);
-	spdlog::info("Scene loaded! [{:.2f}s]", duration.count());
+		// Buffers are mapped below, images are read by gltf_image_open(), when they are needed
+		auto gltf = parser.loadGLTF(&gltf_data, gltf_file.parent_path(), Options::None);
 
-	// Temporary write to descriptor.
-	// This is vallid only for now, as we don't have support for dynamic
-	// texture streaming. Everything is loaded up-front.
-	
-	// Bind uniform buffer
-	VkDescriptorBufferInfo global_uniform_descriptor = {
-		.buffer = renderer->global_uniform_data_buffer.buffer,
-		.offset = 0,
-		.range  = sizeof(Global_Uniform_Data),
-	};
+		if (gltf->parse() != Error::None)
+		throw std::runtime_error("GLTF Problem");
 
-	// Samplers
-	std::vector<VkDescriptorImageInfo> sampler_descriptor_updates;
-	for (uint32_t sampler_index = 0; sampler_index < texture_manager->images.size(); sampler_index++)
-	{
-		VkDescriptorImageInfo update_info = { .sampler = texture_manager->samplers[0] };
-		sampler_descriptor_updates.push_back(update_info);
+		asset = gltf->getParsedAsset();
 	}
 
-	// Images
-	std::vector<VkDescriptorImageInfo> image_descriptor_updates;
-	for (uint32_t image_index = 0; image_index < texture_manager->images.size(); image_index++)
+	compression->draco_primitives.resize(asset->meshes.size());
+	for (size_t mesh_index = 0; mesh_index < asset->meshes.size(); mesh_index++)
 	{
-		VkDescriptorImageInfo update_info = {
-			.imageView   = texture_manager->images[image_index].view,
-			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		};
-		image_descriptor_updates.push_back(update_info);
+		compression->draco_primitives[mesh_index].resize(asset->meshes[mesh_index].primitives.size());
 	}
 
-	// Bind material storage buffer
-	VkDescriptorBufferInfo material_storage_descriptor = {
-		.buffer = material_manager->material_storage_buffer.buffer,
-		.offset = 0,
-		.range  = 40000,
-	};
+	gltf_map_buffers(*asset, gltf_file.parent_path(), buffers);
+	gltf_decode_meshopt_views(*asset, *buffers, compression);
+
+	return asset;
+}
+
+Gltf_Buffers::~Gltf_Buffers()
+{
+	for (auto& file : files) mapped_file_close(&file);
+}
+
+void gltf_map_buffers(const fastgltf::Asset& asset, const std::filesystem::path& directory, Gltf_Buffers* buffers)
+{
+	ZoneScopedN("Buffer mapping");
+	Load_Timer timer(Load_Phase::FILE_READ);
+
+	using namespace fastgltf;
 
-	VkWriteDescriptorSet descriptor_set_writes[] = {
-		{
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet          = renderer->global_data_descriptor_set,
-			.dstBinding      = 0,
-			.dstArrayElement = 0,
-			.descriptorCount = 1,
-			.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-			.pBufferInfo     = &global_uniform_descriptor,
-		},
-		{
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet          = renderer->global_data_descriptor_set,
-			.dstBinding      = 1,
-			.dstArrayElement = 0,
-			.descriptorCount = static_cast<uint32_t>(sampler_descriptor_updates.size()),
-			.descriptorType  = VK_DESCRIPTOR_TYPE_SAMPLER,
-			.pImageInfo      = sampler_descriptor_updates.data(),
-		},
-		{
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet          = renderer->global_data_descriptor_set,
-			.dstBinding      = 2,
-			.dstArrayElement = 0,
-			.descriptorCount = static_cast<uint32_t>(image_descriptor_updates.size()),
-			.descriptorType  = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-			.pImageInfo      = image_descriptor_updates.data(),
-		},
-		{
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet          = renderer->global_data_descriptor_set,
-			.dstBinding      = 3,
-			.dstArrayElement = 0,
-			.descriptorCount = 1,
-			.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.pBufferInfo     = &material_storage_descriptor,
-		},
+	buffers->bytes.resize(asset.buffers.size());
+	for (size_t buffer_index = 0; buffer_index < asset.buffers.size(); buffer_index++)
+	{
+		auto& buffer = asset.buffers[buffer_index];
+
+		const uint8_t* data;
+		size_t         size;
+		if (auto uri = std::get_if<sources::URI>(&buffer.data))
+		{
+			Mapped_File file;
+			if (!uri->uri.isLocalPath() || !mapped_file_open(directory / uri->uri.fspath(), &file))
+			throw std::runtime_error("GLTF Problem");
+
+			buffers->files.push_back(file);
+			if (uri->fileByteOffset > file.size)
+			throw std::runtime_error("GLTF Problem");
+
+			data = file.data + uri->fileByteOffset;
+			size = file.size - uri->fileByteOffset;
+		}
+		else if (auto vector = std::get_if<sources::Vector>(&buffer.data))
+		{
+			data = vector->bytes.data();
+			size = vector->bytes.size();
+		}
+		else
+		{
+			throw std::runtime_error("GLTF Problem");
+		}
+
+		// Views are checked against this, file can be bigger than buffer
+		if (size < buffer.byteLength)
+		throw std::runtime_error("GLTF Problem");
+
+		buffers->bytes[buffer_index] = { data, buffer.byteLength };
+		timer.bytes += buffer.byteLength;
+	}
+}
+
+void gltf_read_draco_primitives(std::string_view json, Gltf_Compression* compression)
+{
+	simdjson::dom::parser   parser;
+	simdjson::dom::element  root;
+	simdjson::dom::array    meshes;
+	if (parser.parse(json.data(), json.size()).get(root) || root["meshes"].get(meshes))
+	throw std::runtime_error("GLTF Problem");
+
+	for (simdjson::dom::element mesh : meshes)
+	{
+		auto& mesh_primitives = compression->draco_primitives.emplace_back();
+
+		simdjson::dom::array primitives;
+		if (mesh["primitives"].get(primitives))
+		throw std::runtime_error("GLTF Problem");
+
+		for (simdjson::dom::element primitive : primitives)
+		{
+			auto& draco = mesh_primitives.emplace_back();
+
+			simdjson::dom::object extension;
+			if (primitive.at_pointer("/extensions/KHR_draco_mesh_compression").get(extension)) continue;
+
+			uint64_t              buffer_view;
+			simdjson::dom::object attributes;
+			if (extension["bufferView"].get(buffer_view) || extension["attributes"].get(attributes))
+			throw std::runtime_error("GLTF Problem");
+
+			draco = Gltf_Draco_Primitive { .buffer_view = buffer_view };
+			for (auto [name, id] : attributes)
+			{
+				uint64_t id_value;
+				if (id.get(id_value))
+				throw std::runtime_error("GLTF Problem");
+
+				draco->attributes.emplace_back(std::string(name), static_cast<uint32_t>(id_value));
+			}
+		}
+	}
+}
+
+void gltf_hide_required_extension(std::string* json, std::string_view extension)
+{
+	// Extension name in extensionsRequired is overwritten with one we always enable, padded by whitespace
+	constexpr std::string_view replacement = "\"KHR_mesh_quantization\"";
+
+	size_t key = json->find("\"extensionsRequired\"");
+	if (key == std::string::npos) return;
+
+	size_t array_begin = json->find('[', key);
+	size_t array_end   = json->find(']', key);
+	if (array_begin == std::string::npos || array_end == std::string::npos)
+	throw std::runtime_error("GLTF Problem");
+
+	std::string quoted = "\"" + std::string(extension) + "\"";
+	size_t position = json->find(quoted, array_begin);
+	if (position == std::string::npos || position > array_end) return;
+
+	std::string padded = std::string(replacement) + std::string(quoted.size() - replacement.size(), ' ');
+	json->replace(position, quoted.size(), padded);
+}
+
+void gltf_decode_meshopt_views(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                               Gltf_Compression* compression)
+{
+	ZoneScopedN("Meshopt decoding");
+	Load_Timer timer(Load_Phase::VERTEX_TRANSCODE);
+
+	using namespace fastgltf;
+
+	compression->meshopt_views.resize(asset.bufferViews.size());
+
+	parallel_for(asset.bufferViews.size(), [&](size_t view_index)
+	{
+		auto& buffer_view = asset.bufferViews[view_index];
+		if (!buffer_view.meshoptCompression) return;
+
+		ZoneScopedN("Meshopt view decode");
+
+		// Compressed data lives in different buffer than the view (which points to fallback one)
+		auto& meshopt = *buffer_view.meshoptCompression;
+		auto& data    = buffers.bytes[meshopt.bufferIndex];
+		if (meshopt.byteOffset + meshopt.byteLength > data.size())
+		throw std::runtime_error("GLTF Problem");
+
+		const uint8_t* source  = data.data() + meshopt.byteOffset;
+		auto&          decoded = compression->meshopt_views[view_index];
+		decoded.resize(meshopt.count * meshopt.byteStride);
+		timer.bytes += decoded.size();
+
+		int result;
+		switch (meshopt.mode)
+		{
+		case MeshoptCompressionMode::Attributes:
+			result = meshopt_decodeVertexBuffer(decoded.data(), meshopt.count, meshopt.byteStride,
+			                                    source, meshopt.byteLength);
+			break;
+		case MeshoptCompressionMode::Triangles:
+			result = meshopt_decodeIndexBuffer(decoded.data(), meshopt.count, meshopt.byteStride,
+			                                   source, meshopt.byteLength);
+			break;
+		case MeshoptCompressionMode::Indices:
+			result = meshopt_decodeIndexSequence(decoded.data(), meshopt.count, meshopt.byteStride,
+			                                     source, meshopt.byteLength);
+			break;
+		default:
+			throw std::runtime_error("GLTF Problem");
+		}
+
+		if (result != 0)
+		throw std::runtime_error("GLTF Problem");
+
+		switch (meshopt.filter)
+		{
+		case MeshoptCompressionFilter::None:
+			break;
+		case MeshoptCompressionFilter::Octahedral:
+			meshopt_decodeFilterOct(decoded.data(), meshopt.count, meshopt.byteStride);
+			break;
+		case MeshoptCompressionFilter::Quaternion:
+			meshopt_decodeFilterQuat(decoded.data(), meshopt.count, meshopt.byteStride);
+			break;
+		case MeshoptCompressionFilter::Exponential:
+			meshopt_decodeFilterExp(decoded.data(), meshopt.count, meshopt.byteStride);
+			break;
+		}
+	});
+}
+
+void gltf_decode_draco(const fastgltf::Asset& asset, const Gltf_Buffers& buffers, const Gltf_Draco_Primitive& draco,
+                       Gltf_Draco_Data* decoded)
+{
+	ZoneScopedN("Draco decode");
+
+	using namespace fastgltf;
+
+	if (draco.buffer_view >= asset.bufferViews.size())
+	throw std::runtime_error("GLTF Problem");
+
+	auto& buffer_view = asset.bufferViews[draco.buffer_view];
+	auto& data        = buffers.bytes[buffer_view.bufferIndex];
+	if (buffer_view.byteOffset + buffer_view.byteLength > data.size())
+	throw std::runtime_error("GLTF Problem");
+
+	draco::DecoderBuffer buffer;
+	buffer.Init(reinterpret_cast<const char*>(data.data() + buffer_view.byteOffset), buffer_view.byteLength);
+
+	draco::Decoder decoder;
+	auto result = decoder.DecodeMeshFromBuffer(&buffer);
+	if (!result.ok())
+	{
+		spdlog::error("Draco decoding failed: {}", result.status().error_msg_string());
+		throw std::runtime_error("GLTF Problem");
+	}
+	std::unique_ptr<draco::Mesh> mesh = std::move(result).value();
+
+	decoded->indices_storage.resize(size_t(mesh->num_faces()) * 3);
+	for (draco::FaceIndex face(0); face < mesh->num_faces(); ++face)
+	{
+		auto& corners = mesh->face(face);
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			decoded->indices_storage[face.value() * 3 + corner] = corners[corner].value();
+		}
+	}
+	decoded->indices = {
+		.data           = reinterpret_cast<const uint8_t*>(decoded->indices_storage.data()),
+		.stride         = sizeof(uint32_t),
+		.count          = decoded->indices_storage.size(),
+		.type           = AccessorType::Scalar,
+		.component_type = ComponentType::UnsignedInt,
+	};
+
+	// Attributes are expanded per point (Draco dedupes values), in whatever type they were decoded to
+	decoded->attributes_storage.resize(draco.attributes.size());
+	for (size_t attribute_index = 0; attribute_index < draco.attributes.size(); attribute_index++)
+	{
+		auto& [name, id] = draco.attributes[attribute_index];
+
+		const draco::PointAttribute* attribute = mesh->GetAttributeByUniqueId(id);
+		if (attribute == nullptr)
+		throw std::runtime_error("GLTF Problem");
+
+		ComponentType component_type;
+		switch (attribute->data_type())
+		{
+		case draco::DT_INT8:    component_type = ComponentType::Byte;          break;
+		case draco::DT_UINT8:   component_type = ComponentType::UnsignedByte;  break;
+		case draco::DT_INT16:   component_type = ComponentType::Short;         break;
+		case draco::DT_UINT16:  component_type = ComponentType::UnsignedShort; break;
+		case draco::DT_FLOAT32: component_type = ComponentType::Float;         break;
+		default:
+			throw std::runtime_error("GLTF Problem");
+		}
+
+		AccessorType types[] = { AccessorType::Scalar, AccessorType::Vec2, AccessorType::Vec3, AccessorType::Vec4 };
+		if (attribute->num_components() < 1 || attribute->num_components() > 4)
+		throw std::runtime_error("GLTF Problem");
+
+		size_t stride   = static_cast<size_t>(attribute->byte_stride());
+		auto&  storage  = decoded->attributes_storage[attribute_index];
+		storage.resize(mesh->num_points() * stride);
+		for (draco::PointIndex point(0); point < mesh->num_points(); ++point)
+		{
+			attribute->GetMappedValue(point, storage.data() + point.value() * stride);
+		}
+
+		decoded->attributes.emplace_back(name, Gltf_Accessor_View {
+			.data           = storage.data(),
+			.stride         = stride,
+			.count          = mesh->num_points(),
+			.type           = types[attribute->num_components() - 1],
+			.component_type = component_type,
+			.normalized     = attribute->normalized(),
+		});
+	}
+}
+
+Gltf_Image_Bytes gltf_image_open(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                 const fastgltf::Image& image, const std::filesystem::path& directory)
+{
+	Gltf_Image_Bytes bytes = {};
+
+	if (auto uri = std::get_if<fastgltf::sources::URI>(&image.data))
+	{
+		if (!uri->uri.isLocalPath() || !mapped_file_open(directory / uri->uri.fspath(), &bytes.file) ||
+		    uri->fileByteOffset > bytes.file.size)
+		throw std::runtime_error("GLTF Problem");
+
+		bytes.mapped = true;
+		bytes.data   = bytes.file.data + uri->fileByteOffset;
+		bytes.size   = bytes.file.size - uri->fileByteOffset;
+	}
+	else if (auto vector = std::get_if<fastgltf::sources::Vector>(&image.data))
+	{
+		// Data URI, decoded by parser
+		bytes.data = vector->bytes.data();
+		bytes.size = vector->bytes.size();
+	}
+	else if (auto view = std::get_if<fastgltf::sources::BufferView>(&image.data))
+	{
+		auto& buffer_view = asset.bufferViews[view->bufferViewIndex];
+		auto& buffer      = buffers.bytes[buffer_view.bufferIndex];
+		if (buffer_view.byteOffset + buffer_view.byteLength > buffer.size())
+		throw std::runtime_error("GLTF Problem");
+
+		bytes.data = buffer.data() + buffer_view.byteOffset;
+		bytes.size = buffer_view.byteLength;
+	}
+	else
+	{
+		throw std::runtime_error("GLTF Problem");
+	}
+
+	return bytes;
+}
+
+void gltf_image_close(Gltf_Image_Bytes* bytes)
+{
+	if (bytes->mapped) mapped_file_close(&bytes->file);
+	*bytes = {};
+}
+
+// Decodes image to RGBA8 straight into destination, which has to be texels_size bytes. stb_image can't decode into
+// caller's buffer, so its output allocation is given the destination (see stbi_target_malloc()). Returns false if
+// image can't be decoded, or doesn't have the expected size.
+bool gltf_decode_image(const Gltf_Image_Bytes& bytes, uint8_t* destination, size_t texels_size)
+{
+	gltf_decode_target = { .data = destination, .size = texels_size, .taken = false };
+
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load_from_memory(bytes.data, static_cast<int>(bytes.size),
+	                                        &width, &height, &channels, STBI_rgb_alpha);
+
+	bool decoded = pixels != nullptr && static_cast<size_t>(width) * height * 4 == texels_size;
+
+	// Temporary buffer of the same size could have taken destination before output did, then it's copied
+	if (decoded && pixels != destination) memcpy(destination, pixels, texels_size);
+
+	if (pixels != nullptr) stbi_image_free(pixels); // Destination isn't freed, it's still the target
+	gltf_decode_target = {};
+
+	return decoded;
+}
+
+// First allocation of the exact size of decode target gets it, the rest goes to the heap
+void* stbi_target_malloc(size_t size)
+{
+	auto& target = gltf_decode_target;
+	if (target.data != nullptr && !target.taken && size == target.size)
+	{
+		target.taken = true;
+		return target.data;
+	}
+	return malloc(size);
+}
+
+void* stbi_target_realloc(void* pointer, size_t size)
+{
+	auto& target = gltf_decode_target;
+	if (pointer == nullptr || pointer != target.data) return realloc(pointer, size);
+
+	// Target can't grow, its content moves to the heap
+	void* moved = malloc(size);
+	if (moved != nullptr) memcpy(moved, pointer, std::min(size, target.size));
+	return moved;
+}
+
+void stbi_target_free(void* pointer)
+{
+	if (pointer == nullptr || pointer != gltf_decode_target.data) free(pointer);
+}
+
+std::vector<size_t> gltf_unique_images(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                       const std::filesystem::path& directory, std::vector<uint32_t>* unique_map)
+{
+	ZoneScopedN("Image deduplication");
+
+	// Hashing encoded bytes is way cheaper than decoding them
+	// First time image files are touched, so it's where they are read from disk
+	std::vector<uint64_t> hashes(asset.images.size());
+	parallel_for(asset.images.size(), [&](size_t image_index)
+	{
+		Load_Timer timer(Load_Phase::FILE_READ);
+
+		Gltf_Image_Bytes bytes = gltf_image_open(asset, buffers, asset.images[image_index], directory);
+		hashes[image_index] = content_hash(bytes.data, bytes.size);
+		timer.bytes = bytes.size;
+		gltf_image_close(&bytes);
+	});
+
+	// Hash only finds candidates, bytes decide, so a collision can't give material wrong texture. Comparing only
+	// costs something for real duplicates.
+	std::vector<size_t>                         unique_images;
+	std::unordered_multimap<uint64_t, uint32_t> unique_by_hash;
+	unique_map->resize(asset.images.size());
+	for (size_t image_index = 0; image_index < asset.images.size(); image_index++)
+	{
+		auto [first, last] = unique_by_hash.equal_range(hashes[image_index]);
+		auto same = std::find_if(first, last, [&](auto& candidate)
+		{
+			return gltf_images_equal(asset, buffers, directory, unique_images[candidate.second], image_index);
+		});
+		if (same == last)
+		{
+			same = unique_by_hash.emplace(hashes[image_index], static_cast<uint32_t>(unique_images.size()));
+			unique_images.push_back(image_index);
+		}
+		(*unique_map)[image_index] = same->second;
+	}
+
+	if (unique_images.size() < asset.images.size())
+	{
+		spdlog::info("{} of {} images are duplicates", asset.images.size() - unique_images.size(), asset.images.size());
+	}
+
+	return unique_images;
+}
+
+bool gltf_images_equal(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                       const std::filesystem::path& directory, size_t first_image, size_t second_image)
+{
+	ZoneScopedN("Image comparison");
+
+	Gltf_Image_Bytes first  = gltf_image_open(asset, buffers, asset.images[first_image], directory);
+	Gltf_Image_Bytes second = gltf_image_open(asset, buffers, asset.images[second_image], directory);
+
+	bool equal = first.size == second.size && memcmp(first.data, second.data, first.size) == 0;
+
+	gltf_image_close(&first);
+	gltf_image_close(&second);
+	return equal;
+}
+
+bool gltf_image_is_ktx2(const Gltf_Image_Bytes& bytes)
+{
+	return bytes.size >= sizeof(GLTF_KTX2_IDENTIFIER)
+	       && memcmp(bytes.data, GLTF_KTX2_IDENTIFIER, sizeof(GLTF_KTX2_IDENTIFIER)) == 0;
+}
+
+Gltf_Ktx2_Info gltf_ktx2_info(const Gltf_Image_Bytes& bytes, bool bc_supported)
+{
+	// Header only, without image data
+	ktxTexture2* texture;
+	if (ktxTexture2_CreateFromMemory(bytes.data, bytes.size, KTX_TEXTURE_CREATE_NO_FLAGS, &texture) != KTX_SUCCESS)
+	throw std::runtime_error("GLTF Problem");
+
+	// Basis Universal (ETC1S or UASTC) gets transcoded, BC7 is the only target that keeps UASTC quality. Without BC
+	// support it's RGBA8, which is 4 times bigger, but samples anywhere.
+	VkFormat format = static_cast<VkFormat>(texture->vkFormat);
+	if (ktxTexture2_NeedsTranscoding(texture))
+	{
+		bool srgb = ktxTexture2_GetOETF(texture) == KHR_DF_TRANSFER_SRGB;
+		if (bc_supported) format = srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+		else              format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	Gltf_Ktx2_Info info = {
+		.format      = format,
+		.width       = texture->baseWidth,
+		.height      = texture->baseHeight,
+		.mip_levels  = texture->numLevels,
+		.texels_size = texture_mip_chain_size(format, texture->baseWidth, texture->baseHeight, texture->numLevels),
+	};
+	bool plain_2d = texture->numDimensions == 2 && texture->numFaces == 1 && texture->numLayers == 1;
+
+	ktxTexture_Destroy(ktxTexture(texture));
+
+	// Cubemaps, arrays and formats we can't upload
+	if (!plain_2d || info.texels_size == 0)
+	throw std::runtime_error("GLTF Problem");
+
+	// Already block compressed ones are uploaded as they are
+	if (!bc_supported && texture_format_is_bc(format))
+	{
+		spdlog::error("KTX2 image is BC compressed, but device doesn't support BC textures");
+		throw std::runtime_error("GLTF Problem");
+	}
+
+	return info;
+}
+
+void gltf_transcode_ktx2(const Gltf_Image_Bytes& bytes, const Gltf_Ktx2_Info& info, uint8_t* destination)
+{
+	ZoneScopedN("KTX2 transcode");
+
+	// Supercompression (zstd) is inflated on creation
+	ktxTexture2* texture;
+	if (ktxTexture2_CreateFromMemory(bytes.data, bytes.size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &texture)
+	    != KTX_SUCCESS)
+	throw std::runtime_error("GLTF Problem");
+
+	ktx_transcode_fmt_e target = texture_format_is_bc(info.format) ? KTX_TTF_BC7_RGBA : KTX_TTF_RGBA32;
+	bool transcoded = !ktxTexture2_NeedsTranscoding(texture)
+	                  || ktxTexture2_TranscodeBasis(texture, target, 0) == KTX_SUCCESS;
+
+	// Levels are stored smallest first in KTX2, we want largest first
+	size_t offset = 0;
+	for (uint32_t level = 0; transcoded && level < info.mip_levels; level++)
+	{
+		size_t level_size = texture_level_size(info.format, std::max(info.width >> level, 1u),
+		                                       std::max(info.height >> level, 1u));
+
+		ktx_size_t level_offset;
+		if (ktxTexture_GetImageOffset(ktxTexture(texture), level, 0, 0, &level_offset) != KTX_SUCCESS ||
+		    ktxTexture_GetImageSize(ktxTexture(texture), level) != level_size)
+		{
+			transcoded = false;
+			break;
+		}
+
+		memcpy(destination + offset, ktxTexture_GetData(ktxTexture(texture)) + level_offset, level_size);
+		offset += level_size;
+	}
+
+	ktxTexture_Destroy(ktxTexture(texture));
+
+	if (!transcoded)
+	throw std::runtime_error("GLTF Problem");
+}
+
+VkSamplerCreateInfo gltf_sampler_create_info(const fastgltf::Sampler& sampler)
+{
+	using namespace fastgltf;
+
+	VkSamplerAddressMode address_mode_u =
+	(sampler.wrapS == Wrap::ClampToEdge)    ? VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE   :
+	(sampler.wrapS == Wrap::MirroredRepeat) ? VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT :
+	VK_SAMPLER_ADDRESS_MODE_REPEAT; // Wrap::Repeat
+
+	VkSamplerAddressMode address_mode_v =
+	(sampler.wrapT == Wrap::ClampToEdge)    ? VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE   :
+	(sampler.wrapT == Wrap::MirroredRepeat) ? VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT :
+	VK_SAMPLER_ADDRESS_MODE_REPEAT; // Wrap::Repeat
+
+	VkFilter mag_filter = VK_FILTER_LINEAR;
+	if (sampler.magFilter.has_value() && sampler.magFilter.value() == Filter::Nearest)
+	{
+		mag_filter = VK_FILTER_NEAREST; // Mag filter can only have linear or nearest.
+	}
+
+	VkFilter min_filter             = VK_FILTER_LINEAR;
+	VkSamplerMipmapMode mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	if (sampler.minFilter.has_value())
+	{
+		auto gltf_f = sampler.minFilter.value();
+		min_filter = (gltf_f == Filter::NearestMipMapNearest || gltf_f == Filter::NearestMipMapLinear)
+		? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+		mipmap_mode = (gltf_f == Filter::NearestMipMapNearest || gltf_f == Filter::LinearMipMapNearest)
+		? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	}
+
+	// TODO FIX this doesn't work!!! Sampler selection in shader is broken. I'll leave anisotropy off and
+	// low mip max lod for debug purposes
+	VkSamplerCreateInfo sampler_create_info = {
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter        = mag_filter,
+		.minFilter        = min_filter,
+		.mipmapMode       = mipmap_mode,
+		.addressModeU     = address_mode_u,
+		.addressModeV     = address_mode_v,
+		.addressModeW     = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		.mipLodBias       = 0,
+		.anisotropyEnable = false,
+		.maxAnisotropy    = 16,
+		.compareEnable    = false,
+		.compareOp        = VK_COMPARE_OP_NEVER,
+		.borderColor      = VK_BORDER_COLOR_INT_OPAQUE_WHITE,
+		.unnormalizedCoordinates = false,
+	};
+	return sampler_create_info;
+}
+
+PBR_Material gltf_material(const fastgltf::Asset& asset, const fastgltf::Material& material,
+                           const std::vector<uint32_t>& image_map, const std::vector<uint32_t>& sampler_map,
+                           uint32_t default_texture, uint32_t default_sampler)
+{
+	using namespace fastgltf;
+
+	if (!material.pbrData.has_value())
+	throw std::runtime_error("GLTF Problem");
+	const PBRData& pbr_data = material.pbrData.value();
+
+	uint32_t albedo_texture          = default_texture;
+	uint32_t albedo_sampler          = default_sampler;
+	uint32_t metal_roughness_texture = default_texture;
+	uint32_t metal_roughness_sampler = default_sampler;
+
+	// Find base color texture and sampler
+	if (pbr_data.baseColorTexture.has_value())
+	{
+		auto& base_color_texture = pbr_data.baseColorTexture.value();
+
+		if (base_color_texture.texCoordIndex != 0)
+		throw std::runtime_error("GLTF Problem");
+
+		auto image_index = asset.textures[base_color_texture.textureIndex].imageIndex;
+		if (!image_index.has_value())
+		throw std::runtime_error("GLTF Problem");
+		albedo_texture = image_map[image_index.value()];
+
+		auto sampler_index = asset.textures[base_color_texture.textureIndex].samplerIndex;
+		if (sampler_index.has_value())
+		{
+			albedo_sampler = sampler_map[sampler_index.value()];
+		}
+	}
+
+	// Find metalness+roughness texture and sampler
+	if (pbr_data.metallicRoughnessTexture.has_value())
+	{
+		auto& mr_texture = pbr_data.metallicRoughnessTexture.value();
+
+		if (mr_texture.texCoordIndex != 0)
+		throw std::runtime_error("GLTF Problem");
+
+		auto image_index = asset.textures[mr_texture.textureIndex].imageIndex;
+		if (!image_index.has_value())
+		throw std::runtime_error("GLTF Problem");
+		metal_roughness_texture = image_map[image_index.value()];
+
+		auto sampler_index = asset.textures[mr_texture.textureIndex].samplerIndex;
+		if (sampler_index.has_value())
+		{
+			metal_roughness_sampler = sampler_map[sampler_index.value()];
+		}
+	}
+
+	PBR_Material pbr_material = {
+		.albedo_color            = glm::make_vec4(pbr_data.baseColorFactor.data()),
+		.albedo_texture          = albedo_texture,
+		.albedo_sampler          = albedo_sampler,
+		.metalness_factor        = pbr_data.metallicFactor,
+		.roughness_factor        = pbr_data.roughnessFactor,
+		.metal_roughness_texture = metal_roughness_texture,
+		.metal_roughness_sampler = metal_roughness_sampler,
+	};
+	return pbr_material;
+}
+
+std::vector<Gltf_Vertex_Group> gltf_vertex_groups(const fastgltf::Asset& asset, const Gltf_Compression& compression)
+{
+	std::vector<Gltf_Vertex_Group>          groups;
+	std::map<std::array<size_t, 4>, size_t> group_by_accessors;
+
+	for (size_t mesh_index = 0; mesh_index < asset.meshes.size(); mesh_index++)
+	{
+		auto& primitives = asset.meshes[mesh_index].primitives;
+		for (size_t primitive_index = 0; primitive_index < primitives.size(); primitive_index++)
+		{
+			auto& attributes = primitives[primitive_index].attributes;
+			auto  accessor   = [&](const char* name)
+			{
+				auto found = attributes.find(name);
+				return (found != attributes.end()) ? found->second : ~size_t(0);
+			};
+
+			// Primitives without position are left alone, import reports them
+			std::array<size_t, 4> key = {
+				accessor("POSITION"), accessor("NORMAL"), accessor("TANGENT"), accessor("TEXCOORD_0"),
+			};
+			if (compression.draco_primitives[mesh_index][primitive_index].has_value() || key[0] == ~size_t(0))
+			{
+				groups.push_back({ .primitives = { { mesh_index, primitive_index } } });
+				continue;
+			}
+
+			auto [found, inserted] = group_by_accessors.try_emplace(key, groups.size());
+			if (inserted) groups.push_back({});
+			groups[found->second].primitives.emplace_back(mesh_index, primitive_index);
+		}
+	}
+
+	return groups;
+}
+
+size_t gltf_vertex_group_size_bound(const fastgltf::Asset& asset, const Gltf_Vertex_Group& group)
+{
+	auto& [first_mesh, first_primitive] = group.primitives[0];
+	auto&  first        = asset.meshes[first_mesh].primitives[first_primitive];
+	size_t vertex_count = asset.accessors[first.attributes.at("POSITION")].count;
+
+	// Widest vertex is all floats, plus alignment of all regions (and of attribute stream)
+	size_t size = vertex_count * 12 * sizeof(float) + 32;
+	for (auto& [mesh_index, primitive_index] : group.primitives)
+	{
+		auto&  primitive     = asset.meshes[mesh_index].primitives[primitive_index];
+		size_t indices_count = primitive.indicesAccessor.has_value()
+		? asset.accessors[primitive.indicesAccessor.value()].count : 0;
+
+		size_t max_meshlets = meshopt_buildMeshletsBound(indices_count, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+		size += indices_count * sizeof(uint32_t) + max_meshlets * sizeof(Meshlet) + 32;
+	}
+	return size;
+}
+
+VkFormat gltf_attribute_format(const Gltf_Accessor_View& view)
+{
+	using namespace fastgltf;
+
+	// 3 component 8 and 16 bit attributes are read as 4 component ones, padding is zeroed
+	auto components = getNumComponents(view.type);
+	bool normalized = view.normalized;
+	bool two        = components == 2;
+
+	switch (view.component_type)
+	{
+	case ComponentType::Float:
+		return (components == 2) ? VK_FORMAT_R32G32_SFLOAT    :
+		       (components == 3) ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R32G32B32A32_SFLOAT;
+	case ComponentType::Byte:
+		return normalized ? (two ? VK_FORMAT_R8G8_SNORM   : VK_FORMAT_R8G8B8A8_SNORM)
+		                  : (two ? VK_FORMAT_R8G8_SSCALED : VK_FORMAT_R8G8B8A8_SSCALED);
+	case ComponentType::UnsignedByte:
+		return normalized ? (two ? VK_FORMAT_R8G8_UNORM   : VK_FORMAT_R8G8B8A8_UNORM)
+		                  : (two ? VK_FORMAT_R8G8_USCALED : VK_FORMAT_R8G8B8A8_USCALED);
+	case ComponentType::Short:
+		return normalized ? (two ? VK_FORMAT_R16G16_SNORM   : VK_FORMAT_R16G16B16A16_SNORM)
+		                  : (two ? VK_FORMAT_R16G16_SSCALED : VK_FORMAT_R16G16B16A16_SSCALED);
+	case ComponentType::UnsignedShort:
+		return normalized ? (two ? VK_FORMAT_R16G16_UNORM   : VK_FORMAT_R16G16B16A16_UNORM)
+		                  : (two ? VK_FORMAT_R16G16_USCALED : VK_FORMAT_R16G16B16A16_USCALED);
+	default:
+		throw std::runtime_error("GLTF Problem");
+	}
+}
+
+Gltf_Accessor_View gltf_accessor_view(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                      const Gltf_Compression& compression, const fastgltf::Accessor& accessor)
+{
+	using namespace fastgltf;
+
+	// Sparse accessors would have to be expanded first
+	if (!accessor.bufferViewIndex.has_value() || accessor.sparse.has_value())
+	throw std::runtime_error("GLTF Problem");
+
+	size_t view_index   = accessor.bufferViewIndex.value();
+	auto&  buffer_view  = asset.bufferViews[view_index];
+	size_t element_size = getElementByteSize(accessor.type, accessor.componentType);
+	size_t stride       = buffer_view.byteStride.value_or(element_size);
+
+	// Decoded meshopt views are buffers of their own
+	const uint8_t* bytes;
+	size_t         bytes_size;
+	size_t         offset;
+	if (buffer_view.meshoptCompression)
+	{
+		auto& decoded = compression.meshopt_views[view_index];
+		bytes      = decoded.data();
+		bytes_size = decoded.size();
+		offset     = accessor.byteOffset;
+	}
+	else
+	{
+		auto& data = buffers.bytes[buffer_view.bufferIndex];
+		bytes      = data.data();
+		bytes_size = data.size();
+		offset     = buffer_view.byteOffset + accessor.byteOffset;
+	}
+
+	if (accessor.count > 0 && offset + stride * (accessor.count - 1) + element_size > bytes_size)
+	throw std::runtime_error("GLTF Problem");
+
+	return {
+		.data           = bytes + offset,
+		.stride         = stride,
+		.count          = accessor.count,
+		.type           = accessor.type,
+		.component_type = accessor.componentType,
+		.normalized     = accessor.normalized,
+	};
+}
+
+std::vector<uint32_t> gltf_read_indices(const Gltf_Accessor_View& view)
+{
+	using namespace fastgltf;
+
+	std::vector<uint32_t> indices(view.count);
+	for (size_t i = 0; i < view.count; i++)
+	{
+		const uint8_t* index = view.data + i * view.stride;
+		switch (view.component_type)
+		{
+		case ComponentType::UnsignedByte:
+			indices[i] = *index;
+			break;
+		case ComponentType::UnsignedShort:
+			uint16_t short_index;
+			memcpy(&short_index, index, sizeof(short_index));
+			indices[i] = short_index;
+			break;
+		case ComponentType::UnsignedInt:
+			memcpy(&indices[i], index, sizeof(uint32_t));
+			break;
+		default:
+			throw std::runtime_error("GLTF Problem");
+		}
+	}
+	return indices;
+}
+
+// Same as fixed function vertex fetch does for the format
+float gltf_decode_component(const Gltf_Accessor_View& view, const uint8_t* component)
+{
+	using namespace fastgltf;
+
+	switch (view.component_type)
+	{
+	case ComponentType::Float:
+		float value;
+		memcpy(&value, component, sizeof(value));
+		return value;
+	case ComponentType::Byte:
+		return view.normalized ? std::max(*reinterpret_cast<const int8_t*>(component) / 127.0f, -1.0f)
+		                       : *reinterpret_cast<const int8_t*>(component);
+	case ComponentType::UnsignedByte:
+		return view.normalized ? *component / 255.0f : *component;
+	case ComponentType::Short:
+		int16_t short_value;
+		memcpy(&short_value, component, sizeof(short_value));
+		return view.normalized ? std::max(short_value / 32767.0f, -1.0f) : short_value;
+	case ComponentType::UnsignedShort:
+		uint16_t ushort_value;
+		memcpy(&ushort_value, component, sizeof(ushort_value));
+		return view.normalized ? ushort_value / 65535.0f : ushort_value;
+	default:
+		throw std::runtime_error("GLTF Problem");
+	}
+}
+
+// Missing components (and whole element of missing attribute) are zeroes
+glm::vec4 gltf_decode_element(const Gltf_Accessor_View& view, size_t index)
+{
+	glm::vec4 element(0.0f);
+	if (view.data == nullptr) return element;
+
+	size_t         component_size = fastgltf::getComponentByteSize(view.component_type);
+	size_t         components     = std::min<size_t>(fastgltf::getNumComponents(view.type), 4);
+	const uint8_t* data           = view.data + index * view.stride;
+	for (size_t component = 0; component < components; component++)
+	{
+		element[component] = gltf_decode_component(view, data + component * component_size);
+	}
+	return element;
+}
+
+std::vector<glm::vec3> gltf_decode_positions(const Gltf_Accessor_View& view)
+{
+	size_t component_size = fastgltf::getComponentByteSize(view.component_type);
+
+	std::vector<glm::vec3> positions(view.count);
+	for (size_t i = 0; i < view.count; i++)
+	{
+		const uint8_t* element = view.data + i * view.stride;
+		positions[i] = { gltf_decode_component(view, element), gltf_decode_component(view, element + component_size),
+		                 gltf_decode_component(view, element + 2 * component_size) };
+	}
+	return positions;
+}
+
+// Octahedron is unfolded into [-1, 1] square, lower half is folded over the diagonals
+glm::vec2 gltf_octahedral_encode(glm::vec3 direction)
+{
+	float length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+	if (length == 0.0f) return glm::vec2(0.0f);
+
+	glm::vec2 encoded = glm::vec2(direction) / length;
+	if (direction.z < 0.0f)
+	{
+		glm::vec2 sign = glm::vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+		encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+	}
+	return encoded;
+}
+
+// Positions are already decoded and in new order, other attributes are read from source_vertices. Positions are
+// quantized to their bounds, which are returned as offset and scale (position = offset + scale * quantized).
+// Destination is vertex region (see vertex_region_size()).
+void gltf_pack_vertices(const std::vector<glm::vec3>& positions, const Gltf_Accessor_View& normal_view,
+                        const Gltf_Accessor_View& tangent_view, const Gltf_Accessor_View& texcoord_view,
+                        const std::vector<uint32_t>& source_vertices, uint8_t* destination,
+                        glm::vec3* position_offset, glm::vec3* position_scale)
+{
+	ZoneScopedN("Vertex packing");
+
+	size_t vertex_count = source_vertices.size();
+
+	glm::vec3 min_position(std::numeric_limits<float>::max());
+	glm::vec3 max_position(std::numeric_limits<float>::lowest());
+	for (size_t vertex = 0; vertex < vertex_count; vertex++)
+	{
+		min_position = glm::min(min_position, positions[vertex]);
+		max_position = glm::max(max_position, positions[vertex]);
+	}
+	if (vertex_count == 0) min_position = max_position = glm::vec3(0.0f);
+
+	*position_offset = min_position;
+	*position_scale  = max_position - min_position;
+
+	// Flat axis quantizes to 0, scale is 0 for it
+	glm::vec3 inverse_scale;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		inverse_scale[axis] = ((*position_scale)[axis] > 0.0f) ? 1.0f / (*position_scale)[axis] : 0.0f;
+	}
+
+	VkDeviceSize attributes_offset      = vertex_attributes_offset(PACKED_VERTEX_FORMAT, uint32_t(vertex_count));
+	uint8_t*     positions_destination  = destination;
+	uint8_t*     attributes_destination = destination + attributes_offset;
+	for (size_t vertex = 0; vertex < vertex_count; vertex++)
+	{
+		size_t    source   = source_vertices[vertex];
+		glm::vec3 position = (positions[vertex] - min_position) * inverse_scale;
+		glm::vec4 tangent  = gltf_decode_element(tangent_view, source);
+		glm::vec2 normal   = gltf_octahedral_encode(glm::vec3(gltf_decode_element(normal_view, source)));
+		glm::vec2 texcoord = glm::vec2(gltf_decode_element(texcoord_view, source));
+		glm::vec2 tangent_direction = gltf_octahedral_encode(glm::vec3(tangent));
+
+		Gltf_Packed_Vertex vertex = {
+			.position = {
+				static_cast<uint16_t>(meshopt_quantizeUnorm(position.x, 16)),
+				static_cast<uint16_t>(meshopt_quantizeUnorm(position.y, 16)),
+				static_cast<uint16_t>(meshopt_quantizeUnorm(position.z, 16)),
+				static_cast<uint16_t>(tangent.w < 0.0f ? 0 : 0xFFFF),
+			},
+			.attributes = {
+				.normal = {
+					static_cast<int16_t>(meshopt_quantizeSnorm(normal.x, 16)),
+					static_cast<int16_t>(meshopt_quantizeSnorm(normal.y, 16)),
+				},
+				.tangent = {
+					static_cast<int16_t>(meshopt_quantizeSnorm(tangent_direction.x, 16)),
+					static_cast<int16_t>(meshopt_quantizeSnorm(tangent_direction.y, 16)),
+				},
+				.texcoord = { meshopt_quantizeHalf(texcoord.x), meshopt_quantizeHalf(texcoord.y) },
+			},
+		};
+		memcpy(positions_destination + vertex * sizeof(vertex.position), vertex.position, sizeof(vertex.position));
+		memcpy(attributes_destination + vertex * sizeof(vertex.attributes), &vertex.attributes,
+		       sizeof(vertex.attributes));
+	}
+}
+
+std::vector<Imported_Primitive> gltf_import_vertex_group(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                                         const Gltf_Compression& compression,
+                                                         const Gltf_Vertex_Group& group,
+                                                         Mapped_Buffer_Writer& writer, Mesh_Import_Stats& stats,
+                                                         bool packed_vertices)
+{
+	using namespace fastgltf;
+
+	for (auto& [mesh_index, primitive_index] : group.primitives)
+	{
+		auto& primitive = asset.meshes[mesh_index].primitives[primitive_index];
+
+		// Right now, only handle triangles (conversion from other types will be implemented later)
+		if (primitive.type != PrimitiveType::Triangles)
+		throw std::runtime_error("GLTF Problem");
+
+		// We don't generate indices as of now
+		if (!primitive.indicesAccessor.has_value())
+		throw std::runtime_error("GLTF Problem");
+	}
+
+	// Vertex attributes are the same for the whole group, they are taken from the first primitive
+	auto& [first_mesh, first_primitive] = group.primitives[0];
+	auto& primitive = asset.meshes[first_mesh].primitives[first_primitive];
+
+	// Check if all required attributes are present
+	bool attributes_present =
+	primitive.attributes.contains("POSITION") &&
+	primitive.attributes.contains("NORMAL") &&
+	primitive.attributes.contains("TEXCOORD_0");
+
+	bool has_tangent = primitive.attributes.contains("TANGENT");
+
+	if (!attributes_present)
+	throw std::runtime_error("GLTF Problem");
+
+	if (!has_tangent)
+	{
+		spdlog::info("Missing tangent!"); // Todo better logging
+	}
+
+	// Draco primitives are decoded here, so it runs in parallel with other primitives. Attributes missing in
+	// Draco data are regular accessors. They are always alone in their group.
+	auto& draco = compression.draco_primitives[first_mesh][first_primitive];
+
+	Gltf_Draco_Data draco_data;
+	if (draco.has_value()) gltf_decode_draco(asset, buffers, *draco, &draco_data);
+
+	auto attribute_view = [&](const char* name)
+	{
+		if (draco.has_value())
+		{
+			for (auto& [draco_name, view] : draco_data.attributes)
+			{
+				if (draco_name == name) return view;
+			}
+		}
+		return gltf_accessor_view(asset, buffers, compression, asset.accessors[primitive.attributes.at(name)]);
+	};
+
+	Gltf_Accessor_View position_view = attribute_view("POSITION");
+	Gltf_Accessor_View normal_view   = attribute_view("NORMAL");
+	Gltf_Accessor_View texcoord_view = attribute_view("TEXCOORD_0");
+	Gltf_Accessor_View tangent_view  = has_tangent ? attribute_view("TANGENT") : Gltf_Accessor_View{};
+
+	// Attributes keep whatever format they have (KHR_mesh_quantization allows 8 and 16 bit ones).
+	// Missing tangents are zeroes, in the smallest format.
+	Vertex_Format vertex_format = {
+		.position = gltf_attribute_format(position_view),
+		.normal   = gltf_attribute_format(normal_view),
+		.tangent  = has_tangent ? gltf_attribute_format(tangent_view) : VK_FORMAT_R8G8B8A8_SNORM,
+		.texcoord = gltf_attribute_format(texcoord_view),
+	};
+
+	auto vertex_stream = [&](const Gltf_Accessor_View& view, VkFormat format)
+	{
+		Vertex_Stream stream = { .size = vertex_attribute_size(format) };
+		if (view.data != nullptr)
+		{
+			// All attributes have matching counts. This is enforced by the specs, but the data is read blindly
+			if (view.count != position_view.count)
+			throw std::runtime_error("GLTF Problem");
+
+			stream.data         = view.data;
+			stream.stride       = view.stride;
+			stream.element_size = static_cast<uint32_t>(getElementByteSize(view.type, view.component_type));
+		}
+		return stream;
+	};
+
+	Vertex_Stream streams[] = {
+		vertex_stream(position_view, vertex_format.position),
+		vertex_stream(normal_view,   vertex_format.normal),
+		vertex_stream(tangent_view,  vertex_format.tangent),
+		vertex_stream(texcoord_view, vertex_format.texcoord),
+	};
+
+	// Streams keep formats of the attributes, they are only interleaved if vertices aren't packed
+	if (packed_vertices) vertex_format = PACKED_VERTEX_FORMAT;
+
+	size_t attr_count = position_view.count;
+
+	// Positions as seen by vertex shader, for overdraw heuristics and meshlet bounds
+	std::vector<glm::vec3> positions = gltf_decode_positions(position_view);
+
+	// Optimize every primitive for post-transform vertex cache, then for overdraw. Then vertices are remapped in
+	// order of first use by any of them (fetch locality). Vertices not referenced by any triangle are dropped.
+
+	struct Group_Primitive
+	{
+		std::vector<uint32_t> indices;
+		VkIndexType           index_type;
+		size_t                transformed_before;
+	};
+
+	std::vector<Group_Primitive> group_primitives(group.primitives.size());
+	std::vector<uint32_t>        group_indices;
+	for (size_t group_index = 0; group_index < group.primitives.size(); group_index++)
+	{
+		auto& [mesh_index, primitive_index] = group.primitives[group_index];
+		auto& group_primitive = group_primitives[group_index];
+
+		auto& indices_index    = asset.meshes[mesh_index].primitives[primitive_index].indicesAccessor;
+		auto& indices_accessor = asset.accessors[indices_index.value()];
+
+		Gltf_Accessor_View indices_view = draco.has_value()
+		? draco_data.indices : gltf_accessor_view(asset, buffers, compression, indices_accessor);
+
+		// Indices can be 8, 16 or 32 bit. There's no 8 bit index type without extension, so those are widened.
+		// Draco decodes 32 bit ones, but values still fit accessor's type.
+		switch (indices_accessor.componentType)
+		{
+		case ComponentType::UnsignedByte:
+		case ComponentType::UnsignedShort:
+			group_primitive.index_type = VK_INDEX_TYPE_UINT16;
+			break;
+		case ComponentType::UnsignedInt:
+			group_primitive.index_type = VK_INDEX_TYPE_UINT32;
+			break;
+		default:
+			throw std::runtime_error("GLTF Problem");
+		}
+
+		auto& indices = group_primitive.indices;
+		indices = gltf_read_indices(indices_view);
+
+		// 16 bit index values are checked too, as Draco ones are decoded as 32 bit
+		uint32_t max_index = (group_primitive.index_type == VK_INDEX_TYPE_UINT32) ? ~0u : 0xFFFF;
+		for (uint32_t index : indices)
+		{
+			if (index >= attr_count || index > max_index)
+			throw std::runtime_error("GLTF Problem");
+		}
+
+		group_primitive.transformed_before = meshopt_analyzeVertexCache(indices.data(), indices.size(), attr_count,
+		                                                                MESH_CACHE_SIZE, 0, 0).vertices_transformed;
+		{
+			ZoneScopedN("Mesh optimization");
+
+			meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), attr_count);
+			meshopt_optimizeOverdraw(indices.data(), indices.data(), indices.size(), &positions[0].x, attr_count,
+			                         sizeof(glm::vec3), 1.05f);
+		}
+
+		group_indices.insert(group_indices.end(), indices.begin(), indices.end());
+	}
+
+	std::vector<uint32_t> remap(attr_count);
+	size_t vertex_count = meshopt_optimizeVertexFetchRemap(remap.data(), group_indices.data(), group_indices.size(),
+	                                                       attr_count);
+	meshopt_remapVertexBuffer(positions.data(), positions.data(), attr_count, sizeof(glm::vec3), remap.data());
+
+	stats.vertices_before += attr_count;
+	stats.vertices_after  += vertex_count;
+
+	// Save offset of vertex region, 16 byte aligned for streaming stores
+	writer.align_next(16);
+	VkDeviceSize vertex_src_offset = writer.offset();
+	VkDeviceSize vertex_size       = vertex_region_size(vertex_format, uint32_t(vertex_count));
+
+	glm::vec3 position_offset = glm::vec3(0.0f);
+	glm::vec3 position_scale  = glm::vec3(1.0f);
+	{
+		ZoneScopedN("Vertex interleaving");
+
+		// Gather vertices in their new order, so mapped memory is written sequentially
+		std::vector<uint32_t> source_vertices(vertex_count);
+		for (size_t offset = 0; offset < attr_count; offset++)
+		{
+			if (remap[offset] != ~0u) source_vertices[remap[offset]] = static_cast<uint32_t>(offset);
+		}
+
+		if (packed_vertices)
+		{
+			gltf_pack_vertices(positions, normal_view, tangent_view, texcoord_view, source_vertices, writer.offset_ptr,
+			                   &position_offset, &position_scale);
+		}
+		else
+		{
+			// Position stream, then the rest interleaved
+			uint8_t* attributes = writer.offset_ptr + vertex_attributes_offset(vertex_format, uint32_t(vertex_count));
+			vertex_interleave(streams, 1, source_vertices.data(), vertex_count, writer.offset_ptr);
+			vertex_interleave(streams + 1, static_cast<uint32_t>(std::size(streams)) - 1, source_vertices.data(),
+			                  vertex_count, attributes);
+		}
+	}
+	writer.advance(vertex_size);
+
+	std::vector<Imported_Primitive> imported_primitives;
+	for (size_t group_index = 0; group_index < group.primitives.size(); group_index++)
+	{
+		auto& [mesh_index, primitive_index] = group.primitives[group_index];
+		auto& group_primitive = group_primitives[group_index];
+		auto& indices         = group_primitive.indices;
+
+		meshopt_remapIndexBuffer(indices.data(), indices.data(), indices.size(), remap.data());
+
+		// Back faces of double-sided materials are visible, so their cones mustn't cull anything
+		auto& material_index = asset.meshes[mesh_index].primitives[primitive_index].materialIndex;
+		bool  double_sided   = material_index.has_value() && asset.materials[material_index.value()].doubleSided;
+
+		Imported_Primitive imported = {
+			.vertex_offset   = vertex_src_offset,
+			.vertex_size     = vertex_size,
+			.vertex_count    = static_cast<uint32_t>(vertex_count),
+			.vertex_format   = vertex_format,
+			.index_type      = group_primitive.index_type,
+			.position_offset = position_offset,
+			.position_scale  = position_scale,
+		};
+		gltf_write_meshlets(indices, positions, vertex_count, double_sided, writer, stats, &imported);
+		stats.transformed_before += group_primitive.transformed_before;
+
+		imported_primitives.push_back(imported);
+	}
+
+	return imported_primitives;
+}
+
+// Meshlets are built from positions (in order of written vertex region), indices are reordered meshlet by meshlet.
+// Fills index and meshlet fields of primitive, its index_type is widened if vertices need it.
+void gltf_write_meshlets(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, size_t vertex_count,
+                         bool double_sided, Mapped_Buffer_Writer& writer, Mesh_Import_Stats& stats,
+                         Imported_Primitive* primitive)
+{
+	size_t indices_count = indices.size();
+
+	// Split into meshlets, and lay out triangles meshlet by meshlet, so each one is a range of indices
+	std::vector<Meshlet> meshlets;
+	{
+		ZoneScopedN("Meshlet building");
+
+		size_t max_meshlets = meshopt_buildMeshletsBound(indices_count, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+		std::vector<meshopt_Meshlet> built_meshlets(max_meshlets);
+		std::vector<uint32_t>        meshlet_vertices(max_meshlets * MESHLET_MAX_VERTICES);
+		std::vector<uint8_t>         meshlet_triangles(max_meshlets * MESHLET_MAX_TRIANGLES * 3);
+
+		size_t meshlet_count = meshopt_buildMeshlets(built_meshlets.data(), meshlet_vertices.data(),
+		                                             meshlet_triangles.data(), indices.data(), indices_count,
+		                                             &positions[0].x, vertex_count, sizeof(glm::vec3),
+		                                             MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, 0.25f);
+
+		size_t first_index = 0;
+		for (size_t meshlet_index = 0; meshlet_index < meshlet_count; meshlet_index++)
+		{
+			auto& built = built_meshlets[meshlet_index];
+			for (size_t corner = 0; corner < built.triangle_count * 3; corner++)
+			{
+				uint8_t local_index = meshlet_triangles[built.triangle_offset + corner];
+				indices[first_index + corner] = meshlet_vertices[built.vertex_offset + local_index];
+			}
+
+			auto bounds = meshopt_computeMeshletBounds(&meshlet_vertices[built.vertex_offset],
+			                                           &meshlet_triangles[built.triangle_offset],
+			                                           built.triangle_count, &positions[0].x, vertex_count,
+			                                           sizeof(glm::vec3));
+
+			meshlets.push_back({
+				.center      = glm::make_vec3(bounds.center),
+				.radius      = bounds.radius,
+				.cone_apex   = glm::make_vec3(bounds.cone_apex),
+				.cone_cutoff = double_sided ? 2.0f : bounds.cone_cutoff,
+				.cone_axis   = glm::make_vec3(bounds.cone_axis),
+				.first_index = static_cast<uint32_t>(first_index),
+				.index_count = built.triangle_count * 3,
+			});
+			first_index += built.triangle_count * 3;
+		}
+		indices_count = first_index; // Degenerate triangles are gone
+	}
+
+	auto cache_after = meshopt_analyzeVertexCache(indices.data(), indices_count, vertex_count, MESH_CACHE_SIZE, 0, 0);
+
+	stats.triangles         += indices_count / 3;
+	stats.meshlets          += meshlets.size();
+	stats.transformed_after += cache_after.vertices_transformed;
+
+	// Shared vertices can be more than 16 bit indices reach, even if every primitive on its own fits
+	VkIndexType index_type = primitive->index_type;
+	if (index_type == VK_INDEX_TYPE_UINT16 && vertex_count > 0x10000 && indices_count > 0 &&
+	    *std::max_element(indices.begin(), indices.begin() + indices_count) > 0xFFFF)
+	{
+		index_type = VK_INDEX_TYPE_UINT32;
+	}
+	size_t index_size = (index_type == VK_INDEX_TYPE_UINT32) ? sizeof(uint32_t) : sizeof(uint16_t);
+
+	// Save offset of indices region
+	writer.align_next(4);
+	VkDeviceSize indices_src_offset = writer.offset();
+
+	// Copy indices
+	if (index_type == VK_INDEX_TYPE_UINT32)
+	{
+		memcpy(writer.offset_ptr, indices.data(), indices_count * sizeof(uint32_t));
+	}
+	else
+	{
+		auto indices_ptr = reinterpret_cast<uint16_t*>(writer.offset_ptr);
+		for (size_t i = 0; i < indices_count; i++)
+		{
+			indices_ptr[i] = static_cast<uint16_t>(indices[i]);
+		}
+	}
+	writer.advance(indices_count * index_size);
+
+	writer.align_next(16);
+	VkDeviceSize meshlets_src_offset = writer.offset();
+	writer.write(meshlets.data(), meshlets.size() * sizeof(Meshlet));
+
+	primitive->indices_offset  = indices_src_offset;
+	primitive->indices_size    = indices_count * index_size;
+	primitive->indices_count   = static_cast<uint32_t>(indices_count);
+	primitive->index_type      = index_type;
+	primitive->meshlets_offset = meshlets_src_offset;
+	primitive->meshlets_count  = static_cast<uint32_t>(meshlets.size());
+}
+
+void gltf_log_import_stats(const Mesh_Import_Stats& stats)
+{
+	if (stats.triangles == 0) return;
+
+	auto acmr = [&](size_t transformed) { return double(transformed) / double(stats.triangles); };
+	auto atvr = [](size_t transformed, size_t vertices) { return double(transformed) / double(vertices); };
+
+	spdlog::info("Meshes: {} triangles, {} meshlets, {} -> {} vertices, ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+	             stats.triangles, stats.meshlets, stats.vertices_before, stats.vertices_after,
+	             acmr(stats.transformed_before), acmr(stats.transformed_after),
+	             atvr(stats.transformed_before, stats.vertices_before),
+	             atvr(stats.transformed_after, stats.vertices_after));
+}
+
+Gltf_Nodes gltf_flatten_nodes(const fastgltf::Asset& asset)
+{
+	using namespace fastgltf;
+
+	Gltf_Nodes nodes;
+
+	// Whole subtrees of animated nodes move with them
+	std::vector<bool> targeted(asset.nodes.size());
+	for (auto& animation : asset.animations)
+	{
+		for (auto& channel : animation.channels)
+		{
+			if (channel.nodeIndex < targeted.size()) targeted[channel.nodeIndex] = true;
+		}
+	}
+
+	struct Enqueued_Node
+	{
+		uint32_t parent;
+		size_t   node_id;
+	};
+	std::vector<Enqueued_Node> nodes_stack;
+
+	// Depth first, children are pushed in reverse, so they come out in order. Root shared by several scenes is
+	// flattened once per scene.
+	for (auto& scene : asset.scenes)
+	{
+		for (auto node_id = scene.nodeIndices.rbegin(); node_id != scene.nodeIndices.rend(); node_id++)
+		{
+			nodes_stack.push_back({ .parent = TRANSFORM_NO_PARENT, .node_id = *node_id });
+		}
+
+		while (!nodes_stack.empty())
+		{
+			Enqueued_Node enqueued_node = nodes_stack.back();
+			nodes_stack.pop_back();
+
+			auto& node = asset.nodes[enqueued_node.node_id];
+
+			// Compose matrix if needed
+			glm::mat4 transform_matrix;
+			if (std::holds_alternative<Node::TransformMatrix>(node.transform))
+			{
+				transform_matrix = glm::make_mat4(std::get<Node::TransformMatrix>(node.transform).data());
+			}
+			else
+			{
+				auto& trs = std::get<Node::TRS>(node.transform);
+				auto t = glm::translate(glm::mat4 { 1.0f }, glm::make_vec3(trs.translation.data()));
+				auto r = glm::mat4_cast(glm::make_quat(trs.rotation.data()));
+				auto s = glm::scale(glm::mat4 { 1.0f }, glm::make_vec3(trs.scale.data()));
+				transform_matrix = t * r * s;
+			}
+
+			auto node_index = static_cast<uint32_t>(nodes.parents.size());
+			nodes.parents.push_back(enqueued_node.parent);
+			nodes.local_transforms.push_back(transform_matrix);
+			nodes.meshes.push_back(node.meshIndex.has_value()
+			                       ? static_cast<uint32_t>(node.meshIndex.value()) : Gltf_Nodes::NO_MESH);
+			uint32_t parent = enqueued_node.parent;
+			nodes.animated.push_back(targeted[enqueued_node.node_id]
+			                         || (parent != TRANSFORM_NO_PARENT && nodes.animated[parent]));
+
+			for (auto child_id = node.children.rbegin(); child_id != node.children.rend(); child_id++)
+			{
+				nodes_stack.push_back({ .parent = node_index, .node_id = *child_id });
+			}
+		}
+	}
+
+	return nodes;
+}
+
+Gltf_Static_Batches gltf_static_batches(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                        const Gltf_Compression& compression, const Gltf_Nodes& nodes)
+{
+	ZoneScopedN("Static batching");
+
+	using namespace fastgltf;
+
+	size_t node_count = nodes.parents.size();
+
+	Gltf_Static_Batches result;
+	result.batched_nodes.resize(node_count);
+	result.world_transforms.resize(node_count);
+
+	// Parents come before their children
+	std::vector<uint32_t> mesh_users(asset.meshes.size());
+	for (size_t node = 0; node < node_count; node++)
+	{
+		uint32_t parent = nodes.parents[node];
+		result.world_transforms[node] = (parent != TRANSFORM_NO_PARENT)
+		? result.world_transforms[parent] * nodes.local_transforms[node] : nodes.local_transforms[node];
+
+		if (nodes.meshes[node] != Gltf_Nodes::NO_MESH) mesh_users[nodes.meshes[node]]++;
+	}
+
+	auto batchable = [&](size_t mesh_index, size_t primitive_index)
+	{
+		auto& primitive  = asset.meshes[mesh_index].primitives[primitive_index];
+		auto& attributes = primitive.attributes;
+
+		if (primitive.type != PrimitiveType::Triangles || !primitive.indicesAccessor.has_value()) return false;
+		if (compression.draco_primitives[mesh_index][primitive_index].has_value()) return false;
+		if (!attributes.contains("POSITION") || !attributes.contains("NORMAL") || !attributes.contains("TEXCOORD_0"))
+		return false;
+
+		size_t vertex_count = asset.accessors[attributes.at("POSITION")].count;
+		return vertex_count > 0 && vertex_count <= STATIC_BATCH_MAX_VERTICES;
+	};
+
+	// Candidates by material, ordered so batches come out the same every time
+	std::map<size_t, std::vector<Gltf_Batch_Candidate>> candidates;
+	size_t batched_count = 0;
+	for (uint32_t node = 0; node < node_count; node++)
+	{
+		uint32_t mesh_index = nodes.meshes[node];
+		if (mesh_index == Gltf_Nodes::NO_MESH || nodes.animated[node] || mesh_users[mesh_index] > 1) continue;
+
+		// Flattening transform has no inverse to take normals with it
+		glm::mat4& transform = result.world_transforms[node];
+		if (glm::determinant(glm::mat3(transform)) == 0.0f) continue;
+
+		auto& primitives = asset.meshes[mesh_index].primitives;
+		bool  all        = !primitives.empty();
+		for (size_t primitive_index = 0; all && primitive_index < primitives.size(); primitive_index++)
+		{
+			all = batchable(mesh_index, primitive_index);
+		}
+		if (!all) continue;
+
+		result.batched_nodes[node] = true;
+		batched_count++;
+
+		for (size_t primitive_index = 0; primitive_index < primitives.size(); primitive_index++)
+		{
+			auto& primitive = primitives[primitive_index];
+
+			auto&              position_accessor = asset.accessors[primitive.attributes.at("POSITION")];
+			Gltf_Accessor_View position_view     = gltf_accessor_view(asset, buffers, compression, position_accessor);
+
+			glm::vec3 min_position(std::numeric_limits<float>::max());
+			glm::vec3 max_position(std::numeric_limits<float>::lowest());
+			for (glm::vec3 position : gltf_decode_positions(position_view))
+			{
+				min_position = glm::min(min_position, position);
+				max_position = glm::max(max_position, position);
+			}
+			glm::vec3 center = glm::vec3(transform * glm::vec4((min_position + max_position) * 0.5f, 1.0f));
+
+			size_t material_index = primitive.materialIndex.has_value()
+			? primitive.materialIndex.value() : Gltf_Static_Batch::NO_MATERIAL;
+
+			candidates[material_index].push_back({
+				.instance      = { .mesh_index = mesh_index, .primitive_index = primitive_index, .node = node },
+				.center        = center,
+				.vertex_count  = static_cast<uint32_t>(position_view.count),
+				.indices_count = asset.accessors[primitive.indicesAccessor.value()].count,
+			});
+		}
+	}
+
+	size_t instance_count = 0;
+	for (auto& [material_index, material_candidates] : candidates)
+	{
+		instance_count += material_candidates.size();
+		gltf_split_static_batch(material_candidates, 0, material_candidates.size(), material_index, &result.batches);
+	}
+
+	spdlog::info("Static batching: {} primitives of {} nodes merged into {} batches", instance_count, batched_count,
+	             result.batches.size());
+
+	return result;
+}
+
+// Median split by vertices along the longest axis of centers. Every candidate fits a batch alone, so both halves
+// always get some.
+void gltf_split_static_batch(std::vector<Gltf_Batch_Candidate>& candidates, size_t begin, size_t end,
+                             size_t material_index, std::vector<Gltf_Static_Batch>* batches)
+{
+	size_t    vertex_count = 0;
+	glm::vec3 min_center(std::numeric_limits<float>::max());
+	glm::vec3 max_center(std::numeric_limits<float>::lowest());
+	for (size_t i = begin; i < end; i++)
+	{
+		vertex_count += candidates[i].vertex_count;
+		min_center    = glm::min(min_center, candidates[i].center);
+		max_center    = glm::max(max_center, candidates[i].center);
+	}
+
+	if (vertex_count <= STATIC_BATCH_MAX_VERTICES)
+	{
+		Gltf_Static_Batch batch = {
+			.material_index = material_index,
+			.vertex_count   = static_cast<uint32_t>(vertex_count),
+			.indices_count  = 0,
+		};
+		for (size_t i = begin; i < end; i++)
+		{
+			batch.instances.push_back(candidates[i].instance);
+			batch.indices_count += candidates[i].indices_count;
+		}
+		batches->push_back(std::move(batch));
+		return;
+	}
+
+	glm::vec3 extent = max_center - min_center;
+	int       axis   = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+	std::sort(candidates.begin() + begin, candidates.begin() + end,
+	          [axis](const Gltf_Batch_Candidate& a, const Gltf_Batch_Candidate& b)
+	{
+		return a.center[axis] < b.center[axis];
+	});
+
+	size_t split = begin + 1;
+	size_t below = candidates[begin].vertex_count;
+	while (split < end - 1 && below + candidates[split].vertex_count <= vertex_count / 2)
+	{
+		below += candidates[split].vertex_count;
+		split++;
+	}
+
+	gltf_split_static_batch(candidates, begin, split, material_index, batches);
+	gltf_split_static_batch(candidates, split, end, material_index, batches);
+}
+
+std::vector<Gltf_Vertex_Group> gltf_unbatched_vertex_groups(const fastgltf::Asset& asset, const Gltf_Nodes& nodes,
+                                                            const Gltf_Static_Batches& static_batches,
+                                                            std::vector<Gltf_Vertex_Group> groups)
+{
+	// Batched meshes have no other node, meshes without any node are still imported as before
+	std::vector<bool> batched_meshes(asset.meshes.size());
+	for (size_t node = 0; node < static_batches.batched_nodes.size(); node++)
+	{
+		if (static_batches.batched_nodes[node]) batched_meshes[nodes.meshes[node]] = true;
+	}
+
+	std::erase_if(groups, [&](const Gltf_Vertex_Group& group)
+	{
+		for (auto& [mesh_index, primitive_index] : group.primitives)
+		{
+			if (!batched_meshes[mesh_index]) return false;
+		}
+		return true;
+	});
+	return groups;
+}
+
+size_t gltf_static_batch_size_bound(const Gltf_Static_Batch& batch)
+{
+	// Batches are always written in float format (or packed, which is smaller)
+	size_t max_meshlets = meshopt_buildMeshletsBound(batch.indices_count, MESHLET_MAX_VERTICES,
+	                                                 MESHLET_MAX_TRIANGLES);
+	return size_t(batch.vertex_count) * 12 * sizeof(float) + 32
+	       + batch.indices_count * sizeof(uint32_t) + max_meshlets * sizeof(Meshlet) + 32;
+}
+
+Imported_Primitive gltf_import_static_batch(const fastgltf::Asset& asset, const Gltf_Buffers& buffers,
+                                            const Gltf_Compression& compression,
+                                            const Gltf_Static_Batches& static_batches, const Gltf_Static_Batch& batch,
+                                            Mapped_Buffer_Writer& writer, Mesh_Import_Stats& stats,
+                                            bool packed_vertices)
+{
+	using namespace fastgltf;
+
+	auto normalize = [](auto direction)
+	{
+		return glm::length(direction) > 0.0f ? glm::normalize(direction) : direction;
+	};
+
+	// Vertices of all instances in world space, decoded to floats
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec4> tangents;
+	std::vector<glm::vec2> texcoords;
+	std::vector<uint32_t>  indices;
+	positions.reserve(batch.vertex_count);
+	normals.reserve(batch.vertex_count);
+	tangents.reserve(batch.vertex_count);
+	texcoords.reserve(batch.vertex_count);
+	indices.reserve(batch.indices_count);
+
+	{
+		ZoneScopedN("Vertex transforming");
+
+		for (auto& instance : batch.instances)
+		{
+			auto& primitive = asset.meshes[instance.mesh_index].primitives[instance.primitive_index];
+
+			auto attribute_view = [&](const char* name)
+			{
+				auto found = primitive.attributes.find(name);
+				if (found == primitive.attributes.end()) return Gltf_Accessor_View{};
+				return gltf_accessor_view(asset, buffers, compression, asset.accessors[found->second]);
+			};
+
+			Gltf_Accessor_View position_view = attribute_view("POSITION");
+			Gltf_Accessor_View normal_view   = attribute_view("NORMAL");
+			Gltf_Accessor_View tangent_view  = attribute_view("TANGENT");
+			Gltf_Accessor_View texcoord_view = attribute_view("TEXCOORD_0");
+
+			// Same check as in vertex groups, data is read blindly
+			if (normal_view.count != position_view.count || texcoord_view.count != position_view.count
+			    || (tangent_view.data != nullptr && tangent_view.count != position_view.count))
+			throw std::runtime_error("GLTF Problem");
+
+			// Normals need inverse transpose, and mirroring flips bitangents (tangent w)
+			glm::mat4 transform     = static_batches.world_transforms[instance.node];
+			glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+			bool      mirrored      = glm::determinant(glm::mat3(transform)) < 0.0f;
+
+			auto first_vertex = static_cast<uint32_t>(positions.size());
+			for (glm::vec3 position : gltf_decode_positions(position_view))
+			{
+				positions.push_back(glm::vec3(transform * glm::vec4(position, 1.0f)));
+			}
+			for (size_t vertex = 0; vertex < position_view.count; vertex++)
+			{
+				glm::vec3 normal  = glm::vec3(gltf_decode_element(normal_view, vertex));
+				glm::vec4 tangent = gltf_decode_element(tangent_view, vertex);
+
+				normals.push_back(normalize(normal_matrix * normal));
+				tangents.push_back(glm::vec4(normalize(glm::mat3(transform) * glm::vec3(tangent)),
+				                             mirrored ? -tangent.w : tangent.w));
+				texcoords.push_back(glm::vec2(gltf_decode_element(texcoord_view, vertex)));
+			}
+
+			auto& indices_accessor = asset.accessors[primitive.indicesAccessor.value()];
+			std::vector<uint32_t> primitive_indices = gltf_read_indices(gltf_accessor_view(asset, buffers, compression,
+			                                                                              indices_accessor));
+			for (uint32_t index : primitive_indices)
+			{
+				if (index >= position_view.count)
+				throw std::runtime_error("GLTF Problem");
+			}
+
+			// Mirroring turns front faces into back faces, swapped corners turn them back
+			for (size_t corner = 0; corner + 2 < primitive_indices.size(); corner += 3)
+			{
+				indices.push_back(first_vertex + primitive_indices[corner]);
+				indices.push_back(first_vertex + primitive_indices[corner + (mirrored ? 2 : 1)]);
+				indices.push_back(first_vertex + primitive_indices[corner + (mirrored ? 1 : 2)]);
+			}
+		}
+	}
+
+	size_t attr_count = positions.size();
+
+	// The same optimizations as vertex groups get, merged instances make one primitive
+	size_t transformed_before = meshopt_analyzeVertexCache(indices.data(), indices.size(), attr_count,
+	                                                       MESH_CACHE_SIZE, 0, 0).vertices_transformed;
+	{
+		ZoneScopedN("Mesh optimization");
+
+		meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), attr_count);
+		meshopt_optimizeOverdraw(indices.data(), indices.data(), indices.size(), &positions[0].x, attr_count,
+		                         sizeof(glm::vec3), 1.05f);
+	}
+
+	// World positions are needed in their original order by the streams below
+	std::vector<glm::vec3> remapped_positions = positions;
+
+	std::vector<uint32_t> remap(attr_count);
+	size_t vertex_count = meshopt_optimizeVertexFetchRemap(remap.data(), indices.data(), indices.size(), attr_count);
+	meshopt_remapVertexBuffer(remapped_positions.data(), remapped_positions.data(), attr_count, sizeof(glm::vec3),
+	                          remap.data());
+	meshopt_remapIndexBuffer(indices.data(), indices.data(), indices.size(), remap.data());
+
+	stats.vertices_before += attr_count;
+	stats.vertices_after  += vertex_count;
+
+	// Decoded attributes are written through views, the same way as the ones straight from glTF buffers
+	auto float_view = [&](const void* data, size_t stride, AccessorType type)
+	{
+		return Gltf_Accessor_View{
+			.data           = static_cast<const uint8_t*>(data),
+			.stride         = stride,
+			.count          = attr_count,
+			.type           = type,
+			.component_type = ComponentType::Float,
+			.normalized     = false,
+		};
+	};
+	Gltf_Accessor_View position_view = float_view(positions.data(), sizeof(glm::vec3), AccessorType::Vec3);
+	Gltf_Accessor_View normal_view   = float_view(normals.data(),   sizeof(glm::vec3), AccessorType::Vec3);
+	Gltf_Accessor_View tangent_view  = float_view(tangents.data(),  sizeof(glm::vec4), AccessorType::Vec4);
+	Gltf_Accessor_View texcoord_view = float_view(texcoords.data(), sizeof(glm::vec2), AccessorType::Vec2);
+
+	Vertex_Format vertex_format = packed_vertices ? PACKED_VERTEX_FORMAT : Vertex_Format{};
+
+	writer.align_next(16);
+	VkDeviceSize vertex_src_offset = writer.offset();
+	VkDeviceSize vertex_size       = vertex_region_size(vertex_format, uint32_t(vertex_count));
+
+	glm::vec3 position_offset = glm::vec3(0.0f);
+	glm::vec3 position_scale  = glm::vec3(1.0f);
+	{
+		ZoneScopedN("Vertex interleaving");
+
+		std::vector<uint32_t> source_vertices(vertex_count);
+		for (size_t offset = 0; offset < attr_count; offset++)
+		{
+			if (remap[offset] != ~0u) source_vertices[remap[offset]] = static_cast<uint32_t>(offset);
+		}
+
+		if (packed_vertices)
+		{
+			gltf_pack_vertices(remapped_positions, normal_view, tangent_view, texcoord_view, source_vertices,
+			                   writer.offset_ptr, &position_offset, &position_scale);
+		}
+		else
+		{
+			auto vertex_stream = [](const Gltf_Accessor_View& view, VkFormat format)
+			{
+				return Vertex_Stream{
+					.data         = view.data,
+					.stride       = view.stride,
+					.element_size = static_cast<uint32_t>(getElementByteSize(view.type, view.component_type)),
+					.size         = vertex_attribute_size(format),
+				};
+			};
+			Vertex_Stream streams[] = {
+				vertex_stream(position_view, vertex_format.position),
+				vertex_stream(normal_view,   vertex_format.normal),
+				vertex_stream(tangent_view,  vertex_format.tangent),
+				vertex_stream(texcoord_view, vertex_format.texcoord),
+			};
+
+			uint8_t* attributes = writer.offset_ptr + vertex_attributes_offset(vertex_format, uint32_t(vertex_count));
+			vertex_interleave(streams, 1, source_vertices.data(), vertex_count, writer.offset_ptr);
+			vertex_interleave(streams + 1, static_cast<uint32_t>(std::size(streams)) - 1, source_vertices.data(),
+			                  vertex_count, attributes);
+		}
+	}
+	writer.advance(vertex_size);
+
+	// Back faces of double-sided materials are visible, so their cones mustn't cull anything
+	bool double_sided = batch.material_index != Gltf_Static_Batch::NO_MATERIAL
+	                    && asset.materials[batch.material_index].doubleSided;
+
+	Imported_Primitive imported = {
+		.vertex_offset   = vertex_src_offset,
+		.vertex_size     = vertex_size,
+		.vertex_count    = static_cast<uint32_t>(vertex_count),
+		.vertex_format   = vertex_format,
+		.index_type      = VK_INDEX_TYPE_UINT16,
+		.position_offset = position_offset,
+		.position_scale  = position_scale,
 	};
+	gltf_write_meshlets(indices, remapped_positions, vertex_count, double_sided, writer, stats, &imported);
+	stats.transformed_before += transformed_before;
 
-	vkUpdateDescriptorSets(gfx_context->device, 4, descriptor_set_writes, 0, nullptr);
-}
\ No newline at end of file
+	return imported;
+}
@@ -0,0 +1,127 @@
+#include "mapped_file.h"
+
+#include "common.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool mapped_file_open(const std::filesystem::path& path, Mapped_File* mapped_file)
+{
+	ZoneScopedN("Map file");
+
+	*mapped_file = {};
+
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		spdlog::error("Can't open file {}", path.string());
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		spdlog::error("Can't map empty file {}", path.string());
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		spdlog::error("Can't create file mapping of {}", path.string());
+		CloseHandle(file);
+		return false;
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr)
+	{
+		spdlog::error("Can't map view of {}", path.string());
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	*mapped_file = {
+		.data           = static_cast<const uint8_t*>(data),
+		.size           = static_cast<size_t>(file_size.QuadPart),
+		.file_handle    = file,
+		.mapping_handle = mapping,
+	};
+	return true;
+}
+
+void mapped_file_close(Mapped_File* mapped_file)
+{
+	if (mapped_file->data == nullptr) return;
+
+	UnmapViewOfFile(mapped_file->data);
+	CloseHandle(mapped_file->mapping_handle);
+	CloseHandle(mapped_file->file_handle);
+	*mapped_file = {};
+}
+
+#else
+
+bool mapped_file_open(const std::filesystem::path& path, Mapped_File* mapped_file)
+{
+	ZoneScopedN("Map file");
+
+	*mapped_file = { .file_descriptor = -1 };
+
+	int file_descriptor = open(path.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+	{
+		spdlog::error("Can't open file {}", path.string());
+		return false;
+	}
+
+	struct stat file_stat;
+	if (fstat(file_descriptor, &file_stat) != 0 || file_stat.st_size == 0)
+	{
+		spdlog::error("Can't map empty file {}", path.string());
+		close(file_descriptor);
+		return false;
+	}
+
+	void* data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	if (data == MAP_FAILED)
+	{
+		spdlog::error("Can't mmap file {}", path.string());
+		close(file_descriptor);
+		return false;
+	}
+
+	// We mostly stream through the whole file
+	madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+
+	*mapped_file = {
+		.data            = static_cast<const uint8_t*>(data),
+		.size            = static_cast<size_t>(file_stat.st_size),
+		.file_descriptor = file_descriptor,
+	};
+	return true;
+}
+
+void mapped_file_close(Mapped_File* mapped_file)
+{
+	if (mapped_file->data == nullptr) return;
+
+	munmap(const_cast<uint8_t*>(mapped_file->data), mapped_file->size);
+	close(mapped_file->file_descriptor);
+	*mapped_file = { .file_descriptor = -1 };
+}
+
+#endif
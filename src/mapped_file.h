@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Read-only memory mapped file. Pages are faulted in lazily by OS, so "loading" file this way is basically free,
+// and reading it on warm page cache is as fast as memcpy.
+struct Mapped_File
+{
+	const uint8_t* data;
+	size_t         size;
+
+#ifdef _WIN32
+	void* file_handle;
+	void* mapping_handle;
+#else
+	int   file_descriptor;
+#endif
+};
+
+// Returns false if file can't be opened or mapped
+bool mapped_file_open(const std::filesystem::path& path, Mapped_File* mapped_file);
+void mapped_file_close(Mapped_File* mapped_file);
@@ -0,0 +1,378 @@
+#include "meshlet_culling.h"
+
+#include "common.h"
+#include "vertex_pulling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <volk.h>
+
+// Private functions
+std::vector<uint8_t> load_file(const char* file_path);
+bool meshlet_visible(const Culling_View& view, const glm::mat4& transform, float scale, const Meshlet& meshlet);
+float transform_max_scale(const glm::mat4& transform);
+
+void meshlet_culling_init()
+{
+	ZoneScopedN("Meshlet culling initialization");
+
+	meshlet_culling = new Meshlet_Culling{};
+
+	{
+		ZoneScopedN("Shader creation");
+
+		// If Spir-V shader is valid, casting bytes to 32-bit words shouldn't matter
+		auto shader_code = load_file("data/shaders/meshlet_cull_comp.spv");
+		VkShaderModuleCreateInfo shader_create_info = {
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.codeSize = shader_code.size(),
+			.pCode    = reinterpret_cast<const uint32_t *>(shader_code.data()),
+		};
+		vkCreateShaderModule(gfx_context->device, &shader_create_info, nullptr, &meshlet_culling->shader);
+		name_object(meshlet_culling->shader, "Meshlet culling shader");
+	}
+
+	// Descriptor set and pipeline layout
+	{
+		ZoneScopedN("Pipeline layout creation");
+
+		VkDescriptorSetLayoutBinding bindings[] = {
+			{ // Meshlets
+				.binding         = 0,
+				.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			{ // Objects
+				.binding         = 1,
+				.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			{ // Draw commands
+				.binding         = 2,
+				.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			{ // Instance transforms
+				.binding         = 3,
+				.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		};
+
+		VkDescriptorSetLayoutCreateInfo set_layout_create_info = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = 4,
+			.pBindings    = bindings,
+		};
+		vkCreateDescriptorSetLayout(gfx_context->device, &set_layout_create_info, nullptr,
+									&meshlet_culling->descriptor_set_layout);
+		name_object(meshlet_culling->descriptor_set_layout, "Meshlet culling descriptor layout");
+
+		VkPushConstantRange push_constant_range = {
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset     = 0,
+			.size       = 6 * sizeof(glm::vec4) + 5 * sizeof(uint32_t), // Planes, camera position, counts
+		};
+
+		VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount         = 1,
+			.pSetLayouts            = &meshlet_culling->descriptor_set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges    = &push_constant_range,
+		};
+		vkCreatePipelineLayout(gfx_context->device, &pipeline_layout_create_info, nullptr,
+							   &meshlet_culling->pipeline_layout);
+		name_object(meshlet_culling->pipeline_layout, "Meshlet culling pipeline layout");
+	}
+
+	// Pipeline
+	{
+		ZoneScopedN("Pipeline creation");
+
+		VkComputePipelineCreateInfo pipeline_create_info = {
+			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			.stage = {
+				.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+				.module = meshlet_culling->shader,
+				.pName  = "main",
+			},
+			.layout = meshlet_culling->pipeline_layout,
+		};
+		vkCreateComputePipelines(gfx_context->device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr,
+								 &meshlet_culling->pipeline);
+		name_object(meshlet_culling->pipeline, "Meshlet culling pipeline");
+	}
+
+	// Per frame buffers and descriptors
+	meshlet_culling->frames.resize(renderer->buffering);
+	for (uint32_t frame_i = 0; frame_i < renderer->buffering; frame_i++)
+	{
+		auto frame = &meshlet_culling->frames[frame_i]; // Shortcut
+
+		{
+			VkBufferCreateInfo creation_info = {
+				.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+				.size  = MESHLET_CULLING_MAX_OBJECTS * sizeof(Cull_Object),
+				.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			};
+
+			VmaAllocationCreateInfo vma_creation_info = {
+				.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+				.usage = VMA_MEMORY_USAGE_AUTO,
+			};
+
+			VmaAllocationInfo allocation_info;
+			vmaCreateBuffer(gfx_context->vma_allocator, &creation_info, &vma_creation_info,
+							&frame->objects_buffer.buffer, &frame->objects_buffer.allocation, &allocation_info);
+			name_object(frame->objects_buffer.buffer, "Cull objects buffer (frame {})", frame_i);
+
+			frame->objects_ptr = reinterpret_cast<Cull_Object*>(allocation_info.pMappedData);
+		}
+
+		{
+			VkBufferCreateInfo creation_info = {
+				.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+				.size  = MESHLET_CULLING_MAX_COMMANDS * sizeof(VkDrawIndexedIndirectCommand),
+				.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			};
+
+			VmaAllocationCreateInfo vma_creation_info = {
+				.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+			};
+
+			vmaCreateBuffer(gfx_context->vma_allocator, &creation_info, &vma_creation_info,
+							&frame->commands_buffer.buffer, &frame->commands_buffer.allocation, nullptr);
+			name_object(frame->commands_buffer.buffer, "Meshlet draw commands buffer (frame {})", frame_i);
+		}
+
+		renderer->descriptor_set_allocator.allocate(gfx_context->device, meshlet_culling->descriptor_set_layout,
+													&frame->descriptor_set);
+		name_object(frame->descriptor_set, "Meshlet culling descriptor (frame {})", frame_i);
+
+		VkDescriptorBufferInfo buffer_infos[] = {
+			{ .buffer = mesh_manager->meshlet_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = frame->objects_buffer.buffer,        .offset = 0, .range = VK_WHOLE_SIZE },
+			{ .buffer = frame->commands_buffer.buffer,       .offset = 0, .range = VK_WHOLE_SIZE },
+			{
+				.buffer = renderer->instance_buffer.buffer,
+				.offset = renderer->instance_buffer_frame_size * frame_i,
+				.range  = MAX_INSTANCES * sizeof(glm::mat4),
+			},
+		};
+
+		VkWriteDescriptorSet writes[4];
+		for (uint32_t binding = 0; binding < 4; binding++)
+		{
+			writes[binding] = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet          = frame->descriptor_set,
+				.dstBinding      = binding,
+				.descriptorCount = 1,
+				.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo     = &buffer_infos[binding],
+			};
+		}
+		vkUpdateDescriptorSets(gfx_context->device, 4, writes, 0, nullptr);
+
+		frame->meshlet_buffer = mesh_manager->meshlet_buffer.buffer;
+	}
+}
+
+void meshlet_culling_deinit()
+{
+	for (auto& frame : meshlet_culling->frames)
+	{
+		vmaDestroyBuffer(gfx_context->vma_allocator, frame.objects_buffer.buffer, frame.objects_buffer.allocation);
+		vmaDestroyBuffer(gfx_context->vma_allocator, frame.commands_buffer.buffer, frame.commands_buffer.allocation);
+	}
+
+	vkDestroyPipeline(gfx_context->device, meshlet_culling->pipeline, nullptr);
+	vkDestroyPipelineLayout(gfx_context->device, meshlet_culling->pipeline_layout, nullptr);
+	vkDestroyDescriptorSetLayout(gfx_context->device, meshlet_culling->descriptor_set_layout, nullptr);
+	vkDestroyShaderModule(gfx_context->device, meshlet_culling->shader, nullptr);
+
+	delete meshlet_culling;
+}
+
+Culling_View culling_view_create(const glm::mat4& render_matrix, glm::vec3 camera_position)
+{
+	// Gribb-Hartmann: planes are sums and differences of rows of projection-view matrix (OpenGL clip space)
+	glm::mat4 m = glm::transpose(render_matrix); // Columns of transposed are rows
+
+	Culling_View view = {
+		.planes = {
+			m[3] + m[0], m[3] - m[0], // Left, right
+			m[3] + m[1], m[3] - m[1], // Bottom, top
+			m[3] + m[2], m[3] - m[2], // Near, far
+		},
+		.camera_position = camera_position,
+	};
+
+	for (auto& plane : view.planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return view;
+}
+
+float transform_max_scale(const glm::mat4& transform)
+{
+	return std::sqrt(std::max({
+		glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+		glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])),
+		glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2])),
+	}));
+}
+
+// Keep in sync with meshlet_cull_comp.glsl
+bool meshlet_visible(const Culling_View& view, const glm::mat4& transform, float scale, const Meshlet& meshlet)
+{
+	glm::vec3 center = transform * glm::vec4(meshlet.center, 1.0f);
+	float     radius = meshlet.radius * scale;
+
+	for (auto& plane : view.planes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+	}
+
+	// All triangles face away if view direction to apex is inside of (negated) normal cone
+	glm::vec3 apex = transform * glm::vec4(meshlet.cone_apex, 1.0f);
+	glm::vec3 axis = glm::normalize(glm::mat3(transform) * meshlet.cone_axis);
+	if (glm::dot(glm::normalize(apex - view.camera_position), axis) >= meshlet.cone_cutoff) return false;
+
+	return true;
+}
+
+void meshlet_cull_cpu(const Culling_View& view, const glm::mat4* transforms, uint32_t instance_count,
+                      const Mesh_Manager::Mesh_Storage& mesh, std::vector<std::pair<uint32_t, uint32_t>>* ranges)
+{
+	std::vector<float> scales(instance_count);
+	for (uint32_t i = 0; i < instance_count; i++)
+	{
+		scales[i] = transform_max_scale(transforms[i]);
+	}
+
+	for (auto& meshlet : mesh.meshlets)
+	{
+		bool visible = false;
+		for (uint32_t i = 0; i < instance_count && !visible; i++)
+		{
+			visible = meshlet_visible(view, transforms[i], scales[i], meshlet);
+		}
+		if (!visible) continue;
+
+		meshlet_culling->meshlets_visible++;
+
+		// Meshlets are consecutive in index buffer, so neighbours make one draw
+		if (!ranges->empty() && ranges->back().first + ranges->back().second == meshlet.first_index)
+		{
+			ranges->back().second += meshlet.index_count;
+		}
+		else
+		{
+			ranges->push_back({ meshlet.first_index, meshlet.index_count });
+		}
+	}
+}
+
+void meshlet_cull_gpu(VkCommandBuffer command_buffer, uint32_t frame_i, const Culling_View& view)
+{
+	ZoneScopedN("Meshlet culling");
+
+	auto frame = &meshlet_culling->frames[frame_i]; // Shortcut
+
+	// Frame's previous use is finished, so objects can be written directly, and so can descriptor set if meshlet
+	// buffer was replaced by bigger one
+	if (frame->meshlet_buffer != mesh_manager->meshlet_buffer.buffer)
+	{
+		frame->meshlet_buffer = mesh_manager->meshlet_buffer.buffer;
+
+		VkDescriptorBufferInfo buffer_info = { .buffer = frame->meshlet_buffer, .offset = 0, .range = VK_WHOLE_SIZE };
+		VkWriteDescriptorSet   write       = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet          = frame->descriptor_set,
+			.dstBinding      = 0,
+			.descriptorCount = 1,
+			.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pBufferInfo     = &buffer_info,
+		};
+		vkUpdateDescriptorSets(gfx_context->device, 1, &write, 0, nullptr);
+	}
+
+	uint32_t object_count  = 0;
+	uint32_t command_count = 0;
+
+	frame->group_commands.resize(scene_data->instance_groups.size());
+	for (size_t i = 0; i < scene_data->instance_groups.size(); i++)
+	{
+		auto& group = scene_data->instance_groups[i];
+		auto& mesh  = mesh_manager->get_mesh(group.mesh_id);
+
+		if (mesh.meshlets_count == 0 || object_count == MESHLET_CULLING_MAX_OBJECTS ||
+		    command_count + mesh.meshlets_count > MESHLET_CULLING_MAX_COMMANDS)
+		{
+			frame->group_commands[i] = Meshlet_Culling::NO_COMMANDS;
+			continue;
+		}
+
+		// Vertex pulling draws from the whole index buffer
+		uint32_t index_base = 0;
+		if (vertex_pulling_used(mesh, i))
+		{
+			index_base = mesh.indices_offset / (mesh.index_type == VK_INDEX_TYPE_UINT32 ? 4 : 2);
+		}
+
+		frame->objects_ptr[object_count++] = {
+			.first_meshlet  = static_cast<uint32_t>(mesh.meshlets_offset / sizeof(Meshlet)),
+			.meshlet_count  = mesh.meshlets_count,
+			.first_command  = command_count,
+			.first_instance = group.first_instance,
+			.instance_count = group.instance_count,
+			.index_base     = index_base,
+		};
+		frame->group_commands[i] = command_count;
+		command_count += mesh.meshlets_count;
+	}
+	vmaFlushAllocation(gfx_context->vma_allocator, frame->objects_buffer.allocation, 0,
+					   object_count * sizeof(Cull_Object));
+
+	if (command_count == 0) return;
+
+	struct Push_Constants
+	{
+		glm::vec4 planes[6];
+		glm::vec3 camera_position;
+		uint32_t  object_count;
+		uint32_t  command_count;
+	} push_constants = {
+		.camera_position = view.camera_position,
+		.object_count    = object_count,
+		.command_count   = command_count,
+	};
+	std::copy(std::begin(view.planes), std::end(view.planes), push_constants.planes);
+
+	command_buffer_region_begin(command_buffer, "Meshlet culling");
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshlet_culling->pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshlet_culling->pipeline_layout,
+							0, 1, &frame->descriptor_set, 0, nullptr);
+	vkCmdPushConstants(command_buffer, meshlet_culling->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+					   0, sizeof(Push_Constants), &push_constants);
+	vkCmdDispatch(command_buffer, (command_count + 63) / 64, 1, 1); // local_size_x = 64
+
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+	};
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+						 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	command_buffer_region_end(command_buffer);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "renderer.h"
+
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Culling of meshlets that are outside of view frustum, or whose all triangles face away from camera.
+// CPU path draws visible ranges of indices directly. GPU path writes one indirect draw per meshlet (culled ones
+// have no indices) with compute shader, and instance group is then drawn with single multi-draw.
+// Meshlet is drawn for all instances of a group if any of them sees it. Only main pass is culled, shadow pass
+// draws whole meshes.
+
+enum class Culling_Mode : uint32_t
+{
+	NONE,
+	CPU,
+	GPU,
+};
+
+constexpr uint32_t MESHLET_CULLING_MAX_OBJECTS  = 16 * 1024;  // Per frame, groups over the limit aren't culled
+constexpr uint32_t MESHLET_CULLING_MAX_COMMANDS = 256 * 1024; // Per frame
+
+struct Culling_View
+{
+	glm::vec4 planes[6]; // Frustum planes in world space, pointing inwards
+	glm::vec3 camera_position;
+};
+
+// Per instance group input of culling shader, layout matches meshlet_cull_comp.glsl (std430)
+struct Cull_Object
+{
+	uint32_t first_meshlet; // Index in mesh_manager->meshlet_buffer
+	uint32_t meshlet_count;
+	uint32_t first_command;
+	uint32_t first_instance;
+	uint32_t instance_count;
+	uint32_t index_base; // Added to first index of meshlets, for meshes drawn from index buffer bound at zero offset
+};
+
+struct Meshlet_Culling
+{
+	struct Frame
+	{
+		AllocatedBuffer objects_buffer;  // Cull_Object[], persistently mapped
+		Cull_Object*    objects_ptr;
+		AllocatedBuffer commands_buffer; // VkDrawIndexedIndirectCommand[]
+		VkDescriptorSet descriptor_set;
+		VkBuffer        meshlet_buffer; // The one in descriptor set, mesh buffers grow
+
+		std::vector<uint32_t> group_commands; // First command of every instance group, or NO_COMMANDS
+	};
+
+	static const uint32_t NO_COMMANDS = ~0u;
+
+	Culling_Mode mode = Culling_Mode::GPU;
+
+	VkShaderModule        shader;
+	VkDescriptorSetLayout descriptor_set_layout;
+	VkPipelineLayout      pipeline_layout;
+	VkPipeline            pipeline;
+
+	std::vector<Frame> frames;
+
+	// Statistics of last frame, visible meshlets are only known with CPU culling
+	uint32_t meshlets_total;
+	uint32_t meshlets_visible;
+};
+
+inline Meshlet_Culling* meshlet_culling;
+
+void meshlet_culling_init(); // Call after renderer frame data and mesh manager are created
+void meshlet_culling_deinit();
+
+Culling_View culling_view_create(const glm::mat4& render_matrix, glm::vec3 camera_position);
+
+// CPU path. Appends (first index, index count) of parts of mesh visible by any of instances to ranges, adjacent
+// ranges are merged.
+void meshlet_cull_cpu(const Culling_View& view, const glm::mat4* transforms, uint32_t instance_count,
+                      const Mesh_Manager::Mesh_Storage& mesh, std::vector<std::pair<uint32_t, uint32_t>>* ranges);
+
+// GPU path. Records culling of all instance groups into command buffer (outside of rendering), and barrier for
+// indirect draws. Draws of instance group can be found in frame's group_commands. Instance transforms of the frame
+// have to be written already.
+void meshlet_cull_gpu(VkCommandBuffer command_buffer, uint32_t frame_i, const Culling_View& view);
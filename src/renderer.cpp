@@ -2,12 +2,20 @@
 
 #include "common.h"
 #include "application.h"
+#include "io_queue.h"
+#include "loader.h"
+#include "meshlet_culling.h"
+#include "vertex_pulling.h"
 #include "vulkan_utilities.h"
 
-#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <numeric>
 #include <glm/gtc/type_ptr.hpp>
 #include <imgui.h>
 #include <imgui/backends/imgui_impl_vulkan.h>
+#include <tuple>
 #include <unordered_map>
 #include <volk.h>
 #include <vulkan/vulkan_core.h>
@@ -24,6 +32,16 @@ void renderer_destroy_pipeline();
 void renderer_create_sync_primitives();
 void renderer_destroy_sync_primitives();
 void renderer_init_shadow_pass();
+AllocatedBuffer mesh_buffer_create(const Mesh_Buffer& mesh_buffer, VkDeviceSize size);
+void mesh_buffer_add_block(Mesh_Buffer* mesh_buffer, VkDeviceSize base, VkDeviceSize size);
+VmaVirtualBlock mesh_buffer_block(Mesh_Buffer* mesh_buffer, VkDeviceSize offset);
+VkDeviceSize mesh_buffer_holes(Mesh_Buffer* mesh_buffer);
+VkDeviceSize mesh_buffer_allocation_size(Mesh_Buffer* mesh_buffer, VmaVirtualAllocation allocation,
+                                         VkDeviceSize offset);
+void mesh_buffer_compact(Mesh_Buffer* mesh_buffer, VkDeviceSize alignment,
+                         VkDeviceSize Mesh_Manager::Mesh_Description::* offset_field,
+                         VmaVirtualAllocation Mesh_Manager::Mesh_Storage::* allocation_field, VkDeviceSize* budget,
+                         std::vector<VkBufferCopy>* copies);
 
 Mapped_Buffer_Writer::Mapped_Buffer_Writer(void* mapped_buffer_ptr)
 {
@@ -315,77 +333,411 @@ void debug_pass_init()
 	}
 }
 
+uint32_t vertex_attribute_size(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		return 16;
+	case VK_FORMAT_R32G32B32_SFLOAT:
+		return 12;
+	case VK_FORMAT_R32G32_SFLOAT:
+	case VK_FORMAT_R16G16B16A16_SNORM:
+	case VK_FORMAT_R16G16B16A16_UNORM:
+	case VK_FORMAT_R16G16B16A16_SSCALED:
+	case VK_FORMAT_R16G16B16A16_USCALED:
+		return 8;
+	case VK_FORMAT_R16G16_SFLOAT:
+	case VK_FORMAT_R16G16_SNORM:
+	case VK_FORMAT_R16G16_UNORM:
+	case VK_FORMAT_R16G16_SSCALED:
+	case VK_FORMAT_R16G16_USCALED:
+	case VK_FORMAT_R8G8B8A8_SNORM:
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SSCALED:
+	case VK_FORMAT_R8G8B8A8_USCALED:
+	case VK_FORMAT_R8G8_SNORM: // Padded
+	case VK_FORMAT_R8G8_UNORM:
+	case VK_FORMAT_R8G8_SSCALED:
+	case VK_FORMAT_R8G8_USCALED:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+uint32_t vertex_attributes_stride(const Vertex_Format& vertex_format)
+{
+	return vertex_attribute_size(vertex_format.normal) + vertex_attribute_size(vertex_format.tangent)
+	     + vertex_attribute_size(vertex_format.texcoord);
+}
+
+VkDeviceSize vertex_attributes_offset(const Vertex_Format& vertex_format, uint32_t vertex_count)
+{
+	// 16 byte aligned, so importer can use streaming stores for both streams
+	VkDeviceSize positions_size = VkDeviceSize(vertex_attribute_size(vertex_format.position)) * vertex_count;
+	return (positions_size + 15) & ~VkDeviceSize(15);
+}
+
+VkDeviceSize vertex_region_size(const Vertex_Format& vertex_format, uint32_t vertex_count)
+{
+	return vertex_attributes_offset(vertex_format, vertex_count)
+	     + VkDeviceSize(vertex_attributes_stride(vertex_format)) * vertex_count;
+}
+
 void mesh_manager_init()
 {
 	ZoneScopedN("Mesh manager initialization");
 
 	mesh_manager = new Mesh_Manager{};
 
-	// Vertex buffer
+	// Storage buffer for vertex pulling
+	mesh_buffer_init(&mesh_manager->vertex_buffer, "Vertex buffer",
+	                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                 Mesh_Manager::VERTEX_BUFFER_SIZE);
+	mesh_buffer_init(&mesh_manager->indices_buffer, "Indices buffer", VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+	                 Mesh_Manager::INDICES_BUFFER_SIZE);
+	mesh_buffer_init(&mesh_manager->meshlet_buffer, "Meshlet buffer", VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                 Mesh_Manager::MESHLET_BUFFER_SIZE);
+}
+
+void mesh_manager_deinit()
+{
+	mesh_buffer_deinit(&mesh_manager->vertex_buffer);
+	mesh_buffer_deinit(&mesh_manager->indices_buffer);
+	mesh_buffer_deinit(&mesh_manager->meshlet_buffer);
+
+	delete mesh_manager;
+}
+
+AllocatedBuffer mesh_buffer_create(const Mesh_Buffer& mesh_buffer, VkDeviceSize size)
+{
+	// Source of copies when it grows
+	VkBufferCreateInfo creation_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size  = size,
+		.usage = mesh_buffer.usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	};
+
+	VmaAllocationCreateInfo vma_creation_info = {
+		.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+	};
+
+	AllocatedBuffer buffer;
+	VkResult result = vmaCreateBuffer(gfx_context->vma_allocator, &creation_info, &vma_creation_info, &buffer.buffer,
+	                                  &buffer.allocation, nullptr);
+	if (result != VK_SUCCESS)
+	throw std::runtime_error("Can't allocate mesh buffer");
+
+	name_object(buffer.buffer, "{} ({} MB)", mesh_buffer.name, size / (1024 * 1024));
+	return buffer;
+}
+
+void mesh_buffer_add_block(Mesh_Buffer* mesh_buffer, VkDeviceSize base, VkDeviceSize size)
+{
+	VmaVirtualBlockCreateInfo create_info = { .size = size, .flags = 0 };
+	VmaVirtualBlock block;
+	vmaCreateVirtualBlock(&create_info, &block);
+	mesh_buffer->blocks.emplace_back(base, block);
+}
+
+void mesh_buffer_init(Mesh_Buffer* mesh_buffer, const char* name, VkBufferUsageFlags usage, VkDeviceSize size)
+{
+	mesh_buffer->name  = name;
+	mesh_buffer->usage = usage;
+	mesh_buffer->size  = size;
+
+	mesh_buffer->loader_buffer = mesh_buffer_create(*mesh_buffer, size);
+	mesh_buffer->buffer        = mesh_buffer->loader_buffer.buffer;
+	mesh_buffer->allocation    = mesh_buffer->loader_buffer.allocation;
+	mesh_buffer->buffer_size   = size;
+
+	mesh_buffer_add_block(mesh_buffer, 0, size);
+}
+
+void mesh_buffer_deinit(Mesh_Buffer* mesh_buffer)
+{
+	// Loader might have grown it in batch that never got committed
+	if (mesh_buffer->loader_buffer.buffer != mesh_buffer->buffer)
 	{
-		VkBufferCreateInfo creation_info = {
-			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-			.size  = 500000000,
-			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		};
+		vmaDestroyBuffer(gfx_context->vma_allocator, mesh_buffer->loader_buffer.buffer,
+		                 mesh_buffer->loader_buffer.allocation);
+	}
+	vmaDestroyBuffer(gfx_context->vma_allocator, mesh_buffer->buffer, mesh_buffer->allocation);
 
-		VmaAllocationCreateInfo vma_creation_info = {
-			.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-			.usage = VMA_MEMORY_USAGE_AUTO,
-		};
+	for (auto& [base, block] : mesh_buffer->blocks)
+	{
+		vmaClearVirtualBlock(block);
+		vmaDestroyVirtualBlock(block);
+	}
+}
 
-		vmaCreateBuffer(gfx_context->vma_allocator,
-						&creation_info,
-						&vma_creation_info,
-						&mesh_manager->vertex_buffer.buffer,
-						&mesh_manager->vertex_buffer.allocation,
-						nullptr);
-		name_object(mesh_manager->vertex_buffer.buffer, "Vertex buffer");
+bool mesh_buffer_allocate(Mesh_Buffer* mesh_buffer, VkDeviceSize size, VkDeviceSize alignment,
+                          VmaVirtualAllocation* allocation, VkDeviceSize* offset, VmaVirtualAllocationCreateFlags flags)
+{
+	std::lock_guard lock(mesh_buffer->mutex);
+
+	VmaVirtualAllocationCreateInfo allocation_info = { .size = size, .alignment = alignment, .flags = flags };
+	for (auto& [base, block] : mesh_buffer->blocks)
+	{
+		VkDeviceSize block_offset;
+		if (vmaVirtualAllocate(block, &allocation_info, allocation, &block_offset) == VK_SUCCESS)
+		{
+			*offset = base + block_offset;
+			return true;
+		}
+	}
+	return false;
+}
+
+void mesh_buffer_free(Mesh_Buffer* mesh_buffer, VmaVirtualAllocation allocation, VkDeviceSize offset)
+{
+	std::lock_guard lock(mesh_buffer->mutex);
+	vmaVirtualFree(mesh_buffer_block(mesh_buffer, offset), allocation);
+}
+
+// Block the offset is in, caller holds the lock
+VmaVirtualBlock mesh_buffer_block(Mesh_Buffer* mesh_buffer, VkDeviceSize offset)
+{
+	// Blocks are in order of their bases
+	auto& blocks = mesh_buffer->blocks;
+	auto  owner  = std::find_if(blocks.rbegin(), blocks.rend(), [&](auto& block) { return block.first <= offset; });
+	return owner->second;
+}
+
+VkDeviceSize mesh_buffer_allocation_size(Mesh_Buffer* mesh_buffer, VmaVirtualAllocation allocation,
+                                         VkDeviceSize offset)
+{
+	std::lock_guard lock(mesh_buffer->mutex);
+
+	VmaVirtualAllocationInfo allocation_info;
+	vmaGetVirtualAllocationInfo(mesh_buffer_block(mesh_buffer, offset), allocation, &allocation_info);
+	return allocation_info.size;
+}
+
+// Free bytes compaction can win. Allocations never span blocks, so it's counted per block: everything besides its
+// largest free range (usually its end), and that one too if the smallest range of some later block would fit there.
+VkDeviceSize mesh_buffer_holes(Mesh_Buffer* mesh_buffer)
+{
+	std::lock_guard lock(mesh_buffer->mutex);
+
+	std::vector<VmaDetailedStatistics> block_statistics(mesh_buffer->blocks.size());
+	for (size_t block_index = 0; block_index < mesh_buffer->blocks.size(); block_index++)
+	{
+		vmaCalculateVirtualBlockStatistics(mesh_buffer->blocks[block_index].second, &block_statistics[block_index]);
 	}
 
-	// Indices buffer
+	VkDeviceSize holes          = 0;
+	VkDeviceSize smallest_later = VK_WHOLE_SIZE; // Smallest range in blocks after current one
+	for (size_t block_index = mesh_buffer->blocks.size(); block_index-- > 0;)
 	{
-		VkBufferCreateInfo creation_info = {
-			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-			.size  = 100000000,
-			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		};
+		auto& statistics = block_statistics[block_index];
 
-		VmaAllocationCreateInfo vma_creation_info = {
-			.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-			.usage = VMA_MEMORY_USAGE_AUTO,
-		};
+		VkDeviceSize free_bytes = statistics.statistics.blockBytes - statistics.statistics.allocationBytes;
+		holes += free_bytes - statistics.unusedRangeSizeMax;
+		if (smallest_later <= statistics.unusedRangeSizeMax) holes += statistics.unusedRangeSizeMax;
 
-		vmaCreateBuffer(gfx_context->vma_allocator,
-						&creation_info,
-						&vma_creation_info,
-						&mesh_manager->indices_buffer.buffer,
-						&mesh_manager->indices_buffer.allocation,
-						nullptr);
-		name_object(mesh_manager->indices_buffer.buffer, "Indices buffer");
+		smallest_later = std::min(smallest_later, statistics.allocationSizeMin);
+	}
+	return holes;
+}
+
+AllocatedBuffer mesh_buffer_grow(Mesh_Buffer* mesh_buffer, VkDeviceSize min_size)
+{
+	ZoneScopedN("Mesh buffer growth");
+
+	VkDeviceSize old_size = mesh_buffer->size;
+	VkDeviceSize new_size = std::max(old_size * 2, old_size + min_size);
+	new_size = (new_size + MESH_BUFFER_GRANULARITY - 1) / MESH_BUFFER_GRANULARITY * MESH_BUFFER_GRANULARITY;
+
+	AllocatedBuffer old_buffer = mesh_buffer->loader_buffer;
+	mesh_buffer->loader_buffer = mesh_buffer_create(*mesh_buffer, new_size);
+
+	{
+		std::lock_guard lock(mesh_buffer->mutex);
+		mesh_buffer->size = new_size;
+		mesh_buffer_add_block(mesh_buffer, old_size, new_size - old_size);
+	}
+
+	spdlog::info("{} grown to {} MB", mesh_buffer->name, new_size / (1024 * 1024));
+	return old_buffer;
+}
+
+void mesh_manager_unload(Mesh_Manager::Id id)
+{
+	auto& mesh    = mesh_manager->get_mesh(id);
+	auto& storage = mesh_manager->get_storage(id);
+
+	auto retire = [&](Mesh_Buffer* mesh_buffer, VmaVirtualAllocation allocation, VkDeviceSize offset)
+	{
+		if (allocation == VK_NULL_HANDLE) return; // Empty range, see scene_upload_mesh_allocate()
+		mesh_manager->retired_ranges.push_back({
+			.frame       = app->frame_number,
+			.mesh_buffer = mesh_buffer,
+			.allocation  = allocation,
+			.offset      = offset,
+		});
+	};
+
+	retire(&mesh_manager->indices_buffer, storage.indices_allocation, mesh.indices_offset);
+	retire(&mesh_manager->meshlet_buffer, storage.meshlets_allocation, mesh.meshlets_offset);
+
+	auto vertex_users = mesh_manager->vertex_users.find(storage.vertex_allocation);
+	if (--vertex_users->second == 0)
+	{
+		retire(&mesh_manager->vertex_buffer, storage.vertex_allocation, mesh.vertex_offset);
+		mesh_manager->vertex_users.erase(vertex_users);
 	}
 
-	// Vertex buffer suballocation
+	storage = {};
+	mesh_manager->meshes.remove(id);
+}
+
+void mesh_manager_update(VkCommandBuffer command_buffer)
+{
+	ZoneScopedN("Mesh manager update");
+
+	uint64_t rendered_value;
+	vkGetSemaphoreCounterValue(gfx_context->device, renderer->render_semaphore, &rendered_value);
+
+	auto& retired_ranges = mesh_manager->retired_ranges;
+	while (!retired_ranges.empty() && retired_ranges.front().frame + renderer->buffering <= rendered_value)
+	{
+		auto& retired = retired_ranges.front();
+		mesh_buffer_free(retired.mesh_buffer, retired.allocation, retired.offset);
+		retired_ranges.pop_front();
+		mesh_manager->compaction_stalled = false;
+	}
+
+	// Loader allocates from mesh buffers, writes and grows them while it runs
+	if (!scene_loader_idle())
 	{
-		VmaVirtualBlockCreateInfo create_info = { .size  = 500000000, .flags = 0 };
-		vmaCreateVirtualBlock(&create_info, &mesh_manager->vertex_sub_allocator);
+		mesh_manager->compaction_stalled = false;
+		return;
 	}
 
-	// Indices buffer suballocation
+	// Nothing could move last time, and layout didn't change since
+	if (mesh_manager->compaction_stalled) return;
+
+	bool fragmented = false;
+	for (Mesh_Buffer* mesh_buffer : { &mesh_manager->vertex_buffer, &mesh_manager->indices_buffer,
+	                                  &mesh_manager->meshlet_buffer })
+	{
+		fragmented = fragmented || mesh_buffer_holes(mesh_buffer) >= MESH_DEFRAG_MIN_HOLES;
+	}
+	if (!fragmented) return;
+
+	ZoneScopedN("Mesh buffer compaction");
+
+	VkDeviceSize budget = MESH_DEFRAG_FRAME_BUDGET;
+	std::vector<VkBufferCopy> vertex_copies, indices_copies, meshlet_copies;
+	mesh_buffer_compact(&mesh_manager->vertex_buffer, 4,
+	                    &Mesh_Manager::Mesh_Description::vertex_offset,
+	                    &Mesh_Manager::Mesh_Storage::vertex_allocation, &budget, &vertex_copies);
+	mesh_buffer_compact(&mesh_manager->indices_buffer, 4,
+	                    &Mesh_Manager::Mesh_Description::indices_offset,
+	                    &Mesh_Manager::Mesh_Storage::indices_allocation, &budget, &indices_copies);
+	mesh_buffer_compact(&mesh_manager->meshlet_buffer, sizeof(Meshlet),
+	                    &Mesh_Manager::Mesh_Description::meshlets_offset,
+	                    &Mesh_Manager::Mesh_Storage::meshlets_allocation, &budget, &meshlet_copies);
+
+	if (vertex_copies.empty() && indices_copies.empty() && meshlet_copies.empty())
 	{
-		VmaVirtualBlockCreateInfo create_info = { .size  = 100000000, .flags = 0 };
-		vmaCreateVirtualBlock(&create_info, &mesh_manager->indices_sub_allocator);
+		mesh_manager->compaction_stalled = true;
+		return;
 	}
+
+	// Sources were written by copies of scene loader, those are only visible to shaders and vertex input
+	VkMemoryBarrier before_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+	};
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+	                     1, &before_barrier, 0, nullptr, 0, nullptr);
+
+	auto copy = [&](Mesh_Buffer* mesh_buffer, const std::vector<VkBufferCopy>& copies)
+	{
+		if (copies.empty()) return;
+		vkCmdCopyBuffer(command_buffer, mesh_buffer->buffer, mesh_buffer->buffer, copies.size(), copies.data());
+		spdlog::debug("{}: moved {} ranges", mesh_buffer->name, copies.size());
+	};
+	copy(&mesh_manager->vertex_buffer, vertex_copies);
+	copy(&mesh_manager->indices_buffer, indices_copies);
+	copy(&mesh_manager->meshlet_buffer, meshlet_copies);
+
+	VkMemoryBarrier after_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+	};
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+	                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+	                     1, &after_barrier, 0, nullptr, 0, nullptr);
 }
 
-void mesh_manager_deinit()
+// Moves ranges of one mesh buffer to the lowest free offsets, highest ranges first, offsets of meshes are patched
+// right away and copies to record are added to copies. Old ranges stay allocated until frames in flight are done with
+// them, so sources and destinations never overlap.
+void mesh_buffer_compact(Mesh_Buffer* mesh_buffer, VkDeviceSize alignment,
+                         VkDeviceSize Mesh_Manager::Mesh_Description::* offset_field,
+                         VmaVirtualAllocation Mesh_Manager::Mesh_Storage::* allocation_field, VkDeviceSize* budget,
+                         std::vector<VkBufferCopy>* copies)
 {
-	vmaDestroyBuffer(gfx_context->vma_allocator, mesh_manager->vertex_buffer.buffer,
-					 mesh_manager->vertex_buffer.allocation);
-	vmaDestroyBuffer(gfx_context->vma_allocator, mesh_manager->indices_buffer.buffer,
-					 mesh_manager->indices_buffer.allocation);
+	if (*budget == 0 || mesh_buffer_holes(mesh_buffer) < MESH_DEFRAG_MIN_HOLES) return;
 
-	delete mesh_manager;
+	// Meshes by their range, highest first (meshes of a vertex group share vertices)
+	std::map<VkDeviceSize, std::vector<uint32_t>, std::greater<>> ranges;
+	for (uint32_t slot = 0; slot < mesh_manager->storage.size(); slot++)
+	{
+		if (mesh_manager->storage[slot].*allocation_field == VK_NULL_HANDLE) continue; // Unloaded or empty range
+		ranges[mesh_manager->meshes.values[slot].*offset_field].push_back(slot);
+	}
+
+	for (auto& [offset, slots] : ranges)
+	{
+		if (*budget == 0) break;
+
+		VmaVirtualAllocation allocation = mesh_manager->storage[slots[0]].*allocation_field;
+
+		// Range bigger than the whole budget would never move otherwise, it goes alone
+		VkDeviceSize size = mesh_buffer_allocation_size(mesh_buffer, allocation, offset);
+		if (size == 0 || (size > *budget && *budget < MESH_DEFRAG_FRAME_BUDGET)) continue;
+
+		VmaVirtualAllocation new_allocation;
+		VkDeviceSize         new_offset;
+		if (!mesh_buffer_allocate(mesh_buffer, size, alignment, &new_allocation, &new_offset,
+		                          VMA_VIRTUAL_ALLOCATION_CREATE_STRATEGY_MIN_OFFSET_BIT)) continue;
+		if (new_offset >= offset)
+		{
+			mesh_buffer_free(mesh_buffer, new_allocation, new_offset);
+			continue;
+		}
+
+		copies->push_back({ .srcOffset = offset, .dstOffset = new_offset, .size = size });
+		*budget -= std::min(size, *budget);
+
+		for (uint32_t slot : slots)
+		{
+			mesh_manager->meshes.values[slot].*offset_field = new_offset;
+			mesh_manager->storage[slot].*allocation_field   = new_allocation;
+		}
+
+		if (allocation_field == &Mesh_Manager::Mesh_Storage::vertex_allocation)
+		{
+			auto users  = mesh_manager->vertex_users.extract(allocation);
+			users.key() = new_allocation;
+			mesh_manager->vertex_users.insert(std::move(users));
+		}
+
+		mesh_manager->retired_ranges.push_back({
+			.frame       = app->frame_number,
+			.mesh_buffer = mesh_buffer,
+			.allocation  = allocation,
+			.offset      = offset,
+		});
+	}
 }
 
 void texture_manager_init()
@@ -415,7 +767,7 @@ void texture_manager_init()
 	};
 	VkSampler default_sampler;
 	vkCreateSampler(gfx_context->device, &default_sampler_create_info, nullptr, &default_sampler);
-	texture_manager->samplers.push_back(default_sampler);
+	texture_manager->samplers.insert(default_sampler);
 
 	// Create default texture
 	Allocated_View_Image view_image; // What we will be allocating
@@ -446,7 +798,7 @@ void texture_manager_init()
 	create_default_image_view(gfx_context->device, image_create_info, view_image.image, nullptr, &view_image.view);
 	name_object(view_image.view, "Default texture's view");
 
-	texture_manager->images.push_back(view_image);
+	texture_manager->images.insert(view_image);
 }
 
 void texture_manager_deinit()
@@ -457,7 +809,7 @@ void texture_manager_deinit()
 void material_manager_init()
 {
 	material_manager = new Material_Manager{};
-	material_manager->materials.reserve(1000);
+	material_manager->materials.values.reserve(1000);
 
 	// Allocate material buffer
 	VkBufferCreateInfo buffer_create_info = {
@@ -479,7 +831,7 @@ void material_manager_init()
 	name_object(material_manager->material_storage_buffer.buffer, "Material storage buffer");
 
 	// Default material
-	material_manager->materials.push_back({
+	material_manager->materials.insert({
 		.albedo_color            = { 0.0f, 0.0f, 0.0f, 1.0f},
 		.albedo_texture          = Texture_Manager::DEFAULT_TEXTURE,
 		.albedo_sampler          = Texture_Manager::DEFAULT_SAMPLER,
@@ -495,9 +847,77 @@ void material_manager_deinit()
 	delete material_manager;
 }
 
+void scene_data_build_instances()
+{
+	ZoneScopedN("Instance groups building");
+
+	auto& render_objects = scene_data->render_objects;
+	auto& groups         = scene_data->instance_groups;
+	auto& nodes          = scene_data->instance_nodes;
+
+	// Sorting by mesh also keeps meshes of same vertex format together, fewer pipeline switches
+	std::vector<uint32_t> order(render_objects.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		return std::tie(render_objects[a].mesh_id, render_objects[a].material_id)
+		     < std::tie(render_objects[b].mesh_id, render_objects[b].material_id);
+	});
+
+	groups.clear();
+	nodes.clear();
+	for (uint32_t render_object_index : order)
+	{
+		auto& render_object = render_objects[render_object_index];
+
+		if (nodes.size() == MAX_INSTANCES)
+		{
+			spdlog::warn("Too many instances, only {} out of {} are drawn", MAX_INSTANCES, render_objects.size());
+			break;
+		}
+
+		if (groups.empty() || groups.back().mesh_id != render_object.mesh_id ||
+		    groups.back().material_id != render_object.material_id)
+		{
+			groups.push_back({
+				.mesh_id        = render_object.mesh_id,
+				.material_id    = render_object.material_id,
+				.first_instance = static_cast<uint32_t>(nodes.size()),
+				.instance_count = 0,
+			});
+		}
+
+		groups.back().instance_count++;
+		nodes.push_back(render_object.transform_node);
+	}
+
+	scene_data->instances_built = true;
+}
+
+void scene_data_update_transforms()
+{
+	ZoneScopedN("Transforms update");
+
+	bool moved = transform_hierarchy_update(&scene_data->transforms);
+	if (!moved && !scene_data->instances_built) return;
+
+	auto& nodes      = scene_data->instance_nodes;
+	auto& worlds     = scene_data->transforms.world_transforms;
+	auto& transforms = scene_data->instance_transforms;
+
+	transforms.resize(nodes.size());
+	for (size_t instance = 0; instance < nodes.size(); instance++) transforms[instance] = worlds[nodes[instance]];
+
+	scene_data->instances_built = false;
+	scene_data->instances_version++;
+}
+
 void renderer_init()
 {
-	renderer = new Renderer;
+	// Scene loader keeps within its staging budget, so heap doesn't have to grow with the scene
+	renderer = new Renderer{
+		.upload_heap = Upload_Heap(app->launch_options.staging_budget + UPLOAD_HEAP_FRAME_RESERVE),
+	};
 
 	scene_data = new Scene_Data { .sun = {glm::vec3(0, 0, 1), 1.0f } };
 	debug_pass_init();
@@ -513,14 +933,20 @@ void renderer_init()
 	renderer_create_shaders();
 	renderer_create_pipeline();
 	renderer_create_sync_primitives();
+	meshlet_culling_init();
+	vertex_pulling_init();
 	load_scene_data();
 	renderer_init_shadow_pass();
 }
 
 void renderer_deinit()
 {
+	scene_loader_deinit();
+
 	vkDeviceWaitIdle(gfx_context->device);
 
+	vertex_pulling_deinit();
+	meshlet_culling_deinit();
 	renderer_destroy_sync_primitives();
 	renderer_destroy_pipeline();
 	renderer_destroy_shaders();
@@ -721,7 +1147,7 @@ void renderer_create_frame_data()
 			vkCreateImageView(gfx_context->device, &image_view_create_info, nullptr,
 							  &frame_data->sun_shadow_map.view);
 
-			texture_manager->images.push_back(frame_data->sun_shadow_map);
+			texture_manager->images.insert(frame_data->sun_shadow_map);
 		}
 	}
 }
@@ -783,19 +1209,27 @@ void renderer_create_global_uniforms()
 				.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				.descriptorCount = 1,
 				.stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT,
-			}
+			},
+			{ // Instance transforms
+				.binding         = 4,
+				.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+				.descriptorCount = 1,
+				.stageFlags      = VK_SHADER_STAGE_VERTEX_BIT,
+			},
 		};
 
+		// Textures are written as scene loader commits them, while frames using other slots are in flight
 		VkDescriptorBindingFlags flags[] = {
 			0,
 			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
-			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+			0,
 			0,
 		};
 
 		VkDescriptorSetLayoutBindingFlagsCreateInfo flags_create_info = {
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
-			.bindingCount  = 4,
+			.bindingCount  = 5,
 			.pBindingFlags = flags,
 		};
 
@@ -803,7 +1237,7 @@ void renderer_create_global_uniforms()
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 			.pNext = &flags_create_info,
 			.flags        = 0,
-			.bindingCount = 4,
+			.bindingCount = 5,
 			.pBindings    = bindings,
 		};
 
@@ -843,25 +1277,55 @@ void renderer_create_global_uniforms()
 						nullptr);
 		name_object(renderer->global_uniform_data_buffer.buffer, "Global data uniform buffer");
 	}
+
+	// Instance buffer
+	{
+		ZoneScopedN("Instance buffer creation");
+
+		renderer->instance_buffer_frame_size = clamp_size_to_alignment(
+			MAX_INSTANCES * sizeof(glm::mat4),
+			gfx_context->physical_device_properties.properties.limits.minStorageBufferOffsetAlignment);
+
+		VkBufferCreateInfo buffer_create_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size  = renderer->instance_buffer_frame_size * renderer->buffering,
+			.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		};
+
+		VmaAllocationCreateInfo vma_buffer_create_info = {
+			.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+			.usage = VMA_MEMORY_USAGE_AUTO,
+		};
+
+		VmaAllocationInfo allocation_info;
+		vmaCreateBuffer(gfx_context->vma_allocator,
+						&buffer_create_info,
+						&vma_buffer_create_info,
+						&renderer->instance_buffer.buffer,
+						&renderer->instance_buffer.allocation,
+						&allocation_info);
+		name_object(renderer->instance_buffer.buffer, "Instance buffer");
+
+		renderer->instance_buffer_ptr = reinterpret_cast<uint8_t*>(allocation_info.pMappedData);
+	}
 }
 
 std::vector<uint8_t> load_file(const char* file_path)
 {
-	std::ifstream file(file_path, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open())
+	// High priority, so it doesn't wait behind scene streaming
+	Io_Read read = io_read({
+		.path     = file_path,
+		.offset   = 0,
+		.size     = IO_WHOLE_FILE,
+		.priority = Io_Priority::HIGH,
+	}).get();
+
+	if (!read.ok)
 	{
 		throw std::runtime_error("Shader file open!");
 	}
 
-	size_t file_size = (size_t) file.tellg();
-	std::vector<uint8_t> buffer(file_size);
-
-	file.seekg(0);
-	file.read((char*) buffer.data(), file_size);
-	file.close();
-
-	return buffer;
+	return std::move(read.bytes);
 }
 
 void renderer_create_shaders()
@@ -906,7 +1370,7 @@ void renderer_create_pipeline()
 		VkPushConstantRange push_constant_range = {
 			.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS,
 			.offset     = 0,
-			.size       = 16 * sizeof(float) + 4,
+			.size       = sizeof(Draw_Push_Constants),
 		};
 
 		VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
@@ -921,159 +1385,200 @@ void renderer_create_pipeline()
 		name_object(renderer->pipeline_layout, "Pipeline layout");
 	}
 
-	// Pipeline
-	{
-		VkPipelineShaderStageCreateInfo vert_stage = {
-			.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.stage  = VK_SHADER_STAGE_VERTEX_BIT,
-			.module = renderer->vertex_shader,
-			.pName  = "main",
-		};
-		VkPipelineShaderStageCreateInfo frag_stage = {
-			.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.stage  = VK_SHADER_STAGE_FRAGMENT_BIT,
-			.module = renderer->fragment_shader,
-			.pName  = "main",
-		};
-		VkPipelineShaderStageCreateInfo stages[2] = {vert_stage, frag_stage};
+	// Pipeline for regular (not quantized) meshes up-front, the rest once they show up
+	renderer_get_pipeline(Vertex_Format{});
+}
 
-		VkVertexInputBindingDescription binding_description = {
+VkPipeline renderer_get_pipeline(const Vertex_Format& vertex_format)
+{
+	auto found = renderer->pipelines.find(vertex_format);
+	if (found != renderer->pipelines.end()) return found->second;
+
+	// Position stream, then the other attributes
+	VkVertexInputBindingDescription binding_descriptions[] = {
+		{
 			.binding   = 0,
-			.stride    = 12 * sizeof(float),
+			.stride    = vertex_attribute_size(vertex_format.position),
 			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-		};
+		},
+		{
+			.binding   = 1,
+			.stride    = vertex_attributes_stride(vertex_format),
+			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+		},
+	};
 
-		VkVertexInputAttributeDescription vertex_attributes[] = {
-			{ // Position attribute
-				.location = 0,
-				.binding  = 0,
-				.format   = VK_FORMAT_R32G32B32_SFLOAT,
-				.offset   = 0,
-			},
-			{ // Normal attribute
-				.location = 1,
-				.binding  = 0,
-				.format   = VK_FORMAT_R32G32B32_SFLOAT,
-				.offset   = 3 * sizeof(float),
-			},
-			{ // Tangents attribute
-				.location = 2,
-				.binding  = 0,
-				.format   = VK_FORMAT_R32G32B32A32_SFLOAT,
-				.offset   = 6 * sizeof(float),
-			},
-			{ // UV attribute
-				.location = 3,
-				.binding  = 0,
-				.format   = VK_FORMAT_R32G32_SFLOAT,
-				.offset   = 10 * sizeof(float),
-			},
-		};
+	uint32_t tangent_offset  = vertex_attribute_size(vertex_format.normal);
+	uint32_t texcoord_offset = tangent_offset + vertex_attribute_size(vertex_format.tangent);
 
-		VkPipelineVertexInputStateCreateInfo vertex_input_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-			.vertexBindingDescriptionCount   = 1,
-			.pVertexBindingDescriptions      = &binding_description,
-			.vertexAttributeDescriptionCount = 4,
-			.pVertexAttributeDescriptions    = vertex_attributes,
-		};
+	VkVertexInputAttributeDescription vertex_attributes[] = {
+		{ // Position attribute
+			.location = 0,
+			.binding  = 0,
+			.format   = vertex_format.position,
+			.offset   = 0,
+		},
+		{ // Normal attribute
+			.location = 1,
+			.binding  = 1,
+			.format   = vertex_format.normal,
+			.offset   = 0,
+		},
+		{ // Tangents attribute
+			.location = 2,
+			.binding  = 1,
+			.format   = vertex_format.tangent,
+			.offset   = tangent_offset,
+		},
+		{ // UV attribute
+			.location = 3,
+			.binding  = 1,
+			.format   = vertex_format.texcoord,
+			.offset   = texcoord_offset,
+		},
+	};
 
-		VkPipelineInputAssemblyStateCreateInfo input_assembly_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-			.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		};
+	VkPipelineVertexInputStateCreateInfo vertex_input_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount   = 2,
+		.pVertexBindingDescriptions      = binding_descriptions,
+		.vertexAttributeDescriptionCount = 4,
+		.pVertexAttributeDescriptions    = vertex_attributes,
+	};
 
-		VkPipelineRasterizationStateCreateInfo rasterization_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-			.depthClampEnable        = VK_FALSE,
-			.rasterizerDiscardEnable = VK_FALSE,
-			.polygonMode             = VK_POLYGON_MODE_FILL,
-			.cullMode                = VK_CULL_MODE_NONE,
-			.frontFace               = VK_FRONT_FACE_CLOCKWISE,
-			.depthBiasEnable         = VK_FALSE,
-			.depthBiasConstantFactor = 0.0f,
-			.depthBiasClamp          = 0.0f,
-			.depthBiasSlopeFactor    = 0.0f,
-			.lineWidth               = 1.0f,
-		};
+	VkPipeline pipeline = renderer_create_main_pipeline(renderer->vertex_shader, renderer->pipeline_layout,
+	                                                    vertex_input_state, vertex_format.packed);
+	name_object(pipeline, "Main pipeline {}", renderer->pipelines.size());
+
+	renderer->pipelines[vertex_format] = pipeline;
+	return pipeline;
+}
+
+VkPipeline renderer_create_main_pipeline(VkShaderModule vertex_shader, VkPipelineLayout layout,
+                                         const VkPipelineVertexInputStateCreateInfo& vertex_input_state, bool packed)
+{
+	ZoneScopedN("Pipeline creation");
 
-		VkPipelineMultisampleStateCreateInfo multisample_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-			.rasterizationSamples  = VK_SAMPLE_COUNT_1_BIT,
-			.sampleShadingEnable   = VK_FALSE,
-			.minSampleShading      = 1.0f,
-			.pSampleMask           = nullptr,
-			.alphaToCoverageEnable = VK_FALSE,
-			.alphaToOneEnable      = VK_FALSE,
-		};
+	// Vertex shader decodes octahedral normals and tangents of packed vertices (PACKED_VERTICES constant)
+	VkBool32 packed_constant = packed;
+	VkSpecializationMapEntry specialization_entry = { .constantID = 0, .offset = 0, .size = sizeof(VkBool32) };
+	VkSpecializationInfo     specialization_info  = {
+		.mapEntryCount = 1,
+		.pMapEntries   = &specialization_entry,
+		.dataSize      = sizeof(packed_constant),
+		.pData         = &packed_constant,
+	};
 
-		VkPipelineViewportStateCreateInfo viewport_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-			.viewportCount = 1,
-			.scissorCount  = 1,
-		};
+	VkPipelineShaderStageCreateInfo vert_stage = {
+		.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage  = VK_SHADER_STAGE_VERTEX_BIT,
+		.module = vertex_shader,
+		.pName  = "main",
+		.pSpecializationInfo = &specialization_info,
+	};
+	VkPipelineShaderStageCreateInfo frag_stage = {
+		.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage  = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.module = renderer->fragment_shader,
+		.pName  = "main",
+	};
+	VkPipelineShaderStageCreateInfo stages[2] = {vert_stage, frag_stage};
 
-		VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-		VkPipelineDynamicStateCreateInfo dynamic_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-			.dynamicStateCount = 2,
-			.pDynamicStates    = dynamic_states,
-		};
+	VkPipelineInputAssemblyStateCreateInfo input_assembly_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+	};
 
-		VkPipelineColorBlendAttachmentState color_blend_attachment_state = {
-			.blendEnable    = VK_FALSE,
-			.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-		};
+	VkPipelineRasterizationStateCreateInfo rasterization_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.depthClampEnable        = VK_FALSE,
+		.rasterizerDiscardEnable = VK_FALSE,
+		.polygonMode             = VK_POLYGON_MODE_FILL,
+		.cullMode                = VK_CULL_MODE_NONE,
+		.frontFace               = VK_FRONT_FACE_CLOCKWISE,
+		.depthBiasEnable         = VK_FALSE,
+		.depthBiasConstantFactor = 0.0f,
+		.depthBiasClamp          = 0.0f,
+		.depthBiasSlopeFactor    = 0.0f,
+		.lineWidth               = 1.0f,
+	};
 
-		VkPipelineColorBlendStateCreateInfo color_blend_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-			.logicOpEnable   = VK_FALSE,
-			.logicOp         = VK_LOGIC_OP_COPY,
-			.attachmentCount = 1,
-			.pAttachments    = &color_blend_attachment_state,
-		};
+	VkPipelineMultisampleStateCreateInfo multisample_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples  = VK_SAMPLE_COUNT_1_BIT,
+		.sampleShadingEnable   = VK_FALSE,
+		.minSampleShading      = 1.0f,
+		.pSampleMask           = nullptr,
+		.alphaToCoverageEnable = VK_FALSE,
+		.alphaToOneEnable      = VK_FALSE,
+	};
 
-		VkPipelineRenderingCreateInfo pipeline_rendering_create_info = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
-			.colorAttachmentCount    = 1,
-			.pColorAttachmentFormats = &gfx_context->swapchain.selected_format.format,
-			.depthAttachmentFormat   = VK_FORMAT_D32_SFLOAT,
-			.stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
-		};
+	VkPipelineViewportStateCreateInfo viewport_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.viewportCount = 1,
+		.scissorCount  = 1,
+	};
 
-		VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-			.depthTestEnable       = true,
-			.depthWriteEnable      = true,
-			.depthCompareOp        = VK_COMPARE_OP_LESS_OR_EQUAL,
-			.depthBoundsTestEnable = false,
-			.stencilTestEnable     = false,
-		};
+	VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkPipelineDynamicStateCreateInfo dynamic_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.dynamicStateCount = 2,
+		.pDynamicStates    = dynamic_states,
+	};
 
-		VkGraphicsPipelineCreateInfo pipeline_create_info = {
-			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-			.pNext = &pipeline_rendering_create_info,
-			.flags      = 0,
-			.stageCount = 2,
-			.pStages    = stages,
-			.pVertexInputState   = &vertex_input_state,
-			.pInputAssemblyState = &input_assembly_state,
-			.pViewportState      = &viewport_state,
-			.pRasterizationState = &rasterization_state,
-			.pMultisampleState   = &multisample_state,
-			.pDepthStencilState  = &depth_stencil_state,
-			.pColorBlendState    = &color_blend_state,
-			.pDynamicState       = &dynamic_state,
-			.layout              = renderer->pipeline_layout,
-			.renderPass          = VK_NULL_HANDLE,
-			.subpass             = 0,
-			.basePipelineHandle  = VK_NULL_HANDLE,
-		};
+	VkPipelineColorBlendAttachmentState color_blend_attachment_state = {
+		.blendEnable    = VK_FALSE,
+		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	};
 
-		vkCreateGraphicsPipelines(gfx_context->device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr,
-								  &renderer->pipeline);
-		name_object(renderer->pipeline, "Main pipeline");
-	}
+	VkPipelineColorBlendStateCreateInfo color_blend_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.logicOpEnable   = VK_FALSE,
+		.logicOp         = VK_LOGIC_OP_COPY,
+		.attachmentCount = 1,
+		.pAttachments    = &color_blend_attachment_state,
+	};
+
+	VkPipelineRenderingCreateInfo pipeline_rendering_create_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+		.colorAttachmentCount    = 1,
+		.pColorAttachmentFormats = &gfx_context->swapchain.selected_format.format,
+		.depthAttachmentFormat   = VK_FORMAT_D32_SFLOAT,
+		.stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+	};
+
+	VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable       = true,
+		.depthWriteEnable      = true,
+		.depthCompareOp        = VK_COMPARE_OP_LESS_OR_EQUAL,
+		.depthBoundsTestEnable = false,
+		.stencilTestEnable     = false,
+	};
+
+	VkGraphicsPipelineCreateInfo pipeline_create_info = {
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.pNext = &pipeline_rendering_create_info,
+		.flags      = 0,
+		.stageCount = 2,
+		.pStages    = stages,
+		.pVertexInputState   = &vertex_input_state,
+		.pInputAssemblyState = &input_assembly_state,
+		.pViewportState      = &viewport_state,
+		.pRasterizationState = &rasterization_state,
+		.pMultisampleState   = &multisample_state,
+		.pDepthStencilState  = &depth_stencil_state,
+		.pColorBlendState    = &color_blend_state,
+		.pDynamicState       = &dynamic_state,
+		.layout              = layout,
+		.renderPass          = VK_NULL_HANDLE,
+		.subpass             = 0,
+		.basePipelineHandle  = VK_NULL_HANDLE,
+	};
+
+	VkPipeline pipeline;
+	vkCreateGraphicsPipelines(gfx_context->device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &pipeline);
+	return pipeline;
 }
 
 void renderer_destroy_pipeline()
@@ -1140,14 +1645,15 @@ void renderer_init_shadow_pass()
 		VkPushConstantRange push_constant_range = {
 			.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS,
 			.offset     = 0,
-			.size       = 32 * sizeof(float), // Projection matrix + model matrix
+			.size       = sizeof(Shadow_Push_Constants),
 		};
 
+		// Global set is only needed for instance transforms
 		VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 			.flags = 0,
-			.setLayoutCount         = 0,
-			.pSetLayouts            = nullptr,
+			.setLayoutCount         = 1,
+			.pSetLayouts            = &renderer->global_data_descriptor_set_layout,
 			.pushConstantRangeCount = 1,
 			.pPushConstantRanges    = &push_constant_range,
 		};
@@ -1156,149 +1662,160 @@ void renderer_init_shadow_pass()
 		name_object(renderer->shadow_pass.pipeline_layout, "Shadow pass layout");
 	}
 
-	// Pipeline
-	{
-		VkPipelineShaderStageCreateInfo vert_stage = {
-			.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.stage  = VK_SHADER_STAGE_VERTEX_BIT,
-			.module = renderer->shadow_pass.vertex_shader,
-			.pName  = "main",
-		};
-		VkPipelineShaderStageCreateInfo frag_stage = {
-			.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.stage  = VK_SHADER_STAGE_FRAGMENT_BIT,
-			.module = renderer->shadow_pass.fragment_shader,
-			.pName  = "main",
-		};
-		VkPipelineShaderStageCreateInfo stages[2] = {vert_stage, frag_stage};
+	shadow_pass_get_pipeline(Vertex_Format{});
+}
 
-		VkVertexInputBindingDescription binding_description = {
-			.binding   = 0,
-			.stride    = 12 * sizeof(float),
-			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-		};
+VkPipeline shadow_pass_get_pipeline(const Vertex_Format& vertex_format)
+{
+	auto found = renderer->shadow_pass.pipelines.find(vertex_format);
+	if (found != renderer->shadow_pass.pipelines.end()) return found->second;
 
-		VkVertexInputAttributeDescription vertex_attributes[] = {
-			{ // Position attribute
-				.location = 0,
-				.binding  = 0,
-				.format   = VK_FORMAT_R32G32B32_SFLOAT,
-				.offset   = 0,
-			},
-		};
+	ZoneScopedN("Shadow pass pipeline creation");
 
-		VkPipelineVertexInputStateCreateInfo vertex_input_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-			.vertexBindingDescriptionCount   = 1,
-			.pVertexBindingDescriptions      = &binding_description,
-			.vertexAttributeDescriptionCount = 1,
-			.pVertexAttributeDescriptions    = vertex_attributes,
-		};
+	VkPipelineShaderStageCreateInfo vert_stage = {
+		.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage  = VK_SHADER_STAGE_VERTEX_BIT,
+		.module = renderer->shadow_pass.vertex_shader,
+		.pName  = "main",
+	};
+	VkPipelineShaderStageCreateInfo frag_stage = {
+		.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage  = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.module = renderer->shadow_pass.fragment_shader,
+		.pName  = "main",
+	};
+	VkPipelineShaderStageCreateInfo stages[2] = {vert_stage, frag_stage};
 
-		VkPipelineInputAssemblyStateCreateInfo input_assembly_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-			.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST,
-		};
+	// Only position stream
+	VkVertexInputBindingDescription binding_description = {
+		.binding   = 0,
+		.stride    = vertex_attribute_size(vertex_format.position),
+		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+	};
 
-		VkPipelineRasterizationStateCreateInfo rasterization_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-			.depthClampEnable        = VK_FALSE,
-			.rasterizerDiscardEnable = VK_FALSE,
-			.polygonMode             = VK_POLYGON_MODE_FILL,
-			.cullMode                = VK_CULL_MODE_NONE,
-			.frontFace               = VK_FRONT_FACE_CLOCKWISE,
-			.depthBiasEnable         = VK_FALSE,
-			.depthBiasConstantFactor = 0.0f,
-			.depthBiasClamp          = 0.0f,
-			.depthBiasSlopeFactor    = 0.0f,
-			.lineWidth               = 1.0f,
-		};
+	VkVertexInputAttributeDescription vertex_attributes[] = {
+		{ // Position attribute
+			.location = 0,
+			.binding  = 0,
+			.format   = vertex_format.position,
+			.offset   = 0,
+		},
+	};
 
-		VkPipelineMultisampleStateCreateInfo multisample_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-			.rasterizationSamples  = VK_SAMPLE_COUNT_1_BIT,
-			.sampleShadingEnable   = VK_FALSE,
-			.minSampleShading      = 1.0f,
-			.pSampleMask           = nullptr,
-			.alphaToCoverageEnable = VK_FALSE,
-			.alphaToOneEnable      = VK_FALSE,
-		};
+	VkPipelineVertexInputStateCreateInfo vertex_input_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount   = 1,
+		.pVertexBindingDescriptions      = &binding_description,
+		.vertexAttributeDescriptionCount = 1,
+		.pVertexAttributeDescriptions    = vertex_attributes,
+	};
 
-		VkPipelineDynamicStateCreateInfo dynamic_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-		};
+	VkPipelineInputAssemblyStateCreateInfo input_assembly_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST,
+	};
 
-		VkPipelineColorBlendAttachmentState color_blend_attachment_state = {
-			.blendEnable    = VK_FALSE,
-			.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-		};
+	VkPipelineRasterizationStateCreateInfo rasterization_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.depthClampEnable        = VK_FALSE,
+		.rasterizerDiscardEnable = VK_FALSE,
+		.polygonMode             = VK_POLYGON_MODE_FILL,
+		.cullMode                = VK_CULL_MODE_NONE,
+		.frontFace               = VK_FRONT_FACE_CLOCKWISE,
+		.depthBiasEnable         = VK_FALSE,
+		.depthBiasConstantFactor = 0.0f,
+		.depthBiasClamp          = 0.0f,
+		.depthBiasSlopeFactor    = 0.0f,
+		.lineWidth               = 1.0f,
+	};
 
-		VkPipelineColorBlendStateCreateInfo color_blend_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-			.logicOpEnable   = VK_FALSE,
-			.logicOp         = VK_LOGIC_OP_COPY,
-			.attachmentCount = 1,
-			.pAttachments    = &color_blend_attachment_state,
-		};
+	VkPipelineMultisampleStateCreateInfo multisample_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples  = VK_SAMPLE_COUNT_1_BIT,
+		.sampleShadingEnable   = VK_FALSE,
+		.minSampleShading      = 1.0f,
+		.pSampleMask           = nullptr,
+		.alphaToCoverageEnable = VK_FALSE,
+		.alphaToOneEnable      = VK_FALSE,
+	};
 
-		VkPipelineRenderingCreateInfo pipeline_rendering_create_info = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
-			.colorAttachmentCount    = 0,
-			.depthAttachmentFormat   = VK_FORMAT_D32_SFLOAT,
-			.stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
-		};
+	VkPipelineDynamicStateCreateInfo dynamic_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+	};
 
-		VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-			.depthTestEnable       = true,
-			.depthWriteEnable      = true,
-			.depthCompareOp        = VK_COMPARE_OP_LESS_OR_EQUAL,
-			.depthBoundsTestEnable = false,
-			.stencilTestEnable     = false,
-		};
+	VkPipelineColorBlendAttachmentState color_blend_attachment_state = {
+		.blendEnable    = VK_FALSE,
+		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	};
 
-		VkViewport viewport = {
-			.x        = 0,
-			.y        = (float) 2048,
-			.width    = (float) 2048,
-			.height   = -1 * (float) 2048,
-			.minDepth = 0.0f,
-			.maxDepth = 1.0f,
-		};
-		VkRect2D scissor = { .offset = {}, .extent = { 2048, 2048 } };
+	VkPipelineColorBlendStateCreateInfo color_blend_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.logicOpEnable   = VK_FALSE,
+		.logicOp         = VK_LOGIC_OP_COPY,
+		.attachmentCount = 1,
+		.pAttachments    = &color_blend_attachment_state,
+	};
 
-		VkPipelineViewportStateCreateInfo viewport_state = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-			.viewportCount = 1,
-			.pViewports    = &viewport,
-			.scissorCount  = 1,
-			.pScissors     = &scissor,
-		};
+	VkPipelineRenderingCreateInfo pipeline_rendering_create_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+		.colorAttachmentCount    = 0,
+		.depthAttachmentFormat   = VK_FORMAT_D32_SFLOAT,
+		.stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+	};
 
-		VkGraphicsPipelineCreateInfo pipeline_create_info = {
-			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-			.pNext = &pipeline_rendering_create_info,
-			.flags      = 0,
-			.stageCount = 2,
-			.pStages    = stages,
-			.pVertexInputState   = &vertex_input_state,
-			.pInputAssemblyState = &input_assembly_state,
-			.pViewportState      = &viewport_state,
-			.pRasterizationState = &rasterization_state,
-			.pMultisampleState   = &multisample_state,
-			.pDepthStencilState  = &depth_stencil_state,
-			.pColorBlendState    = &color_blend_state,
-			.pDynamicState       = &dynamic_state,
-			.layout              = renderer->shadow_pass.pipeline_layout,
-			.renderPass          = VK_NULL_HANDLE,
-			.subpass             = 0,
-			.basePipelineHandle  = VK_NULL_HANDLE,
-		};
+	VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable       = true,
+		.depthWriteEnable      = true,
+		.depthCompareOp        = VK_COMPARE_OP_LESS_OR_EQUAL,
+		.depthBoundsTestEnable = false,
+		.stencilTestEnable     = false,
+	};
 
-		vkCreateGraphicsPipelines(gfx_context->device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr,
-								  &renderer->shadow_pass.pipeline);
-		name_object(renderer->shadow_pass.pipeline, "Shadow pass line pipeline");
-	}
+	VkViewport viewport = {
+		.x        = 0,
+		.y        = (float) 2048,
+		.width    = (float) 2048,
+		.height   = -1 * (float) 2048,
+		.minDepth = 0.0f,
+		.maxDepth = 1.0f,
+	};
+	VkRect2D scissor = { .offset = {}, .extent = { 2048, 2048 } };
+
+	VkPipelineViewportStateCreateInfo viewport_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.viewportCount = 1,
+		.pViewports    = &viewport,
+		.scissorCount  = 1,
+		.pScissors     = &scissor,
+	};
+
+	VkGraphicsPipelineCreateInfo pipeline_create_info = {
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.pNext = &pipeline_rendering_create_info,
+		.flags      = 0,
+		.stageCount = 2,
+		.pStages    = stages,
+		.pVertexInputState   = &vertex_input_state,
+		.pInputAssemblyState = &input_assembly_state,
+		.pViewportState      = &viewport_state,
+		.pRasterizationState = &rasterization_state,
+		.pMultisampleState   = &multisample_state,
+		.pDepthStencilState  = &depth_stencil_state,
+		.pColorBlendState    = &color_blend_state,
+		.pDynamicState       = &dynamic_state,
+		.layout              = renderer->shadow_pass.pipeline_layout,
+		.renderPass          = VK_NULL_HANDLE,
+		.subpass             = 0,
+		.basePipelineHandle  = VK_NULL_HANDLE,
+	};
+
+	VkPipeline pipeline;
+	vkCreateGraphicsPipelines(gfx_context->device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &pipeline);
+	name_object(pipeline, "Shadow pass line pipeline {}", renderer->shadow_pass.pipelines.size());
+
+	renderer->shadow_pass.pipelines[vertex_format] = pipeline;
+	return pipeline;
 }
 
 Upload_Heap::Upload_Heap(size_t initial_size)
@@ -1338,12 +1855,12 @@ Upload_Heap::~Upload_Heap()
 
 void Upload_Heap::begin_frame()
 {
+	std::lock_guard lock(mutex);
+
 	frame_number++;
-	
-	if (delete_queue.size() == 0) return;
 
 	// Process deletes
-	for (; delete_queue.front().frame < frame_number - 3; delete_queue.pop_front())
+	for (; !delete_queue.empty() && delete_queue.front().frame < frame_number - 3; delete_queue.pop_front())
 	{
 		Free_Slot& slot = delete_queue.front();
 		vmaVirtualFree(virtual_block, slot.block.allocation);
@@ -1352,6 +1869,8 @@ void Upload_Heap::begin_frame()
 
 Upload_Heap::Block Upload_Heap::allocate_block(size_t size, size_t alignment)
 {
+	std::lock_guard lock(mutex);
+
 	VmaVirtualAllocationCreateInfo virtual_allocation_create_info = { 
 		.size      = size, 
 		.alignment = alignment,
@@ -1375,16 +1894,34 @@ Upload_Heap::Block Upload_Heap::allocate_block(size_t size, size_t alignment)
 
 void Upload_Heap::submit_free(Upload_Heap::Block block)
 {
+	std::lock_guard lock(mutex);
+
 	Free_Slot free_slot = { .block = block, .frame = frame_number };
 	delete_queue.push_back(free_slot);
 
+	flush_block(block);
+}
+
+void Upload_Heap::flush_block(Upload_Heap::Block block)
+{
 	vmaFlushAllocation(gfx_context->vma_allocator, upload_buffer.allocation, block.offset, block.size);
 }
 
+void Upload_Heap::free_block(Upload_Heap::Block block)
+{
+	std::lock_guard lock(mutex);
+
+	vmaVirtualFree(virtual_block, block.allocation);
+}
+
 void renderer_dispatch()
 {
 	ZoneScopedN("Renderer dispatch");
 
+	// Submit whatever scene loader prepared, so it's part of this frame
+	scene_loader_update();
+	scene_data_update_transforms();
+
 	auto frame_i = app->frame_number % renderer->buffering;
 	auto current_frame = &renderer->frame_data[frame_i];
 
@@ -1580,6 +2117,8 @@ void renderer_dispatch()
 	};
 	vkBeginCommandBuffer(current_frame->draw_command_buffer, &draw_begin_info);
 
+	mesh_manager_update(current_frame->draw_command_buffer);
+
 	{
 		ZoneScopedN("Transition shit");
 
@@ -1608,6 +2147,32 @@ void renderer_dispatch()
 			1, &render_transition_barrier);
 	}
 
+	// Instance transforms, rewritten only if they changed since frame's part of buffer was used
+	auto current_instance_buffer_offset = static_cast<uint32_t>(renderer->instance_buffer_frame_size * frame_i);
+	if (current_frame->instances_version != scene_data->instances_version)
+	{
+		ZoneScopedN("Instance transforms writing");
+
+		size_t size = scene_data->instance_transforms.size() * sizeof(glm::mat4);
+		memcpy(renderer->instance_buffer_ptr + current_instance_buffer_offset,
+			   scene_data->instance_transforms.data(), size);
+		vmaFlushAllocation(gfx_context->vma_allocator, renderer->instance_buffer.allocation,
+						   current_instance_buffer_offset, size);
+
+		current_frame->instances_version = scene_data->instances_version;
+	}
+
+	vertex_pulling_prepare(frame_i);
+
+	// Has to be recorded outside of rendering
+	Culling_View culling_view = culling_view_create(render_matrix, camera->position);
+	meshlet_culling->meshlets_total   = 0;
+	meshlet_culling->meshlets_visible = 0;
+	if (meshlet_culling->mode == Culling_Mode::GPU)
+	{
+		meshlet_cull_gpu(current_frame->draw_command_buffer, frame_i, culling_view);
+	}
+
 	{
 		VkClearValue depth_clear_value = { .depthStencil = { .depth = 1 } };
 
@@ -1634,9 +2199,11 @@ void renderer_dispatch()
 			.pDepthAttachment     = &depth_attachment_info,
 		};
 
+		// Meshes of other vertex formats rebind as needed
+		VkPipeline bound_pipeline = shadow_pass_get_pipeline(Vertex_Format{});
 		{
 			ZoneScopedN("Pipeline bind");
-			vkCmdBindPipeline(current_frame->draw_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderer->shadow_pass.pipeline);
+			vkCmdBindPipeline(current_frame->draw_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bound_pipeline);
 		}
 
 		vkCmdBeginRendering(current_frame->draw_command_buffer, &rendering_info);
@@ -1649,19 +2216,37 @@ void renderer_dispatch()
 			glm::mat4 proj = glm::ortho(0.0f, 800.0f, 0.0f, 600.0f, 0.1f, 100.0f);
 			glm::mat4 light_space = proj * pos * glm::rotate(glm::identity<glm::mat4>(), 3.14f/2.f, glm::vec3(0.62, 0, 0.777));
 
-			vkCmdPushConstants(current_frame->draw_command_buffer, renderer->shadow_pass.pipeline_layout,
-							   VK_SHADER_STAGE_ALL_GRAPHICS, 16 * sizeof(float), 16 * sizeof(float), &light_space);
+			Shadow_Push_Constants push_constants = { .light_space_matrix = light_space };
+
+			uint32_t offsets[] = { static_cast<uint32_t>(current_per_frame_data_buffer_offset),
+			                       current_instance_buffer_offset };
+			vkCmdBindDescriptorSets(current_frame->draw_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+									renderer->shadow_pass.pipeline_layout, 0, 1, &renderer->global_data_descriptor_set,
+									2, offsets);
 
-			for (auto& render_object : scene_data->render_objects)
+			for (auto& group : scene_data->instance_groups)
 			{
-				Mesh_Manager::Mesh_Description mesh = mesh_manager->get_mesh(render_object.mesh_id);
+				auto& mesh = mesh_manager->get_mesh(group.mesh_id);
+
+				VkPipeline pipeline = shadow_pass_get_pipeline(mesh.vertex_format);
+				if (pipeline != bound_pipeline)
+				{
+					vkCmdBindPipeline(current_frame->draw_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+					bound_pipeline = pipeline;
+				}
+
+				push_constants.position_offset = mesh.position_offset;
+				push_constants.position_scale  = mesh.position_scale;
+				vkCmdPushConstants(current_frame->draw_command_buffer, renderer->shadow_pass.pipeline_layout,
+								   VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(push_constants), &push_constants);
+
+				// Position stream only
 				vkCmdBindVertexBuffers(current_frame->draw_command_buffer, 0, 1, &mesh_manager->vertex_buffer.buffer,
 									   &mesh.vertex_offset);
 				vkCmdBindIndexBuffer(current_frame->draw_command_buffer, mesh_manager->indices_buffer.buffer,
-									 mesh.indices_offset, VK_INDEX_TYPE_UINT16);
-				vkCmdPushConstants(current_frame->draw_command_buffer, renderer->shadow_pass.pipeline_layout,
-								   VK_SHADER_STAGE_ALL_GRAPHICS, 0, 16 * sizeof(float), &render_object.transform);
-				vkCmdDrawIndexed(current_frame->draw_command_buffer, mesh.indices_count, 1, 0, 0, 1);
+									 mesh.indices_offset, mesh.index_type);
+				vkCmdDrawIndexed(current_frame->draw_command_buffer, mesh.indices_count, group.instance_count, 0, 0,
+								 group.first_instance);
 			}
 		}
 		command_buffer_region_end(current_frame->draw_command_buffer);
@@ -1787,18 +2372,21 @@ void renderer_dispatch()
 		{
 			ZoneScopedN("Bind descriptor");
 
-			uint32_t offset = current_per_frame_data_buffer_offset;
+			uint32_t offsets[] = { static_cast<uint32_t>(current_per_frame_data_buffer_offset),
+			                       current_instance_buffer_offset };
 			vkCmdBindDescriptorSets(current_frame->draw_command_buffer,
 									VK_PIPELINE_BIND_POINT_GRAPHICS,
 									renderer->pipeline_layout,
 									0,
 									1, &renderer->global_data_descriptor_set,
-									1, &offset);
+									2, offsets);
 		}
 
+		// Meshes of other vertex formats rebind as needed
+		VkPipeline bound_pipeline = renderer_get_pipeline(Vertex_Format{});
 		{
 			ZoneScopedN("Pipeline bind");
-			vkCmdBindPipeline(current_frame->draw_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderer->pipeline);
+			vkCmdBindPipeline(current_frame->draw_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bound_pipeline);
 		}
 
 		vkCmdBeginRendering(current_frame->draw_command_buffer, &rendering_info);
@@ -1806,18 +2394,104 @@ void renderer_dispatch()
 		{
 			ZoneScopedN("Drawing");
 
-			for (auto& render_object : scene_data->render_objects)
+			std::vector<std::pair<uint32_t, uint32_t>> visible_ranges;
+
+			// Pulled meshes share index buffer bound at zero offset, it's rebound only when index type changes
+			bool        pulling_set_bound = false;
+			VkIndexType bound_index_type  = VK_INDEX_TYPE_MAX_ENUM;
+
+			for (size_t group_i = 0; group_i < scene_data->instance_groups.size(); group_i++)
 			{
-				Mesh_Manager::Mesh_Description mesh = mesh_manager->get_mesh(render_object.mesh_id);
-				vkCmdBindVertexBuffers(current_frame->draw_command_buffer, 0, 1, &mesh_manager->vertex_buffer.buffer,
-									   &mesh.vertex_offset);
-				vkCmdBindIndexBuffer(current_frame->draw_command_buffer, mesh_manager->indices_buffer.buffer,
-									 mesh.indices_offset, VK_INDEX_TYPE_UINT16);
-				vkCmdPushConstants(current_frame->draw_command_buffer, renderer->pipeline_layout,
-								   VK_SHADER_STAGE_ALL_GRAPHICS, 0, 16 * sizeof(float), &render_object.transform);
-				vkCmdPushConstants(current_frame->draw_command_buffer, renderer->pipeline_layout,
-								   VK_SHADER_STAGE_ALL_GRAPHICS, 16 * sizeof(float), 4, &render_object.material_id);
-				vkCmdDrawIndexed(current_frame->draw_command_buffer, mesh.indices_count, 1, 0, 0, 1);
+				auto& group = scene_data->instance_groups[group_i];
+				auto& mesh  = mesh_manager->get_mesh(group.mesh_id);
+
+				bool       pulled   = vertex_pulling_used(mesh, group_i);
+				VkPipeline pipeline = pulled ? vertex_pulling_pipeline(mesh)
+				                             : renderer_get_pipeline(mesh.vertex_format);
+				if (pipeline != bound_pipeline)
+				{
+					vkCmdBindPipeline(current_frame->draw_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+					bound_pipeline = pipeline;
+				}
+
+				// First index of mesh in index buffer, if it isn't bound at mesh's offset
+				uint32_t         index_base      = 0;
+				VkPipelineLayout pipeline_layout = renderer->pipeline_layout;
+				if (pulled)
+				{
+					// Layouts are compatible, global descriptor set stays bound
+					pipeline_layout = vertex_pulling->pipeline_layout;
+					if (!pulling_set_bound)
+					{
+						vkCmdBindDescriptorSets(current_frame->draw_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+												pipeline_layout, 1, 1, &vertex_pulling->frames[frame_i].descriptor_set,
+												0, nullptr);
+						pulling_set_bound = true;
+					}
+					if (bound_index_type != mesh.index_type)
+					{
+						vkCmdBindIndexBuffer(current_frame->draw_command_buffer, mesh_manager->indices_buffer.buffer,
+											 0, mesh.index_type);
+						bound_index_type = mesh.index_type;
+					}
+					index_base = mesh.indices_offset / (mesh.index_type == VK_INDEX_TYPE_UINT32 ? 4 : 2);
+				}
+				else
+				{
+					VkBuffer     vertex_buffer    = mesh_manager->vertex_buffer.buffer;
+					VkBuffer     vertex_buffers[] = { vertex_buffer, vertex_buffer };
+					VkDeviceSize vertex_offsets[] = {
+						mesh.vertex_offset,
+						mesh.vertex_offset + vertex_attributes_offset(mesh.vertex_format, mesh.vertex_count),
+					};
+					vkCmdBindVertexBuffers(current_frame->draw_command_buffer, 0, 2, vertex_buffers, vertex_offsets);
+					vkCmdBindIndexBuffer(current_frame->draw_command_buffer, mesh_manager->indices_buffer.buffer,
+										 mesh.indices_offset, mesh.index_type);
+					bound_index_type = VK_INDEX_TYPE_MAX_ENUM;
+				}
+
+				Draw_Push_Constants push_constants = {
+					.material_id     = group.material_id,
+					.draw_index      = static_cast<uint32_t>(group_i),
+					.position_offset = mesh.position_offset,
+					.position_scale  = mesh.position_scale,
+				};
+				vkCmdPushConstants(current_frame->draw_command_buffer, pipeline_layout,
+								   VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(push_constants), &push_constants);
+
+				meshlet_culling->meshlets_total += mesh.meshlets_count;
+
+				uint32_t first_command = Meshlet_Culling::NO_COMMANDS;
+				if (meshlet_culling->mode == Culling_Mode::GPU)
+				{
+					first_command = meshlet_culling->frames[frame_i].group_commands[group_i];
+				}
+
+				if (first_command != Meshlet_Culling::NO_COMMANDS)
+				{
+					// Culled meshlets are draws without indices
+					vkCmdDrawIndexedIndirect(current_frame->draw_command_buffer,
+											 meshlet_culling->frames[frame_i].commands_buffer.buffer,
+											 first_command * sizeof(VkDrawIndexedIndirectCommand),
+											 mesh.meshlets_count, sizeof(VkDrawIndexedIndirectCommand));
+				}
+				else if (meshlet_culling->mode == Culling_Mode::CPU && mesh.meshlets_count > 0)
+				{
+					visible_ranges.clear();
+					meshlet_cull_cpu(culling_view, &scene_data->instance_transforms[group.first_instance],
+									 group.instance_count, mesh_manager->get_storage(group.mesh_id), &visible_ranges);
+
+					for (auto [first_index, index_count] : visible_ranges)
+					{
+						vkCmdDrawIndexed(current_frame->draw_command_buffer, index_count, group.instance_count,
+										 index_base + first_index, 0, group.first_instance);
+					}
+				}
+				else
+				{
+					vkCmdDrawIndexed(current_frame->draw_command_buffer, mesh.indices_count, group.instance_count,
+									 index_base, 0, group.first_instance);
+				}
 			}
 		}
 		command_buffer_region_end(current_frame->draw_command_buffer);
@@ -1,10 +1,15 @@
 #pragma once
 
 #include "gfx_context.h"
+#include "slot_map.h"
+#include "transform_hierarchy.h"
 #include "vulkan_utilities.h"
 
+#include <compare>
 #include <map>
 #include <deque>
+#include <mutex>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include <vulkan/vulkan.h>
 
@@ -50,50 +55,186 @@ struct Debug_Pass
 
 inline Debug_Pass* debug_pass;
 
-// Meshes are stored in interleaved format, all in one buffer
-// TODO-FUTURE: separate position and properties stream (faster z rendering).
+// Formats of interleaved vertex attributes, in this order. Quantized meshes (KHR_mesh_quantization) keep their
+// compact formats, every attribute is padded to multiple of 4 bytes. Each distinct format gets its own pipelines.
+struct Vertex_Format
+{
+	VkFormat position = VK_FORMAT_R32G32B32_SFLOAT;
+	VkFormat normal   = VK_FORMAT_R32G32B32_SFLOAT;
+	VkFormat tangent  = VK_FORMAT_R32G32B32A32_SFLOAT;
+	VkFormat texcoord = VK_FORMAT_R32G32_SFLOAT;
+	bool     packed   = false; // Normal and tangent are octahedral, w of position is tangent's sign
+
+	auto operator<=>(const Vertex_Format&) const = default;
+};
+
+// Packed vertex is 20 bytes instead of 48: position quantized to mesh bounds (see Mesh_Description), octahedral
+// normal and tangent, half float UV. Opt-in, see Launch_Options::packed_vertices.
+constexpr Vertex_Format PACKED_VERTEX_FORMAT = {
+	.position = VK_FORMAT_R16G16B16A16_UNORM,
+	.normal   = VK_FORMAT_R16G16_SNORM,
+	.tangent  = VK_FORMAT_R16G16_SNORM,
+	.texcoord = VK_FORMAT_R16G16_SFLOAT,
+	.packed   = true,
+};
+
+// Vertices of a mesh are two streams in one region: positions tightly packed (all that depth only passes read), then
+// the other attributes interleaved, from 16 byte boundary
+uint32_t vertex_attribute_size(VkFormat format); // Including padding, 0 if format isn't supported as attribute
+uint32_t vertex_attributes_stride(const Vertex_Format& vertex_format); // Of the second stream
+VkDeviceSize vertex_attributes_offset(const Vertex_Format& vertex_format, uint32_t vertex_count); // From region start
+VkDeviceSize vertex_region_size(const Vertex_Format& vertex_format, uint32_t vertex_count);
+
+// Cluster of up to 64 vertices and 124 triangles, for culling. Triangles of a meshlet are contiguous in mesh's
+// indices. Layout matches the one in meshlet_cull_comp.glsl (std430).
+struct Meshlet
+{
+	glm::vec3 center;      // Bounding sphere, in mesh space
+	float     radius;
+	glm::vec3 cone_apex;   // Normal cone, for back-face culling
+	float     cone_cutoff; // Above 1 if meshlet can't be culled by its cone (e.g. double-sided material)
+	glm::vec3 cone_axis;
+	uint32_t  first_index; // Relative to mesh
+	uint32_t  index_count;
+	uint8_t   _pad0[12];
+};
+
+constexpr uint32_t MESHLET_MAX_VERTICES  = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Device local buffer meshes are sub-allocated from, filled only by copies from upload heap. It starts small and
+// grows when allocation doesn't fit: its address space is a chain of virtual blocks, every growth adds one covering
+// [size, new size), and loader reallocates the buffer, copying old content on GPU (see scene_upload_mesh()).
+struct Mesh_Buffer
+{
+	VkBuffer      buffer;     // Used by frames, switched by main thread once batch that grew it is committed
+	VmaAllocation allocation;
+
+	const char*        name;
+	VkBufferUsageFlags usage;
+	AllocatedBuffer    loader_buffer; // Newest one, loader records its copies into it
+	VkDeviceSize       size;          // Of loader_buffer
+	VkDeviceSize       buffer_size;   // Of buffer
+
+	std::vector<std::pair<VkDeviceSize, VmaVirtualBlock>> blocks; // Base offset, block
+	std::mutex mutex; // Guards blocks, loader allocates and main thread frees
+};
+
+// Block bases are multiple of it, so they satisfy alignment of anything in mesh buffers (sizeof(Meshlet) is largest)
+constexpr VkDeviceSize MESH_BUFFER_GRANULARITY = 64;
+
+void mesh_buffer_init(Mesh_Buffer* mesh_buffer, const char* name, VkBufferUsageFlags usage, VkDeviceSize size);
+void mesh_buffer_deinit(Mesh_Buffer* mesh_buffer);
+
+// Returns false if there's no room left, buffer has to grow first. Alignment has to be power of two, at most
+// MESH_BUFFER_GRANULARITY. Thread safe.
+bool mesh_buffer_allocate(Mesh_Buffer* mesh_buffer, VkDeviceSize size, VkDeviceSize alignment,
+                          VmaVirtualAllocation* allocation, VkDeviceSize* offset,
+                          VmaVirtualAllocationCreateFlags flags = 0);
+void mesh_buffer_free(Mesh_Buffer* mesh_buffer, VmaVirtualAllocation allocation, VkDeviceSize offset);
+
+// Loader side. Creates new loader_buffer with room for at least min_size more bytes, old one is returned and has
+// to be copied into the new one on GPU.
+AllocatedBuffer mesh_buffer_grow(Mesh_Buffer* mesh_buffer, VkDeviceSize min_size);
+
+// Meshes are stored as position stream and interleaved attributes (see vertex_region_size()), all in one buffer
 struct Mesh_Manager
 {
-	typedef uint32_t Id;
+	typedef Slot_Handle Id;
 
-	// TODO should we separate these into two objects? (we only need indices for rendering - better cache utilization)
+	// What drawing needs, kept apart from the rest so the draw loops only touch these
 	struct Mesh_Description
 	{
-		VkDeviceSize vertex_offset;
-		uint32_t     vertex_count;
-		VkDeviceSize indices_offset;
-		uint32_t     indices_count;
+		VkDeviceSize  vertex_offset; // Of position stream, attributes follow it
+		uint32_t      vertex_count;
+		VkDeviceSize  indices_offset;
+		uint32_t      indices_count;
+		Vertex_Format vertex_format;
+		VkIndexType   index_type; // UINT16 or UINT32
+		VkDeviceSize  meshlets_offset; // In meshlet_buffer, multiple of sizeof(Meshlet)
+		uint32_t      meshlets_count;
+		glm::vec3     position_offset = glm::vec3(0.0f); // Position is offset + scale * attribute, for packed ones
+		glm::vec3     position_scale  = glm::vec3(1.0f);
+	};
+
+	// Needed only when mesh is freed or culled on CPU
+	struct Mesh_Storage
+	{
 		VmaVirtualAllocation vertex_allocation;
 		VmaVirtualAllocation indices_allocation;
+		VmaVirtualAllocation meshlets_allocation;
+
+		std::vector<Meshlet> meshlets; // Copy for CPU culling
 	};
 
-	struct Mesh_Upload
+	// Initial sizes, they grow with the scene
+	static const VkDeviceSize VERTEX_BUFFER_SIZE  = 64 * 1024 * 1024;
+	static const VkDeviceSize INDICES_BUFFER_SIZE = 16 * 1024 * 1024;
+	static const VkDeviceSize MESHLET_BUFFER_SIZE = 4 * 1024 * 1024;
+
+	Mesh_Buffer vertex_buffer;
+	Mesh_Buffer indices_buffer;
+	Mesh_Buffer meshlet_buffer;
+
+	Slot_Map<Mesh_Description> meshes;
+	std::vector<Mesh_Storage>  storage; // By slot index of meshes
+
+	// Primitives imported from the same vertex accessors share one vertex allocation, it's only freed with the last
+	// of its meshes
+	std::unordered_map<VmaVirtualAllocation, uint32_t> vertex_users;
+
+	// Ranges of unloaded or moved meshes, freed once frames that might read them are done
+	struct Retired_Range
 	{
-		Id       id;
-		void*    ptr;
-		uint32_t size;
+		uint64_t             frame; // Frames before this one might still read it
+		Mesh_Buffer*         mesh_buffer;
+		VmaVirtualAllocation allocation;
+		VkDeviceSize         offset;
 	};
+	std::deque<Retired_Range> retired_ranges;
 
-	AllocatedBuffer vertex_buffer;
-	AllocatedBuffer indices_buffer;
-	VmaVirtualBlock vertex_sub_allocator;
-	VmaVirtualBlock indices_sub_allocator;
-
-	Id next_index;
-	std::map<Id, Mesh_Description> meshes;
+	bool compaction_stalled = false; // Last compaction moved nothing, tried again once something is freed or loaded
 
 	inline Mesh_Description& get_mesh(Id id) { return meshes[id]; }
+	inline Mesh_Storage& get_storage(Id id) { return storage[id.index]; }
 };
 
 inline Mesh_Manager* mesh_manager;
 
+// Compaction of mesh buffers. Runs while scene loader is idle and buffer has enough free space that ranges above it
+// could move to (see mesh_buffer_holes()), moving about MESH_DEFRAG_FRAME_BUDGET bytes per frame. Range bigger than
+// the budget is moved alone in a frame of its own.
+constexpr VkDeviceSize MESH_DEFRAG_MIN_HOLES    = 4 * 1024 * 1024;
+constexpr VkDeviceSize MESH_DEFRAG_FRAME_BUDGET = 8 * 1024 * 1024;
+
+// Main thread. Mesh is forgotten right away, so nothing may refer to it anymore (render objects included). Its ranges
+// are freed once frames in flight are done with them.
+void mesh_manager_unload(Mesh_Manager::Id id);
+
+// Call every frame on main thread, before anything else is recorded into command_buffer. Frees retired ranges and
+// moves meshes towards start of their buffers (copies are recorded into command_buffer, offsets of meshes are
+// patched right away, so everything recorded after it uses the new ones).
+void mesh_manager_update(VkCommandBuffer command_buffer);
+
 struct Render_Object
 {
 	Mesh_Manager::Id mesh_id;
 	uint32_t         material_id;
-	glm::mat4        transform;
+	uint32_t         transform_node; // In scene_data->transforms
 };
 
+// Render objects sharing mesh and material, drawn with single instanced draw. Transforms of its instances are
+// consecutive in instance buffer, starting at first_instance (shaders index it with gl_InstanceIndex).
+struct Instance_Group
+{
+	Mesh_Manager::Id mesh_id;
+	uint32_t         material_id;
+	uint32_t         first_instance;
+	uint32_t         instance_count;
+};
+
+constexpr uint32_t MAX_INSTANCES = 64 * 1024; // Per frame, instances over the limit aren't drawn
+
 struct Directional_Light
 {
 	glm::vec3 direction;
@@ -112,6 +253,16 @@ struct Scene_Data
 {
 	std::vector<Render_Object> render_objects;
 	std::vector<Point_Light>   point_lights;
+	Transform_Hierarchy        transforms; // Moving node moves all render objects in its subtree
+
+	// Built from render_objects by scene_data_build_instances(), call it whenever they change
+	std::vector<Instance_Group> instance_groups;
+	std::vector<uint32_t>       instance_nodes;
+	bool                        instances_built; // Instance transforms have to be gathered again
+
+	// Gathered from world transforms by scene_data_update_transforms()
+	std::vector<glm::mat4> instance_transforms;
+	uint64_t               instances_version; // Bumped on every gather
 
 	// Directional light
 	float             yaw;
@@ -121,14 +272,17 @@ struct Scene_Data
 
 inline Scene_Data* scene_data;
 
+void scene_data_build_instances();
+void scene_data_update_transforms(); // Call every frame, after scene loader commits and before instances are used
+
+// Images and samplers are referred to by slot index in materials and descriptors
 struct Texture_Manager
 {
 	static const uint32_t DEFAULT_SAMPLER = 0;
 	static const uint32_t DEFAULT_TEXTURE = 0;
 
-	// FIXME Both of these should actually _not_ be textures, but rather an slot allocator.
-	std::vector<VkSampler>            samplers;
-	std::vector<Allocated_View_Image> images;
+	Slot_Map<VkSampler>            samplers;
+	Slot_Map<Allocated_View_Image> images;
 };
 
 inline Texture_Manager* texture_manager;
@@ -153,8 +307,8 @@ struct Material_Manager
 {
 	static const uint32_t DEFAULT_MATERIAL = 0;
 
-	AllocatedBuffer           material_storage_buffer;
-	std::vector<PBR_Material> materials;
+	AllocatedBuffer        material_storage_buffer; // By slot index
+	Slot_Map<PBR_Material> materials;
 };
 
 inline Material_Manager* material_manager;
@@ -171,6 +325,8 @@ struct Frame_Data
 
 	VkSemaphore acquire_semaphore; // Swapchain image_handle acquire event
 
+	uint64_t instances_version; // Of instance transforms in frame's part of instance buffer
+
 	Allocated_View_Image sun_shadow_map;
 };
 
@@ -189,6 +345,9 @@ enum Buffering_Type : uint32_t
 	TRIPLE = 3,
 };
 
+// Room in upload heap for per-frame uploads, on top of scene loader's staging budget
+constexpr size_t UPLOAD_HEAP_FRAME_RESERVE = 32 * 1000 * 1000;
+
 // Manages upload heap.
 // It a persistently mapped, host-visible buffer, that you can use to upload data to other buffers.
 // You allocate space on it, and memcpy to it. You are free to do whatever you want with it.
@@ -220,6 +379,7 @@ struct Upload_Heap
 
 	std::deque<Free_Slot> delete_queue;
 	uint32_t              frame_number; // Internal frame tracking / TODO: do we need it?
+	std::mutex            mutex;        // Scene loader allocates from its own thread
 
 	Upload_Heap(size_t initial_size = 300 * 1000 * 1000); // 300 Mb by default
 	~Upload_Heap();
@@ -227,6 +387,29 @@ struct Upload_Heap
 	void  begin_frame();
 	Block allocate_block(size_t size, size_t alignment = 0);
 	void  submit_free   (Block block);
+	void  flush_block   (Block block);
+	void  free_block    (Block block); // Frees immediately, only when GPU is known to be done with the block
+};
+
+// Push constants of main pipeline, layout matches triangle_vert.glsl and triangle_pull_vert.glsl. Transforms are in
+// instance buffer. Vertex pulling takes offset and scale from draw data instead, see vertex_pulling.h.
+struct Draw_Push_Constants
+{
+	uint32_t  material_id;
+	uint32_t  draw_index; // Only with vertex pulling
+	uint32_t  _pad0[2];
+	glm::vec3 position_offset; // Of mesh, see Mesh_Description
+	float     _pad1;
+	glm::vec3 position_scale;
+};
+
+// Push constants of shadow pass pipeline, layout matches shadow_pass_vert.glsl
+struct Shadow_Push_Constants
+{
+	glm::mat4 light_space_matrix;
+	glm::vec3 position_offset; // Of mesh, see Mesh_Description
+	float     _pad0;
+	glm::vec3 position_scale;
 };
 
 struct Renderer
@@ -236,7 +419,8 @@ struct Renderer
 		VkShaderModule       vertex_shader;
 		VkShaderModule       fragment_shader;
 		VkPipelineLayout     pipeline_layout;
-		VkPipeline           pipeline;
+
+		std::map<Vertex_Format, VkPipeline> pipelines;
 	} shadow_pass;
 
 	Descriptor_Set_Allocator descriptor_set_allocator; // Global descriptor set allocator
@@ -245,6 +429,9 @@ struct Renderer
 	VkDescriptorSetLayout global_data_descriptor_set_layout;
 	VkDescriptorSet       global_data_descriptor_set;
 	AllocatedBuffer       global_uniform_data_buffer;
+	AllocatedBuffer       instance_buffer;            // Transforms of instances, one part per frame
+	uint8_t*              instance_buffer_ptr;
+	size_t                instance_buffer_frame_size; // Size of one part
 
 	// Frames-in-flight related
 	Buffering_Type          buffering;
@@ -256,7 +443,8 @@ struct Renderer
 	VkShaderModule fragment_shader;
 
 	VkPipelineLayout pipeline_layout;
-	VkPipeline       pipeline;
+
+	std::map<Vertex_Format, VkPipeline> pipelines; // Created on first use of vertex format
 
 	// Major stages of rendering a frame are controlled by timeline semaphores with value of frame number
 	// adjusted to avoid having to account for first few frames
@@ -280,4 +468,11 @@ void depth_buffer_create();
 void depth_buffer_destroy();
 
 void renderer_create_frame_data();
-void renderer_destroy_frame_data();
\ No newline at end of file
+void renderer_destroy_frame_data();
+
+// Pipelines matching vertex format of mesh, created on first use
+VkPipeline renderer_get_pipeline(const Vertex_Format& vertex_format);
+VkPipeline shadow_pass_get_pipeline(const Vertex_Format& vertex_format);
+// Main pass pipeline state with given vertex shader and input, packed sets PACKED_VERTICES specialization constant
+VkPipeline renderer_create_main_pipeline(VkShaderModule vertex_shader, VkPipelineLayout layout,
+                                         const VkPipelineVertexInputStateCreateInfo& vertex_input_state, bool packed);
\ No newline at end of file
@@ -0,0 +1,1196 @@
+#include "scene_pack.h"
+
+#include "common.h"
+#include "io_queue.h"
+#include "job_system.h"
+#include "load_report.h"
+#include "loader.h"
+#include "mapped_file.h"
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <unordered_map>
+#include <fastgltf/parser.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <stb_image.h>
+#include <tracy/common/tracy_lz4.hpp>
+#include <tracy/common/tracy_lz4hc.hpp>
+
+// Private functions
+std::vector<uint8_t> bake_mip_chain(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t mip_levels,
+                                    bool srgb);
+std::vector<uint8_t> bake_compressed_chain(const std::vector<uint8_t>& chain, uint32_t width, uint32_t height,
+                                           uint32_t mip_levels, VkFormat format);
+std::vector<bool> pack_metal_roughness_images(const fastgltf::Asset& asset, const std::vector<uint32_t>& image_map,
+                                              size_t image_count);
+VkSamplerCreateInfo pack_sampler_create_info(const Pack_Sampler& sampler);
+void pack_read_chunk(const Mapped_File& file, const Pack_Chunk& chunk, uint8_t* destination);
+void pack_decompress_chunk(const uint8_t* source, const Pack_Chunk& chunk, uint8_t* destination);
+Vertex_Format pack_vertex_format(const Pack_Mesh& mesh);
+std::vector<uint8_t> pack_bake_sources(std::vector<std::filesystem::path> files,
+                                       const std::filesystem::path& pack_file, uint32_t* source_count);
+bool pack_sources_unchanged(const std::vector<uint8_t>& sources, uint32_t source_count,
+                            const std::filesystem::path& pack_file);
+
+template<typename T>
+void pack_read_array(const Mapped_File& file, const Pack_Chunk& chunk, std::vector<T>* array)
+{
+	array->resize(chunk.raw_size / sizeof(T));
+	pack_read_chunk(file, chunk, reinterpret_cast<uint8_t*>(array->data()));
+}
+
+std::filesystem::path scene_pack_path(const std::filesystem::path& gltf_file)
+{
+	return std::filesystem::path(gltf_file).replace_extension(".pack");
+}
+
+// --- Baking ---
+
+bool bake_scene_pack(const std::filesystem::path& gltf_file, const std::filesystem::path& pack_file, bool compress,
+                     bool packed_vertices, bool static_batching)
+{
+	ZoneScopedN("Baking scene pack");
+
+	auto start_time = std::chrono::high_resolution_clock::now();
+
+	spdlog::info("Baking {} into {}{}", gltf_file.string(), pack_file.string(), compress ? " (LZ4)" : "");
+
+	Gltf_Buffers     buffers;
+	Gltf_Compression compression;
+	auto asset = gltf_parse(gltf_file, &buffers, &compression);
+
+	// Images. Decoded, mipped and block compressed in parallel, every image ends up in its own chunk, so runtime can
+	// upload them in batches. Color goes to BC7, metalness+roughness only needs two channels, so it goes to BC5.
+	// Images with the same bytes are baked once.
+
+	std::vector<uint32_t> image_map; // Maps index of glTF image to pack index
+	std::vector<size_t>   unique_images = gltf_unique_images(*asset, buffers, gltf_file.parent_path(), &image_map);
+
+	std::vector<Pack_Image>           images(unique_images.size());
+	std::vector<std::vector<uint8_t>> image_texels(unique_images.size());
+	std::vector<bool>                 metal_roughness_images = pack_metal_roughness_images(*asset, image_map,
+	                                                                                        unique_images.size());
+
+	{
+		ZoneScopedN("Image baking");
+
+		parallel_for(unique_images.size(), [&](size_t image_index)
+		{
+			ZoneScopedN("Image bake");
+
+			auto&            asset_image = asset->images[unique_images[image_index]];
+			Gltf_Image_Bytes bytes       = gltf_image_open(*asset, buffers, asset_image, gltf_file.parent_path());
+
+			// KTX2 is compressed and mipped already
+			if (gltf_image_is_ktx2(bytes))
+			{
+				Gltf_Ktx2_Info info = gltf_ktx2_info(bytes, true); // Packs are all BC anyway
+
+				image_texels[image_index].resize(info.texels_size);
+				gltf_transcode_ktx2(bytes, info, image_texels[image_index].data());
+				gltf_image_close(&bytes);
+				images[image_index] = {
+					.width      = info.width,
+					.height     = info.height,
+					.mip_levels = info.mip_levels,
+					.format     = static_cast<uint32_t>(info.format),
+					.components = { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+					                VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
+				};
+				return;
+			}
+
+			int width, height, channels;
+			auto pixels = stbi_load_from_memory(bytes.data, static_cast<int>(bytes.size),
+			                                    &width, &height, &channels, STBI_rgb_alpha);
+			gltf_image_close(&bytes);
+			if (pixels == nullptr)
+			throw std::runtime_error("GLTF Problem");
+
+			// Full mip chain, unlike runtime path, which blits fixed number of mips
+			uint32_t mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+
+			Pack_Image image = {
+				.width      = static_cast<uint32_t>(width),
+				.height     = static_cast<uint32_t>(height),
+				.mip_levels = mip_levels,
+				.format     = VK_FORMAT_BC7_SRGB_BLOCK,
+				.components = { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+				                VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
+			};
+
+			if (metal_roughness_images[image_index])
+			{
+				// Roughness (G) and metalness (B) are stored in R and G, view swizzles them back, so shaders see
+				// the usual layout
+				size_t pixel_count = static_cast<size_t>(width) * height;
+				for (size_t pixel = 0; pixel < pixel_count; pixel++)
+				{
+					pixels[pixel * 4 + 0] = pixels[pixel * 4 + 1];
+					pixels[pixel * 4 + 1] = pixels[pixel * 4 + 2];
+				}
+
+				image.format        = VK_FORMAT_BC5_UNORM_BLOCK;
+				image.components[0] = VK_COMPONENT_SWIZZLE_ZERO;
+				image.components[1] = VK_COMPONENT_SWIZZLE_R;
+				image.components[2] = VK_COMPONENT_SWIZZLE_G;
+				image.components[3] = VK_COMPONENT_SWIZZLE_ONE;
+			}
+
+			bool srgb  = !metal_roughness_images[image_index];
+			auto chain = bake_mip_chain(pixels, width, height, mip_levels, srgb);
+			stbi_image_free(pixels);
+
+			image_texels[image_index] = bake_compressed_chain(chain, width, height, mip_levels,
+			                                                  static_cast<VkFormat>(image.format));
+			images[image_index] = image;
+		});
+	}
+
+	// Samplers
+
+	std::vector<Pack_Sampler> samplers;
+	for (auto& sampler : asset->samplers)
+	{
+		VkSamplerCreateInfo create_info = gltf_sampler_create_info(sampler);
+		samplers.push_back({
+			.mag_filter     = static_cast<uint32_t>(create_info.magFilter),
+			.min_filter     = static_cast<uint32_t>(create_info.minFilter),
+			.mipmap_mode    = static_cast<uint32_t>(create_info.mipmapMode),
+			.address_mode_u = static_cast<uint32_t>(create_info.addressModeU),
+			.address_mode_v = static_cast<uint32_t>(create_info.addressModeV),
+		});
+	}
+
+	// Materials, pack indices of samplers are the same as glTF ones (runtime shares identical samplers anyway)
+
+	std::vector<uint32_t> sampler_map(asset->samplers.size());
+	for (uint32_t i = 0; i < sampler_map.size(); i++) sampler_map[i] = i;
+
+	std::vector<PBR_Material> materials;
+	for (auto& material : asset->materials)
+	{
+		materials.push_back(gltf_material(*asset, material, image_map, sampler_map,
+		                                  PACK_DEFAULT_INDEX, PACK_DEFAULT_INDEX));
+	}
+
+	// Meshes, every primitive becomes separate mesh. All geometry is baked into a single blob, which is then cut into
+	// chunks at vertex group boundaries. Primitives of the same vertex group share vertices, their meshes have the same
+	// vertex region. Static batches are meshes of their own, after all of them.
+
+	Gltf_Nodes          asset_nodes = gltf_flatten_nodes(*asset);
+	Gltf_Static_Batches static_batches;
+	std::vector<Gltf_Vertex_Group> vertex_groups = gltf_vertex_groups(*asset, compression);
+	if (static_batching)
+	{
+		static_batches = gltf_static_batches(*asset, buffers, compression, asset_nodes);
+		vertex_groups  = gltf_unbatched_vertex_groups(*asset, asset_nodes, static_batches, std::move(vertex_groups));
+	}
+
+	size_t geometry_size_bound = 0;
+	for (auto& group : vertex_groups)
+	{
+		geometry_size_bound += gltf_vertex_group_size_bound(*asset, group);
+	}
+	for (auto& batch : static_batches.batches)
+	{
+		geometry_size_bound += gltf_static_batch_size_bound(batch);
+	}
+
+	std::vector<uint8_t> geometry(geometry_size_bound);
+	Mapped_Buffer_Writer geometry_writer(geometry.data());
+
+	struct Primitive
+	{
+		uint32_t mesh_index;
+		uint32_t material_index;
+	};
+
+	std::vector<Pack_Mesh>                 meshes;
+	std::vector<std::vector<Primitive>>    asset_map_meshes(asset->meshes.size());
+	Mesh_Import_Stats                      stats = {};
+	std::vector<std::pair<size_t, size_t>> geometry_chunks; // Ranges of geometry, meshes refer to them by index
+
+	{
+		ZoneScopedN("Geometry baking");
+
+		auto pack_mesh = [](const Imported_Primitive& imported)
+		{
+			return Pack_Mesh{
+				.vertex_offset   = imported.vertex_offset,
+				.vertex_size     = imported.vertex_size,
+				.indices_offset  = imported.indices_offset,
+				.indices_size    = imported.indices_size,
+				.vertex_count    = imported.vertex_count,
+				.indices_count   = imported.indices_count,
+				.position_format = static_cast<uint32_t>(imported.vertex_format.position),
+				.normal_format   = static_cast<uint32_t>(imported.vertex_format.normal),
+				.tangent_format  = static_cast<uint32_t>(imported.vertex_format.tangent),
+				.texcoord_format = static_cast<uint32_t>(imported.vertex_format.texcoord),
+				.index_type      = static_cast<uint32_t>(imported.index_type),
+				.meshlets_count  = imported.meshlets_count,
+				.meshlets_offset = imported.meshlets_offset,
+				.position_offset = { imported.position_offset.x, imported.position_offset.y,
+				                     imported.position_offset.z },
+				.position_scale  = { imported.position_scale.x, imported.position_scale.y,
+				                     imported.position_scale.z },
+				.packed_vertices = imported.vertex_format.packed,
+			};
+		};
+
+		// Every vertex group (or batch) is a block, chunks are made of whole blocks
+		std::vector<size_t> block_starts; // In geometry
+		std::vector<size_t> mesh_blocks;  // [mesh]
+		auto begin_block = [&]
+		{
+			geometry_writer.align_next(PACK_CHUNK_ALIGNMENT);
+			block_starts.push_back(geometry_writer.offset());
+		};
+
+		for (auto& group : vertex_groups)
+		{
+			begin_block();
+			std::vector<Imported_Primitive> imported_primitives =
+			gltf_import_vertex_group(*asset, buffers, compression, group, geometry_writer, stats, packed_vertices);
+
+			for (size_t group_index = 0; group_index < group.primitives.size(); group_index++)
+			{
+				auto& [asset_mesh_index, primitive_index] = group.primitives[group_index];
+				auto& primitive = asset->meshes[asset_mesh_index].primitives[primitive_index];
+				auto& imported  = imported_primitives[group_index];
+
+				meshes.push_back(pack_mesh(imported));
+				mesh_blocks.push_back(block_starts.size() - 1);
+
+				uint32_t material_index = primitive.materialIndex.has_value()
+				? static_cast<uint32_t>(primitive.materialIndex.value()) : PACK_DEFAULT_INDEX;
+
+				asset_map_meshes[asset_mesh_index].push_back({
+					.mesh_index     = static_cast<uint32_t>(meshes.size() - 1),
+					.material_index = material_index,
+				});
+			}
+		}
+
+		for (auto& batch : static_batches.batches)
+		{
+			begin_block();
+			meshes.push_back(pack_mesh(gltf_import_static_batch(*asset, buffers, compression, static_batches, batch,
+			                                                    geometry_writer, stats, packed_vertices)));
+			mesh_blocks.push_back(block_starts.size() - 1);
+		}
+
+		geometry.resize(geometry_writer.offset());
+		gltf_log_import_stats(stats);
+
+		// Blocks bigger than chunk size get a chunk of their own
+		std::vector<uint32_t> block_chunks(block_starts.size());
+		for (size_t block = 0; block < block_starts.size(); block++)
+		{
+			size_t start = block_starts[block];
+			size_t end   = (block + 1 < block_starts.size()) ? block_starts[block + 1] : geometry.size();
+
+			bool full = !geometry_chunks.empty() && geometry_chunks.back().second > geometry_chunks.back().first &&
+			            end - geometry_chunks.back().first > PACK_GEOMETRY_CHUNK_SIZE;
+			if (geometry_chunks.empty() || full)
+			{
+				geometry_chunks.emplace_back(start, start);
+			}
+			geometry_chunks.back().second = end;
+			block_chunks[block] = static_cast<uint32_t>(geometry_chunks.size() - 1);
+		}
+
+		// Chunks start at aligned offsets, so alignment within them holds
+		for (size_t mesh_index = 0; mesh_index < meshes.size(); mesh_index++)
+		{
+			auto&  mesh        = meshes[mesh_index];
+			size_t chunk_start = geometry_chunks[block_chunks[mesh_blocks[mesh_index]]].first;
+
+			mesh.vertex_offset   -= chunk_start;
+			mesh.indices_offset  -= chunk_start;
+			mesh.meshlets_offset -= chunk_start;
+			mesh.geometry_chunk   = block_chunks[mesh_blocks[mesh_index]];
+		}
+	}
+
+	// Flattened node hierarchy, and render objects of nodes with mesh. Batched nodes are drawn by their batches.
+
+	std::vector<Pack_Node>          nodes(asset_nodes.parents.size());
+	std::vector<Pack_Render_Object> render_objects;
+	for (uint32_t node_index = 0; node_index < nodes.size(); node_index++)
+	{
+		nodes[node_index].parent = (asset_nodes.parents[node_index] == TRANSFORM_NO_PARENT)
+		? PACK_DEFAULT_INDEX : asset_nodes.parents[node_index];
+		memcpy(nodes[node_index].local_transform, glm::value_ptr(asset_nodes.local_transforms[node_index]),
+		       sizeof(Pack_Node::local_transform));
+
+		if (asset_nodes.meshes[node_index] == Gltf_Nodes::NO_MESH) continue;
+		if (static_batching && static_batches.batched_nodes[node_index]) continue;
+
+		for (Primitive& primitive : asset_map_meshes[asset_nodes.meshes[node_index]])
+		{
+			render_objects.push_back({
+				.mesh_index     = primitive.mesh_index,
+				.material_index = primitive.material_index,
+				.node           = node_index,
+			});
+		}
+	}
+
+	// Batches are in world space, under extra root node with identity transform. Their meshes follow the others.
+	if (!static_batches.batches.empty())
+	{
+		auto      batch_node = static_cast<uint32_t>(nodes.size());
+		glm::mat4 identity   = glm::mat4(1.0f);
+		nodes.push_back({ .parent = PACK_DEFAULT_INDEX });
+		memcpy(nodes.back().local_transform, glm::value_ptr(identity), sizeof(Pack_Node::local_transform));
+
+		auto first_batch_mesh = static_cast<uint32_t>(meshes.size() - static_batches.batches.size());
+		for (uint32_t batch_index = 0; batch_index < static_batches.batches.size(); batch_index++)
+		{
+			auto& batch = static_batches.batches[batch_index];
+			render_objects.push_back({
+				.mesh_index     = first_batch_mesh + batch_index,
+				.material_index = (batch.material_index != Gltf_Static_Batch::NO_MATERIAL)
+				                  ? static_cast<uint32_t>(batch.material_index) : PACK_DEFAULT_INDEX,
+				.node           = batch_node,
+			});
+		}
+	}
+
+	// Files the pack is baked from: glTF, and external buffers and images it refers to
+
+	std::vector<std::filesystem::path> source_files = { gltf_file };
+	auto add_source = [&](const auto& source)
+	{
+		auto uri = std::get_if<fastgltf::sources::URI>(&source);
+		if (uri == nullptr || !uri->uri.isLocalPath()) return;
+
+		source_files.push_back(gltf_file.parent_path() / uri->uri.fspath());
+	};
+	for (auto& buffer : asset->buffers) add_source(buffer.data);
+	for (auto& image : asset->images)   add_source(image.data);
+
+	uint32_t             source_count;
+	std::vector<uint8_t> sources = pack_bake_sources(std::move(source_files), pack_file, &source_count);
+
+	// Gather chunks. Geometry and texel chunks go last, after all the single ones.
+
+	struct Bake_Chunk
+	{
+		Pack_Chunk_Type      type;
+		const uint8_t*       data;
+		size_t               size;
+		Pack_Compression     compression;
+		std::vector<uint8_t> compressed;
+	};
+
+	std::vector<Bake_Chunk> chunks;
+	auto add_chunk = [&](Pack_Chunk_Type type, const void* data, size_t size)
+	{
+		chunks.push_back({ .type = type, .data = static_cast<const uint8_t*>(data), .size = size });
+	};
+
+	add_chunk(Pack_Chunk_Type::SAMPLERS,       samplers.data(),       samplers.size()       * sizeof(Pack_Sampler));
+	add_chunk(Pack_Chunk_Type::MATERIALS,      materials.data(),      materials.size()      * sizeof(PBR_Material));
+	add_chunk(Pack_Chunk_Type::MESHES,         meshes.data(),         meshes.size()         * sizeof(Pack_Mesh));
+	add_chunk(Pack_Chunk_Type::RENDER_OBJECTS, render_objects.data(), render_objects.size() * sizeof(Pack_Render_Object));
+	add_chunk(Pack_Chunk_Type::IMAGES,         images.data(),         images.size()         * sizeof(Pack_Image));
+	add_chunk(Pack_Chunk_Type::NODES,          nodes.data(),          nodes.size()          * sizeof(Pack_Node));
+	add_chunk(Pack_Chunk_Type::SOURCES,        sources.data(),        sources.size());
+
+	// Meshes chunk points to meshes, so their geometry chunks can still be filled in
+	auto first_geometry_chunk = static_cast<uint32_t>(chunks.size());
+	for (auto& [start, end] : geometry_chunks)
+	{
+		add_chunk(Pack_Chunk_Type::GEOMETRY_DATA, geometry.data() + start, end - start);
+	}
+	for (auto& mesh : meshes) mesh.geometry_chunk += first_geometry_chunk;
+
+	// Images chunk points to images, so their texel chunks can still be filled in
+	for (uint32_t image_index = 0; image_index < images.size(); image_index++)
+	{
+		images[image_index].texel_chunk = static_cast<uint32_t>(chunks.size());
+		add_chunk(Pack_Chunk_Type::TEXEL_DATA, image_texels[image_index].data(), image_texels[image_index].size());
+	}
+
+	// Compression. HC is slow, but it's done once, and decompression speed is the same as for fast mode.
+	// Chunks that don't get smaller are kept raw.
+
+	if (compress)
+	{
+		ZoneScopedN("Chunk compression");
+
+		parallel_for(chunks.size(), [&](size_t chunk_index)
+		{
+			ZoneScopedN("Chunk compress");
+
+			Bake_Chunk& chunk = chunks[chunk_index];
+			if (chunk.size == 0 || chunk.size > LZ4_MAX_INPUT_SIZE) return;
+
+			chunk.compressed.resize(tracy::LZ4_compressBound(static_cast<int>(chunk.size)));
+			int compressed_size = tracy::LZ4_compress_HC(reinterpret_cast<const char*>(chunk.data),
+			                                             reinterpret_cast<char*>(chunk.compressed.data()),
+			                                             static_cast<int>(chunk.size),
+			                                             static_cast<int>(chunk.compressed.size()),
+			                                             LZ4HC_CLEVEL_DEFAULT);
+
+			if (compressed_size > 0 && static_cast<size_t>(compressed_size) < chunk.size)
+			{
+				chunk.compressed.resize(compressed_size);
+				chunk.compression = Pack_Compression::LZ4;
+			}
+			else
+			{
+				chunk.compressed = {};
+			}
+		});
+	}
+
+	// Layout and write the file
+
+	Pack_Header header = {
+		.magic           = PACK_MAGIC,
+		.version         = PACK_VERSION,
+		.chunk_count     = static_cast<uint32_t>(chunks.size()),
+		.source_count    = source_count,
+		.packed_vertices = packed_vertices,
+		.static_batching = static_batching,
+	};
+
+	std::vector<Pack_Chunk> chunk_table;
+	uint64_t offset = sizeof(Pack_Header) + chunks.size() * sizeof(Pack_Chunk);
+	for (auto& chunk : chunks)
+	{
+		offset = (offset + PACK_CHUNK_ALIGNMENT - 1) & ~static_cast<uint64_t>(PACK_CHUNK_ALIGNMENT - 1);
+		size_t stored_size = (chunk.compression == Pack_Compression::LZ4) ? chunk.compressed.size() : chunk.size;
+
+		chunk_table.push_back({
+			.type        = chunk.type,
+			.compression = chunk.compression,
+			.offset      = offset,
+			.size        = stored_size,
+			.raw_size    = chunk.size,
+		});
+		offset += stored_size;
+	}
+
+	{
+		ZoneScopedN("Pack writing");
+
+		std::ofstream file(pack_file, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			spdlog::error("Can't open {} for writing", pack_file.string());
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(chunk_table.data()), chunk_table.size() * sizeof(Pack_Chunk));
+
+		const char padding[PACK_CHUNK_ALIGNMENT] = {};
+		for (size_t chunk_index = 0; chunk_index < chunks.size(); chunk_index++)
+		{
+			Bake_Chunk& chunk = chunks[chunk_index];
+			size_t padding_size = chunk_table[chunk_index].offset - static_cast<uint64_t>(file.tellp());
+			file.write(padding, padding_size);
+
+			const uint8_t* stored = (chunk.compression == Pack_Compression::LZ4) ? chunk.compressed.data() : chunk.data;
+			file.write(reinterpret_cast<const char*>(stored), chunk_table[chunk_index].size);
+		}
+
+		if (!file)
+		{
+			spdlog::error("Failed writing {}", pack_file.string());
+			return false;
+		}
+	}
+
+	auto finish_time = std::chrono::high_resolution_clock::now();
+	auto duration = std::chrono::duration_cast<std::chrono::duration<float>>(finish_time - start_time);
+	spdlog::info("Scene pack baked! {} images, {} meshes, {} render objects, {:.1f} MB [{:.2f}s]",
+	             images.size(), meshes.size(), render_objects.size(), offset / 1000000.0, duration.count());
+
+	return true;
+}
+
+// Box filter, done in linear space (if texels are sRGB). Alpha is linear already.
+std::vector<uint8_t> bake_mip_chain(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t mip_levels,
+                                    bool srgb)
+{
+	static const std::array<float, 256> srgb_to_linear = []
+	{
+		std::array<float, 256> table;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			float s = i / 255.0f;
+			table[i] = (s <= 0.04045f) ? s / 12.92f : std::pow((s + 0.055f) / 1.055f, 2.4f);
+		}
+		return table;
+	}();
+
+	auto linear_to_srgb = [](float l)
+	{
+		float s = (l <= 0.0031308f) ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+		return static_cast<uint8_t>(std::clamp(s * 255.0f + 0.5f, 0.0f, 255.0f));
+	};
+
+	std::vector<uint8_t> chain(texture_mip_chain_size(VK_FORMAT_R8G8B8A8_UNORM, width, height, mip_levels));
+
+	// Mip 0 is copied as is, rest is filtered from previous level kept in floats
+	size_t mip_0_size = static_cast<size_t>(width) * height * 4;
+	memcpy(chain.data(), pixels, mip_0_size);
+
+	std::vector<float> level(mip_0_size);
+	for (size_t i = 0; i < mip_0_size; i++)
+	{
+		level[i] = (i % 4 == 3 || !srgb) ? pixels[i] / 255.0f : srgb_to_linear[pixels[i]];
+	}
+
+	size_t   chain_offset = mip_0_size;
+	uint32_t src_width    = width;
+	uint32_t src_height   = height;
+
+	for (uint32_t mip = 1; mip < mip_levels; mip++)
+	{
+		uint32_t dst_width  = std::max(src_width  / 2, 1u);
+		uint32_t dst_height = std::max(src_height / 2, 1u);
+
+		std::vector<float> next_level(static_cast<size_t>(dst_width) * dst_height * 4);
+		for (uint32_t y = 0; y < dst_height; y++)
+		{
+			uint32_t y0 = std::min(y * 2, src_height - 1), y1 = std::min(y * 2 + 1, src_height - 1);
+			for (uint32_t x = 0; x < dst_width; x++)
+			{
+				uint32_t x0 = std::min(x * 2, src_width - 1), x1 = std::min(x * 2 + 1, src_width - 1);
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					float sum = level[(y0 * src_width + x0) * 4 + c] + level[(y0 * src_width + x1) * 4 + c]
+					          + level[(y1 * src_width + x0) * 4 + c] + level[(y1 * src_width + x1) * 4 + c];
+					float value = sum * 0.25f;
+
+					next_level[(y * dst_width + x) * 4 + c] = value;
+					chain[chain_offset + (y * dst_width + x) * 4 + c] = (c == 3 || !srgb)
+					? static_cast<uint8_t>(std::clamp(value * 255.0f + 0.5f, 0.0f, 255.0f))
+					: linear_to_srgb(value);
+				}
+			}
+		}
+
+		chain_offset += next_level.size();
+		level        = std::move(next_level);
+		src_width    = dst_width;
+		src_height   = dst_height;
+	}
+
+	return chain;
+}
+
+// Chain is RGBA8 mip chain from bake_mip_chain(), levels are encoded one by one (each one in parallel)
+std::vector<uint8_t> bake_compressed_chain(const std::vector<uint8_t>& chain, uint32_t width, uint32_t height,
+                                           uint32_t mip_levels, VkFormat format)
+{
+	ZoneScopedN("Image compress");
+
+	std::vector<uint8_t> blocks(texture_mip_chain_size(format, width, height, mip_levels));
+
+	size_t chain_offset  = 0;
+	size_t blocks_offset = 0;
+	for (uint32_t mip = 0; mip < mip_levels; mip++)
+	{
+		uint32_t mip_width  = std::max(width >> mip, 1u);
+		uint32_t mip_height = std::max(height >> mip, 1u);
+
+		texture_encode_bc(chain.data() + chain_offset, mip_width, mip_height, format, blocks.data() + blocks_offset);
+
+		chain_offset  += texture_level_size(VK_FORMAT_R8G8B8A8_UNORM, mip_width, mip_height);
+		blocks_offset += texture_level_size(format, mip_width, mip_height);
+	}
+
+	return blocks;
+}
+
+// Pack images sampled only as metalness+roughness, anything else is treated as color
+std::vector<bool> pack_metal_roughness_images(const fastgltf::Asset& asset, const std::vector<uint32_t>& image_map,
+                                              size_t image_count)
+{
+	std::vector<bool> metal_roughness(image_count, false);
+	std::vector<bool> color(image_count, false);
+
+	auto mark = [&](const fastgltf::TextureInfo& texture_info, std::vector<bool>& images)
+	{
+		auto image_index = asset.textures[texture_info.textureIndex].imageIndex;
+		if (image_index.has_value() && image_index.value() < image_map.size()) images[image_map[image_index.value()]] = true;
+	};
+
+	for (auto& material : asset.materials)
+	{
+		if (!material.pbrData.has_value()) continue;
+
+		auto& pbr = material.pbrData.value();
+		if (pbr.baseColorTexture.has_value())         mark(pbr.baseColorTexture.value(), color);
+		if (pbr.metallicRoughnessTexture.has_value()) mark(pbr.metallicRoughnessTexture.value(), metal_roughness);
+	}
+
+	for (size_t image_index = 0; image_index < metal_roughness.size(); image_index++)
+	{
+		metal_roughness[image_index] = metal_roughness[image_index] && !color[image_index];
+	}
+	return metal_roughness;
+}
+
+// --- Loading ---
+
+bool load_scene_pack(const std::filesystem::path& pack_file)
+{
+	ZoneScopedN("Loading scene pack");
+
+	spdlog::info("Loading scene pack {}", pack_file.string());
+
+	Mapped_File file;
+	if (!mapped_file_open(pack_file, &file)) return false;
+
+	// Validate everything before touching any of the managers, so we can still fall back to glTF
+
+	auto reject = [&](const char* reason)
+	{
+		spdlog::warn("Scene pack {} can't be used: {}", pack_file.string(), reason);
+		mapped_file_close(&file);
+		return false;
+	};
+
+	if (file.size < sizeof(Pack_Header)) return reject("truncated header");
+
+	Pack_Header header;
+	memcpy(&header, file.data, sizeof(header));
+	if (header.magic != PACK_MAGIC)     return reject("not a scene pack");
+	if (header.version != PACK_VERSION) return reject("version mismatch, rebake it");
+
+	// Options baked in have to match the ones we run with, glTF is imported with the right ones instead
+	if (header.packed_vertices != scene_loader->packed_vertices)
+	return reject("baked with different --packed-vertices, rebake it");
+	if (header.static_batching != scene_loader->static_batching)
+	return reject("baked with different --static-batching, rebake it");
+
+	if (file.size < sizeof(Pack_Header) + static_cast<size_t>(header.chunk_count) * sizeof(Pack_Chunk))
+	return reject("truncated chunk table");
+
+	auto chunks = reinterpret_cast<const Pack_Chunk*>(file.data + sizeof(Pack_Header));
+
+	// Every type before GEOMETRY_DATA is a single chunk
+	const Pack_Chunk* chunk_by_type[static_cast<uint32_t>(Pack_Chunk_Type::GEOMETRY_DATA)] = {};
+	for (uint32_t chunk_index = 0; chunk_index < header.chunk_count; chunk_index++)
+	{
+		const Pack_Chunk& chunk = chunks[chunk_index];
+
+		if (chunk.offset > file.size || chunk.size > file.size - chunk.offset)  return reject("chunk out of bounds");
+		if (chunk.compression == Pack_Compression::NONE && chunk.size != chunk.raw_size)
+		return reject("chunk size mismatch");
+		if (chunk.compression != Pack_Compression::NONE && chunk.compression != Pack_Compression::LZ4)
+		return reject("unknown compression");
+
+		uint32_t type = static_cast<uint32_t>(chunk.type);
+		if (type < std::size(chunk_by_type)) chunk_by_type[type] = &chunk;
+	}
+
+	for (auto chunk : chunk_by_type)
+	{
+		if (chunk == nullptr) return reject("missing chunk");
+	}
+
+	{
+		ZoneScopedN("Pack sources checking");
+
+		std::vector<uint8_t> sources;
+		pack_read_array(file, *chunk_by_type[static_cast<uint32_t>(Pack_Chunk_Type::SOURCES)], &sources);
+		if (!pack_sources_unchanged(sources, header.source_count, pack_file))
+		return reject("sources changed, rebake it");
+	}
+
+	std::vector<Pack_Sampler>       samplers;
+	std::vector<PBR_Material>       materials;
+	std::vector<Pack_Mesh>          meshes;
+	std::vector<Pack_Render_Object> render_objects;
+	std::vector<Pack_Image>         images;
+	std::vector<Pack_Node>          nodes;
+
+	{
+		ZoneScopedN("Pack metadata reading");
+
+		pack_read_array(file, *chunk_by_type[static_cast<uint32_t>(Pack_Chunk_Type::SAMPLERS)],       &samplers);
+		pack_read_array(file, *chunk_by_type[static_cast<uint32_t>(Pack_Chunk_Type::MATERIALS)],      &materials);
+		pack_read_array(file, *chunk_by_type[static_cast<uint32_t>(Pack_Chunk_Type::MESHES)],         &meshes);
+		pack_read_array(file, *chunk_by_type[static_cast<uint32_t>(Pack_Chunk_Type::RENDER_OBJECTS)], &render_objects);
+		pack_read_array(file, *chunk_by_type[static_cast<uint32_t>(Pack_Chunk_Type::IMAGES)],         &images);
+		pack_read_array(file, *chunk_by_type[static_cast<uint32_t>(Pack_Chunk_Type::NODES)],          &nodes);
+	}
+
+	auto valid_index = [](uint32_t index, size_t count) { return index == PACK_DEFAULT_INDEX || index < count; };
+
+	for (auto& image : images)
+	{
+		size_t texels_size = texture_mip_chain_size(static_cast<VkFormat>(image.format), image.width, image.height,
+		                                            image.mip_levels);
+		if (image.texel_chunk >= header.chunk_count || chunks[image.texel_chunk].type != Pack_Chunk_Type::TEXEL_DATA ||
+		    texels_size == 0 || chunks[image.texel_chunk].raw_size != texels_size)
+		return reject("bad image");
+		for (uint32_t component : image.components)
+		{
+			if (component > VK_COMPONENT_SWIZZLE_A) return reject("bad image");
+		}
+		if (!gfx_context->texture_compression_bc && texture_format_is_bc(static_cast<VkFormat>(image.format)))
+		return reject("device doesn't support BC textures");
+	}
+	for (auto& material : materials)
+	{
+		if (!valid_index(material.albedo_texture, images.size())            ||
+		    !valid_index(material.metal_roughness_texture, images.size())   ||
+		    !valid_index(material.albedo_sampler, samplers.size())          ||
+		    !valid_index(material.metal_roughness_sampler, samplers.size()))
+		return reject("bad material");
+	}
+	for (auto& mesh : meshes)
+	{
+		if (mesh.geometry_chunk >= header.chunk_count ||
+		    chunks[mesh.geometry_chunk].type != Pack_Chunk_Type::GEOMETRY_DATA)
+		return reject("bad mesh");
+
+		const Pack_Chunk& geometry_chunk = chunks[mesh.geometry_chunk];
+		if (mesh.vertex_offset + mesh.vertex_size > geometry_chunk.raw_size ||
+		    mesh.indices_offset + mesh.indices_size > geometry_chunk.raw_size)
+		return reject("bad mesh");
+
+		Vertex_Format vertex_format = pack_vertex_format(mesh);
+		size_t        index_size    = (mesh.index_type == VK_INDEX_TYPE_UINT32) ? sizeof(uint32_t) : sizeof(uint16_t);
+		if (vertex_attribute_size(vertex_format.position) == 0 || vertex_attribute_size(vertex_format.normal) == 0 ||
+		    vertex_attribute_size(vertex_format.tangent) == 0 || vertex_attribute_size(vertex_format.texcoord) == 0 ||
+		    vertex_region_size(vertex_format, mesh.vertex_count) != mesh.vertex_size ||
+		    (mesh.index_type != VK_INDEX_TYPE_UINT16 && mesh.index_type != VK_INDEX_TYPE_UINT32) ||
+		    index_size * mesh.indices_count != mesh.indices_size ||
+		    mesh.meshlets_offset % 16 != 0 || mesh.packed_vertices > 1 ||
+		    mesh.meshlets_offset + uint64_t(mesh.meshlets_count) * sizeof(Meshlet) > geometry_chunk.raw_size)
+		return reject("bad mesh");
+	}
+	for (uint32_t node_index = 0; node_index < nodes.size(); node_index++)
+	{
+		// Pre-order, parents come first
+		if (nodes[node_index].parent != PACK_DEFAULT_INDEX && nodes[node_index].parent >= node_index)
+		return reject("bad node");
+	}
+	for (auto& render_object : render_objects)
+	{
+		if (render_object.mesh_index >= meshes.size() || !valid_index(render_object.material_index, materials.size()) ||
+		    render_object.node >= nodes.size())
+		return reject("bad render object");
+	}
+
+	// Pack is fine, create everything. Texels come last, materials use default texture until theirs land.
+
+	std::vector<Slot_Handle> image_slots(images.size());
+	for (auto& slot : image_slots) slot = scene_loader_reserve_image();
+
+	uint32_t nodes_start = scene_loader_reserve_nodes(nodes.size());
+
+	std::vector<uint32_t> sampler_map(samplers.size());
+	std::vector<uint32_t> material_map(materials.size());
+
+	// First batch: defaults, nodes, samplers and materials
+
+	{
+		Scene_Upload* upload = scene_upload_begin(4);
+
+		scene_upload_defaults(*upload);
+
+		std::vector<uint32_t>  node_parents;
+		std::vector<glm::mat4> node_transforms;
+		for (auto& node : nodes)
+		{
+			node_parents.push_back((node.parent == PACK_DEFAULT_INDEX) ? TRANSFORM_NO_PARENT : node.parent);
+			node_transforms.push_back(glm::make_mat4(node.local_transform));
+		}
+		scene_upload_nodes(*upload, nodes_start, node_parents, node_transforms);
+
+		for (size_t sampler_index = 0; sampler_index < samplers.size(); sampler_index++)
+		{
+			sampler_map[sampler_index] = scene_upload_sampler(*upload, pack_sampler_create_info(samplers[sampler_index]),
+			                                                  "Pack").index;
+		}
+
+		auto remap_image = [&](uint32_t index)
+		{
+			return (index == PACK_DEFAULT_INDEX) ? Texture_Manager::DEFAULT_TEXTURE : image_slots[index].index;
+		};
+		auto remap_sampler = [&](uint32_t index)
+		{
+			return (index == PACK_DEFAULT_INDEX) ? Texture_Manager::DEFAULT_SAMPLER : sampler_map[index];
+		};
+
+		for (size_t material_index = 0; material_index < materials.size(); material_index++)
+		{
+			auto& material = materials[material_index];
+
+			PBR_Material pbr_material = material;
+			pbr_material.albedo_texture          = remap_image(material.albedo_texture);
+			pbr_material.albedo_sampler          = remap_sampler(material.albedo_sampler);
+			pbr_material.metal_roughness_texture = remap_image(material.metal_roughness_texture);
+			pbr_material.metal_roughness_sampler = remap_sampler(material.metal_roughness_sampler);
+
+			material_map[material_index] = scene_upload_material(*upload, pbr_material).index;
+		}
+
+		scene_upload_finish(upload);
+	}
+
+	// Geometry and render objects, in batches of bounded size like texels. Meshes sharing vertices were baked into
+	// the same chunk, so they're in the same batch. Render objects go in the batch of their mesh.
+
+	{
+		std::vector<uint32_t>              geometry_chunks; // In order of first use
+		std::vector<std::vector<uint32_t>> chunk_meshes;    // [geometry_chunks index]
+		std::unordered_map<uint32_t, size_t> chunk_ordinals;
+		for (uint32_t mesh_index = 0; mesh_index < meshes.size(); mesh_index++)
+		{
+			auto [ordinal, inserted] = chunk_ordinals.try_emplace(meshes[mesh_index].geometry_chunk,
+			                                                      geometry_chunks.size());
+			if (inserted)
+			{
+				geometry_chunks.push_back(meshes[mesh_index].geometry_chunk);
+				chunk_meshes.emplace_back();
+			}
+			chunk_meshes[ordinal->second].push_back(mesh_index);
+		}
+
+		std::vector<std::vector<uint32_t>> mesh_render_objects(meshes.size());
+		for (uint32_t render_object_index = 0; render_object_index < render_objects.size(); render_object_index++)
+		{
+			mesh_render_objects[render_objects[render_object_index].mesh_index].push_back(render_object_index);
+		}
+
+		size_t batch_start = 0;
+		while (batch_start < geometry_chunks.size())
+		{
+			ZoneScopedN("Geometry batch");
+
+			// Chunks bigger than batch size still go in their own batch
+			size_t batch_end  = batch_start;
+			size_t batch_size = 0;
+			while (batch_end < geometry_chunks.size())
+			{
+				size_t chunk_size = chunks[geometry_chunks[batch_end]].raw_size + PACK_CHUNK_ALIGNMENT;
+				if (batch_end > batch_start && batch_size + chunk_size > scene_loader->batch_size) break;
+				batch_size += chunk_size;
+				batch_end++;
+			}
+
+			Scene_Upload* upload = scene_upload_begin(batch_size);
+
+			std::vector<VkDeviceSize> geometry_offsets;
+			for (size_t ordinal = batch_start; ordinal < batch_end; ordinal++)
+			{
+				upload->upload_writer.align_next(PACK_CHUNK_ALIGNMENT);
+				geometry_offsets.push_back(upload->upload_writer.offset());
+				upload->upload_writer.advance(chunks[geometry_chunks[ordinal]].raw_size);
+			}
+
+			parallel_for(batch_end - batch_start, [&](size_t batch_index)
+			{
+				ZoneScopedN("Geometry reading");
+				pack_read_chunk(file, chunks[geometry_chunks[batch_start + batch_index]],
+				                upload->upload_writer.base_ptr + geometry_offsets[batch_index]);
+			});
+
+			for (size_t batch_index = 0; batch_index < batch_end - batch_start; batch_index++)
+			{
+				VkDeviceSize geometry_offset = geometry_offsets[batch_index];
+
+				// Meshes baked from the same vertex group point to the same vertices, those are uploaded once
+				std::unordered_map<uint64_t, uint32_t> vertex_meshes; // First pack mesh by vertex offset
+				std::unordered_map<uint32_t, Mesh_Manager::Id> mesh_ids;
+				for (uint32_t mesh_index : chunk_meshes[batch_start + batch_index])
+				{
+					auto& mesh = meshes[mesh_index];
+
+					Imported_Primitive primitive = {
+						.vertex_offset   = geometry_offset + mesh.vertex_offset,
+						.vertex_size     = mesh.vertex_size,
+						.vertex_count    = mesh.vertex_count,
+						.indices_offset  = geometry_offset + mesh.indices_offset,
+						.indices_size    = mesh.indices_size,
+						.indices_count   = mesh.indices_count,
+						.vertex_format   = pack_vertex_format(mesh),
+						.index_type      = static_cast<VkIndexType>(mesh.index_type),
+						.meshlets_offset = geometry_offset + mesh.meshlets_offset,
+						.meshlets_count  = mesh.meshlets_count,
+						.position_offset = glm::make_vec3(mesh.position_offset),
+						.position_scale  = glm::make_vec3(mesh.position_scale),
+					};
+
+					std::optional<Mesh_Manager::Id> shared_vertices;
+					auto [vertex_mesh, inserted] = vertex_meshes.try_emplace(mesh.vertex_offset, mesh_index);
+					if (!inserted)
+					{
+						auto& first = meshes[vertex_mesh->second];
+						if (first.vertex_size == mesh.vertex_size && first.vertex_count == mesh.vertex_count &&
+						    first.position_format == mesh.position_format &&
+						    first.normal_format == mesh.normal_format &&
+						    first.tangent_format == mesh.tangent_format &&
+						    first.texcoord_format == mesh.texcoord_format &&
+						    first.packed_vertices == mesh.packed_vertices)
+						{
+							shared_vertices = mesh_ids.at(vertex_mesh->second);
+						}
+					}
+					Mesh_Manager::Id mesh_id = scene_upload_mesh(*upload, primitive, shared_vertices);
+					mesh_ids.emplace(mesh_index, mesh_id);
+
+					for (uint32_t render_object_index : mesh_render_objects[mesh_index])
+					{
+						auto& render_object = render_objects[render_object_index];
+						upload->render_objects.push_back({
+							.mesh_id        = mesh_id,
+							.material_id    = (render_object.material_index == PACK_DEFAULT_INDEX)
+							? Material_Manager::DEFAULT_MATERIAL : material_map[render_object.material_index],
+							.transform_node = nodes_start + render_object.node,
+						});
+					}
+				}
+			}
+
+			scene_upload_finish(upload);
+
+			batch_start = batch_end;
+		}
+	}
+
+	// Texels, in batches of bounded size (whole mipped scene is bigger than upload heap). Reads of all chunks
+	// within a batch are in flight at once (I/O queue), stored ones land straight in upload heap, LZ4 ones are
+	// decompressed into it in parallel, as their reads complete.
+
+	size_t batch_start = 0;
+	while (batch_start < images.size())
+	{
+		ZoneScopedN("Texel batch");
+
+		// Images bigger than batch size still go in their own batch
+		size_t batch_end  = batch_start;
+		size_t batch_size = 0;
+		while (batch_end < images.size())
+		{
+			size_t image_size = chunks[images[batch_end].texel_chunk].raw_size + PACK_CHUNK_ALIGNMENT;
+			if (batch_end > batch_start && batch_size + image_size > scene_loader->batch_size) break;
+			batch_size += image_size;
+			batch_end++;
+		}
+
+		Scene_Upload* upload = scene_upload_begin(batch_size);
+
+		std::vector<VkDeviceSize> texel_offsets;
+		for (size_t image_index = batch_start; image_index < batch_end; image_index++)
+		{
+			auto& image = images[image_index];
+
+			VkImageCreateInfo image_create_info = {
+				.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+				.imageType     = VK_IMAGE_TYPE_2D,
+				.format        = static_cast<VkFormat>(image.format),
+				.extent        = { image.width, image.height, 1 },
+				.mipLevels     = image.mip_levels,
+				.arrayLayers   = 1,
+				.samples       = VK_SAMPLE_COUNT_1_BIT,
+				.tiling        = VK_IMAGE_TILING_OPTIMAL,
+				.usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+				.sharingMode   = VK_SHARING_MODE_EXCLUSIVE,
+				.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			};
+
+			upload->upload_writer.align_next(PACK_CHUNK_ALIGNMENT);
+			VkDeviceSize offset = upload->upload_writer.offset();
+			upload->upload_writer.advance(chunks[image.texel_chunk].raw_size);
+			texel_offsets.push_back(offset);
+
+			VkComponentMapping components = {
+				.r = static_cast<VkComponentSwizzle>(image.components[0]),
+				.g = static_cast<VkComponentSwizzle>(image.components[1]),
+				.b = static_cast<VkComponentSwizzle>(image.components[2]),
+				.a = static_cast<VkComponentSwizzle>(image.components[3]),
+			};
+			scene_upload_image(*upload, image_slots[image_index], image_create_info, offset, false, "Pack",
+			                   components);
+		}
+
+		std::vector<std::future<Io_Read>> texel_reads;
+		for (size_t batch_index = 0; batch_index < batch_end - batch_start; batch_index++)
+		{
+			auto& chunk = chunks[images[batch_start + batch_index].texel_chunk];
+			texel_reads.push_back(io_read({
+				.path        = pack_file,
+				.offset      = chunk.offset,
+				.size        = chunk.size,
+				.destination = (chunk.compression == Pack_Compression::NONE)
+				? upload->upload_writer.base_ptr + texel_offsets[batch_index] : nullptr,
+				.priority    = Io_Priority::NORMAL,
+			}));
+		}
+
+		// Futures have to be waited on even if some read fails, reads write into upload heap
+		parallel_for(batch_end - batch_start, [&](size_t batch_index)
+		{
+			ZoneScopedN("Texel chunk reading");
+
+			auto&      chunk = chunks[images[batch_start + batch_index].texel_chunk];
+			Load_Timer timer(Load_Phase::FILE_READ, chunk.raw_size);
+
+			Io_Read read = texel_reads[batch_index].get();
+			if (!read.ok)
+			throw std::runtime_error("Scene pack problem");
+
+			if (chunk.compression != Pack_Compression::NONE)
+			{
+				pack_decompress_chunk(read.bytes.data(), chunk, upload->upload_writer.base_ptr + texel_offsets[batch_index]);
+			}
+		});
+
+		scene_upload_finish(upload);
+
+		batch_start = batch_end;
+	}
+
+	mapped_file_close(&file);
+
+	spdlog::info("Scene pack loaded, {} images, {} meshes, {} render objects",
+	             images.size(), meshes.size(), render_objects.size());
+
+	return true;
+}
+
+// Paths are made relative to the pack, so pack and its sources can be moved together. Each file is listed once.
+std::vector<uint8_t> pack_bake_sources(std::vector<std::filesystem::path> files,
+                                       const std::filesystem::path& pack_file, uint32_t* source_count)
+{
+	std::filesystem::path pack_directory = std::filesystem::absolute(pack_file).parent_path();
+	for (auto& file : files)
+	{
+		file = std::filesystem::absolute(file).lexically_normal().lexically_proximate(pack_directory);
+	}
+	std::sort(files.begin(), files.end());
+	files.erase(std::unique(files.begin(), files.end()), files.end());
+
+	std::vector<Pack_Source> sources;
+	std::u8string            paths;
+	for (auto& file : files)
+	{
+		// Baking read all of them already
+		uint64_t size       = std::filesystem::file_size(pack_directory / file);
+		auto     write_time = std::filesystem::last_write_time(pack_directory / file);
+
+		std::u8string name = file.generic_u8string();
+		sources.push_back({
+			.size        = size,
+			.write_time  = static_cast<int64_t>(write_time.time_since_epoch().count()),
+			.path_offset = static_cast<uint32_t>(paths.size()),
+			.path_size   = static_cast<uint32_t>(name.size()),
+		});
+		paths += name;
+	}
+
+	// Paths go after the table
+	std::vector<uint8_t> data(sources.size() * sizeof(Pack_Source) + paths.size());
+	for (auto& source : sources) source.path_offset += static_cast<uint32_t>(sources.size() * sizeof(Pack_Source));
+	memcpy(data.data(), sources.data(), sources.size() * sizeof(Pack_Source));
+	memcpy(data.data() + sources.size() * sizeof(Pack_Source), paths.data(), paths.size());
+
+	*source_count = static_cast<uint32_t>(sources.size());
+	return data;
+}
+
+// Sources is content of SOURCES chunk
+bool pack_sources_unchanged(const std::vector<uint8_t>& sources, uint32_t source_count,
+                            const std::filesystem::path& pack_file)
+{
+	if (sources.size() < static_cast<size_t>(source_count) * sizeof(Pack_Source)) return false;
+
+	std::filesystem::path pack_directory = std::filesystem::absolute(pack_file).parent_path();
+	for (uint32_t source_index = 0; source_index < source_count; source_index++)
+	{
+		Pack_Source source;
+		memcpy(&source, sources.data() + source_index * sizeof(Pack_Source), sizeof(source));
+		if (source.path_offset > sources.size() || source.path_size > sources.size() - source.path_offset)
+		return false;
+
+		std::filesystem::path path = pack_directory / std::u8string(reinterpret_cast<const char8_t*>(sources.data())
+		                                                            + source.path_offset, source.path_size);
+
+		// Missing file counts as changed
+		std::error_code size_error, time_error;
+		uint64_t size       = std::filesystem::file_size(path, size_error);
+		auto     write_time = std::filesystem::last_write_time(path, time_error);
+		if (size_error || time_error || size != source.size
+		    || write_time.time_since_epoch().count() != source.write_time)
+		{
+			spdlog::info("{} changed since scene pack was baked", path.string());
+			return false;
+		}
+	}
+	return true;
+}
+
+void pack_read_chunk(const Mapped_File& file, const Pack_Chunk& chunk, uint8_t* destination)
+{
+	Load_Timer timer(Load_Phase::FILE_READ, chunk.raw_size);
+
+	const uint8_t* source = file.data + chunk.offset;
+
+	if (chunk.compression == Pack_Compression::NONE)
+	{
+		memcpy(destination, source, chunk.size);
+		return;
+	}
+
+	pack_decompress_chunk(source, chunk, destination);
+}
+
+void pack_decompress_chunk(const uint8_t* source, const Pack_Chunk& chunk, uint8_t* destination)
+{
+	int decompressed_size = tracy::LZ4_decompress_safe(reinterpret_cast<const char*>(source),
+	                                                   reinterpret_cast<char*>(destination),
+	                                                   static_cast<int>(chunk.size),
+	                                                   static_cast<int>(chunk.raw_size));
+	if (decompressed_size < 0 || static_cast<uint64_t>(decompressed_size) != chunk.raw_size)
+	throw std::runtime_error("Scene pack problem");
+}
+
+VkSamplerCreateInfo pack_sampler_create_info(const Pack_Sampler& sampler)
+{
+	// Same as gltf_sampler_create_info(), except for filtering and addressing which come from the pack
+	VkSamplerCreateInfo sampler_create_info = {
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter        = static_cast<VkFilter>(sampler.mag_filter),
+		.minFilter        = static_cast<VkFilter>(sampler.min_filter),
+		.mipmapMode       = static_cast<VkSamplerMipmapMode>(sampler.mipmap_mode),
+		.addressModeU     = static_cast<VkSamplerAddressMode>(sampler.address_mode_u),
+		.addressModeV     = static_cast<VkSamplerAddressMode>(sampler.address_mode_v),
+		.addressModeW     = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		.mipLodBias       = 0,
+		.anisotropyEnable = false,
+		.maxAnisotropy    = 16,
+		.compareEnable    = false,
+		.compareOp        = VK_COMPARE_OP_NEVER,
+		.borderColor      = VK_BORDER_COLOR_INT_OPAQUE_WHITE,
+		.unnormalizedCoordinates = false,
+	};
+	return sampler_create_info;
+}
+
+Vertex_Format pack_vertex_format(const Pack_Mesh& mesh)
+{
+	return {
+		.position = static_cast<VkFormat>(mesh.position_format),
+		.normal   = static_cast<VkFormat>(mesh.normal_format),
+		.tangent  = static_cast<VkFormat>(mesh.tangent_format),
+		.texcoord = static_cast<VkFormat>(mesh.texcoord_format),
+		.packed   = mesh.packed_vertices != 0,
+	};
+}
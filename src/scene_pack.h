@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Scene pack is baked, ready-to-upload version of a glTF scene. Everything in it is already in the form renderer
+// wants (interleaved vertices, indices, materials, fully mipped BC7/BC5 texels, flattened node hierarchy), so loading
+// is just mapping the file and copying (or LZ4 decompressing) chunks straight into upload heap.
+//
+// Layout:
+//   Pack_Header
+//   Pack_Chunk[chunk_count]  (chunk table)
+//   chunk data, each chunk aligned to PACK_CHUNK_ALIGNMENT
+//
+// All indices inside the pack (images, samplers, materials, meshes, nodes) are local to the pack, PACK_DEFAULT_INDEX
+// refers to default texture/sampler/material of the renderer.
+//
+// Pack remembers size and modification time of every file it was baked from (glTF, external buffers and images), and
+// it isn't used once any of them changes or disappears.
+
+constexpr uint32_t PACK_MAGIC           = 'R' | ('D' << 8) | ('S' << 16) | ('P' << 24);
+constexpr uint32_t PACK_VERSION         = 12;
+constexpr uint32_t PACK_CHUNK_ALIGNMENT = 16;
+constexpr uint32_t PACK_DEFAULT_INDEX   = UINT32_MAX;
+
+// Geometry chunks are filled with whole vertex groups up to this size, so loading can upload them in batches
+constexpr uint64_t PACK_GEOMETRY_CHUNK_SIZE = 4 * 1024 * 1024;
+
+enum class Pack_Chunk_Type : uint32_t
+{
+	SAMPLERS,       // Pack_Sampler[]
+	MATERIALS,      // PBR_Material[], with pack-local texture and sampler indices
+	MESHES,         // Pack_Mesh[]
+	RENDER_OBJECTS, // Pack_Render_Object[]
+	IMAGES,         // Pack_Image[]
+	NODES,          // Pack_Node[], in pre-order
+	SOURCES,        // Pack_Source[source_count], followed by their paths
+	GEOMETRY_DATA,  // Vertices, indices and meshlets of some meshes, see PACK_GEOMETRY_CHUNK_SIZE
+	TEXEL_DATA,     // Texels of single image, all mip levels tightly packed (largest first)
+};
+
+enum class Pack_Compression : uint32_t
+{
+	NONE,
+	LZ4,
+};
+
+struct Pack_Header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t chunk_count;
+	uint32_t source_count;    // Files pack was baked from, see SOURCES chunk
+	uint32_t packed_vertices; // 1 if baked with --packed-vertices
+	uint32_t static_batching; // 1 if baked with --static-batching
+};
+
+struct Pack_Chunk
+{
+	Pack_Chunk_Type  type;
+	Pack_Compression compression;
+	uint64_t         offset;   // From start of the file
+	uint64_t         size;     // Stored size
+	uint64_t         raw_size; // Size after decompression
+};
+
+// File pack was baked from, as it was at the time
+struct Pack_Source
+{
+	uint64_t size;
+	int64_t  write_time;  // std::filesystem::file_time_type ticks
+	uint32_t path_offset; // From start of SOURCES chunk, path is UTF-8 and relative to the pack
+	uint32_t path_size;
+};
+
+struct Pack_Sampler
+{
+	uint32_t mag_filter;     // VkFilter
+	uint32_t min_filter;     // VkFilter
+	uint32_t mipmap_mode;    // VkSamplerMipmapMode
+	uint32_t address_mode_u; // VkSamplerAddressMode
+	uint32_t address_mode_v; // VkSamplerAddressMode
+};
+
+struct Pack_Image
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_levels;
+	uint32_t format;        // VkFormat
+	uint32_t components[4]; // VkComponentSwizzle of image view (RGBA)
+	uint32_t texel_chunk;   // Index of TEXEL_DATA chunk in chunk table
+};
+
+// Offsets are relative to start of mesh's GEOMETRY_DATA chunk (after decompression)
+struct Pack_Mesh
+{
+	uint64_t vertex_offset;
+	uint64_t vertex_size;
+	uint64_t indices_offset;
+	uint64_t indices_size;
+	uint32_t vertex_count;
+	uint32_t indices_count;
+	uint32_t position_format; // VkFormat
+	uint32_t normal_format;   // VkFormat
+	uint32_t tangent_format;  // VkFormat
+	uint32_t texcoord_format; // VkFormat
+	uint32_t index_type;      // VkIndexType
+	uint32_t meshlets_count;
+	uint64_t meshlets_offset; // Meshlet[]
+	float    position_offset[3]; // Dequantization of packed positions
+	float    position_scale[3];
+	uint32_t packed_vertices; // 1 if vertices are in PACKED_VERTEX_FORMAT
+	uint32_t geometry_chunk;  // Index of GEOMETRY_DATA chunk in chunk table
+};
+
+struct Pack_Node
+{
+	uint32_t parent;             // Index of earlier node, or PACK_DEFAULT_INDEX for roots
+	float    local_transform[16];
+};
+
+struct Pack_Render_Object
+{
+	uint32_t mesh_index;
+	uint32_t material_index;
+	uint32_t node;
+};
+
+// Pack lives next to its source, with .pack extension
+std::filesystem::path scene_pack_path(const std::filesystem::path& gltf_file);
+
+// Uses job_system, has to be initialized. Returns false on failure.
+bool bake_scene_pack(const std::filesystem::path& gltf_file, const std::filesystem::path& pack_file, bool compress,
+                     bool packed_vertices, bool static_batching);
+
+// Loads pack through scene_loader batches, so call it from the loader. Returns false if pack can't be used (missing,
+// wrong version, corrupted, baked from files that changed since or with different loader options), nothing is created
+// in this case.
+bool load_scene_pack(const std::filesystem::path& pack_file);
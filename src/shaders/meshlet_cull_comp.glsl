@@ -0,0 +1,100 @@
+#version 450
+
+// One invocation per meshlet of every culled instance group. Writes indirect draw of the meshlet for all instances,
+// with no indices if none of them sees it. Keep in sync with meshlet_visible() in meshlet_culling.cpp.
+
+layout (local_size_x = 64) in;
+
+struct Meshlet
+{
+	vec3 center;
+	float radius;
+	vec3 cone_apex;
+	float cone_cutoff;
+	vec3 cone_axis;
+	uint first_index;
+	uint index_count;
+	uint _pad0, _pad1, _pad2;
+};
+
+struct Cull_Object
+{
+	uint first_meshlet;
+	uint meshlet_count;
+	uint first_command;
+	uint first_instance;
+	uint instance_count;
+	uint index_base;
+};
+
+struct Draw_Command // VkDrawIndexedIndirectCommand
+{
+	uint index_count;
+	uint instance_count;
+	uint first_index;
+	int  vertex_offset;
+	uint first_instance;
+};
+
+layout (std430, set = 0, binding = 0) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout (std430, set = 0, binding = 1) readonly buffer Objects { Cull_Object objects[]; };
+layout (std430, set = 0, binding = 2) writeonly buffer Commands { Draw_Command commands[]; };
+layout (std430, set = 0, binding = 3) readonly buffer Instances { mat4 instance_transforms[]; };
+
+layout( push_constant ) uniform constants
+{
+	vec4 planes[6];
+	vec3 camera_position;
+	uint object_count;
+	uint command_count;
+} push_constants;
+
+void main()
+{
+	uint command_index = gl_GlobalInvocationID.x;
+	if (command_index >= push_constants.command_count) return;
+
+	// Find object owning this command, objects are sorted by first_command
+	uint low  = 0;
+	uint high = push_constants.object_count - 1;
+	while (low < high)
+	{
+		uint middle = (low + high + 1) / 2;
+		if (objects[middle].first_command <= command_index) low = middle;
+		else high = middle - 1;
+	}
+
+	Cull_Object object  = objects[low];
+	Meshlet     meshlet = meshlets[object.first_meshlet + command_index - object.first_command];
+
+	bool visible = false;
+	for (uint instance = 0; instance < object.instance_count && !visible; instance++)
+	{
+		mat4 transform = instance_transforms[object.first_instance + instance];
+
+		// Largest scale of transform
+		float scale = sqrt(max(max(dot(transform[0].xyz, transform[0].xyz), dot(transform[1].xyz, transform[1].xyz)),
+		                       dot(transform[2].xyz, transform[2].xyz)));
+
+		vec3  center = vec3(transform * vec4(meshlet.center, 1.0f));
+		float radius = meshlet.radius * scale;
+
+		bool inside = true;
+		for (int i = 0; i < 6; i++)
+		{
+			if (dot(push_constants.planes[i].xyz, center) + push_constants.planes[i].w < -radius) inside = false;
+		}
+
+		vec3 apex = vec3(transform * vec4(meshlet.cone_apex, 1.0f));
+		vec3 axis = normalize(mat3(transform) * meshlet.cone_axis);
+		bool back_facing = dot(normalize(apex - push_constants.camera_position), axis) >= meshlet.cone_cutoff;
+
+		visible = inside && !back_facing;
+	}
+
+	commands[command_index].index_count    = visible ? meshlet.index_count : 0;
+	commands[command_index].instance_count = object.instance_count;
+	commands[command_index].first_index    = object.index_base + meshlet.first_index;
+	commands[command_index].vertex_offset  = 0;
+	commands[command_index].first_instance = object.first_instance;
+}
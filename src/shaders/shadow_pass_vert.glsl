@@ -1,14 +1,18 @@
 #version 450
 
+layout (std430, set = 0, binding = 4) readonly buffer Instance_Data { mat4 instance_transforms[]; };
+
 layout( push_constant ) uniform constants
 {
-    mat4 model_matrix;
     mat4 light_space_matrix;
+    vec3 position_offset; // Position is offset + scale * in_position (quantized meshes)
+    layout(offset = 80) vec3 position_scale;
 } push_constants;
 
 layout (location = 0) in vec3 in_position;
 
 void main()
 {
-    gl_Position = push_constants.light_space_matrix * push_constants.model_matrix * vec4(in_position, 1.0f);
+    vec3 position = push_constants.position_offset + push_constants.position_scale * in_position;
+    gl_Position   = push_constants.light_space_matrix * instance_transforms[gl_InstanceIndex] * vec4(position, 1.0f);
 }
\ No newline at end of file
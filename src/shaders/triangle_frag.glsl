@@ -42,7 +42,6 @@ layout (std430, set = 0, binding = 3) buffer  Material_Data { PBR_Material mater
 
 layout (push_constant) uniform Push_Constants
 {
-	mat4 model_matrix;
 	uint material_id;
 } push_constants;
 
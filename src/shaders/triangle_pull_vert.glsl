@@ -0,0 +1,81 @@
+#version 450
+
+// Same as triangle_vert.glsl, but vertices are read from vertex buffer by gl_VertexIndex. Index buffer isn't offset
+// per mesh, so indices are relative to vertices of the mesh in draw data. See vertex_pulling.h.
+
+layout (set = 0, binding = 0) uniform Global_Data
+{
+	mat4 pv_matrix;
+} global_data;
+layout (std430, set = 0, binding = 4) readonly buffer Instance_Data { mat4 instance_transforms[]; };
+
+struct Draw_Data
+{
+	uint first_position; // In words of vertex buffer
+	uint first_attribute;
+	vec3 position_offset;
+	vec3 position_scale;
+};
+
+layout (std430, set = 1, binding = 0) readonly buffer Vertices { uint vertices[]; };
+layout (std430, set = 1, binding = 1) readonly buffer Draws { Draw_Data draws[]; };
+
+layout( push_constant ) uniform constants
+{
+	uint material_id;
+	uint draw_index;
+} push_constants;
+
+// Packed vertices have octahedral normal and tangent, sign of tangent is w of position
+layout (constant_id = 0) const bool PACKED_VERTICES = false;
+
+layout (location = 0) out vec3 out_normal;
+layout (location = 1) out vec2 out_uv;
+layout (location = 2) out vec3 out_world_position;
+
+vec3 octahedral_decode(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold  = max(-normal.z, 0.0f);
+	normal.xy  += mix(vec2(fold), vec2(-fold), greaterThanEqual(normal.xy, vec2(0.0f)));
+	return normalize(normal);
+}
+
+void main()
+{
+	Draw_Data draw = draws[push_constants.draw_index];
+	uint vertex    = gl_VertexIndex;
+
+	vec3 in_position;
+	vec3 normal;
+	vec2 uv;
+	if (PACKED_VERTICES)
+	{
+		// Position is 4 unorm16, attributes are octahedral normal, octahedral tangent and half float UV
+		uint p = draw.first_position + 2 * vertex;
+		uint a = draw.first_attribute + 3 * vertex;
+
+		in_position = vec3(unpackUnorm2x16(vertices[p]), unpackUnorm2x16(vertices[p + 1]).x);
+		normal      = octahedral_decode(unpackSnorm2x16(vertices[a]));
+		uv          = unpackHalf2x16(vertices[a + 2]);
+	}
+	else
+	{
+		// Position is 3 floats, attributes are normal (3), tangent (4) and UV (2)
+		uint p = draw.first_position + 3 * vertex;
+		uint a = draw.first_attribute + 9 * vertex;
+
+		in_position = uintBitsToFloat(uvec3(vertices[p], vertices[p + 1], vertices[p + 2]));
+		normal      = uintBitsToFloat(uvec3(vertices[a], vertices[a + 1], vertices[a + 2]));
+		uv          = uintBitsToFloat(uvec2(vertices[a + 7], vertices[a + 8]));
+	}
+
+	mat4 model_matrix = instance_transforms[gl_InstanceIndex];
+	vec4 position     = vec4(draw.position_offset + draw.position_scale * in_position, 1.0f);
+
+	out_normal         = normal;
+	out_uv             = uv;
+	out_world_position = vec3(model_matrix * position);
+
+	gl_Position = global_data.pv_matrix * model_matrix * position;
+}
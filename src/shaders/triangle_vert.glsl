@@ -6,14 +6,19 @@ layout (set = 0, binding = 0) uniform Global_Data
 } global_data;
 layout (set = 0, binding = 1) uniform sampler     global_samplers[100];
 layout (set = 0, binding = 2) uniform texture2D   global_sampled_textures[5000];
+layout (std430, set = 0, binding = 4) readonly buffer Instance_Data { mat4 instance_transforms[]; };
 
 layout( push_constant ) uniform constants
 {
-	mat4 model_matrix;
-	int  texture_id;
+	uint material_id;
+	layout(offset = 16) vec3 position_offset; // Position is offset + scale * in_position (quantized meshes)
+	layout(offset = 32) vec3 position_scale;
 } push_constants;
 
-layout (location = 0) in vec3 in_position;
+// Packed vertices have octahedral normal and tangent, sign of tangent is w of position
+layout (constant_id = 0) const bool PACKED_VERTICES = false;
+
+layout (location = 0) in vec4 in_position;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in vec4 in_tangent;
 layout (location = 3) in vec2 in_uv;
@@ -22,11 +27,25 @@ layout (location = 0) out vec3 out_normal;
 layout (location = 1) out vec2 out_uv;
 layout (location = 2) out vec3 out_world_position;
 
+vec3 octahedral_decode(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold  = max(-normal.z, 0.0f);
+	normal.xy  += mix(vec2(fold), vec2(-fold), greaterThanEqual(normal.xy, vec2(0.0f)));
+	return normalize(normal);
+}
+
 void main()
 {
-	out_normal         = in_normal;
+	mat4 model_matrix = instance_transforms[gl_InstanceIndex];
+	vec4 position     = vec4(push_constants.position_offset + push_constants.position_scale * in_position.xyz, 1.0f);
+
+	// Tangent isn't used yet, packed one is vec4(octahedral_decode(in_tangent.xy), in_position.w * 2.0f - 1.0f)
+	vec3 normal = PACKED_VERTICES ? octahedral_decode(in_normal.xy) : in_normal;
+
+	out_normal         = normal;
 	out_uv             = in_uv;
-	out_world_position = vec3(push_constants.model_matrix * vec4(in_position, 1.0f));
+	out_world_position = vec3(model_matrix * position);
 
-	gl_Position = global_data.pv_matrix * push_constants.model_matrix * vec4(in_position, 1.0f);
+	gl_Position = global_data.pv_matrix * model_matrix * position;
 }
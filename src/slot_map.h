@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cassert>
+#include <compare>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Handle of value in Slot_Map. Index of slot stays the same for as long as the value lives, so it's what GPU data
+// (materials, descriptor array elements, push constants) refers to. Generation tells apart values that used the slot.
+struct Slot_Handle
+{
+	uint32_t index;
+	uint32_t generation;
+
+	auto operator<=>(const Slot_Handle&) const = default;
+};
+
+// Values stored densely by slot index, so lookup is plain indexing. Removing value bumps generation of its slot and
+// puts the slot on free list, handles of removed value are then stale (contains() is false for them).
+//
+// Slots can be reserved before their values exist: loader reserves them on its thread, so batches can refer to
+// values that main thread sets later, when batches are committed. reserve() and remove() are thread safe, everything
+// else is main thread only.
+template <typename T>
+struct Slot_Map
+{
+	std::vector<T>           values;      // By slot index, slots without value hold T{}
+	std::vector<uint32_t>    generations; // By slot index
+	std::vector<Slot_Handle> free_slots;  // With generation they get when reused
+	uint32_t                 slot_count = 0; // Including reserved slots past values
+	std::mutex               mutex;          // Guards free_slots and slot_count
+
+	Slot_Handle reserve()
+	{
+		std::lock_guard lock(mutex);
+		if (!free_slots.empty())
+		{
+			Slot_Handle handle = free_slots.back();
+			free_slots.pop_back();
+			return handle;
+		}
+		return { slot_count++, 0 };
+	}
+
+	void set(Slot_Handle handle, T value)
+	{
+		if (values.size() <= handle.index)
+		{
+			values.resize(handle.index + 1);
+			generations.resize(handle.index + 1, 0);
+		}
+		values[handle.index]      = std::move(value);
+		generations[handle.index] = handle.generation;
+	}
+
+	Slot_Handle insert(T value)
+	{
+		Slot_Handle handle = reserve();
+		set(handle, std::move(value));
+		return handle;
+	}
+
+	// Only forgets the value, destroying whatever it owns is up to caller
+	void remove(Slot_Handle handle)
+	{
+		assert(contains(handle));
+		values[handle.index] = T{};
+		uint32_t generation  = ++generations[handle.index];
+
+		std::lock_guard lock(mutex);
+		free_slots.push_back({ handle.index, generation });
+	}
+
+	bool contains(Slot_Handle handle) const
+	{
+		return handle.index < values.size() && generations[handle.index] == handle.generation;
+	}
+
+	T& operator[](Slot_Handle handle)
+	{
+		assert(contains(handle));
+		return values[handle.index];
+	}
+
+	const T& operator[](Slot_Handle handle) const
+	{
+		assert(contains(handle));
+		return values[handle.index];
+	}
+
+	// Slots up to the last one set, including free ones. Values can be iterated by index up to it.
+	size_t size() const { return values.size(); }
+};
@@ -0,0 +1,334 @@
+#include "texture_compression.h"
+
+#include "common.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+constexpr uint32_t TEXTURE_ENCODE_BAND_ROWS = 8; // Rows of blocks encoded by single job
+
+// Interpolation weights of BC7 4-bit indices, out of 64
+constexpr int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct Bc7_Candidate
+{
+	int      endpoints[2][4]; // RGBA, 7 bits of endpoint + p-bit
+	uint8_t  indices[16];
+	uint32_t error;
+};
+
+// Private functions
+uint32_t texture_block_size(VkFormat format);
+void bc7_encode_block(const uint8_t pixels[16][4], uint8_t* block);
+void bc7_fit_endpoints(const uint8_t pixels[16][4], const float low[4], const float high[4], Bc7_Candidate* best);
+void bc4_encode_block(const uint8_t pixels[16][4], uint32_t channel, uint8_t* block);
+
+bool texture_format_is_bc(VkFormat format)
+{
+	return texture_block_size(format) != 0;
+}
+
+size_t texture_level_size(VkFormat format, uint32_t width, uint32_t height)
+{
+	if (format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB)
+	{
+		return static_cast<size_t>(width) * height * 4;
+	}
+
+	size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * texture_block_size(format);
+}
+
+size_t texture_mip_chain_size(VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels)
+{
+	size_t size = 0;
+	for (uint32_t mip = 0; mip < mip_levels; mip++)
+	{
+		size += texture_level_size(format, std::max(width >> mip, 1u), std::max(height >> mip, 1u));
+	}
+	return size;
+}
+
+uint32_t texture_block_size(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+		return 8;
+
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		return 16;
+
+	default:
+		return 0;
+	}
+}
+
+void texture_encode_bc(const uint8_t* texels, uint32_t width, uint32_t height, VkFormat format, uint8_t* blocks)
+{
+	bool bc7 = (format == VK_FORMAT_BC7_UNORM_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK);
+	if (!bc7 && format != VK_FORMAT_BC5_UNORM_BLOCK)
+	throw std::runtime_error("Texture compression problem");
+
+	uint32_t blocks_x = (width + 3) / 4;
+	uint32_t blocks_y = (height + 3) / 4;
+	uint32_t bands    = (blocks_y + TEXTURE_ENCODE_BAND_ROWS - 1) / TEXTURE_ENCODE_BAND_ROWS;
+
+	parallel_for(bands, [&](size_t band)
+	{
+		ZoneScopedN("Texture band encode");
+
+		uint32_t first_row = static_cast<uint32_t>(band) * TEXTURE_ENCODE_BAND_ROWS;
+		uint32_t last_row  = std::min(first_row + TEXTURE_ENCODE_BAND_ROWS, blocks_y);
+		for (uint32_t block_y = first_row; block_y < last_row; block_y++)
+		{
+			for (uint32_t block_x = 0; block_x < blocks_x; block_x++)
+			{
+				uint8_t pixels[16][4];
+				for (uint32_t i = 0; i < 16; i++)
+				{
+					uint32_t x = std::min(block_x * 4 + i % 4, width - 1);
+					uint32_t y = std::min(block_y * 4 + i / 4, height - 1);
+					memcpy(pixels[i], texels + (static_cast<size_t>(y) * width + x) * 4, 4);
+				}
+
+				uint8_t* block = blocks + (static_cast<size_t>(block_y) * blocks_x + block_x) * 16;
+				if (bc7)
+				{
+					bc7_encode_block(pixels, block);
+				}
+				else
+				{
+					bc4_encode_block(pixels, 0, block);
+					bc4_encode_block(pixels, 1, block + 8);
+				}
+			}
+		}
+	});
+}
+
+// Mode 6: single subset, 7-bit RGBA endpoints with a p-bit each, 4-bit indices
+void bc7_encode_block(const uint8_t pixels[16][4], uint8_t* block)
+{
+	// Principal axis of the block (power iteration on covariance), endpoints start at extremes of projections on it
+	float mean[4] = {};
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		for (uint32_t c = 0; c < 4; c++) mean[c] += pixels[i][c] / 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		for (uint32_t a = 0; a < 4; a++)
+		{
+			for (uint32_t b = 0; b < 4; b++) covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+		}
+	}
+
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (uint32_t iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		for (uint32_t a = 0; a < 4; a++)
+		{
+			for (uint32_t b = 0; b < 4; b++) next[a] += covariance[a][b] * axis[b];
+		}
+
+		float largest = std::max({ std::abs(next[0]), std::abs(next[1]), std::abs(next[2]), std::abs(next[3]) });
+		if (largest < 1e-6f) break; // Solid block
+		for (uint32_t c = 0; c < 4; c++) axis[c] = next[c] / largest;
+	}
+
+	float axis_length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3]);
+	for (uint32_t c = 0; c < 4; c++) axis[c] /= axis_length;
+
+	float t_min = 0.0f, t_max = 0.0f;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (uint32_t c = 0; c < 4; c++) t += (pixels[i][c] - mean[c]) * axis[c];
+		t_min = std::min(t_min, t);
+		t_max = std::max(t_max, t);
+	}
+
+	float low[4], high[4];
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		low[c]  = mean[c] + t_min * axis[c];
+		high[c] = mean[c] + t_max * axis[c];
+	}
+
+	Bc7_Candidate best = { .error = UINT32_MAX };
+	bc7_fit_endpoints(pixels, low, high, &best);
+
+	// Refit endpoints by least squares for the chosen indices, it's kept only if it helps
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float low_sum[4] = {}, high_sum[4] = {};
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float w = BC7_WEIGHTS[best.indices[i]] / 64.0f;
+		aa += (1.0f - w) * (1.0f - w);
+		ab += (1.0f - w) * w;
+		bb += w * w;
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			low_sum[c]  += (1.0f - w) * pixels[i][c];
+			high_sum[c] += w * pixels[i][c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (best.error > 0 && std::abs(determinant) > 1e-6f)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			low[c]  = (bb * low_sum[c] - ab * high_sum[c]) / determinant;
+			high[c] = (aa * high_sum[c] - ab * low_sum[c]) / determinant;
+		}
+		bc7_fit_endpoints(pixels, low, high, &best);
+	}
+
+	// Top bit of anchor (first pixel) index is implicit zero, swap endpoints if it's set
+	if (best.indices[0] >= 8)
+	{
+		for (uint32_t c = 0; c < 4; c++) std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+		for (uint32_t i = 0; i < 16; i++) best.indices[i] = 15 - best.indices[i];
+	}
+
+	memset(block, 0, 16);
+	uint32_t bit = 0;
+	auto put_bits = [&](uint32_t value, uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; i++, bit++) block[bit / 8] |= ((value >> i) & 1) << (bit % 8);
+	};
+
+	put_bits(1 << 6, 7);
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		put_bits(best.endpoints[0][c] >> 1, 7);
+		put_bits(best.endpoints[1][c] >> 1, 7);
+	}
+	put_bits(best.endpoints[0][0] & 1, 1);
+	put_bits(best.endpoints[1][0] & 1, 1);
+
+	put_bits(best.indices[0], 3);
+	for (uint32_t i = 1; i < 16; i++) put_bits(best.indices[i], 4);
+}
+
+// Quantizes endpoints with all four p-bit combinations, replaces best if any of them has lower error
+void bc7_fit_endpoints(const uint8_t pixels[16][4], const float low[4], const float high[4], Bc7_Candidate* best)
+{
+	for (int p_bits = 0; p_bits < 4; p_bits++)
+	{
+		Bc7_Candidate candidate = { .error = 0 };
+
+		auto quantize = [](float value, int p_bit)
+		{
+			return std::clamp(static_cast<int>(std::lround((value - p_bit) / 2.0f)), 0, 127) * 2 + p_bit;
+		};
+
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			candidate.endpoints[0][c] = quantize(low[c],  p_bits & 1);
+			candidate.endpoints[1][c] = quantize(high[c], p_bits >> 1);
+		}
+
+		int palette[16][4];
+		for (uint32_t index = 0; index < 16; index++)
+		{
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				palette[index][c] = ((64 - BC7_WEIGHTS[index]) * candidate.endpoints[0][c]
+				                     + BC7_WEIGHTS[index] * candidate.endpoints[1][c] + 32) >> 6;
+			}
+		}
+
+		int direction[4];
+		int direction_length = 0;
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			direction[c]      = candidate.endpoints[1][c] - candidate.endpoints[0][c];
+			direction_length += direction[c] * direction[c];
+		}
+
+		// Weights are almost uniform, so projection on endpoint line lands at most one index off the best one
+		for (uint32_t i = 0; i < 16 && candidate.error < best->error; i++)
+		{
+			int guess = 0;
+			if (direction_length > 0)
+			{
+				int projection = 0;
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					projection += (pixels[i][c] - candidate.endpoints[0][c]) * direction[c];
+				}
+				guess = std::clamp((projection * 15 + direction_length / 2) / direction_length, 0, 15);
+			}
+
+			uint32_t best_pixel_error = UINT32_MAX;
+			for (int index = std::max(guess - 1, 0); index <= std::min(guess + 1, 15); index++)
+			{
+				uint32_t pixel_error = 0;
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					int difference = pixels[i][c] - palette[index][c];
+					pixel_error += difference * difference;
+				}
+				if (pixel_error < best_pixel_error)
+				{
+					best_pixel_error     = pixel_error;
+					candidate.indices[i] = static_cast<uint8_t>(index);
+				}
+			}
+			candidate.error += best_pixel_error;
+		}
+
+		if (candidate.error < best->error) *best = candidate;
+	}
+}
+
+// Eight value mode only (first endpoint is the larger one), 3-bit indices
+void bc4_encode_block(const uint8_t pixels[16][4], uint32_t channel, uint8_t* block)
+{
+	int low = 255, high = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		low  = std::min(low,  static_cast<int>(pixels[i][channel]));
+		high = std::max(high, static_cast<int>(pixels[i][channel]));
+	}
+
+	uint64_t indices = 0;
+	if (high > low)
+	{
+		int range = high - low;
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			// Position on the ramp, from low (0) to high (7). Index 0 is high, 1 low, 2-7 go from high to low.
+			int position = ((pixels[i][channel] - low) * 14 + range) / (2 * range);
+			uint64_t index = (position == 7) ? 0 : (position == 0) ? 1 : 8 - position;
+			indices |= index << (3 * i);
+		}
+	}
+
+	block[0] = static_cast<uint8_t>(high);
+	block[1] = static_cast<uint8_t>(low);
+	for (uint32_t byte = 0; byte < 6; byte++) block[2 + byte] = static_cast<uint8_t>(indices >> (8 * byte));
+}
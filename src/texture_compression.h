@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+// Texel formats images can be uploaded in, and CPU encoder of block compressed ones. All sizes are of tightly
+// packed texels (rows of 4x4 blocks for BC formats), which is how upload heap and scene packs hold them.
+//
+// Encoder does BC7 (mode 6 only, single subset with RGBA endpoints) and BC5 (two BC4 blocks). That's not what
+// offline compressors get out of BC7, but it's fast enough to run at bake time and is noticeably better than BC1/BC3.
+
+// BC formats can only be sampled if device has textureCompressionBC (see Gfx_Context)
+bool texture_format_is_bc(VkFormat format);
+
+// Size of single mip level, 0 for formats we can't upload
+size_t texture_level_size(VkFormat format, uint32_t width, uint32_t height);
+
+// Size of mip levels packed one after another (largest first), 0 for formats we can't upload
+size_t texture_mip_chain_size(VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels);
+
+// Encode RGBA8 texels into VK_FORMAT_BC7_*_BLOCK or VK_FORMAT_BC5_UNORM_BLOCK (from R and G channels) blocks.
+// Partial blocks at right and bottom edges are filled by clamping. Rows of blocks are encoded in parallel, so
+// job_system has to be initialized (calling from a job is fine).
+void texture_encode_bc(const uint8_t* texels, uint32_t width, uint32_t height, VkFormat format, uint8_t* blocks);
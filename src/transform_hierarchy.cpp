@@ -0,0 +1,172 @@
+#include "transform_hierarchy.h"
+
+#include "common.h"
+#include "job_system.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_HIERARCHY_SSE2
+#include <emmintrin.h>
+#endif
+
+// Subtrees bigger than this are split between their children, and sweeps are grouped into jobs of about this size
+constexpr uint32_t TRANSFORM_SWEEP_CHUNK = 4096;
+
+// Private functions
+void transform_multiply(const glm::mat4& parent, const glm::mat4& local, glm::mat4* world);
+void transform_sweep(Transform_Hierarchy* hierarchy, uint32_t root);
+
+void transform_hierarchy_insert(Transform_Hierarchy* hierarchy, uint32_t first_node, const uint32_t* parents,
+                                const glm::mat4* local_transforms, uint32_t count)
+{
+	uint32_t end = first_node + count;
+	hierarchy->parents.resize(end, TRANSFORM_NO_PARENT);
+	hierarchy->subtree_ends.resize(end);
+	hierarchy->local_transforms.resize(end, glm::mat4(1.0f));
+	hierarchy->world_transforms.resize(end, glm::mat4(1.0f));
+
+	std::copy(parents, parents + count, hierarchy->parents.begin() + first_node);
+	std::copy(local_transforms, local_transforms + count, hierarchy->local_transforms.begin() + first_node);
+
+	// Subtree ends bubble up from leaves, in pre-order descendants are right after their parent
+	for (uint32_t node = first_node; node < end; node++) hierarchy->subtree_ends[node] = node + 1;
+	for (uint32_t node = end; node-- > first_node;)
+	{
+		uint32_t parent = hierarchy->parents[node];
+		if (parent == TRANSFORM_NO_PARENT) continue;
+
+		if (parent >= node)
+		throw std::runtime_error("Transform hierarchy not in pre-order");
+
+		hierarchy->subtree_ends[parent] = std::max(hierarchy->subtree_ends[parent], hierarchy->subtree_ends[node]);
+	}
+
+	for (uint32_t node = first_node; node < end; node++)
+	{
+		if (hierarchy->parents[node] == TRANSFORM_NO_PARENT) hierarchy->dirty_nodes.push_back(node);
+	}
+}
+
+void transform_hierarchy_set_local(Transform_Hierarchy* hierarchy, uint32_t node, const glm::mat4& local_transform)
+{
+	hierarchy->local_transforms[node] = local_transform;
+	hierarchy->dirty_nodes.push_back(node);
+}
+
+bool transform_hierarchy_update(Transform_Hierarchy* hierarchy)
+{
+	if (hierarchy->dirty_nodes.empty()) return false;
+
+	ZoneScopedN("Transform hierarchy update");
+
+	auto& parents      = hierarchy->parents;
+	auto& subtree_ends = hierarchy->subtree_ends;
+	auto& locals       = hierarchy->local_transforms;
+	auto& worlds       = hierarchy->world_transforms;
+
+	// Subtrees nested in other dirty subtrees are swept with them
+	auto& dirty = hierarchy->dirty_nodes;
+	std::sort(dirty.begin(), dirty.end());
+	dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+	// Roots of subtrees to sweep, with their own world transform already computed. Big subtrees are split into
+	// subtrees of their children.
+	std::vector<uint32_t> roots;
+	uint32_t              covered_end = 0;
+	for (uint32_t node : dirty)
+	{
+		if (node < covered_end) continue;
+		covered_end = subtree_ends[node];
+
+		std::vector<uint32_t> stack = { node };
+		while (!stack.empty())
+		{
+			uint32_t root = stack.back();
+			stack.pop_back();
+
+			if (parents[root] == TRANSFORM_NO_PARENT) worlds[root] = locals[root];
+			else transform_multiply(worlds[parents[root]], locals[root], &worlds[root]);
+
+			if (subtree_ends[root] - root <= TRANSFORM_SWEEP_CHUNK)
+			{
+				roots.push_back(root);
+				continue;
+			}
+
+			// Children in reverse, so they come out of stack in order
+			std::vector<uint32_t> children;
+			for (uint32_t child = root + 1; child < subtree_ends[root]; child = subtree_ends[child])
+			{
+				children.push_back(child);
+			}
+			stack.insert(stack.end(), children.rbegin(), children.rend());
+		}
+	}
+	dirty.clear();
+
+	// Group small subtrees into jobs of about TRANSFORM_SWEEP_CHUNK nodes
+	std::vector<uint32_t> job_starts = { 0 };
+	uint32_t              job_nodes  = 0;
+	for (uint32_t root_i = 0; root_i < roots.size(); root_i++)
+	{
+		job_nodes += subtree_ends[roots[root_i]] - roots[root_i];
+		if (job_nodes >= TRANSFORM_SWEEP_CHUNK && root_i + 1 < roots.size())
+		{
+			job_starts.push_back(root_i + 1);
+			job_nodes = 0;
+		}
+	}
+	job_starts.push_back(static_cast<uint32_t>(roots.size()));
+
+	auto sweep_job = [&](size_t job_i)
+	{
+		for (uint32_t root_i = job_starts[job_i]; root_i < job_starts[job_i + 1]; root_i++)
+		{
+			transform_sweep(hierarchy, roots[root_i]);
+		}
+	};
+
+	size_t job_count = job_starts.size() - 1;
+	if (job_count == 1) sweep_job(0);
+	else parallel_for(job_count, sweep_job);
+
+	return true;
+}
+
+// Root's world transform has to be computed already
+void transform_sweep(Transform_Hierarchy* hierarchy, uint32_t root)
+{
+	const uint32_t*  parents = hierarchy->parents.data();
+	const glm::mat4* locals  = hierarchy->local_transforms.data();
+	glm::mat4*       worlds  = hierarchy->world_transforms.data();
+
+	// Parents come first, so single pass is enough
+	uint32_t end = hierarchy->subtree_ends[root];
+	for (uint32_t node = root + 1; node < end; node++)
+	{
+		transform_multiply(worlds[parents[node]], locals[node], &worlds[node]);
+	}
+}
+
+void transform_multiply(const glm::mat4& parent, const glm::mat4& local, glm::mat4* world)
+{
+#ifdef TRANSFORM_HIERARCHY_SSE2
+	// Column major, every column of result is combination of parent's columns
+	const float* p = &parent[0][0];
+	const float* l = &local[0][0];
+	float*       w = &(*world)[0][0];
+
+	__m128 parent_columns[4] = { _mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), _mm_loadu_ps(p + 12) };
+	for (int column = 0; column < 4; column++)
+	{
+		__m128 result = _mm_mul_ps(parent_columns[0], _mm_set1_ps(l[column * 4 + 0]));
+		result = _mm_add_ps(result, _mm_mul_ps(parent_columns[1], _mm_set1_ps(l[column * 4 + 1])));
+		result = _mm_add_ps(result, _mm_mul_ps(parent_columns[2], _mm_set1_ps(l[column * 4 + 2])));
+		result = _mm_add_ps(result, _mm_mul_ps(parent_columns[3], _mm_set1_ps(l[column * 4 + 3])));
+		_mm_storeu_ps(w + column * 4, result);
+	}
+#else
+	*world = parent * local;
+#endif
+}
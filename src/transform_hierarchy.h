@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Node hierarchy flattened into arrays in depth-first pre-order: parent always comes before its children, and every
+// subtree is a contiguous range [node, subtree_ends[node]). World transforms are recomputed by a linear sweep over
+// dirty subtrees only, so moving a node costs O(its subtree), not a reload. Big subtrees are split between their
+// children and swept on job system.
+
+constexpr uint32_t TRANSFORM_NO_PARENT = ~0u;
+
+struct Transform_Hierarchy
+{
+	std::vector<uint32_t>  parents;      // TRANSFORM_NO_PARENT for roots
+	std::vector<uint32_t>  subtree_ends; // One past last descendant
+	std::vector<glm::mat4> local_transforms;
+	std::vector<glm::mat4> world_transforms;
+
+	std::vector<uint32_t> dirty_nodes; // Local transform changed since last update, whole subtree needs sweeping
+};
+
+// Nodes are written at [first_node, first_node + count), they have to come after all nodes already in hierarchy.
+// Parents are absolute indices (or TRANSFORM_NO_PARENT), and have to be in pre-order.
+void transform_hierarchy_insert(Transform_Hierarchy* hierarchy, uint32_t first_node, const uint32_t* parents,
+                                const glm::mat4* local_transforms, uint32_t count);
+
+void transform_hierarchy_set_local(Transform_Hierarchy* hierarchy, uint32_t node, const glm::mat4& local_transform);
+
+// Recomputes world transforms of dirty subtrees, returns false if nothing was dirty
+bool transform_hierarchy_update(Transform_Hierarchy* hierarchy);
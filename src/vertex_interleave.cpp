@@ -0,0 +1,212 @@
+#include "vertex_interleave.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEX_INTERLEAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Vertices are interleaved block by block in small buffer that stays in L1, then copied out
+constexpr size_t VERTEX_INTERLEAVE_BLOCK = 64;
+
+// Private functions
+uint32_t vertex_streams_stride(const Vertex_Stream* streams, uint32_t stream_count);
+#ifdef VERTEX_INTERLEAVE_SSE2
+bool vertex_stream_kernel(const Vertex_Stream& stream, const uint32_t* source_indices, size_t first_vertex,
+                          size_t count, uint8_t* block, uint32_t stride);
+#endif
+
+void vertex_interleave(const Vertex_Stream* streams, uint32_t stream_count, const uint32_t* source_indices,
+                       size_t vertex_count, uint8_t* destination)
+{
+#ifdef VERTEX_INTERLEAVE_SSE2
+	uint32_t stride = vertex_streams_stride(streams, stream_count);
+	if (stride > VERTEX_INTERLEAVE_MAX_STRIDE)
+	{
+		vertex_interleave_scalar(streams, stream_count, source_indices, vertex_count, destination);
+		return;
+	}
+
+	// Block is multiple of 16 bytes, as strides are multiples of 4
+	alignas(16) uint8_t block[VERTEX_INTERLEAVE_BLOCK * VERTEX_INTERLEAVE_MAX_STRIDE];
+	bool streaming = reinterpret_cast<uintptr_t>(destination) % 16 == 0;
+
+	for (size_t first_vertex = 0; first_vertex < vertex_count; first_vertex += VERTEX_INTERLEAVE_BLOCK)
+	{
+		size_t count = std::min(VERTEX_INTERLEAVE_BLOCK, vertex_count - first_vertex);
+
+		// Stream by stream, so element size is known in inner loop
+		uint32_t offset = 0;
+		for (uint32_t stream_i = 0; stream_i < stream_count; stream_i++)
+		{
+			auto& stream = streams[stream_i];
+			if (!vertex_stream_kernel(stream, source_indices, first_vertex, count, block + offset, stride))
+			{
+				// Odd sized attribute
+				for (size_t vertex_i = 0; vertex_i < count; vertex_i++)
+				{
+					size_t   source  = source_indices ? source_indices[first_vertex + vertex_i] : first_vertex + vertex_i;
+					uint8_t* element = block + offset + vertex_i * stride;
+					memcpy(element, stream.data + source * stream.stride, stream.element_size);
+					memset(element + stream.element_size, 0, stream.size - stream.element_size);
+				}
+			}
+			offset += stream.size;
+		}
+
+		uint8_t* block_destination = destination + first_vertex * stride;
+		size_t   block_size        = count * stride;
+		if (streaming && block_size % 16 == 0)
+		{
+			// Bypass cache, vertices aren't read back by CPU
+			auto chunk_src = reinterpret_cast<const __m128i*>(block);
+			auto chunk_dst = reinterpret_cast<__m128i*>(block_destination);
+			for (size_t chunk = 0; chunk < block_size / 16; chunk++) _mm_stream_si128(chunk_dst + chunk, chunk_src[chunk]);
+		}
+		else
+		{
+			memcpy(block_destination, block, block_size);
+		}
+	}
+	_mm_sfence();
+#else
+	vertex_interleave_scalar(streams, stream_count, source_indices, vertex_count, destination);
+#endif
+}
+
+void vertex_interleave_scalar(const Vertex_Stream* streams, uint32_t stream_count, const uint32_t* source_indices,
+                              size_t vertex_count, uint8_t* destination)
+{
+	uint8_t* element = destination;
+	for (size_t vertex_i = 0; vertex_i < vertex_count; vertex_i++)
+	{
+		size_t source = (source_indices != nullptr) ? source_indices[vertex_i] : vertex_i;
+		for (uint32_t stream_i = 0; stream_i < stream_count; stream_i++)
+		{
+			auto&    stream = streams[stream_i];
+			uint32_t copied = 0;
+			if (stream.data != nullptr)
+			{
+				memcpy(element, stream.data + source * stream.stride, stream.element_size);
+				copied = stream.element_size;
+			}
+			memset(element + copied, 0, stream.size - copied);
+			element += stream.size;
+		}
+	}
+}
+
+uint32_t vertex_streams_stride(const Vertex_Stream* streams, uint32_t stream_count)
+{
+	uint32_t stride = 0;
+	for (uint32_t stream_i = 0; stream_i < stream_count; stream_i++)
+	{
+		stride += streams[stream_i].size;
+	}
+	return stride;
+}
+
+#ifdef VERTEX_INTERLEAVE_SSE2
+
+// Loads exactly LOAD bytes zero extended (element can be last one in buffer), and stores exactly STORE bytes,
+// so padding is zeroed and neighbouring elements aren't touched
+template <uint32_t LOAD, uint32_t STORE>
+void vertex_stream_copy(const Vertex_Stream& stream, const uint32_t* source_indices, size_t first_vertex,
+                        size_t count, uint8_t* block, uint32_t stride)
+{
+	for (size_t vertex_i = 0; vertex_i < count; vertex_i++)
+	{
+		size_t source = (source_indices != nullptr) ? source_indices[first_vertex + vertex_i] : first_vertex + vertex_i;
+		const uint8_t* element = stream.data + source * stream.stride;
+
+		__m128i value;
+		uint16_t low16;
+		uint32_t low32;
+		if constexpr (LOAD == 2)
+		{
+			memcpy(&low16, element, 2);
+			value = _mm_cvtsi32_si128(low16);
+		}
+		else if constexpr (LOAD == 3)
+		{
+			memcpy(&low16, element, 2);
+			value = _mm_cvtsi32_si128(low16 | (element[2] << 16));
+		}
+		else if constexpr (LOAD == 4)
+		{
+			memcpy(&low32, element, 4);
+			value = _mm_cvtsi32_si128(static_cast<int>(low32));
+		}
+		else if constexpr (LOAD == 6)
+		{
+			memcpy(&low32, element, 4);
+			memcpy(&low16, element + 4, 2);
+			value = _mm_unpacklo_epi32(_mm_cvtsi32_si128(static_cast<int>(low32)), _mm_cvtsi32_si128(low16));
+		}
+		else if constexpr (LOAD == 8)
+		{
+			value = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(element));
+		}
+		else if constexpr (LOAD == 12)
+		{
+			memcpy(&low32, element + 8, 4);
+			value = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(element)),
+			                           _mm_cvtsi32_si128(static_cast<int>(low32)));
+		}
+		else
+		{
+			value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(element));
+		}
+
+		uint8_t* destination = block + vertex_i * stride;
+		if constexpr (STORE == 4)
+		{
+			low32 = static_cast<uint32_t>(_mm_cvtsi128_si32(value));
+			memcpy(destination, &low32, 4);
+		}
+		else if constexpr (STORE == 8)
+		{
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(destination), value);
+		}
+		else if constexpr (STORE == 12)
+		{
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(destination), value);
+			low32 = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(value, 8)));
+			memcpy(destination + 8, &low32, 4);
+		}
+		else
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination), value);
+		}
+	}
+}
+
+// Returns false if there's no kernel for stream's sizes
+bool vertex_stream_kernel(const Vertex_Stream& stream, const uint32_t* source_indices, size_t first_vertex,
+                          size_t count, uint8_t* block, uint32_t stride)
+{
+	if (stream.data == nullptr)
+	{
+		for (size_t vertex_i = 0; vertex_i < count; vertex_i++) memset(block + vertex_i * stride, 0, stream.size);
+		return true;
+	}
+
+	auto kernel = &vertex_stream_copy<16, 16>;
+	switch (stream.element_size * 100 + stream.size)
+	{
+	case  204: kernel = &vertex_stream_copy<2,  4>;  break;
+	case  304: kernel = &vertex_stream_copy<3,  4>;  break;
+	case  404: kernel = &vertex_stream_copy<4,  4>;  break;
+	case  608: kernel = &vertex_stream_copy<6,  8>;  break;
+	case  808: kernel = &vertex_stream_copy<8,  8>;  break;
+	case 1212: kernel = &vertex_stream_copy<12, 12>; break;
+	case 1616: kernel = &vertex_stream_copy<16, 16>; break;
+	default:   return false;
+	}
+	kernel(stream, source_indices, first_vertex, count, block, stride);
+	return true;
+}
+
+#endif
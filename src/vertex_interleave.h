@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Bulk interleaving of separate attribute streams (glTF accessors) into vertex buffer. Whole streams are read with
+// known strides, and vertices are written sequentially, which is what write-combined mapped memory wants.
+// SSE2 kernel is used on x86, scalar one everywhere else.
+
+constexpr uint32_t VERTEX_INTERLEAVE_MAX_STRIDE = 64;
+
+struct Vertex_Stream
+{
+	const uint8_t* data;         // Null if attribute is missing, it's zeroed then
+	size_t         stride;
+	uint32_t       element_size; // At most 16 bytes
+	uint32_t       size;         // In interleaved vertex, element is zero padded to it
+};
+
+// Writes vertex_count vertices to destination, stride is sum of stream sizes. Vertex i is gathered from element
+// source_indices[i] of every stream, or from element i if source_indices is null.
+void vertex_interleave(const Vertex_Stream* streams, uint32_t stream_count, const uint32_t* source_indices,
+                       size_t vertex_count, uint8_t* destination);
+
+// Reference implementation, for comparison
+void vertex_interleave_scalar(const Vertex_Stream* streams, uint32_t stream_count, const uint32_t* source_indices,
+                              size_t vertex_count, uint8_t* destination);
@@ -0,0 +1,233 @@
+#include "vertex_pulling.h"
+
+#include "common.h"
+
+#include <algorithm>
+#include <volk.h>
+
+// Private functions
+std::vector<uint8_t> load_file(const char* file_path);
+VkDeviceSize vertex_pulling_range();
+
+void vertex_pulling_init()
+{
+	ZoneScopedN("Vertex pulling initialization");
+
+	vertex_pulling = new Vertex_Pulling{};
+
+	{
+		ZoneScopedN("Shader creation");
+
+		auto shader_code = load_file("data/shaders/triangle_pull_vert.spv");
+		VkShaderModuleCreateInfo shader_create_info = {
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.codeSize = shader_code.size(),
+			.pCode    = reinterpret_cast<const uint32_t *>(shader_code.data()),
+		};
+		vkCreateShaderModule(gfx_context->device, &shader_create_info, nullptr, &vertex_pulling->shader);
+		name_object(vertex_pulling->shader, "Vertex pulling shader");
+	}
+
+	// Descriptor set and pipeline layout
+	{
+		ZoneScopedN("Pipeline layout creation");
+
+		VkDescriptorSetLayoutBinding bindings[] = {
+			{ // Vertices
+				.binding         = 0,
+				.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags      = VK_SHADER_STAGE_VERTEX_BIT,
+			},
+			{ // Draw data
+				.binding         = 1,
+				.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags      = VK_SHADER_STAGE_VERTEX_BIT,
+			},
+		};
+
+		VkDescriptorSetLayoutCreateInfo set_layout_create_info = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = 2,
+			.pBindings    = bindings,
+		};
+		vkCreateDescriptorSetLayout(gfx_context->device, &set_layout_create_info, nullptr,
+									&vertex_pulling->descriptor_set_layout);
+		name_object(vertex_pulling->descriptor_set_layout, "Vertex pulling descriptor layout");
+
+		VkDescriptorSetLayout set_layouts[] = {
+			renderer->global_data_descriptor_set_layout,
+			vertex_pulling->descriptor_set_layout,
+		};
+
+		// Same as main pipeline layout, so switching between them keeps global descriptor set and push constants
+		VkPushConstantRange push_constant_range = {
+			.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS,
+			.offset     = 0,
+			.size       = sizeof(Draw_Push_Constants),
+		};
+
+		VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount         = 2,
+			.pSetLayouts            = set_layouts,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges    = &push_constant_range,
+		};
+		vkCreatePipelineLayout(gfx_context->device, &pipeline_layout_create_info, nullptr,
+							   &vertex_pulling->pipeline_layout);
+		name_object(vertex_pulling->pipeline_layout, "Vertex pulling pipeline layout");
+	}
+
+	// No vertex input, shader decodes both formats (PACKED_VERTICES constant)
+	VkPipelineVertexInputStateCreateInfo vertex_input_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+	};
+	for (uint32_t packed = 0; packed < 2; packed++)
+	{
+		vertex_pulling->pipelines[packed] = renderer_create_main_pipeline(vertex_pulling->shader,
+		                                                                  vertex_pulling->pipeline_layout,
+		                                                                  vertex_input_state, packed);
+		name_object(vertex_pulling->pipelines[packed], "Vertex pulling pipeline {}", packed);
+	}
+
+	// Per frame buffers and descriptors
+	vertex_pulling->frames.resize(renderer->buffering);
+	for (uint32_t frame_i = 0; frame_i < renderer->buffering; frame_i++)
+	{
+		auto frame = &vertex_pulling->frames[frame_i]; // Shortcut
+
+		VkBufferCreateInfo creation_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size  = VERTEX_PULLING_MAX_DRAWS * sizeof(Draw_Data),
+			.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		};
+
+		VmaAllocationCreateInfo vma_creation_info = {
+			.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+			.usage = VMA_MEMORY_USAGE_AUTO,
+		};
+
+		VmaAllocationInfo allocation_info;
+		vmaCreateBuffer(gfx_context->vma_allocator, &creation_info, &vma_creation_info,
+						&frame->draw_data_buffer.buffer, &frame->draw_data_buffer.allocation, &allocation_info);
+		name_object(frame->draw_data_buffer.buffer, "Draw data buffer (frame {})", frame_i);
+
+		frame->draw_data_ptr = reinterpret_cast<Draw_Data*>(allocation_info.pMappedData);
+
+		renderer->descriptor_set_allocator.allocate(gfx_context->device, vertex_pulling->descriptor_set_layout,
+													&frame->descriptor_set);
+		name_object(frame->descriptor_set, "Vertex pulling descriptor (frame {})", frame_i);
+
+		frame->vertex_buffer = mesh_manager->vertex_buffer.buffer;
+
+		VkDescriptorBufferInfo buffer_infos[] = {
+			{ .buffer = frame->vertex_buffer,            .offset = 0, .range = vertex_pulling_range() },
+			{ .buffer = frame->draw_data_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+		};
+
+		VkWriteDescriptorSet writes[2];
+		for (uint32_t binding = 0; binding < 2; binding++)
+		{
+			writes[binding] = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet          = frame->descriptor_set,
+				.dstBinding      = binding,
+				.descriptorCount = 1,
+				.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo     = &buffer_infos[binding],
+			};
+		}
+		vkUpdateDescriptorSets(gfx_context->device, 2, writes, 0, nullptr);
+	}
+}
+
+void vertex_pulling_deinit()
+{
+	for (auto& frame : vertex_pulling->frames)
+	{
+		vmaDestroyBuffer(gfx_context->vma_allocator, frame.draw_data_buffer.buffer, frame.draw_data_buffer.allocation);
+	}
+
+	for (VkPipeline pipeline : vertex_pulling->pipelines)
+	{
+		vkDestroyPipeline(gfx_context->device, pipeline, nullptr);
+	}
+	vkDestroyPipelineLayout(gfx_context->device, vertex_pulling->pipeline_layout, nullptr);
+	vkDestroyDescriptorSetLayout(gfx_context->device, vertex_pulling->descriptor_set_layout, nullptr);
+	vkDestroyShaderModule(gfx_context->device, vertex_pulling->shader, nullptr);
+
+	delete vertex_pulling;
+}
+
+// Part of vertex buffer visible to shader, it can outgrow what storage buffer descriptor can cover
+VkDeviceSize vertex_pulling_range()
+{
+	VkDeviceSize max_range = gfx_context->physical_device_properties.properties.limits.maxStorageBufferRange;
+	return std::min(mesh_manager->vertex_buffer.buffer_size, max_range);
+}
+
+bool vertex_pulling_used(const Mesh_Manager::Mesh_Description& mesh, size_t group_i)
+{
+	if (vertex_pulling->mode != Geometry_Mode::VERTEX_PULLING || group_i >= VERTEX_PULLING_MAX_DRAWS) return false;
+	if (mesh.vertex_format != Vertex_Format{} && mesh.vertex_format != PACKED_VERTEX_FORMAT) return false;
+
+	return mesh.vertex_offset + vertex_region_size(mesh.vertex_format, mesh.vertex_count) <= vertex_pulling_range();
+}
+
+VkPipeline vertex_pulling_pipeline(const Mesh_Manager::Mesh_Description& mesh)
+{
+	return vertex_pulling->pipelines[mesh.vertex_format.packed ? 1 : 0];
+}
+
+void vertex_pulling_prepare(uint32_t frame_i)
+{
+	if (vertex_pulling->mode != Geometry_Mode::VERTEX_PULLING) return;
+
+	ZoneScopedN("Draw data writing");
+
+	auto frame = &vertex_pulling->frames[frame_i]; // Shortcut
+
+	// Frame's previous use is finished, so draw data can be written directly, and so can descriptor set if vertex
+	// buffer was replaced by bigger one
+	if (frame->vertex_buffer != mesh_manager->vertex_buffer.buffer)
+	{
+		frame->vertex_buffer = mesh_manager->vertex_buffer.buffer;
+
+		VkDescriptorBufferInfo buffer_info = {
+			.buffer = frame->vertex_buffer,
+			.offset = 0,
+			.range  = vertex_pulling_range(),
+		};
+		VkWriteDescriptorSet write = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet          = frame->descriptor_set,
+			.dstBinding      = 0,
+			.descriptorCount = 1,
+			.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pBufferInfo     = &buffer_info,
+		};
+		vkUpdateDescriptorSets(gfx_context->device, 1, &write, 0, nullptr);
+	}
+
+	// Draw data is indexed by instance group, ones that aren't pulled keep a gap
+	size_t draw_count = std::min<size_t>(scene_data->instance_groups.size(), VERTEX_PULLING_MAX_DRAWS);
+	for (size_t i = 0; i < draw_count; i++)
+	{
+		auto& mesh = mesh_manager->get_mesh(scene_data->instance_groups[i].mesh_id);
+		if (!vertex_pulling_used(mesh, i)) continue;
+
+		// Vertex regions are 4 byte aligned, attributes start at 16 byte boundary of the region
+		VkDeviceSize attributes_offset = mesh.vertex_offset + vertex_attributes_offset(mesh.vertex_format,
+		                                                                               mesh.vertex_count);
+		frame->draw_data_ptr[i] = {
+			.first_position  = static_cast<uint32_t>(mesh.vertex_offset / sizeof(uint32_t)),
+			.first_attribute = static_cast<uint32_t>(attributes_offset / sizeof(uint32_t)),
+			.position_offset = mesh.position_offset,
+			.position_scale  = mesh.position_scale,
+		};
+	}
+	vmaFlushAllocation(gfx_context->vma_allocator, frame->draw_data_buffer.allocation, 0,
+					   draw_count * sizeof(Draw_Data));
+}
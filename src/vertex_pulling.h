@@ -0,0 +1,64 @@
+#pragma once
+
+#include "renderer.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Main pass geometry fetched by vertex shader from vertex buffer bound as storage buffer, instead of fixed function
+// vertex input. Nothing is bound per draw: all meshes are drawn from the global index buffer with firstIndex, and
+// shader finds vertices of the mesh in draw data, by draw index from push constants (it's the instance group index).
+// Regular and packed vertex formats are pulled, meshes of other formats and groups over VERTEX_PULLING_MAX_DRAWS
+// use vertex input. Shadow pass always uses vertex input.
+
+enum class Geometry_Mode : uint32_t
+{
+	VERTEX_INPUT,
+	VERTEX_PULLING,
+};
+
+constexpr uint32_t VERTEX_PULLING_MAX_DRAWS = 16 * 1024; // Per frame
+
+// Per draw input of pulling shader, layout matches triangle_pull_vert.glsl (std430)
+struct Draw_Data
+{
+	uint32_t  first_position;  // In 32-bit words of vertex buffer
+	uint32_t  first_attribute; // Same
+	uint32_t  _pad0[2];
+	glm::vec3 position_offset; // Of mesh, see Mesh_Description
+	float     _pad1;
+	glm::vec3 position_scale;
+	float     _pad2;
+};
+
+struct Vertex_Pulling
+{
+	struct Frame
+	{
+		AllocatedBuffer draw_data_buffer; // Draw_Data[], persistently mapped
+		Draw_Data*      draw_data_ptr;
+		VkDescriptorSet descriptor_set;
+		VkBuffer        vertex_buffer; // The one in descriptor set, mesh buffers grow
+	};
+
+	Geometry_Mode mode = Geometry_Mode::VERTEX_INPUT;
+
+	VkShaderModule        shader;
+	VkDescriptorSetLayout descriptor_set_layout; // Set 1, global data is set 0
+	VkPipelineLayout      pipeline_layout;       // Compatible with main one, so set 0 stays bound
+	VkPipeline            pipelines[2];          // Regular and packed vertices
+
+	std::vector<Frame> frames;
+};
+
+inline Vertex_Pulling* vertex_pulling;
+
+void vertex_pulling_init(); // Call after main pipeline layout and mesh manager are created
+void vertex_pulling_deinit();
+
+// Whether instance group draws mesh by vertex pulling in current mode
+bool vertex_pulling_used(const Mesh_Manager::Mesh_Description& mesh, size_t group_i);
+VkPipeline vertex_pulling_pipeline(const Mesh_Manager::Mesh_Description& mesh);
+
+// Writes draw data of all instance groups pulled in the frame, call before recording its draws
+void vertex_pulling_prepare(uint32_t frame_i);
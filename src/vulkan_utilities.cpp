@@ -13,8 +13,9 @@ size_t clamp_size_to_alignment(size_t block_size, size_t alignment)
 	return block_size;
 }
 
-VkResult create_default_image_view(VkDevice device, VkImageCreateInfo &image_create_info, VkImage image,
-								   VkAllocationCallbacks* allocation_callbacks, VkImageView *image_view)
+VkResult create_default_image_view(VkDevice device, const VkImageCreateInfo &image_create_info, VkImage image,
+								   VkAllocationCallbacks* allocation_callbacks, VkImageView *image_view,
+								   VkComponentMapping components)
 {
 	VkImageViewCreateInfo image_view_create_info = {
 		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -23,7 +24,7 @@ VkResult create_default_image_view(VkDevice device, VkImageCreateInfo &image_cre
 					  (image_create_info.imageType == VK_IMAGE_TYPE_2D) ? VK_IMAGE_VIEW_TYPE_2D :
 					  VK_IMAGE_VIEW_TYPE_3D,
 		.format     = image_create_info.format,
-		.components = {},
+		.components = components,
 		.subresourceRange = {
 			.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
 			.baseMipLevel   = 0,
@@ -9,8 +9,9 @@
 size_t clamp_size_to_alignment(size_t block_size, size_t alignment);
 
 // Create basic image view based on image creation info
-VkResult create_default_image_view(VkDevice device, VkImageCreateInfo& image_create_info, VkImage image,
-								   VkAllocationCallbacks* allocation_callbacks, VkImageView* image_view);
+VkResult create_default_image_view(VkDevice device, const VkImageCreateInfo& image_create_info, VkImage image,
+								   VkAllocationCallbacks* allocation_callbacks, VkImageView* image_view,
+								   VkComponentMapping components = {});
 
 // Helper class for dealing with descriptor allocation
 struct Descriptor_Set_Allocator